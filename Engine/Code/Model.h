@@ -44,6 +44,13 @@ public:
             meshes[i].Draw(shader);
     }
 
+    // draws the depth of all its meshes
+    void DrawDepth()
+    {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawDepth();
+    }
+
 private:
 
     unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false) 
@@ -55,6 +62,7 @@ private:
         glGenTextures(1, &textureID);
 
         int width, height, nrComponents;
+        stbi_set_flip_vertically_on_load_thread(false);
         unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
         if (data)
         {
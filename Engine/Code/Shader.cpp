@@ -59,6 +59,8 @@ Shader::Shader(const char* vertexFile, const char* fragmentFile)
 	glLinkProgram(ID);
 	// Checks if Shaders linked succesfully
 	compileErrors(ID, "PROGRAM");
+	// Cache the uniform tables and assign a texture unit to every sampler
+	ReflectProgram(ID, reflection);
 
 	// Delete the now useless Vertex and Fragment Shader objects
 	glDeleteShader(vertexShader);
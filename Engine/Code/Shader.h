@@ -9,6 +9,8 @@
 #include<cerrno>
 #include<glm/glm.hpp>
 
+#include "program_reflection.h"
+
 std::string get_file_contents(const char* filename);
 
 class Shader
@@ -23,13 +25,24 @@ public:
 	// Deletes the Shader Program
 	void Delete();
 
-	void setMat4(const std::string& name, const glm::mat4& mat) const
+	// Resolves a uniform through the reflection table built at link time (-1 if it is not active)
+	GLint GetUniformLocation(const char* name) const { return FindUniformLocation(reflection, name); }
+	// Texture unit assigned to a sampler at link time (-1 if it is not active)
+	i32 GetSamplerUnit(const char* name) const { return FindSamplerUnit(reflection, name); }
+
+	void setMat4(GLint location, const glm::mat4& mat) const
+	{
+		glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
+	}
+	void setMat4(const char* name, const glm::mat4& mat) const
 	{
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		setMat4(GetUniformLocation(name), mat);
 	}
 public:
 	// Reference ID of the Shader Program
 	GLuint ID;
+	// Active uniforms, uniform blocks and samplers of the linked program
+	ProgramReflection reflection;
 private:
 	// Checks if the different Shaders have compiled properly
 	void compileErrors(unsigned int shader, const char* type);
@@ -0,0 +1,607 @@
+#include "aabb_tree.h"
+
+#include <float.h>
+
+static f32 SurfaceArea(const Aabb& aabb)
+{
+    const glm::vec3 size = aabb.max - aabb.min;
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+static bool Contains(const Aabb& outer, const Aabb& inner)
+{
+    return glm::all(glm::lessThanEqual(outer.min, inner.min)) && glm::all(glm::greaterThanEqual(outer.max, inner.max));
+}
+
+static bool Overlaps(const Aabb& a, const Aabb& b)
+{
+    return glm::all(glm::lessThanEqual(a.min, b.max)) && glm::all(glm::greaterThanEqual(a.max, b.min));
+}
+
+static bool IsLeaf(const AabbTreeNode& node)
+{
+    return node.child1 == AABB_TREE_NULL_NODE;
+}
+
+static void AddFreeNodes(AabbTree& tree, u32 first)
+{
+    for (u32 i = first; i < tree.nodes.size(); ++i)
+    {
+        tree.nodes[i].parent = i + 1 < tree.nodes.size() ? i + 1 : AABB_TREE_NULL_NODE;
+        tree.nodes[i].height = -1;
+    }
+    tree.freeList = first;
+}
+
+AabbTree CreateAabbTree(u32 capacity)
+{
+    AabbTree tree = {};
+    tree.root = AABB_TREE_NULL_NODE;
+    tree.nodes.resize(glm::max(capacity, 16u));
+    AddFreeNodes(tree, 0);
+    return tree;
+}
+
+static u32 AllocateNode(AabbTree& tree)
+{
+    if (tree.freeList == AABB_TREE_NULL_NODE)
+    {
+        const u32 first = (u32)tree.nodes.size();
+        tree.nodes.resize(first * 2);
+        AddFreeNodes(tree, first);
+    }
+
+    const u32 nodeIdx = tree.freeList;
+    AabbTreeNode& node = tree.nodes[nodeIdx];
+    tree.freeList = node.parent;
+    node.parent = AABB_TREE_NULL_NODE;
+    node.child1 = AABB_TREE_NULL_NODE;
+    node.child2 = AABB_TREE_NULL_NODE;
+    node.height = 0;
+    node.userData = UINT32_MAX;
+    return nodeIdx;
+}
+
+static void FreeNode(AabbTree& tree, u32 nodeIdx)
+{
+    tree.nodes[nodeIdx].parent = tree.freeList;
+    tree.nodes[nodeIdx].height = -1;
+    tree.freeList = nodeIdx;
+}
+
+// Rotates the higher grandchild of an unbalanced node up, returns the new root of the subtree
+static u32 Balance(AabbTree& tree, u32 iA)
+{
+    AabbTreeNode* A = &tree.nodes[iA];
+    if (IsLeaf(*A) || A->height < 2)
+        return iA;
+
+    const u32 iB = A->child1;
+    const u32 iC = A->child2;
+    AabbTreeNode* B = &tree.nodes[iB];
+    AabbTreeNode* C = &tree.nodes[iC];
+
+    const i32 balance = C->height - B->height;
+
+    // Rotate C up
+    if (balance > 1)
+    {
+        const u32 iF = C->child1;
+        const u32 iG = C->child2;
+        AabbTreeNode* F = &tree.nodes[iF];
+        AabbTreeNode* G = &tree.nodes[iG];
+
+        C->child1 = iA;
+        C->parent = A->parent;
+        A->parent = iC;
+
+        if (C->parent != AABB_TREE_NULL_NODE)
+        {
+            AabbTreeNode& parent = tree.nodes[C->parent];
+            if (parent.child1 == iA) parent.child1 = iC;
+            else                     parent.child2 = iC;
+        }
+        else
+        {
+            tree.root = iC;
+        }
+
+        // The higher child of C stays with it, the other one replaces C under A
+        if (F->height > G->height)
+        {
+            C->child2 = iF;
+            A->child2 = iG;
+            G->parent = iA;
+            A->aabb = UnionAabb(B->aabb, G->aabb);
+            C->aabb = UnionAabb(A->aabb, F->aabb);
+            A->height = 1 + glm::max(B->height, G->height);
+            C->height = 1 + glm::max(A->height, F->height);
+        }
+        else
+        {
+            C->child2 = iG;
+            A->child2 = iF;
+            F->parent = iA;
+            A->aabb = UnionAabb(B->aabb, F->aabb);
+            C->aabb = UnionAabb(A->aabb, G->aabb);
+            A->height = 1 + glm::max(B->height, F->height);
+            C->height = 1 + glm::max(A->height, G->height);
+        }
+
+        return iC;
+    }
+
+    // Rotate B up
+    if (balance < -1)
+    {
+        const u32 iD = B->child1;
+        const u32 iE = B->child2;
+        AabbTreeNode* D = &tree.nodes[iD];
+        AabbTreeNode* E = &tree.nodes[iE];
+
+        B->child1 = iA;
+        B->parent = A->parent;
+        A->parent = iB;
+
+        if (B->parent != AABB_TREE_NULL_NODE)
+        {
+            AabbTreeNode& parent = tree.nodes[B->parent];
+            if (parent.child1 == iA) parent.child1 = iB;
+            else                     parent.child2 = iB;
+        }
+        else
+        {
+            tree.root = iB;
+        }
+
+        if (D->height > E->height)
+        {
+            B->child2 = iD;
+            A->child1 = iE;
+            E->parent = iA;
+            A->aabb = UnionAabb(C->aabb, E->aabb);
+            B->aabb = UnionAabb(A->aabb, D->aabb);
+            A->height = 1 + glm::max(C->height, E->height);
+            B->height = 1 + glm::max(A->height, D->height);
+        }
+        else
+        {
+            B->child2 = iE;
+            A->child1 = iD;
+            D->parent = iA;
+            A->aabb = UnionAabb(C->aabb, D->aabb);
+            B->aabb = UnionAabb(A->aabb, E->aabb);
+            A->height = 1 + glm::max(C->height, D->height);
+            B->height = 1 + glm::max(A->height, E->height);
+        }
+
+        return iB;
+    }
+
+    return iA;
+}
+
+// Walks up from a node refitting the boxes and heights, rebalancing on the way
+static void RefitAncestors(AabbTree& tree, u32 nodeIdx)
+{
+    while (nodeIdx != AABB_TREE_NULL_NODE)
+    {
+        nodeIdx = Balance(tree, nodeIdx);
+
+        AabbTreeNode& node = tree.nodes[nodeIdx];
+        const AabbTreeNode& child1 = tree.nodes[node.child1];
+        const AabbTreeNode& child2 = tree.nodes[node.child2];
+        node.height = 1 + glm::max(child1.height, child2.height);
+        node.aabb = UnionAabb(child1.aabb, child2.aabb);
+
+        nodeIdx = node.parent;
+    }
+}
+
+static void InsertLeaf(AabbTree& tree, u32 leaf)
+{
+    tree.flatValid = false;
+    tree.changed = true;
+    if (tree.root == AABB_TREE_NULL_NODE)
+    {
+        tree.root = leaf;
+        tree.nodes[leaf].parent = AABB_TREE_NULL_NODE;
+        return;
+    }
+
+    // Descend to the sibling with the lowest surface area cost: the new parent pays for the
+    // combined box, and every ancestor above it for the area it grows
+    const Aabb leafAabb = tree.nodes[leaf].aabb;
+    u32 index = tree.root;
+    while (!IsLeaf(tree.nodes[index]))
+    {
+        const AabbTreeNode& node = tree.nodes[index];
+        const f32 area = SurfaceArea(node.aabb);
+        const f32 combinedArea = SurfaceArea(UnionAabb(node.aabb, leafAabb));
+
+        // Cost of making the leaf a sibling of this node, and the cost pushed down to the children
+        const f32 cost = 2.0f * combinedArea;
+        const f32 inheritanceCost = 2.0f * (combinedArea - area);
+
+        f32 childCosts[2];
+        const u32 children[2] = { node.child1, node.child2 };
+        for (u32 c = 0; c < 2; ++c)
+        {
+            const AabbTreeNode& child = tree.nodes[children[c]];
+            const f32 childArea = SurfaceArea(UnionAabb(child.aabb, leafAabb));
+            childCosts[c] = IsLeaf(child) ? childArea + inheritanceCost : childArea - SurfaceArea(child.aabb) + inheritanceCost;
+        }
+
+        if (cost < childCosts[0] && cost < childCosts[1])
+            break;
+
+        index = childCosts[0] < childCosts[1] ? node.child1 : node.child2;
+    }
+
+    const u32 sibling = index;
+    const u32 oldParent = tree.nodes[sibling].parent;
+    const u32 newParent = AllocateNode(tree);
+
+    AabbTreeNode& parent = tree.nodes[newParent];
+    parent.parent = oldParent;
+    parent.aabb = UnionAabb(leafAabb, tree.nodes[sibling].aabb);
+    parent.height = tree.nodes[sibling].height + 1;
+    parent.child1 = sibling;
+    parent.child2 = leaf;
+
+    if (oldParent != AABB_TREE_NULL_NODE)
+    {
+        if (tree.nodes[oldParent].child1 == sibling) tree.nodes[oldParent].child1 = newParent;
+        else                                         tree.nodes[oldParent].child2 = newParent;
+    }
+    else
+    {
+        tree.root = newParent;
+    }
+
+    tree.nodes[sibling].parent = newParent;
+    tree.nodes[leaf].parent = newParent;
+
+    RefitAncestors(tree, oldParent);
+}
+
+static void RemoveLeaf(AabbTree& tree, u32 leaf)
+{
+    tree.flatValid = false;
+    tree.changed = true;
+    if (leaf == tree.root)
+    {
+        tree.root = AABB_TREE_NULL_NODE;
+        return;
+    }
+
+    // The sibling takes the place of the parent
+    const u32 parent = tree.nodes[leaf].parent;
+    const u32 grandParent = tree.nodes[parent].parent;
+    const u32 sibling = tree.nodes[parent].child1 == leaf ? tree.nodes[parent].child2 : tree.nodes[parent].child1;
+
+    if (grandParent != AABB_TREE_NULL_NODE)
+    {
+        if (tree.nodes[grandParent].child1 == parent) tree.nodes[grandParent].child1 = sibling;
+        else                                          tree.nodes[grandParent].child2 = sibling;
+        tree.nodes[sibling].parent = grandParent;
+        FreeNode(tree, parent);
+
+        RefitAncestors(tree, grandParent);
+    }
+    else
+    {
+        tree.root = sibling;
+        tree.nodes[sibling].parent = AABB_TREE_NULL_NODE;
+        FreeNode(tree, parent);
+    }
+}
+
+static Aabb FattenAabb(const Aabb& aabb)
+{
+    return Aabb{ aabb.min - glm::vec3(AABB_TREE_FAT_MARGIN), aabb.max + glm::vec3(AABB_TREE_FAT_MARGIN) };
+}
+
+u32 CreateTreeProxy(AabbTree& tree, const Aabb& aabb, u32 userData)
+{
+    const u32 proxy = AllocateNode(tree);
+    tree.nodes[proxy].aabb = FattenAabb(aabb);
+    tree.nodes[proxy].userData = userData;
+
+    InsertLeaf(tree, proxy);
+    tree.proxyCount++;
+    return proxy;
+}
+
+void DestroyTreeProxy(AabbTree& tree, u32 proxy)
+{
+    ASSERT(IsLeaf(tree.nodes[proxy]), "Only leaves are proxies");
+
+    RemoveLeaf(tree, proxy);
+    FreeNode(tree, proxy);
+    tree.proxyCount--;
+}
+
+bool MoveTreeProxy(AabbTree& tree, u32 proxy, const Aabb& aabb)
+{
+    ASSERT(IsLeaf(tree.nodes[proxy]), "Only leaves are proxies");
+
+    if (Contains(tree.nodes[proxy].aabb, aabb))
+        return false;
+
+    RemoveLeaf(tree, proxy);
+    tree.nodes[proxy].aabb = FattenAabb(aabb);
+    InsertLeaf(tree, proxy);
+    return true;
+}
+
+// Writes the subtree from flatIdx on, returns the index past its last node
+static u32 FlattenSubtree(AabbTree& tree, u32 nodeIdx, u32 flatIdx, u32& leafCount)
+{
+    const AabbTreeNode& node = tree.nodes[nodeIdx];
+    AabbTreeFlatNode& flatNode = tree.flatNodes[flatIdx];
+    flatNode.aabb = node.aabb;
+    flatNode.firstLeaf = leafCount;
+
+    u32 skip = flatIdx + 1;
+    if (IsLeaf(node))
+    {
+        tree.flatLeaves[leafCount++] = node.userData;
+    }
+    else
+    {
+        skip = FlattenSubtree(tree, node.child1, skip, leafCount);
+        skip = FlattenSubtree(tree, node.child2, skip, leafCount);
+    }
+
+    tree.flatNodes[flatIdx].skip = skip;
+    tree.flatNodes[flatIdx].leafCount = leafCount - tree.flatNodes[flatIdx].firstLeaf;
+    return skip;
+}
+
+void FlattenAabbTree(AabbTree& tree)
+{
+    if (tree.flatValid)
+        return;
+
+    if (tree.changed)
+    {
+        tree.changed = false;
+        return;
+    }
+
+    // A tree of n leaves has n - 1 inner nodes
+    tree.flatNodes.resize(tree.proxyCount > 0 ? 2 * tree.proxyCount - 1 : 0);
+    tree.flatLeaves.resize(tree.proxyCount);
+    if (tree.root != AABB_TREE_NULL_NODE)
+    {
+        u32 leafCount = 0;
+        FlattenSubtree(tree, tree.root, 0, leafCount);
+    }
+    tree.flatValid = true;
+}
+
+// Depth first traversal, the overlap test decides which subtrees are visited
+template <typename OverlapTest>
+static void QueryTree(const AabbTree& tree, OverlapTest overlaps, std::vector<u32>& results)
+{
+    if (tree.root == AABB_TREE_NULL_NODE)
+        return;
+
+    u32 stack[AABB_TREE_STACK_SIZE];
+    u32 stackSize = 0;
+    stack[stackSize++] = tree.root;
+
+    while (stackSize > 0)
+    {
+        const AabbTreeNode& node = tree.nodes[stack[--stackSize]];
+        if (!overlaps(node.aabb))
+            continue;
+
+        if (IsLeaf(node))
+        {
+            results.push_back(node.userData);
+        }
+        else
+        {
+            ASSERT(stackSize + 2 <= AABB_TREE_STACK_SIZE, "The tree is too deep");
+            stack[stackSize++] = node.child1;
+            stack[stackSize++] = node.child2;
+        }
+    }
+}
+
+void QueryTreeAabb(const AabbTree& tree, const Aabb& aabb, std::vector<u32>& results)
+{
+    QueryTree(tree, [&aabb](const Aabb& nodeAabb) { return Overlaps(nodeAabb, aabb); }, results);
+}
+
+void QueryTreeSphere(const AabbTree& tree, const glm::vec3& center, f32 radius, std::vector<u32>& results)
+{
+    const f32 radiusSq = radius * radius;
+    QueryTree(tree, [&center, radiusSq](const Aabb& nodeAabb) {
+        const glm::vec3 closest = glm::clamp(center, nodeAabb.min, nodeAabb.max);
+        const glm::vec3 delta = closest - center;
+        return glm::dot(delta, delta) <= radiusSq;
+    }, results);
+}
+
+// Subtrees fully inside the frustum are added without testing them any further
+static void AddSubtreeLeaves(const AabbTree& tree, u32 nodeIdx, std::vector<u32>& results)
+{
+    u32 stack[AABB_TREE_STACK_SIZE];
+    u32 stackSize = 0;
+    stack[stackSize++] = nodeIdx;
+
+    while (stackSize > 0)
+    {
+        const AabbTreeNode& node = tree.nodes[stack[--stackSize]];
+        if (IsLeaf(node))
+        {
+            results.push_back(node.userData);
+        }
+        else
+        {
+            ASSERT(stackSize + 2 <= AABB_TREE_STACK_SIZE, "The tree is too deep");
+            stack[stackSize++] = node.child1;
+            stack[stackSize++] = node.child2;
+        }
+    }
+}
+
+// Culls a box against the planes of the mask, clears the planes it is inside of from the mask
+static bool IsOutsideFrustum(const Aabb& aabb, const glm::vec4 planes[6], u32& planeMask)
+{
+    const glm::vec3 center = (aabb.min + aabb.max) * 0.5f;
+    const glm::vec3 extent = (aabb.max - aabb.min) * 0.5f;
+
+    for (u32 p = 0; p < 6; ++p)
+    {
+        if (!(planeMask & (1u << p)))
+            continue;
+
+        const glm::vec3 normal = glm::vec3(planes[p]);
+        const f32 distance = glm::dot(normal, center) + planes[p].w;
+        const f32 radius = glm::dot(glm::abs(normal), extent);
+        if (distance + radius < 0.0f)
+            return true;
+        if (distance - radius >= 0.0f)
+            planeMask &= ~(1u << p);
+    }
+    return false;
+}
+
+// Walks the depth first copy front to back: a culled subtree is skipped in one jump, and the
+// leaves of a subtree inside the frustum are a contiguous range appended at once
+static void QueryFlatTreeFrustum(const AabbTree& tree, const glm::vec4 planes[6], std::vector<u32>& results)
+{
+    const AabbTreeFlatNode* nodes = tree.flatNodes.data();
+    const u32* leaves = tree.flatLeaves.data();
+    const u32 nodeCount = (u32)tree.flatNodes.size();
+
+    // End of the subtrees being walked and the planes they straddle
+    u32 stackEnds[AABB_TREE_STACK_SIZE];
+    u32 stackMasks[AABB_TREE_STACK_SIZE];
+    u32 stackSize = 0;
+
+    u32 nodeIdx = 0;
+    while (nodeIdx < nodeCount)
+    {
+        while (stackSize > 0 && nodeIdx >= stackEnds[stackSize - 1])
+            --stackSize;
+
+        const AabbTreeFlatNode& node = nodes[nodeIdx];
+        u32 planeMask = stackSize > 0 ? stackMasks[stackSize - 1] : 0x3F;
+        if (IsOutsideFrustum(node.aabb, planes, planeMask))
+        {
+            nodeIdx = node.skip;
+        }
+        else if (planeMask == 0 || node.leafCount == 1)
+        {
+            results.insert(results.end(), leaves + node.firstLeaf, leaves + node.firstLeaf + node.leafCount);
+            nodeIdx = node.skip;
+        }
+        else
+        {
+            ASSERT(stackSize < AABB_TREE_STACK_SIZE, "The tree is too deep");
+            stackEnds[stackSize] = node.skip;
+            stackMasks[stackSize++] = planeMask;
+            ++nodeIdx;
+        }
+    }
+}
+
+void QueryTreeFrustum(const AabbTree& tree, const glm::vec4 planes[6], std::vector<u32>& results)
+{
+    if (tree.root == AABB_TREE_NULL_NODE)
+        return;
+
+    if (tree.flatValid)
+    {
+        QueryFlatTreeFrustum(tree, planes, results);
+        return;
+    }
+
+    // Every node carries the planes its parent straddles, the children of a box that is
+    // inside a plane do not test that plane again
+    u32 stack[AABB_TREE_STACK_SIZE];
+    u32 stackMasks[AABB_TREE_STACK_SIZE];
+    u32 stackSize = 0;
+    stack[stackSize] = tree.root;
+    stackMasks[stackSize++] = 0x3F;
+
+    while (stackSize > 0)
+    {
+        --stackSize;
+        const u32 nodeIdx = stack[stackSize];
+        u32 planeMask = stackMasks[stackSize];
+        const AabbTreeNode& node = tree.nodes[nodeIdx];
+
+        if (IsOutsideFrustum(node.aabb, planes, planeMask))
+            continue;
+
+        if (planeMask == 0 || IsLeaf(node))
+        {
+            AddSubtreeLeaves(tree, nodeIdx, results);
+        }
+        else
+        {
+            ASSERT(stackSize + 2 <= AABB_TREE_STACK_SIZE, "The tree is too deep");
+            stack[stackSize] = node.child1;
+            stackMasks[stackSize++] = planeMask;
+            stack[stackSize] = node.child2;
+            stackMasks[stackSize++] = planeMask;
+        }
+    }
+}
+
+// Slab test, returns the entry distance or FLT_MAX on a miss
+static f32 RayAabbDistance(const Aabb& aabb, const glm::vec3& origin, const glm::vec3& invDirection, f32 maxDistance)
+{
+    const glm::vec3 t0 = (aabb.min - origin) * invDirection;
+    const glm::vec3 t1 = (aabb.max - origin) * invDirection;
+    const glm::vec3 tmin = glm::min(t0, t1);
+    const glm::vec3 tmax = glm::max(t0, t1);
+
+    const f32 enter = glm::max(glm::max(tmin.x, tmin.y), glm::max(tmin.z, 0.0f));
+    const f32 exit = glm::min(glm::min(tmax.x, tmax.y), glm::min(tmax.z, maxDistance));
+    return enter <= exit ? enter : FLT_MAX;
+}
+
+u32 QueryTreeRay(const AabbTree& tree, const glm::vec3& origin, const glm::vec3& direction, f32 maxDistance, f32& hitDistance)
+{
+    hitDistance = maxDistance;
+    u32 hit = UINT32_MAX;
+    if (tree.root == AABB_TREE_NULL_NODE)
+        return hit;
+
+    const glm::vec3 invDirection = 1.0f / direction;
+
+    u32 stack[AABB_TREE_STACK_SIZE];
+    u32 stackSize = 0;
+    stack[stackSize++] = tree.root;
+
+    while (stackSize > 0)
+    {
+        const AabbTreeNode& node = tree.nodes[stack[--stackSize]];
+
+        // Nodes behind the closest hit so far are skipped
+        const f32 distance = RayAabbDistance(node.aabb, origin, invDirection, hitDistance);
+        if (distance == FLT_MAX)
+            continue;
+
+        if (IsLeaf(node))
+        {
+            hitDistance = distance;
+            hit = node.userData;
+        }
+        else
+        {
+            ASSERT(stackSize + 2 <= AABB_TREE_STACK_SIZE, "The tree is too deep");
+            stack[stackSize++] = node.child1;
+            stack[stackSize++] = node.child2;
+        }
+    }
+
+    return hit;
+}
@@ -0,0 +1,82 @@
+//
+// aabb_tree.h: Dynamic bounding volume hierarchy over entity bounds. Leaves store fattened
+// boxes so small moves do not touch the tree, inserts pick the sibling with the lowest
+// surface area cost, and rotations keep the tree balanced so queries stay logarithmic.
+//
+
+#pragma once
+
+#include "platform.h"
+
+#define AABB_TREE_NULL_NODE  UINT32_MAX
+#define AABB_TREE_FAT_MARGIN 0.1f // World units added around every leaf box
+#define AABB_TREE_STACK_SIZE 256  // Traversal stack, the balanced tree height stays under 1.44 * log2(leaves)
+
+struct Aabb
+{
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+struct AabbTreeNode
+{
+    Aabb aabb;
+    u32  parent;   // Next free node while the node is in the free list
+    u32  child1;
+    u32  child2;
+    i32  height;   // 0 for leaves, -1 for free nodes
+    u32  userData; // Entity index of the leaves
+};
+
+// Node of the depth first copy of the tree, its subtree is the range [node, skip) and its
+// leaves the range [firstLeaf, firstLeaf + leafCount) of the flattened leaves
+struct AabbTreeFlatNode
+{
+    Aabb aabb;
+    u32  skip;
+    u32  firstLeaf;
+    u32  leafCount;
+};
+
+struct AabbTree
+{
+    std::vector<AabbTreeNode> nodes;
+    u32                       root;
+    u32                       freeList;
+    u32                       proxyCount;
+
+    // Depth first copy the frustum queries walk in memory order, valid until the tree changes
+    std::vector<AabbTreeFlatNode> flatNodes;
+    std::vector<u32>              flatLeaves; // User data of the leaves
+    bool                          flatValid;
+    bool                          changed;    // Since the last FlattenAabbTree() call
+};
+
+AabbTree CreateAabbTree(u32 capacity);
+
+// Returns the proxy (leaf node) that has to be passed to move and destroy it
+u32  CreateTreeProxy(AabbTree& tree, const Aabb& aabb, u32 userData);
+void DestroyTreeProxy(AabbTree& tree, u32 proxy);
+
+// Refits the proxy, returns false when the new box still fits its fat box and the tree was left as is
+bool MoveTreeProxy(AabbTree& tree, u32 proxy, const Aabb& aabb);
+
+/**
+ * Rebuilds the depth first copy of the tree once it stops changing: a tree that changed since
+ * the last call is likely to change again, so the rebuild waits for a call without changes.
+ * Call it once per frame after moving the proxies, the frustum queries walk the nodes until then.
+ */
+void FlattenAabbTree(AabbTree& tree);
+
+// Overlap queries, append the user data of the leaves found to results
+void QueryTreeAabb(const AabbTree& tree, const Aabb& aabb, std::vector<u32>& results);
+void QueryTreeSphere(const AabbTree& tree, const glm::vec3& center, f32 radius, std::vector<u32>& results);
+void QueryTreeFrustum(const AabbTree& tree, const glm::vec4 planes[6], std::vector<u32>& results);
+
+// Closest leaf box hit by the ray, UINT32_MAX if none. The distance is along the (normalized) direction.
+u32 QueryTreeRay(const AabbTree& tree, const glm::vec3& origin, const glm::vec3& direction, f32 maxDistance, f32& hitDistance);
+
+inline Aabb UnionAabb(const Aabb& a, const Aabb& b)
+{
+    return Aabb{ glm::min(a.min, b.min), glm::max(a.max, b.max) };
+}
@@ -3,6 +3,8 @@
 #include <assimp/postprocess.h>
 #include "engine.h"
 
+#include <float.h>
+
 void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, MeshStruct* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices)
 {
     std::vector<float> vertices;
@@ -11,12 +13,17 @@ void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, MeshStruct* myMesh, u
     bool hasTexCoords = false;
     bool hasTangentSpace = false;
 
+    glm::vec3 aabbMin = glm::vec3(FLT_MAX);
+    glm::vec3 aabbMax = glm::vec3(-FLT_MAX);
+
     // process vertices
     for (unsigned int i = 0; i < mesh->mNumVertices; i++)
     {
         vertices.push_back(mesh->mVertices[i].x);
         vertices.push_back(mesh->mVertices[i].y);
         vertices.push_back(mesh->mVertices[i].z);
+        aabbMin = glm::min(aabbMin, glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z));
+        aabbMax = glm::max(aabbMax, glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z));
         vertices.push_back(mesh->mNormals[i].x);
         vertices.push_back(mesh->mNormals[i].y);
         vertices.push_back(mesh->mNormals[i].z);
@@ -86,6 +93,8 @@ void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, MeshStruct* myMesh, u
     submesh.vertexBufferLayout = vertexBufferLayout;
     submesh.vertices.swap(vertices);
     submesh.indices.swap(indices);
+    submesh.aabbMin = aabbMin;
+    submesh.aabbMax = aabbMax;
     myMesh->submeshes.push_back(submesh);
 }
 
@@ -243,5 +252,7 @@ u32 LoadModel(App* app, const char* filename)
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
+    AddToStaticGeometry(app, mesh);
+
     return modelIdx;
 }
\ No newline at end of file
@@ -0,0 +1,295 @@
+#include "batched_draw.h"
+#include "engine.h"
+
+void AddToStaticGeometry(App* app, MeshStruct& mesh)
+{
+    StaticGeometry& geometry = app->staticGeometry;
+
+    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+    {
+        Submesh& submesh = mesh.submeshes[i];
+        const VertexBufferLayout& layout = submesh.vertexBufferLayout;
+        const u32 strideInFloats = layout.stride / sizeof(f32);
+        const u32 vertexCount = submesh.vertices.size() / strideInFloats;
+
+        submesh.sharedBaseVertex = geometry.vertices.size() / STATIC_VERTEX_FLOATS;
+        submesh.sharedFirstIndex = geometry.indices.size();
+
+        // Beyond the width of the field, different submeshes would share sort keys and interleave
+        ASSERT(geometry.submeshCount < (1u << SORT_KEY_SUBMESH_BITS), "Too many submeshes for the render queue sort keys");
+        submesh.sortIdx = geometry.submeshCount++;
+
+        // Every submesh is converted to the same position/normal/uv format so they can share a VAO
+        const u32 firstVertexFloat = geometry.vertices.size();
+        geometry.vertices.resize(firstVertexFloat + vertexCount * STATIC_VERTEX_FLOATS, 0.0f);
+
+        for (u32 a = 0; a < layout.attributes.size(); ++a)
+        {
+            const VertexBufferAttribute& attribute = layout.attributes[a];
+
+            u32 dstOffset;
+            switch (attribute.location)
+            {
+            case 0: dstOffset = 0; break; // position
+            case 1: dstOffset = 3; break; // normal
+            case 2: dstOffset = 6; break; // tex coords
+            default: continue;            // tangent space is not used by the indirect path
+            }
+
+            const u32 srcOffset = attribute.offset / sizeof(f32);
+            for (u32 v = 0; v < vertexCount; ++v)
+            {
+                const f32* src = &submesh.vertices[v * strideInFloats + srcOffset];
+                f32* dst = &geometry.vertices[firstVertexFloat + v * STATIC_VERTEX_FLOATS + dstOffset];
+                for (u32 c = 0; c < attribute.componentCount; ++c)
+                    dst[c] = src[c];
+            }
+        }
+
+        geometry.indices.insert(geometry.indices.end(), submesh.indices.begin(), submesh.indices.end());
+    }
+}
+
+void UploadStaticGeometry(App* app)
+{
+    StaticGeometry& geometry = app->staticGeometry;
+
+    glGenBuffers(1, &geometry.vertexBufferHandle);
+    glBindBuffer(GL_ARRAY_BUFFER, geometry.vertexBufferHandle);
+    glBufferData(GL_ARRAY_BUFFER, geometry.vertices.size() * sizeof(f32), geometry.vertices.data(), GL_STATIC_DRAW);
+
+    glGenBuffers(1, &geometry.indexBufferHandle);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry.indexBufferHandle);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, geometry.indices.size() * sizeof(u32), geometry.indices.data(), GL_STATIC_DRAW);
+
+    geometry.drawIdCapacity = 0;
+    glGenBuffers(1, &geometry.drawIdBufferHandle);
+    glGenBuffers(1, &geometry.commandBufferHandle);
+    glGenBuffers(1, &geometry.drawDataBufferHandle);
+    geometry.commandBufferSize = 0;
+    geometry.drawDataBufferSize = 0;
+
+    glGenVertexArrays(1, &geometry.vao);
+    glBindVertexArray(geometry.vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, geometry.vertexBufferHandle);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry.indexBufferHandle);
+
+    const GLsizei stride = STATIC_VERTEX_FLOATS * sizeof(f32);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(f32)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(f32)));
+    glEnableVertexAttribArray(2);
+
+    // Draw id: one value per instance, the first one selected by the command's baseInstance
+    glBindBuffer(GL_ARRAY_BUFFER, geometry.drawIdBufferHandle);
+    glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(u32), (void*)0);
+    glVertexAttribDivisor(3, 1);
+    glEnableVertexAttribArray(3);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    // The CPU copies are not needed anymore
+    std::vector<f32>().swap(geometry.vertices);
+    std::vector<u32>().swap(geometry.indices);
+}
+
+static void EnsureDrawIdCapacity(StaticGeometry& geometry, u32 drawCount)
+{
+    if (drawCount <= geometry.drawIdCapacity)
+        return;
+
+    u32 capacity = geometry.drawIdCapacity > 0 ? geometry.drawIdCapacity : 256;
+    while (capacity < drawCount)
+        capacity *= 2;
+
+    std::vector<u32> drawIds(capacity);
+    for (u32 i = 0; i < capacity; ++i)
+        drawIds[i] = i;
+
+    // Same handle, so the vao keeps pointing to it
+    glBindBuffer(GL_ARRAY_BUFFER, geometry.drawIdBufferHandle);
+    glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(u32), drawIds.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    geometry.drawIdCapacity = capacity;
+}
+
+static void UploadStreamData(GLenum target, GLuint handle, u32& bufferSize, const void* data, u32 size)
+{
+    // The storage is orphaned before every upload, the driver hands out a new one while the
+    // GPU may still be reading the previous frame from the old one, instead of syncing
+    if (size > bufferSize)
+        bufferSize = size * 2;
+
+    glBindBuffer(target, handle);
+    glBufferData(target, bufferSize, NULL, GL_STREAM_DRAW);
+    glBufferSubData(target, 0, size, data);
+}
+
+// Packets that can be merged into instances of the same draw
+static bool IsSameDraw(const DrawPacket& a, const DrawPacket& b)
+{
+    return a.meshIdx == b.meshIdx && a.submeshIdx == b.submeshIdx && a.materialIdx == b.materialIdx;
+}
+
+static void UploadDrawData(StaticGeometry& geometry)
+{
+    UploadStreamData(GL_SHADER_STORAGE_BUFFER, geometry.drawDataBufferHandle, geometry.drawDataBufferSize,
+        geometry.drawData.data(), geometry.drawData.size() * sizeof(DrawData));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING(0), geometry.drawDataBufferHandle);
+}
+
+void ExecuteRenderQueueInstanced(App* app, RenderPassId pass)
+{
+    StaticGeometry& geometry = app->staticGeometry;
+    const RenderQueue& queue = app->renderQueue;
+
+    u32 begin, end;
+    GetRenderPassRange(queue, pass, begin, end);
+    if (begin == end)
+        return;
+
+    geometry.drawData.clear();
+    geometry.instanceGroups.clear();
+
+    const glm::mat4 viewProjection = app->camera.projection * app->camera.viewMatrix;
+    const glm::mat4& previousViewProjection = app->temporalUpsampling.previousViewProjection;
+
+    // The queue is sorted by material and mesh, so the instances of a group are contiguous
+    for (u32 i = begin; i < end; ++i)
+    {
+        const DrawPacket& packet = queue.packets[queue.items[i].packetIdx];
+        const Entity& entity = app->entities[packet.entityIdx];
+
+        if (geometry.instanceGroups.empty() ||
+            !IsSameDraw(queue.packets[queue.items[geometry.instanceGroups.back().firstItem].packetIdx], packet))
+        {
+            InstanceGroup group = { i, (u32)geometry.drawData.size(), 0 };
+            geometry.instanceGroups.push_back(group);
+        }
+
+        DrawData drawData = { entity.worldMatrix, viewProjection * entity.worldMatrix, previousViewProjection * entity.previousWorldMatrix };
+        geometry.drawData.push_back(drawData);
+        geometry.instanceGroups.back().instanceCount++;
+    }
+
+    UploadDrawData(geometry);
+
+    Program& program = app->programs[app->geometryPassInstancedShaderId];
+    glUseProgram(program.handle);
+
+    GLuint boundVao = 0;
+    u32    boundMaterial = UINT32_MAX;
+
+    for (u32 i = 0; i < geometry.instanceGroups.size(); ++i)
+    {
+        const InstanceGroup& group = geometry.instanceGroups[i];
+        const DrawPacket& packet = queue.packets[queue.items[group.firstItem].packetIdx];
+        MeshStruct& mesh = app->meshes[packet.meshIdx];
+        const Submesh& submesh = mesh.submeshes[packet.submeshIdx];
+
+        GLuint vao = FindVAO(mesh, packet.submeshIdx, program);
+        if (vao != boundVao)
+        {
+            glBindVertexArray(vao);
+            boundVao = vao;
+        }
+
+        if (packet.materialIdx != boundMaterial)
+        {
+            const Material& material = app->materials[packet.materialIdx];
+            BindSamplerTexture(app->programGPassInstancedUniformTexture, GL_TEXTURE_2D, app->textures[material.albedoTextureIdx].handle);
+            boundMaterial = packet.materialIdx;
+        }
+
+        glUniform1ui(app->programGPassInstancedUniformInstanceOffset, group.firstInstance);
+        glDrawElementsInstanced(GL_TRIANGLES, submesh.indices.size(), GL_UNSIGNED_INT, (void*)(u64)submesh.indexOffset, group.instanceCount);
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void ExecuteRenderQueueIndirect(App* app, RenderPassId pass)
+{
+    StaticGeometry& geometry = app->staticGeometry;
+    const RenderQueue& queue = app->renderQueue;
+
+    u32 begin, end;
+    GetRenderPassRange(queue, pass, begin, end);
+    if (begin == end)
+        return;
+
+    geometry.commands.clear();
+    geometry.drawData.clear();
+    geometry.batches.clear();
+
+    const glm::mat4 viewProjection = app->camera.projection * app->camera.viewMatrix;
+    const glm::mat4& previousViewProjection = app->temporalUpsampling.previousViewProjection;
+
+    // The queue is sorted by material, so every batch is a contiguous run of commands,
+    // and entities drawing the same submesh become instances of a single command
+    const DrawPacket* previousPacket = NULL;
+    for (u32 i = begin; i < end; ++i)
+    {
+        const DrawPacket& packet = queue.packets[queue.items[i].packetIdx];
+        const Submesh& submesh = app->meshes[packet.meshIdx].submeshes[packet.submeshIdx];
+        const Entity& entity = app->entities[packet.entityIdx];
+
+        if (geometry.batches.empty() || geometry.batches.back().materialIdx != packet.materialIdx)
+        {
+            IndirectDrawBatch batch = { packet.materialIdx, (u32)geometry.commands.size(), 0 };
+            geometry.batches.push_back(batch);
+        }
+
+        if (previousPacket != NULL && IsSameDraw(*previousPacket, packet))
+        {
+            geometry.commands.back().instanceCount++;
+        }
+        else
+        {
+            // The draw id of every instance is baseInstance + gl_InstanceID
+            DrawElementsIndirectCommand command = {};
+            command.count = submesh.indices.size();
+            command.instanceCount = 1;
+            command.firstIndex = submesh.sharedFirstIndex;
+            command.baseVertex = (i32)submesh.sharedBaseVertex;
+            command.baseInstance = (u32)geometry.drawData.size();
+            geometry.commands.push_back(command);
+            geometry.batches.back().commandCount++;
+        }
+
+        DrawData drawData = { entity.worldMatrix, viewProjection * entity.worldMatrix, previousViewProjection * entity.previousWorldMatrix };
+        geometry.drawData.push_back(drawData);
+        previousPacket = &packet;
+    }
+
+    EnsureDrawIdCapacity(geometry, geometry.drawData.size());
+    UploadDrawData(geometry);
+
+    UploadStreamData(GL_DRAW_INDIRECT_BUFFER, geometry.commandBufferHandle, geometry.commandBufferSize,
+        geometry.commands.data(), geometry.commands.size() * sizeof(DrawElementsIndirectCommand));
+
+    Program& program = app->programs[app->geometryPassIndirectShaderId];
+    glUseProgram(program.handle);
+    glBindVertexArray(geometry.vao);
+
+    for (u32 i = 0; i < geometry.batches.size(); ++i)
+    {
+        const IndirectDrawBatch& batch = geometry.batches[i];
+        const Material& material = app->materials[batch.materialIdx];
+        BindSamplerTexture(app->programGPassIndirectUniformTexture, GL_TEXTURE_2D, app->textures[material.albedoTextureIdx].handle);
+
+        const u64 commandOffset = batch.firstCommand * sizeof(DrawElementsIndirectCommand);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)commandOffset, batch.commandCount, 0);
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
@@ -0,0 +1,97 @@
+//
+// batched_draw.h: Submission of the sorted render queue in batches. Entities sharing a
+// submesh are drawn as instances, and static geometry packed in shared buffers lets whole
+// passes go through glMultiDrawElementsIndirect (one call per material).
+//
+
+#pragma once
+
+#include <glad/glad.h>
+
+#include "platform.h"
+#include "render_queue.h"
+
+struct App;
+struct MeshStruct;
+
+// Layout expected by GL for every command of the indirect buffer
+struct DrawElementsIndirectCommand
+{
+    u32 count;
+    u32 instanceCount;
+    u32 firstIndex;
+    i32 baseVertex;
+    u32 baseInstance;
+};
+
+// Per-draw (or per-instance) data read by the shaders, indexed by the draw id
+struct DrawData
+{
+    glm::mat4 worldMatrix;
+    glm::mat4 worldViewProjectionMatrix;
+    glm::mat4 previousWorldViewProjectionMatrix; // Unjittered, of the last frame
+};
+
+// Consecutive commands that share the same material
+struct IndirectDrawBatch
+{
+    u32 materialIdx;
+    u32 firstCommand;
+    u32 commandCount;
+};
+
+// Consecutive queue items that draw the same submesh with the same material
+struct InstanceGroup
+{
+    u32 firstItem;
+    u32 firstInstance;
+    u32 instanceCount;
+};
+
+enum GeometrySubmission
+{
+    GeometrySubmission_PerDraw,
+    GeometrySubmission_Instanced,
+    GeometrySubmission_MultiDrawIndirect
+};
+
+struct StaticGeometry
+{
+    // position (3) + normal (3) + tex coords (2)
+    std::vector<f32> vertices;
+    std::vector<u32> indices;
+    u32              submeshCount; // Added so far, the next one gets this sort index
+
+    GLuint vertexBufferHandle;
+    GLuint indexBufferHandle;
+    GLuint vao;
+
+    // Holds 0, 1, 2... and feeds the draw id as an instanced attribute through baseInstance,
+    // since gl_DrawID needs GL 4.6 (or ARB_shader_draw_parameters) and we target 4.3
+    GLuint drawIdBufferHandle;
+    u32    drawIdCapacity;
+
+    GLuint commandBufferHandle;
+    GLuint drawDataBufferHandle;
+    u32    commandBufferSize;
+    u32    drawDataBufferSize;
+
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<DrawData>                    drawData;
+    std::vector<IndirectDrawBatch>           batches;
+    std::vector<InstanceGroup>               instanceGroups;
+};
+
+#define STATIC_VERTEX_FLOATS 8
+
+// Appends the submeshes of a mesh to the shared vertex and index arrays
+void AddToStaticGeometry(App* app, MeshStruct& mesh);
+
+// Creates the shared buffers once every model has been loaded
+void UploadStaticGeometry(App* app);
+
+// Draws every group of identical submeshes of a pass with a single glDrawElementsInstanced
+void ExecuteRenderQueueInstanced(App* app, RenderPassId pass);
+
+// Draws the sorted range of a pass with one glMultiDrawElementsIndirect per material
+void ExecuteRenderQueueIndirect(App* app, RenderPassId pass);
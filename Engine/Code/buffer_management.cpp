@@ -1,4 +1,11 @@
 #include "buffer_management.h"
+#include <string.h>
+
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT   0x0080
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+static PFNGLBUFFERSTORAGEPROC BufferStorage = NULL;
 
 bool IsPowerOf2(u32 value)
 {
@@ -52,6 +59,177 @@ void PushAlignedData(Buffer& buffer, const void* data, u32 size, u32 alignment)
 {
     ASSERT(buffer.data != NULL, "The buffer must be mapped first");
     AlignHead(buffer, alignment);
+    ASSERT(buffer.head + size <= buffer.size, "Pushing more data than the buffer can hold");
     memcpy((u8*)buffer.data + buffer.head, data, size);
     buffer.head += size;
-}
\ No newline at end of file
+}
+
+void LoadBufferStorageExtension(GLADloadproc getProcAddress)
+{
+    bool supported = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 4);
+
+    GLint extensionCount = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+    for (GLint i = 0; i < extensionCount && !supported; ++i)
+        supported = strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_ARB_buffer_storage") == 0;
+
+    BufferStorage = supported ? (PFNGLBUFFERSTORAGEPROC)getProcAddress("glBufferStorage") : NULL;
+}
+
+RingBuffer CreateRingBuffer(u32 regionSize, GLenum type, u32 alignment)
+{
+    RingBuffer ring = {};
+    ring.regionSize = Align(regionSize, alignment);
+    ring.buffer.type = type;
+    ring.buffer.size = ring.regionSize * RING_BUFFER_REGIONS;
+
+    glGenBuffers(1, &ring.buffer.handle);
+    glBindBuffer(type, ring.buffer.handle);
+
+    if (BufferStorage)
+    {
+        // Mapped once for the whole lifetime of the buffer
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        BufferStorage(type, ring.buffer.size, NULL, flags);
+        ring.persistentData = glMapBufferRange(type, 0, ring.buffer.size, flags);
+    }
+    else
+    {
+        glBufferData(type, ring.buffer.size, NULL, GL_STREAM_DRAW);
+    }
+
+    glBindBuffer(type, 0);
+
+    return ring;
+}
+
+void DestroyRingBuffer(RingBuffer& ring)
+{
+    if (ring.persistentData)
+    {
+        BindBuffer(ring.buffer);
+        UnmapBuffer(ring.buffer);
+    }
+
+    for (u32 i = 0; i < RING_BUFFER_REGIONS; ++i)
+        if (ring.fences[i])
+            glDeleteSync(ring.fences[i]);
+
+    // The driver keeps the storage alive until the GPU is done with it
+    glDeleteBuffers(1, &ring.buffer.handle);
+    ring = {};
+}
+
+void BeginRingBufferFrame(RingBuffer& ring)
+{
+    // Only blocks if the GPU is more than RING_BUFFER_REGIONS frames behind
+    GLsync& fence = ring.fences[ring.regionIdx];
+    if (fence)
+    {
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        while (result == GL_TIMEOUT_EXPIRED)
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        glDeleteSync(fence);
+        fence = 0;
+    }
+
+    Buffer& buffer = ring.buffer;
+    if (ring.persistentData)
+    {
+        buffer.data = ring.persistentData;
+    }
+    else
+    {
+        // The fence already protects the region, so the driver must not synchronize the map
+        glBindBuffer(buffer.type, buffer.handle);
+        buffer.data = glMapBufferRange(buffer.type, 0, ring.regionSize * RING_BUFFER_REGIONS, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    }
+
+    // Offsets pushed this frame are absolute, so they can be bound straight away
+    buffer.head = ring.regionIdx * ring.regionSize;
+    buffer.size = buffer.head + ring.regionSize;
+}
+
+void EndRingBufferFrame(RingBuffer& ring)
+{
+    if (!ring.persistentData)
+    {
+        BindBuffer(ring.buffer);
+        UnmapBuffer(ring.buffer);
+        ring.buffer.data = NULL;
+    }
+}
+
+void FenceRingBufferFrame(RingBuffer& ring)
+{
+    ring.fences[ring.regionIdx] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ring.regionIdx = (ring.regionIdx + 1) % RING_BUFFER_REGIONS;
+}
+
+UniformBufferPool CreateUniformBufferPool(u32 chunkSize, u32 alignment)
+{
+    UniformBufferPool pool = {};
+    pool.chunkSize = chunkSize;
+    pool.alignment = alignment;
+    pool.chunks.push_back(CreateRingBuffer(chunkSize, GL_UNIFORM_BUFFER, alignment));
+    return pool;
+}
+
+void BeginUniformBufferPoolFrame(UniformBufferPool& pool)
+{
+    // Chunks are begun lazily, the first one is always used
+    BeginRingBufferFrame(pool.chunks[0]);
+    pool.chunksInUse = 1;
+}
+
+Buffer& AllocUniformBlock(UniformBufferPool& pool, u32 size, UniformBlockHandle& handle)
+{
+    ASSERT(size <= pool.chunkSize, "The uniform block does not fit in a chunk");
+
+    Buffer* buffer = &pool.chunks[pool.chunksInUse - 1].buffer;
+    if (Align(buffer->head, pool.alignment) + size > buffer->size)
+    {
+        if (pool.chunksInUse == pool.chunks.size())
+        {
+            // New chunks join the ring at the region of the current frame
+            RingBuffer chunk = CreateRingBuffer(pool.chunkSize, GL_UNIFORM_BUFFER, pool.alignment);
+            chunk.regionIdx = pool.chunks[0].regionIdx;
+            pool.chunks.push_back(chunk);
+        }
+
+        BeginRingBufferFrame(pool.chunks[pool.chunksInUse]);
+        buffer = &pool.chunks[pool.chunksInUse].buffer;
+        pool.chunksInUse++;
+    }
+
+    AlignHead(*buffer, pool.alignment);
+
+    handle.chunk = pool.chunksInUse - 1;
+    handle.offset = buffer->head;
+    handle.size = size;
+
+    return *buffer;
+}
+
+void EndUniformBufferPoolFrame(UniformBufferPool& pool)
+{
+    for (u32 i = 0; i < pool.chunksInUse; ++i)
+        EndRingBufferFrame(pool.chunks[i]);
+}
+
+void FenceUniformBufferPoolFrame(UniformBufferPool& pool)
+{
+    for (u32 i = 0; i < pool.chunks.size(); ++i)
+    {
+        // Unused chunks keep their older fences, which is still safe for the region
+        if (i < pool.chunksInUse)
+            FenceRingBufferFrame(pool.chunks[i]);
+        else
+            pool.chunks[i].regionIdx = (pool.chunks[i].regionIdx + 1) % RING_BUFFER_REGIONS;
+    }
+}
+
+GLuint GetUniformBlockBuffer(const UniformBufferPool& pool, const UniformBlockHandle& handle)
+{
+    return pool.chunks[handle.chunk].buffer.handle;
+}
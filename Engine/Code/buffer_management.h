@@ -16,11 +16,32 @@
 #include "engine.h"
 
 struct Buffer;
+struct RingBuffer;
+struct UniformBufferPool;
+struct UniformBlockHandle;
 
 u32 Align(u32 value, u32 alignment);
 
 Buffer CreateBuffer(u32 size, GLenum type, GLenum usage);
 
+// glBufferStorage is GL 4.4, above the version of our loader, so it is resolved at runtime
+void LoadBufferStorageExtension(GLADloadproc getProcAddress);
+
+RingBuffer CreateRingBuffer(u32 regionSize, GLenum type, u32 alignment);
+void DestroyRingBuffer(RingBuffer& ring);
+void BeginRingBufferFrame(RingBuffer& ring); // Waits for the region fence and prepares it for pushing
+void EndRingBufferFrame(RingBuffer& ring);
+void FenceRingBufferFrame(RingBuffer& ring); // Call once the frame commands reading the region are issued
+
+UniformBufferPool CreateUniformBufferPool(u32 chunkSize, u32 alignment);
+void BeginUniformBufferPoolFrame(UniformBufferPool& pool);
+// Reserves an aligned block of the given size, adding a chunk if needed. Returns the chunk
+// buffer with its head at handle.offset; the reference is only valid until the next call.
+Buffer& AllocUniformBlock(UniformBufferPool& pool, u32 size, UniformBlockHandle& handle);
+void EndUniformBufferPoolFrame(UniformBufferPool& pool);
+void FenceUniformBufferPoolFrame(UniformBufferPool& pool);
+GLuint GetUniformBlockBuffer(const UniformBufferPool& pool, const UniformBlockHandle& handle);
+
 void PushAlignedData(Buffer& buffer, const void* data, u32 size, u32 alignment);
 
 void BindBuffer(const Buffer& buffer);
@@ -0,0 +1,101 @@
+#include "command_list.h"
+
+void ResetCommandList(CommandList& list)
+{
+    // The capacity is kept, a list settles at the size of the scene after a few frames
+    list.commands.clear();
+}
+
+void RecordUseProgram(CommandList& list, GLuint program)
+{
+    Command command;
+    command.type = Command_UseProgram;
+    command.program.handle = program;
+    list.commands.push_back(command);
+}
+
+void RecordBindVertexArray(CommandList& list, GLuint vertexArray)
+{
+    Command command;
+    command.type = Command_BindVertexArray;
+    command.vertexArray.handle = vertexArray;
+    list.commands.push_back(command);
+}
+
+void RecordBindTexture(CommandList& list, i32 unit, GLenum target, GLuint texture)
+{
+    if (unit < 0)
+        return;
+
+    Command command;
+    command.type = Command_BindTexture;
+    command.texture.unit = (GLuint)unit;
+    command.texture.target = target;
+    command.texture.handle = texture;
+    list.commands.push_back(command);
+}
+
+void RecordBindBufferRange(CommandList& list, GLenum target, GLuint index, GLuint buffer, u32 offset, u32 size)
+{
+    Command command;
+    command.type = Command_BindBufferRange;
+    command.bufferRange.target = target;
+    command.bufferRange.index = index;
+    command.bufferRange.handle = buffer;
+    command.bufferRange.offset = offset;
+    command.bufferRange.size = size;
+    list.commands.push_back(command);
+}
+
+void RecordUniform1f(CommandList& list, GLint location, f32 value)
+{
+    Command command;
+    command.type = Command_Uniform1f;
+    command.uniform1f.location = location;
+    command.uniform1f.value = value;
+    list.commands.push_back(command);
+}
+
+void RecordDrawElements(CommandList& list, GLenum mode, u32 count, GLenum type, u32 offset)
+{
+    Command command;
+    command.type = Command_DrawElements;
+    command.drawElements.mode = mode;
+    command.drawElements.count = count;
+    command.drawElements.type = type;
+    command.drawElements.offset = offset;
+    list.commands.push_back(command);
+}
+
+void ExecuteCommandList(const CommandList& list)
+{
+    const Command* command = list.commands.data();
+    const Command* end = command + list.commands.size();
+    for (; command != end; ++command)
+    {
+        switch (command->type)
+        {
+        case Command_UseProgram:
+            glUseProgram(command->program.handle);
+            break;
+        case Command_BindVertexArray:
+            glBindVertexArray(command->vertexArray.handle);
+            break;
+        case Command_BindTexture:
+            glActiveTexture(GL_TEXTURE0 + command->texture.unit);
+            glBindTexture(command->texture.target, command->texture.handle);
+            break;
+        case Command_BindBufferRange:
+            glBindBufferRange(command->bufferRange.target, command->bufferRange.index, command->bufferRange.handle,
+                              command->bufferRange.offset, command->bufferRange.size);
+            break;
+        case Command_Uniform1f:
+            glUniform1f(command->uniform1f.location, command->uniform1f.value);
+            break;
+        case Command_DrawElements:
+            glDrawElements(command->drawElements.mode, command->drawElements.count, command->drawElements.type,
+                           (void*)(u64)command->drawElements.offset);
+            break;
+        }
+    }
+}
@@ -0,0 +1,54 @@
+//
+// command_list.h: Engine-side list of GL state changes and draws. Any thread can record a
+// list since recording only appends plain values, the GL thread then replays the lists in
+// order in a single loop. Draw preparation (walking the queue, resolving materials and
+// buffers, filtering redundant state) can so be split across threads while the GL calls
+// stay on the thread owning the context.
+//
+
+#pragma once
+
+#include <glad/glad.h>
+
+#include "platform.h"
+
+enum CommandType
+{
+    Command_UseProgram,
+    Command_BindVertexArray,
+    Command_BindTexture,
+    Command_BindBufferRange,
+    Command_Uniform1f,
+    Command_DrawElements
+};
+
+struct Command
+{
+    CommandType type;
+    union
+    {
+        struct { GLuint handle; } program;
+        struct { GLuint handle; } vertexArray;
+        struct { GLuint unit; GLenum target; GLuint handle; } texture;
+        struct { GLenum target; GLuint index; GLuint handle; u32 offset; u32 size; } bufferRange;
+        struct { GLint location; f32 value; } uniform1f;
+        struct { GLenum mode; u32 count; GLenum type; u32 offset; } drawElements;
+    };
+};
+
+struct CommandList
+{
+    std::vector<Command> commands;
+};
+
+void ResetCommandList(CommandList& list);
+
+void RecordUseProgram(CommandList& list, GLuint program);
+void RecordBindVertexArray(CommandList& list, GLuint vertexArray);
+void RecordBindTexture(CommandList& list, i32 unit, GLenum target, GLuint texture); // Skipped for units < 0, like BindSamplerTexture
+void RecordBindBufferRange(CommandList& list, GLenum target, GLuint index, GLuint buffer, u32 offset, u32 size);
+void RecordUniform1f(CommandList& list, GLint location, f32 value);
+void RecordDrawElements(CommandList& list, GLenum mode, u32 count, GLenum type, u32 offset);
+
+// Issues the recorded commands, only on the thread owning the GL context
+void ExecuteCommandList(const CommandList& list);
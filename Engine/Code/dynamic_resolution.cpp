@@ -0,0 +1,99 @@
+#include "dynamic_resolution.h"
+
+#include <math.h>
+
+void InitDynamicResolution(DynamicResolution& resolution)
+{
+    resolution.enabled = false;
+    resolution.targetMs = 1000.0f / 60.0f;
+    resolution.minScale = 0.5f;
+    resolution.maxScale = 1.0f;
+    resolution.sharpness = 0.5f;
+    resolution.scale = 1.0f;
+
+    for (u32 i = 0; i < DYNAMIC_RESOLUTION_QUERY_FRAMES; ++i)
+        glGenQueries(2, resolution.queries[i]);
+}
+
+static f32 QuantizeScale(f32 scale)
+{
+    return floorf(scale / DYNAMIC_RESOLUTION_STEP + 0.001f) * DYNAMIC_RESOLUTION_STEP;
+}
+
+static void ReadGpuTime(DynamicResolution& resolution)
+{
+    // The slot about to be reused holds the oldest frame
+    if (resolution.frame < DYNAMIC_RESOLUTION_QUERY_FRAMES)
+        return;
+
+    GLuint* queries = resolution.queries[resolution.frame % DYNAMIC_RESOLUTION_QUERY_FRAMES];
+    GLint available = 0;
+    glGetQueryObjectiv(queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return;
+
+    GLuint64 begin = 0, end = 0;
+    glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &end);
+
+    const f32 ms = (f32)((end - begin) / 1.0e6);
+    resolution.gpuMs = resolution.gpuMs == 0.0f ? ms : glm::mix(resolution.gpuMs, ms, 0.2f);
+}
+
+static void LogDecision(DynamicResolution& resolution, f32 newScale, glm::ivec2 displaySize)
+{
+    DynamicResolutionDecision& decision = resolution.history[resolution.decisionCount % DYNAMIC_RESOLUTION_HISTORY];
+    decision.frame = resolution.frame;
+    decision.gpuMs = resolution.gpuMs;
+    decision.oldScale = resolution.scale;
+    decision.newScale = newScale;
+    resolution.decisionCount++;
+
+    const glm::ivec2 size = glm::max(glm::ivec2(glm::vec2(displaySize) * newScale), glm::ivec2(1));
+    ILOG("Dynamic resolution: frame %u, GPU %.2f ms for a %.2f ms budget, scale %.3f -> %.3f (%dx%d)",
+         resolution.frame, resolution.gpuMs, resolution.targetMs, resolution.scale, newScale, size.x, size.y);
+}
+
+glm::ivec2 UpdateDynamicResolution(DynamicResolution& resolution, glm::ivec2 displaySize)
+{
+    ReadGpuTime(resolution);
+    resolution.framesSinceChange++;
+
+    f32 newScale = resolution.scale;
+    if (!resolution.enabled)
+    {
+        newScale = 1.0f;
+    }
+    else if (resolution.gpuMs > 0.0f && resolution.framesSinceChange >= DYNAMIC_RESOLUTION_COOLDOWN)
+    {
+        // Cost follows the pixel count, the square of the scale
+        const f32 ideal = resolution.scale * sqrtf(resolution.targetMs / resolution.gpuMs);
+
+        if (resolution.gpuMs > resolution.targetMs)
+            newScale = QuantizeScale(ideal);
+        else if (resolution.gpuMs < resolution.targetMs * DYNAMIC_RESOLUTION_HEADROOM)
+            newScale = glm::min(QuantizeScale(ideal), resolution.scale + DYNAMIC_RESOLUTION_MAX_STEPS_UP * DYNAMIC_RESOLUTION_STEP);
+
+        newScale = glm::clamp(newScale, resolution.minScale, resolution.maxScale);
+    }
+
+    if (newScale != resolution.scale)
+    {
+        LogDecision(resolution, newScale, displaySize);
+        resolution.scale = newScale;
+        resolution.framesSinceChange = 0;
+    }
+
+    return glm::max(glm::ivec2(glm::vec2(displaySize) * resolution.scale), glm::ivec2(1));
+}
+
+void BeginDynamicResolutionFrame(DynamicResolution& resolution)
+{
+    glQueryCounter(resolution.queries[resolution.frame % DYNAMIC_RESOLUTION_QUERY_FRAMES][0], GL_TIMESTAMP);
+}
+
+void EndDynamicResolutionFrame(DynamicResolution& resolution)
+{
+    glQueryCounter(resolution.queries[resolution.frame % DYNAMIC_RESOLUTION_QUERY_FRAMES][1], GL_TIMESTAMP);
+    resolution.frame++;
+}
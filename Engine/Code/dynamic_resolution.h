@@ -0,0 +1,61 @@
+//
+// dynamic_resolution.h: Scales the internal resolution of the deferred targets to hold a GPU
+// frame time. The GPU time of the render graph is measured with timestamp queries read a few
+// frames late, and the scale of each axis follows the square root of the budget over the
+// measured time, since the cost of the deferred passes grows with the pixel count. Every
+// change is logged with the measurement that caused it.
+//
+
+#pragma once
+
+#include <glad/glad.h>
+
+#include "platform.h"
+
+#define DYNAMIC_RESOLUTION_QUERY_FRAMES 3       // Frames in flight before a measurement is read
+#define DYNAMIC_RESOLUTION_STEP         (1.0f / 32.0f) // Scales are multiples of it
+#define DYNAMIC_RESOLUTION_MAX_STEPS_UP 2       // Growth of a single change, shrinking is not limited
+#define DYNAMIC_RESOLUTION_HEADROOM     0.85f   // Measured fraction of the budget below which the scale grows
+#define DYNAMIC_RESOLUTION_COOLDOWN     15      // Frames between two changes, so a change is measured before the next
+#define DYNAMIC_RESOLUTION_HISTORY      8       // Decisions kept for the GUI
+
+struct DynamicResolutionDecision
+{
+    u32 frame;
+    f32 gpuMs;
+    f32 oldScale;
+    f32 newScale;
+};
+
+struct DynamicResolution
+{
+    // Settings
+    bool  enabled;
+    f32   targetMs;   // GPU frame time to hold
+    f32   minScale;   // Bounds of the scale of each axis
+    f32   maxScale;
+    f32   sharpness;  // Of the upscale, from 0 to 1
+
+    f32   scale;
+    f32   gpuMs;      // Smoothed GPU time of the render graph
+
+    GLuint queries[DYNAMIC_RESOLUTION_QUERY_FRAMES][2]; // Begin and end timestamps of each frame
+    u32    frame;
+    u32    framesSinceChange;
+
+    DynamicResolutionDecision history[DYNAMIC_RESOLUTION_HISTORY];
+    u32    decisionCount;
+};
+
+void InitDynamicResolution(DynamicResolution& resolution);
+
+/**
+ * Reads the oldest measurement without waiting for it and changes the scale when the GPU
+ * time is over the budget, or well under it, and the previous change had time to be
+ * measured. Returns the size the deferred targets are rendered at.
+ */
+glm::ivec2 UpdateDynamicResolution(DynamicResolution& resolution, glm::ivec2 displaySize);
+
+// Timestamps around the GPU work of a frame
+void BeginDynamicResolutionFrame(DynamicResolution& resolution);
+void EndDynamicResolutionFrame(DynamicResolution& resolution);
@@ -87,6 +87,72 @@ GLuint CreateProgramFromSource(String programSource, const char* shaderName)
     return programHandle;
 }
 
+GLuint CreateComputeProgramFromSource(String programSource, const char* shaderName)
+{
+    GLchar  infoLogBuffer[1024] = {};
+    GLsizei infoLogBufferSize = sizeof(infoLogBuffer);
+    GLsizei infoLogSize;
+    GLint   success;
+
+    char versionString[] = "#version 430\n";
+    char shaderNameDefine[128];
+    sprintf_s(shaderNameDefine, "#define %s\n", shaderName);
+    char computeShaderDefine[] = "#define COMPUTE\n";
+
+    const GLchar* computeShaderSource[] = {
+        versionString,
+        shaderNameDefine,
+        computeShaderDefine,
+        programSource.str
+    };
+    const GLint computeShaderLengths[] = {
+        (GLint)strlen(versionString),
+        (GLint)strlen(shaderNameDefine),
+        (GLint)strlen(computeShaderDefine),
+        (GLint)programSource.len
+    };
+
+    GLuint cshader = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(cshader, ARRAY_COUNT(computeShaderSource), computeShaderSource, computeShaderLengths);
+    glCompileShader(cshader);
+    glGetShaderiv(cshader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(cshader, infoLogBufferSize, &infoLogSize, infoLogBuffer);
+        ELOG("glCompileShader() failed with compute shader %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+    }
+
+    GLuint programHandle = glCreateProgram();
+    glAttachShader(programHandle, cshader);
+    glLinkProgram(programHandle);
+    glGetProgramiv(programHandle, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glGetProgramInfoLog(programHandle, infoLogBufferSize, &infoLogSize, infoLogBuffer);
+        ELOG("glLinkProgram() failed with program %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+    }
+
+    glDetachShader(programHandle, cshader);
+    glDeleteShader(cshader);
+
+    return programHandle;
+}
+
+u32 LoadComputeProgram(App* app, const char* filepath, const char* programName)
+{
+    String programSource = ReadTextFile(filepath);
+
+    Program program = {};
+    program.handle = CreateComputeProgramFromSource(programSource, programName);
+    program.filepath = filepath;
+    program.programName = programName;
+    program.lastWriteTimestamp = GetFileLastWriteTimestamp(filepath);
+    ReflectProgram(program.handle, program.reflection);
+    app->programs.push_back(program);
+
+    return app->programs.size() - 1;
+}
+
 u32 LoadProgram(App* app, const char* filepath, const char* programName)
 {
     String programSource = ReadTextFile(filepath);
@@ -96,6 +162,7 @@ u32 LoadProgram(App* app, const char* filepath, const char* programName)
     program.filepath = filepath;
     program.programName = programName;
     program.lastWriteTimestamp = GetFileLastWriteTimestamp(filepath);
+    ReflectProgram(program.handle, program.reflection);
     app->programs.push_back(program);
 
     return app->programs.size() - 1;
@@ -104,7 +171,8 @@ u32 LoadProgram(App* app, const char* filepath, const char* programName)
 Image LoadImage(const char* filename)
 {
     Image img = {};
-    stbi_set_flip_vertically_on_load(true);
+    // The flip is set per thread, loads run on the job workers with other settings
+    stbi_set_flip_vertically_on_load_thread(true);
     img.pixels = stbi_load(filename, &img.size.x, &img.size.y, &img.nchannels, 0);
     if (img.pixels)
     {
@@ -176,16 +244,25 @@ u32 LoadTexture2D(App* app, const char* filepath)
     }
 }
 
-GLuint FindVAO(MeshStruct& mesh, u32 submeshIndex, const Program& program)
+GLuint LookupVAO(const MeshStruct& mesh, u32 submeshIndex, const Program& program)
 {
-    Submesh& submesh = mesh.submeshes[submeshIndex];
-
-    // Try finding a vao for this submesh/program
+    const Submesh& submesh = mesh.submeshes[submeshIndex];
     for (u32 i = 0; i < (u32)submesh.vaos.size(); ++i)
     {
         if (submesh.vaos[i].programHandle == program.handle)
             return submesh.vaos[i].handle;
     }
+    return 0;
+}
+
+GLuint FindVAO(MeshStruct& mesh, u32 submeshIndex, const Program& program)
+{
+    Submesh& submesh = mesh.submeshes[submeshIndex];
+
+    // Try finding a vao for this submesh/program
+    const GLuint existingVao = LookupVAO(mesh, submeshIndex, program);
+    if (existingVao != 0)
+        return existingVao;
 
     // Create a new vao for this submesh/program
     GLuint vaoHandle = 0;
@@ -260,7 +337,62 @@ void InitEntitiesInBulk(App* app, std::vector<glm::vec3> positions, u32 modelId,
         );
 
         app->entities.push_back(entity);
+
+        Entity& added = app->entities.back();
+        added.treeProxy = CreateTreeProxy(app->entityTree, ComputeEntityBounds(app, added), (u32)app->entities.size() - 1);
+    }
+}
+
+Aabb ComputeEntityBounds(App* app, const Entity& entity)
+{
+    const glm::vec3 position = glm::vec3(entity.worldMatrix[3]);
+    if (entity.modelIndex >= app->models.size())
+        return Aabb{ position, position };
+
+    const MeshStruct& mesh = app->meshes[app->models[entity.modelIndex].meshIdx];
+    const glm::mat3 linear = glm::mat3(entity.worldMatrix);
+    const glm::mat3 absLinear = glm::mat3(glm::abs(linear[0]), glm::abs(linear[1]), glm::abs(linear[2]));
+
+    Aabb bounds = { position, position };
+    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+    {
+        const Submesh& submesh = mesh.submeshes[i];
+        const glm::vec3 center = glm::vec3(entity.worldMatrix * glm::vec4((submesh.aabbMin + submesh.aabbMax) * 0.5f, 1.0f));
+        const glm::vec3 extent = absLinear * ((submesh.aabbMax - submesh.aabbMin) * 0.5f);
+        bounds = i == 0 ? Aabb{ center - extent, center + extent } : UnionAabb(bounds, Aabb{ center - extent, center + extent });
     }
+
+    return bounds;
+}
+
+void MoveEntity(App* app, u32 entityIdx, const glm::mat4& worldMatrix)
+{
+    Entity& entity = app->entities[entityIdx];
+    const Aabb previousBounds = ComputeEntityBounds(app, entity);
+    entity.worldMatrix = worldMatrix;
+    const Aabb bounds = ComputeEntityBounds(app, entity);
+
+    // The cached shadow cascades where the entity was or now is have to be rendered again
+    InvalidateShadowMaps(app->shadowMaps, previousBounds);
+    InvalidateShadowMaps(app->shadowMaps, bounds);
+
+    // The tree is only touched when the entity leaves its fattened box
+    MoveTreeProxy(app->entityTree, entity.treeProxy, bounds);
+    UpdateEntityCullingBounds(app->frustumCuller, entityIdx, entity, app->models, app->meshes);
+}
+
+void PickEntity(App* app, glm::vec2 mousePos)
+{
+    // Ray through the pixel, from the near to the far plane
+    const glm::vec2 ndc = glm::vec2(mousePos.x / app->displaySize.x * 2.0f - 1.0f, 1.0f - mousePos.y / app->displaySize.y * 2.0f);
+    const glm::mat4 inverseViewProjection = glm::inverse(app->camera.projection * app->camera.viewMatrix);
+    glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndc, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc, 1.0f, 1.0f);
+    const glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+    const glm::vec3 toFar = glm::vec3(farPoint) / farPoint.w - origin;
+
+    f32 hitDistance;
+    app->pickedEntity = QueryTreeRay(app->entityTree, origin, glm::normalize(toFar), glm::length(toFar), hitDistance);
 }
 
 void Init(App* app)
@@ -272,11 +404,25 @@ void Init(App* app)
     app->glInfo.GLSLversion = (const char*)glGetString(GL_SHADING_LANGUAGE_VERSION);
        
     app->enableDeferredShading = false;
+    app->deferredLighting = DeferredLighting_Tiled;
+    app->geometrySubmission = GeometrySubmission_MultiDrawIndirect;
+    app->enableParallelRecording = true;
+    app->enableFrustumCulling = true;
+    app->enableOcclusionCulling = true;
+    app->enableShadows = true;
+    app->entityTree = CreateAabbTree(256);
+    app->pickedEntity = UINT32_MAX;
+    InitJobSystem(app->jobSystem);
+    InitFullscreenQuad(app);
     
     InitModelsAndLights(app);
+    InitShadowMaps(app);
     InitSkybox(app);
     InitBackPack(app);
-    InitWaterShader(app);    
+    InitWater(app);
+
+    // Every static mesh has been loaded
+    UploadStaticGeometry(app);
 
     // Camera    
     app->camera = Camera(
@@ -300,26 +446,72 @@ void InitModelsAndLights(App* app)
     // Program 
     app->texturedGeometryProgramIdx = LoadProgram(app, "textured_geometry_shader.glsl", "TEXTURED_GEOMETRY");
     Program& texturedGeometryProgram = app->programs[app->texturedGeometryProgramIdx];
-    app->programUniformTexture = glGetUniformLocation(texturedGeometryProgram.handle, "uTexture");
+    app->programUniformTexture = FindSamplerUnit(texturedGeometryProgram.reflection, "uTexture");
+    app->programTexturedGeometryUniformTexCoordScale = FindUniformLocation(texturedGeometryProgram.reflection, "uTexCoordScale");
+    app->programTexturedGeometryUniformSharpness = FindUniformLocation(texturedGeometryProgram.reflection, "uSharpness");
+
+    app->gBufferViewShaderId = LoadProgram(app, "gbuffer_view_shader.glsl", "GBUFFER_VIEW_SHADER");
+    Program& gBufferViewProgram = app->programs[app->gBufferViewShaderId];
+    app->programGBufferViewUniformTextureNormals = FindSamplerUnit(gBufferViewProgram.reflection, "gNormal");
+    app->programGBufferViewUniformTextureAlbedo = FindSamplerUnit(gBufferViewProgram.reflection, "gAlbedoSpec");
+    app->programGBufferViewUniformTextureDepth = FindSamplerUnit(gBufferViewProgram.reflection, "gDepth");
+    app->programGBufferViewUniformRenderTarget = FindUniformLocation(gBufferViewProgram.reflection, "uRenderTarget");
+    app->programGBufferViewUniformFar = FindUniformLocation(gBufferViewProgram.reflection, "uFar");
+    app->programGBufferViewUniformSourceScale = FindUniformLocation(gBufferViewProgram.reflection, "uSourceScale");
 
     app->geometryPassShaderId = LoadProgram(app, "geometry_pass_shader.glsl", "GEOMETRY_PASS_SHADER");
     Program& geometryPassShader = app->programs[app->geometryPassShaderId];
-    app->programGPassUniformTexture = glGetUniformLocation(geometryPassShader.handle, "uTexture");
+    app->programGPassUniformTexture = FindSamplerUnit(geometryPassShader.reflection, "uTexture");
+    app->programGPassUniformHasNormalMap = FindUniformLocation(geometryPassShader.reflection, "hasNormalMap");
+    app->programGPassUniformHasReliefMap = FindUniformLocation(geometryPassShader.reflection, "hasReliefMap");
+    app->programGPassUniformRelief = FindUniformLocation(geometryPassShader.reflection, "Relief");
+    app->programGPassUniformBumpiness = FindUniformLocation(geometryPassShader.reflection, "Bumpiness");
     SetAttributes(geometryPassShader);
 
+    app->geometryPassIndirectShaderId = LoadProgram(app, "geometry_pass_batched_shader.glsl", "GEOMETRY_PASS_INDIRECT_SHADER");
+    Program& geometryPassIndirectShader = app->programs[app->geometryPassIndirectShaderId];
+    app->programGPassIndirectUniformTexture = FindSamplerUnit(geometryPassIndirectShader.reflection, "uTexture");
+
+    app->geometryPassInstancedShaderId = LoadProgram(app, "geometry_pass_batched_shader.glsl", "GEOMETRY_PASS_INSTANCED_SHADER");
+    Program& geometryPassInstancedShader = app->programs[app->geometryPassInstancedShaderId];
+    app->programGPassInstancedUniformTexture = FindSamplerUnit(geometryPassInstancedShader.reflection, "uTexture");
+    app->programGPassInstancedUniformInstanceOffset = FindUniformLocation(geometryPassInstancedShader.reflection, "uInstanceOffset");
+    SetAttributes(geometryPassInstancedShader);
+
     // Program
     app->shadingPassShaderId = LoadProgram(app, "shading_pass_shader.glsl", "SHADING_PASS_SHADER");
     Program& shadingPassShader = app->programs[app->shadingPassShaderId];
-    app->programShadingPassUniformTexturePosition = glGetUniformLocation(shadingPassShader.handle, "gPosition");
-    app->programShadingPassUniformTextureNormals = glGetUniformLocation(shadingPassShader.handle, "gNormal");
-    app->programShadingPassUniformTextureAlbedo = glGetUniformLocation(shadingPassShader.handle, "gAlbedoSpec");
-    app->programShadingPassUniformTextureDepth = glGetUniformLocation(shadingPassShader.handle, "gDepth");
+    app->programShadingPassUniformTextureNormals = FindSamplerUnit(shadingPassShader.reflection, "gNormal");
+    app->programShadingPassUniformTextureAlbedo = FindSamplerUnit(shadingPassShader.reflection, "gAlbedoSpec");
+    app->programShadingPassUniformTextureDepth = FindSamplerUnit(shadingPassShader.reflection, "gDepth");
+    app->programShadingPassUniformShadowMap = FindSamplerUnit(shadingPassShader.reflection, "uShadowMap");
+    app->programShadingPassUniformDirectionalOnly = FindUniformLocation(shadingPassShader.reflection, "uDirectionalOnly");
+    app->programShadingPassAmbient = FindAmbientUniforms(shadingPassShader.reflection);
     SetAttributes(shadingPassShader);
 
+    app->tiledDeferredShaderId = LoadComputeProgram(app, "tiled_deferred_shader.glsl", "TILED_DEFERRED_SHADER");
+    Program& tiledDeferredShader = app->programs[app->tiledDeferredShaderId];
+    app->programTiledDeferredUniformTextureDepth = FindSamplerUnit(tiledDeferredShader.reflection, "gDepth");
+    app->programTiledDeferredUniformTextureNormals = FindSamplerUnit(tiledDeferredShader.reflection, "gNormal");
+    app->programTiledDeferredUniformTextureAlbedo = FindSamplerUnit(tiledDeferredShader.reflection, "gAlbedoSpec");
+    app->programTiledDeferredUniformShadowMap = FindSamplerUnit(tiledDeferredShader.reflection, "uShadowMap");
+    app->programTiledDeferredUniformInverseProjection = FindUniformLocation(tiledDeferredShader.reflection, "uInverseProjectionMatrix");
+    app->programTiledDeferredUniformOutputSize = FindUniformLocation(tiledDeferredShader.reflection, "uOutputSize");
+    app->programTiledDeferredAmbient = FindAmbientUniforms(tiledDeferredShader.reflection);
+
+    app->lightVolumeShaderId = LoadProgram(app, "light_volume_shader.glsl", "LIGHT_VOLUME_SHADER");
+    Program& lightVolumeShader = app->programs[app->lightVolumeShaderId];
+    app->programLightVolumeUniformTextureDepth = FindSamplerUnit(lightVolumeShader.reflection, "gDepth");
+    app->programLightVolumeUniformTextureNormals = FindSamplerUnit(lightVolumeShader.reflection, "gNormal");
+    app->programLightVolumeUniformTextureAlbedo = FindSamplerUnit(lightVolumeShader.reflection, "gAlbedoSpec");
+    app->programLightVolumeUniformViewProjection = FindUniformLocation(lightVolumeShader.reflection, "uViewProjectionMatrix");
+    SetAttributes(lightVolumeShader);
+
     app->lightsShaderId = LoadProgram(app, "lights_shader.glsl", "LIGHTS_SHADER");
     Program& lightsShader = app->programs[app->lightsShaderId];
-    app->programLightsUniformColor = glGetUniformLocation(lightsShader.handle, "lightColor");
-    app->programLightsUniformWorldMatrix = glGetUniformLocation(lightsShader.handle, "uWorldViewProjectionMatrix");
+    app->programLightsUniformType = FindUniformLocation(lightsShader.reflection, "uLightType");
+    app->programLightsUniformScale = FindUniformLocation(lightsShader.reflection, "uLightScale");
+    app->programLightsUniformViewProjection = FindUniformLocation(lightsShader.reflection, "uViewProjectionMatrix");
     SetAttributes(lightsShader);
 
     app->texturedMeshProgramIdx = LoadProgram(app, "show_textured_mesh.glsl", "SHOW_TEXTURED_MESH");
@@ -329,7 +521,7 @@ void InitModelsAndLights(App* app)
     // Init models
     //u32 patrickTexIdx = LoadModel(app, "Models/Patrick/Patrick.obj");
     //app->planeId = LoadModel(app, "Models/Plane/plane.obj");
-    //app->sphereId = LoadModel(app, "Models/Sphere/sphere.obj");
+    app->sphereId = LoadModel(app, "Models/Sphere/sphere.obj"); // Point light volumes and gizmos
     //u32 cyborgId = LoadModel(app, "Models/Cyborg/cyborg.obj");
     //u32 planetMarsId = LoadModel(app, "Models/Planet/Mars/mars.obj");
     u32 woodenCartId = LoadModel(app, "Models/WoodenCart/cart_OBJ.obj");
@@ -419,16 +611,25 @@ void InitModelsAndLights(App* app)
     // Local parameters
     glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &app->maxUniformBufferSize);
     glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &app->uniformBufferAlignment);
-    app->uniformBuffer = CreateConstantBuffer(app->maxUniformBufferSize);
+    app->uniformPool = CreateUniformBufferPool(UNIFORM_POOL_CHUNK_SIZE, app->uniformBufferAlignment);
 
     // Global parameters
     glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &app->maxGlobalParamsBufferSize);
     glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &app->globalParamsAlignment);
-    app->globalBuffer = CreateConstantBuffer(app->maxGlobalParamsBufferSize);
+    app->globalBuffer = CreateRingBuffer(app->maxGlobalParamsBufferSize, GL_UNIFORM_BUFFER, app->globalParamsAlignment);
 
-    // FBO
-    app->gFbo.Initialize(app->displaySize.x, app->displaySize.y);
-    app->shadingFbo.Initialize(app->displaySize.x, app->displaySize.y);
+    // Grown in Update() when there are more lights than fit in a region
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &app->storageBufferAlignment);
+    app->lightsBuffer = CreateRingBuffer(64 * sizeof(GPULight), GL_SHADER_STORAGE_BUFFER, app->storageBufferAlignment);
+    app->clusterBuffer = CreateRingBuffer(CLUSTER_COUNT * sizeof(LightCluster) * 2, GL_SHADER_STORAGE_BUFFER, app->storageBufferAlignment);
+
+    // The G-buffer and shading targets are pooled by the render graph
+    glGenQueries(2, app->gBufferTimerQueries);
+
+    InitDynamicResolution(app->dynamicResolution);
+    InitTemporalUpsampling(app);
+    InitFrameCapture(app->frameCapture);
+    app->renderSize = app->displaySize;
 }
 
 void InitBackPack(App* app)
@@ -437,6 +638,16 @@ void InitBackPack(App* app)
     Shader shader("model_loading.vert", "model_loading.frag");
     app->backpack.model = model;
     app->backpack.shader = shader;
+    app->backpack.uniformProjection = shader.GetUniformLocation("projection");
+    app->backpack.uniformView = shader.GetUniformLocation("view");
+    app->backpack.uniformModel = shader.GetUniformLocation("model");
+
+    app->depthPrepassShader = Shader("depth_prepass.vert", "depth_prepass.frag");
+    app->depthPrepassUniformProjection = app->depthPrepassShader.GetUniformLocation("projection");
+    app->depthPrepassUniformView = app->depthPrepassShader.GetUniformLocation("view");
+    app->depthPrepassUniformModel = app->depthPrepassShader.GetUniformLocation("model");
+    app->depthPrepassMode = DepthPrepass_Auto;
+    glGenQueries(2, app->forwardTimerQueries);
 }
 
 void Gui(App* app)
@@ -491,6 +702,59 @@ void Gui(App* app)
     ImGui::Separator();
     ImGui::Text("Render Targets - gBuffer");
     ImGui::Checkbox("Enable deferred shading", &app->enableDeferredShading);
+    const f32 gBufferMB = (f32)app->renderSize.x * app->renderSize.y * GBUFFER_BYTES_PER_PIXEL / (1024.0f * 1024.0f);
+    ImGui::Text("G-buffer: %d bits/pixel, %.1f MB/frame, geometry pass %.3f ms", GBUFFER_BYTES_PER_PIXEL * 8, gBufferMB, app->gBufferPassMs);
+    const char* deferredLightings[] = { "Clustered", "Tiled (compute)", "Light volumes" };
+    int deferredLighting = (int)app->deferredLighting;
+    if (ImGui::Combo("Deferred lighting", &deferredLighting, deferredLightings, IM_ARRAYSIZE(deferredLightings)))
+    {
+        app->deferredLighting = (DeferredLighting)deferredLighting;
+    }
+    ImGui::Checkbox("Frustum culling", &app->enableFrustumCulling);
+    ImGui::SameLine();
+    ImGui::Text("%u/%u entities, %u/%u submeshes", app->frustumCuller.visibleEntityCount, (u32)app->entities.size(),
+                app->frustumCuller.visibleBoxCount, app->frustumCuller.boxCount);
+    ImGui::Checkbox("Occlusion culling", &app->enableOcclusionCulling);
+    ImGui::SameLine();
+    ImGui::Text("%u occluders, %u submeshes hidden", app->occlusionCuller.occluderCount, app->occlusionCuller.occludedBoxCount);
+    ImGui::Checkbox("Cascaded shadows", &app->enableShadows);
+    ImGui::SameLine();
+    ImGui::Text("%u cascades, %u casters rendered", app->shadowMaps.renderedCascades, app->shadowMaps.renderedCasters);
+    const RenderGraph& graph = app->renderGraph;
+    ImGui::Text("Render graph: %u passes (%u culled), %u transient targets in %.1f MB instead of %.1f MB, %u clears, %u depth copies",
+                (u32)graph.passes.size(), graph.culledPassCount, graph.transientCount, graph.pooledBytes / (1024.0f * 1024.0f),
+                graph.transientBytes / (1024.0f * 1024.0f), graph.clearCount, graph.blitCount);
+    ImGui::Text("%u pooled textures, %u allocated since startup%s", (u32)graph.textures.size(), graph.allocationCount,
+                graph.stableFrames < RENDER_GRAPH_RESIZE_DEBOUNCE ? ", resizing" : "");
+    if (app->pickedEntity != UINT32_MAX)
+    {
+        ImGui::Text("Picked entity: %u (right click)", app->pickedEntity);
+
+        // Moving it refits its proxy in the entity tree and its culling bounds
+        glm::mat4 worldMatrix = app->entities[app->pickedEntity].worldMatrix;
+        if (ImGui::DragFloat3("Picked position", &worldMatrix[3][0], 0.1f))
+            MoveEntity(app, app->pickedEntity, worldMatrix);
+    }
+    else
+        ImGui::Text("Picked entity: none (right click)");
+    const char* depthPrepassModes[] = { "Off", "On", "Auto" };
+    int depthPrepassMode = (int)app->depthPrepassMode;
+    if (ImGui::Combo("Forward depth prepass", &depthPrepassMode, depthPrepassModes, IM_ARRAYSIZE(depthPrepassModes)))
+    {
+        app->depthPrepassMode = (DepthPrepassMode)depthPrepassMode;
+    }
+    ImGui::Text("Forward pass: %.3f ms without prepass, %.3f ms with it", app->forwardPassMs[0], app->forwardPassMs[1]);
+    const char* submissions[] = { "Per draw", "Instanced", "Multi-draw indirect" };
+    int submission = (int)app->geometrySubmission;
+    if (ImGui::Combo("Geometry submission", &submission, submissions, IM_ARRAYSIZE(submissions)))
+    {
+        app->geometrySubmission = (GeometrySubmission)submission;
+    }
+    if (app->geometrySubmission == GeometrySubmission_PerDraw)
+    {
+        ImGui::Checkbox("Parallel command recording", &app->enableParallelRecording);
+        ImGui::Text("%u commands recorded in %u slices", app->recordedCommands, app->recordingSlices);
+    }
     const char* items[] = { "Default", "Position", "Normals", "Albedo", "Depth" };
     static int item = 0;
     if (ImGui::Combo("Render Target", &item, items, IM_ARRAYSIZE(items)))
@@ -506,88 +770,424 @@ void Gui(App* app)
     ImGui::Text("Bump Strength");
     ImGui::DragFloat("##bumpStrengh", &app->bumpStrength, 0.01f, 0.0, 1.0f);
 
+    // Water, only drawn by the deferred path
+    ImGui::Separator();
+    ImGui::Checkbox("Water", &app->renderWater);
+    const char* waterScales[] = { "Full", "1/2", "1/4" };
+    int reflectionScale = app->water.reflectionDivisor == 4 ? 2 : app->water.reflectionDivisor - 1;
+    if (ImGui::Combo("Reflection resolution", &reflectionScale, waterScales, IM_ARRAYSIZE(waterScales)))
+    {
+        app->water.reflectionDivisor = 1 << reflectionScale;
+    }
+    int refractionScale = app->water.refractionDivisor == 4 ? 2 : app->water.refractionDivisor - 1;
+    if (ImGui::Combo("Refraction resolution", &refractionScale, waterScales, IM_ARRAYSIZE(waterScales)))
+    {
+        app->water.refractionDivisor = 1 << refractionScale;
+    }
+    ImGui::Checkbox("Reflection every other frame", &app->water.alternateReflection);
+    ImGui::Text("%u water scenes, %u draws", app->water.renderedScenes, app->water.renderedDraws);
+
+    // Ambient lighting of the sky, only in the deferred path
+    ImageBasedLighting& ibl = app->imageBasedLighting;
+    ImGui::Separator();
+    ImGui::Checkbox("Image based lighting", &ibl.enabled);
+    ImGui::SliderFloat("Ambient intensity", &ibl.intensity, 0.0f, 2.0f);
+    ImGui::SliderFloat("Ambient specular roughness", &ibl.roughness, 0.0f, 1.0f);
+    ImGui::Text("%s in %.1f ms", ibl.loadedFromCache ? "Loaded from the cache" : "Baked", ibl.bakeMs);
+
+    // Dynamic resolution, only applied to the deferred path
+    DynamicResolution& resolution = app->dynamicResolution;
+    ImGui::Separator();
+    ImGui::Checkbox("Dynamic resolution", &resolution.enabled);
+    ImGui::DragFloat("GPU budget (ms)", &resolution.targetMs, 0.1f, 1.0f, 100.0f);
+    ImGui::SliderFloat("Minimum scale", &resolution.minScale, 0.25f, 1.0f);
+    ImGui::SliderFloat("Upscale sharpness", &resolution.sharpness, 0.0f, 1.0f);
+    ImGui::Text("Scale %.3f, %dx%d of %dx%d, GPU %.2f ms", resolution.scale, app->renderSize.x, app->renderSize.y,
+                app->displaySize.x, app->displaySize.y, resolution.gpuMs);
+    const u32 decisionCount = glm::min(resolution.decisionCount, (u32)DYNAMIC_RESOLUTION_HISTORY);
+    for (u32 i = 0; i < decisionCount; ++i)
+    {
+        const DynamicResolutionDecision& decision = resolution.history[(resolution.decisionCount - 1 - i) % DYNAMIC_RESOLUTION_HISTORY];
+        ImGui::Text("Frame %u: %.2f ms, %.3f -> %.3f", decision.frame, decision.gpuMs, decision.oldScale, decision.newScale);
+    }
+
+    // Temporal upsampling, resolves the deferred targets to the display size over several frames
+    TemporalUpsampling& temporal = app->temporalUpsampling;
+    ImGui::Separator();
+    ImGui::Checkbox("Temporal upsampling", &temporal.enabled);
+    ImGui::SliderFloat("Render scale", &temporal.renderScale, 0.25f, 1.0f);
+    ImGui::SliderFloat("History blend", &temporal.blend, 0.02f, 1.0f);
+    if (temporal.active)
+        ImGui::Text("%u jitter phases, %dx%d to %dx%d", temporal.jitterPhases, app->renderSize.x, app->renderSize.y, app->displaySize.x, app->displaySize.y);
+
+    // Frame capture, the settings apply to the next recording
+    FrameCapture& capture = app->frameCapture;
+    ImGui::Separator();
+    if (!capture.recording)
+    {
+        int frameStep = (int)capture.frameStep;
+        if (ImGui::SliderInt("Capture every n frames", &frameStep, 1, 10))
+            capture.frameStep = (u32)frameStep;
+        if (ImGui::Button("Start capture"))
+            StartFrameCapture(capture);
+    }
+    else if (ImGui::Button("Stop capture"))
+    {
+        StopFrameCapture(capture);
+    }
+    if (capture.capturedFrames > 0)
+        ImGui::Text("%s: %u captured, %u written, %u dropped, %u failed, %u in flight", capture.directory, capture.capturedFrames,
+                    capture.writtenFrames.load(), capture.droppedFrames, capture.failedFrames.load(), GetPendingCaptureCount(capture));
+
+    JobSystem& jobs = app->jobSystem;
+    ImGui::Separator();
+    ImGui::Text("Jobs: %u threads, %u executed, %u stolen", jobs.threadCount, jobs.executedJobs.load(), jobs.stolenJobs.load());
+
     ImGui::End();
 }
 
 void Update(App* app)
 {
+    // GL work the jobs of the last frame queued for the main thread
+    RunMainThreadJobs(app->jobSystem);
+
     // You can handle app->input keyboard/mouse here
     app->camera.HandleInput(app);
 
-    // Global parameters
-    MapBuffer(app->globalBuffer, GL_WRITE_ONLY);
-    app->globalParamsOffset = app->globalBuffer.head;
+    if (app->input.mouseButtons[RIGHT] == BUTTON_PRESS)
+        PickEntity(app, app->input.mousePos);
+
+    // The deferred targets follow the GPU time, the forward path always renders at the display size.
+    // Without dynamic resolution the temporal upsampling renders at its own fixed scale.
+    app->renderSize = app->enableDeferredShading ? UpdateDynamicResolution(app->dynamicResolution, app->displaySize) : app->displaySize;
+    if (app->enableDeferredShading && app->temporalUpsampling.enabled && !app->dynamicResolution.enabled)
+        app->renderSize = GetTemporalRenderSize(app->temporalUpsampling, app->displaySize);
+
+    // The window may have been resized, and the temporal upsampling jitters the projection of every frame
+    app->camera.aspectRatio = (f32)app->displaySize.x / (f32)app->displaySize.y;
+    const glm::mat4 projection = glm::perspective(glm::radians(60.0f), app->camera.aspectRatio, app->camera.znear, app->camera.zfar);
+    UpdateTemporalUpsampling(app, projection);
+
+    // Light clusters of the current view
+    LightClusterGrid& grid = app->lightClusters;
+    BuildLightClusters(grid, app->jobSystem, app->lights, app->camera.viewMatrix, app->camera.projection, app->camera.znear, app->camera.zfar, app->renderSize);
+
+    // Entities outside of the view get no uniforms and no draws
+    const glm::mat4 viewProjectionMatrix = app->camera.projection * app->camera.viewMatrix;
+    UpdateCullingBounds(app->frustumCuller, app->entities, app->models, app->meshes);
+    FlattenAabbTree(app->entityTree); // The entities of this frame are moved, the GUI runs before Update()
+    if (app->enableFrustumCulling && app->entities.size() >= ENTITY_TREE_CULLING_MIN_ENTITIES)
+    {
+        // The tree rejects whole groups of entities, only the submeshes of the rest are tested
+        glm::vec4 planes[6];
+        ExtractFrustumPlanes(viewProjectionMatrix, planes);
+        app->treeQueryResults.clear();
+        QueryTreeFrustum(app->entityTree, planes, app->treeQueryResults);
+        CullFrustum(app->frustumCuller, app->jobSystem, viewProjectionMatrix, true, &app->treeQueryResults);
+    }
+    else
+    {
+        CullFrustum(app->frustumCuller, app->jobSystem, viewProjectionMatrix, app->enableFrustumCulling);
+    }
 
-    PushVec3(app->globalBuffer, app->camera.position);
-    PushUInt(app->globalBuffer, app->lights.size());
+    if (app->enableOcclusionCulling)
+    {
+        CullOcclusion(app->occlusionCuller, app->jobSystem, app->frustumCuller, app->entities, app->models, app->meshes, viewProjectionMatrix, app->camera.position);
+    }
+
+    // Shadow cascades of the directional lights, fitted to the current view
+    UpdateShadowCascades(app);
+
+    // Global parameters
+    BeginRingBufferFrame(app->globalBuffer);
+    app->globalParamsOffset = app->globalBuffer.buffer.head;
+
+    PushVec3(app->globalBuffer.buffer, app->camera.position);
+    PushUInt(app->globalBuffer.buffer, app->lights.size());
+    PushMat4(app->globalBuffer.buffer, app->camera.viewMatrix);
+    PushUInt(app->globalBuffer.buffer, CLUSTER_GRID_X);
+    PushUInt(app->globalBuffer.buffer, CLUSTER_GRID_Y);
+    PushUInt(app->globalBuffer.buffer, CLUSTER_GRID_Z);
+    PushUInt(app->globalBuffer.buffer, grid.directionalLightCount);
+    PushVec4(app->globalBuffer.buffer, glm::vec4(grid.tileSize, grid.sliceScale, grid.sliceBias));
+    PushMat4(app->globalBuffer.buffer, glm::inverse(app->camera.projection * app->camera.viewMatrix));
+    PushVec4(app->globalBuffer.buffer, glm::vec4(glm::vec2(app->renderSize), 1.0f / glm::vec2(app->renderSize)));
+    PushVec4(app->globalBuffer.buffer, glm::vec4(app->temporalUpsampling.jitter, app->temporalUpsampling.jitter * 0.5f * glm::vec2(app->renderSize)));
+
+    app->globalParamsSize = app->globalBuffer.buffer.head - app->globalParamsOffset;
+
+    AlignHead(app->globalBuffer.buffer, app->globalParamsAlignment);
+    app->shadowParamsOffset = app->globalBuffer.buffer.head;
+    PushShadowParams(app, app->globalBuffer.buffer);
+    app->shadowParamsSize = app->globalBuffer.buffer.head - app->shadowParamsOffset;
+
+    EndRingBufferFrame(app->globalBuffer);
 
     // Lights
+    const u32 lightsSize = (u32)glm::max(app->lights.size(), (size_t)1) * sizeof(GPULight);
+    if (lightsSize > app->lightsBuffer.regionSize)
+    {
+        DestroyRingBuffer(app->lightsBuffer);
+        app->lightsBuffer = CreateRingBuffer(lightsSize * 2, GL_SHADER_STORAGE_BUFFER, app->storageBufferAlignment);
+    }
+
+    BeginRingBufferFrame(app->lightsBuffer);
+    app->lightsOffset = app->lightsBuffer.buffer.head;
+
     for (int i = 0; i < app->lights.size(); ++i)
     {
-        AlignHead(app->globalBuffer, sizeof(glm::vec4));
-
-        Light& light = app->lights[i];
-        PushUInt(app->globalBuffer, static_cast<u32>(light.type));
-        PushVec3(app->globalBuffer, light.position);
-        PushVec3(app->globalBuffer, light.color);
-        PushVec3(app->globalBuffer, light.direction);
-        PushUInt(app->globalBuffer, light.intensity);
+        const Light& light = app->lights[i];
+
+        GPULight gpuLight = {};
+        gpuLight.position = light.position;
+        gpuLight.type = static_cast<u32>(light.type);
+        gpuLight.color = light.color;
+        gpuLight.intensity = light.intensity;
+        gpuLight.direction = light.direction;
+        gpuLight.range = light.type == LightType_Point ? PointLightRange(light) : 0.0f;
+        PushAlignedData(app->lightsBuffer.buffer, &gpuLight, sizeof(gpuLight), sizeof(glm::vec4));
+    }
+
+    app->lightsSize = lightsSize;
+
+    EndRingBufferFrame(app->lightsBuffer);
+
+    // Cluster ranges followed by the light index list
+    const u32 clustersSize = CLUSTER_COUNT * sizeof(LightCluster);
+    const u32 lightIndicesSize = (u32)glm::max(grid.lightIndices.size(), (size_t)1) * sizeof(u32);
+    const u32 clusterDataSize = Align(clustersSize, app->storageBufferAlignment) + lightIndicesSize;
+    if (clusterDataSize > app->clusterBuffer.regionSize)
+    {
+        DestroyRingBuffer(app->clusterBuffer);
+        app->clusterBuffer = CreateRingBuffer(clusterDataSize * 2, GL_SHADER_STORAGE_BUFFER, app->storageBufferAlignment);
     }
 
-    app->globalParamsSize = app->globalBuffer.head - app->globalParamsOffset;
+    BeginRingBufferFrame(app->clusterBuffer);
 
-    UnmapBuffer(app->globalBuffer);
+    app->clustersOffset = app->clusterBuffer.buffer.head;
+    app->clustersSize = clustersSize;
+    PushData(app->clusterBuffer.buffer, grid.clusters.data(), clustersSize);
 
+    AlignHead(app->clusterBuffer.buffer, app->storageBufferAlignment);
+    app->lightIndicesOffset = app->clusterBuffer.buffer.head;
+    app->lightIndicesSize = lightIndicesSize;
+    PushData(app->clusterBuffer.buffer, grid.lightIndices.data(), grid.lightIndices.size() * sizeof(u32));
 
-    MapBuffer(app->uniformBuffer, GL_WRITE_ONLY);
+    EndRingBufferFrame(app->clusterBuffer);
+
+
+    BeginUniformBufferPoolFrame(app->uniformPool);
 
     // Entities
     for (int i = 0; i < app->entities.size(); ++i)
     {
-        AlignHead(app->uniformBuffer, app->uniformBufferAlignment);
+        if (!app->frustumCuller.entityVisible[i])
+            continue;
+
+        Entity& entity = app->entities[i];
 
-        glm::mat4 worldMatrix = app->entities[i].worldMatrix;
-        glm::mat4 worldViewProjectionMatrix = app->camera.projection * app->camera.viewMatrix * worldMatrix;
+        glm::mat4 worldMatrix = entity.worldMatrix;
+        glm::mat4 worldViewProjectionMatrix = viewProjectionMatrix * worldMatrix;
+        glm::mat4 previousWorldViewProjectionMatrix = app->temporalUpsampling.previousViewProjection * entity.previousWorldMatrix;
 
-        app->entities[i].localParamsOffset = app->uniformBuffer.head;
-        PushMat4(app->uniformBuffer, worldMatrix);
-        PushMat4(app->uniformBuffer, worldViewProjectionMatrix);
-        app->entities[i].localParamsSize = app->uniformBuffer.head - app->entities[i].localParamsOffset;
+        Buffer& chunk = AllocUniformBlock(app->uniformPool, 3 * sizeof(glm::mat4), entity.localParams);
+        PushMat4(chunk, worldMatrix);
+        PushMat4(chunk, worldViewProjectionMatrix);
+        PushMat4(chunk, previousWorldViewProjectionMatrix);
     }
 
-    UnmapBuffer(app->uniformBuffer);
+    EndUniformBufferPoolFrame(app->uniformPool);
 }
 
 void Render(App* app)
 {
-    // Clear the screen (also ImGui...)
-    {
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glViewport(0, 0, app->displaySize.x, app->displaySize.y);
-        glEnable(GL_DEPTH_TEST);
-    }
+    glEnable(GL_DEPTH_TEST);
 
     //Relief mapping activated
     if (app->relief) {
         //RenderRelief();
     }
 
-    //Water rendering if enabled
-    if (app->renderWater) {
-
-        RenderWater(app);
-    }
+    // Passes of the frame with what they read and write. The graph drops the ones whose
+    // results are not used, pools their targets and does the clears and depth copies.
+    RenderGraph& graph = app->renderGraph;
+    FrameResources& frame = app->frameResources;
+    BeginRenderGraph(graph);
+    frame.backbuffer = ImportRenderGraphBackbuffer(graph, app->displaySize);
 
+    u32 sceneDepth = frame.backbuffer;
     if (app->enableDeferredShading)
     {
-        //RenderDeferredRenderingScene(app);
+        const glm::vec4 background = glm::vec4(0.1f, 0.1f, 0.1f, 1.0f);
+        // Allocated at the display size and rendered in the corner of the current scale, so
+        // scale changes do not reallocate
+        frame.gAlbedo = CreateRenderGraphScaledTexture(graph, "G-buffer albedo", app->renderSize, app->displaySize, GL_RGBA8);
+        frame.gNormal = CreateRenderGraphScaledTexture(graph, "G-buffer normals", app->renderSize, app->displaySize, GL_RG16);
+        frame.gDepth = CreateRenderGraphScaledTexture(graph, "G-buffer depth", app->renderSize, app->displaySize, GL_DEPTH_COMPONENT24);
+        frame.shading = CreateRenderGraphScaledTexture(graph, "Shading", app->renderSize, app->displaySize, GL_RGBA8);
+        frame.sceneColor = frame.shading;
+        frame.shadowMaps = ImportRenderGraphTexture(graph, "Shadow maps", app->shadowMaps.texture, glm::ivec2(SHADOW_MAP_SIZE), GL_DEPTH_COMPONENT32F);
+        sceneDepth = frame.gDepth;
+
+        // Only the cascades scheduled by Update() are drawn, the others keep their cached maps
+        if (app->enableShadows)
+        {
+            const u32 shadows = AddRenderGraphPass(graph, "Shadow maps", RenderShadowMaps);
+            WriteRenderGraphTexture(graph, shadows, frame.shadowMaps, RenderGraphAccess_Storage);
+        }
+
+        const u32 geometry = AddRenderGraphPass(graph, "Geometry pass", RenderGeometryPass);
+        WriteRenderGraphTexture(graph, geometry, frame.gAlbedo, RenderGraphAccess_ColorTarget, RenderGraphLoad_Clear, background);
+        WriteRenderGraphTexture(graph, geometry, frame.gNormal, RenderGraphAccess_ColorTarget, RenderGraphLoad_Clear, background);
+        WriteRenderGraphTexture(graph, geometry, frame.gDepth, RenderGraphAccess_DepthTarget, RenderGraphLoad_Clear, glm::vec4(1.0f));
+        if (app->temporalUpsampling.active)
+        {
+            // Pixels without geometry did not move, only the camera did, and the resolve skips them
+            frame.gVelocity = CreateRenderGraphScaledTexture(graph, "G-buffer velocity", app->renderSize, app->displaySize, GL_RG16F);
+            WriteRenderGraphTexture(graph, geometry, frame.gVelocity, RenderGraphAccess_ColorTarget, RenderGraphLoad_Clear, glm::vec4(0.0f));
+        }
+
+        const u32 shading = AddRenderGraphPass(graph, "Deferred shading", RenderDeferredShading);
+        ReadRenderGraphTexture(graph, shading, frame.gAlbedo);
+        ReadRenderGraphTexture(graph, shading, frame.gNormal);
+        ReadRenderGraphTexture(graph, shading, frame.gDepth);
+        ReadRenderGraphTexture(graph, shading, frame.shadowMaps);
+        if (app->deferredLighting == DeferredLighting_LightVolumes)
+            ReadRenderGraphTexture(graph, shading, frame.gDepth, RenderGraphAccess_DepthTest);
+        WriteRenderGraphTexture(graph, shading, frame.shading, RenderGraphAccess_ColorTarget, RenderGraphLoad_Clear, background);
+
+        //Water rendering if enabled
+        if (app->renderWater && app->water.entityIdx != UINT32_MAX) {
+            // The reflection is kept across frames, the refraction is only needed by this frame
+            const Water& water = app->water;
+            const bool updateReflection = PrepareWaterReflection(app);
+            const glm::ivec2 refractionSize = GetWaterTargetSize(app->renderSize, water.refractionDivisor);
+            const glm::ivec2 refractionCapacity = GetWaterTargetSize(app->displaySize, water.refractionDivisor);
+            frame.waterReflection = ImportRenderGraphTexture(graph, "Water reflection", water.reflectionTexture, water.reflectionSize, GL_RGBA8);
+            frame.waterReflectionDepth = ImportRenderGraphTexture(graph, "Water reflection depth", water.reflectionDepth, water.reflectionSize, GL_DEPTH_COMPONENT24);
+            frame.waterRefraction = CreateRenderGraphScaledTexture(graph, "Water refraction", refractionSize, refractionCapacity, GL_RGBA8);
+            frame.waterRefractionDepth = CreateRenderGraphScaledTexture(graph, "Water refraction depth", refractionSize, refractionCapacity, GL_DEPTH_COMPONENT24);
+
+            if (updateReflection)
+            {
+                const u32 reflection = AddRenderGraphPass(graph, "Water reflection", RenderWaterReflection);
+                WriteRenderGraphTexture(graph, reflection, frame.waterReflection, RenderGraphAccess_ColorTarget, RenderGraphLoad_Clear);
+                WriteRenderGraphTexture(graph, reflection, frame.waterReflectionDepth, RenderGraphAccess_DepthTarget, RenderGraphLoad_Clear, glm::vec4(1.0f));
+            }
+
+            const u32 refraction = AddRenderGraphPass(graph, "Water refraction", RenderWaterRefraction);
+            WriteRenderGraphTexture(graph, refraction, frame.waterRefraction, RenderGraphAccess_ColorTarget, RenderGraphLoad_Clear);
+            WriteRenderGraphTexture(graph, refraction, frame.waterRefractionDepth, RenderGraphAccess_DepthTarget, RenderGraphLoad_Clear, glm::vec4(1.0f));
+
+            const u32 surface = AddRenderGraphPass(graph, "Water surface", RenderWaterSurface);
+            ReadRenderGraphTexture(graph, surface, frame.waterReflection);
+            ReadRenderGraphTexture(graph, surface, frame.waterReflectionDepth);
+            ReadRenderGraphTexture(graph, surface, frame.waterRefraction);
+            ReadRenderGraphTexture(graph, surface, frame.waterRefractionDepth);
+            ReadRenderGraphTexture(graph, surface, frame.gDepth, RenderGraphAccess_DepthTest);
+            WriteRenderGraphTexture(graph, surface, frame.shading, RenderGraphAccess_ColorTarget);
+        }
+
+        // Rendered on top of the lit scene, tested against its depth
+        const u32 lights = AddRenderGraphPass(graph, "Lights", RenderLights);
+        ReadRenderGraphTexture(graph, lights, frame.gDepth, RenderGraphAccess_DepthTest);
+        WriteRenderGraphTexture(graph, lights, frame.shading, RenderGraphAccess_ColorTarget);
+
+        // The shading is accumulated into the history at the display size, which then stands in for it
+        if (app->temporalUpsampling.active)
+        {
+            const TemporalUpsampling& temporal = app->temporalUpsampling;
+            frame.temporalHistory = ImportRenderGraphTexture(graph, "Temporal history", temporal.historyTextures[temporal.historyIndex ^ 1], app->displaySize, GL_RGBA16F);
+            frame.temporalOutput = ImportRenderGraphTexture(graph, "Temporal output", temporal.historyTextures[temporal.historyIndex], app->displaySize, GL_RGBA16F);
+
+            const u32 resolve = AddRenderGraphPass(graph, "Temporal resolve", RenderTemporalResolve);
+            ReadRenderGraphTexture(graph, resolve, frame.shading);
+            ReadRenderGraphTexture(graph, resolve, frame.gVelocity);
+            ReadRenderGraphTexture(graph, resolve, frame.gDepth);
+            ReadRenderGraphTexture(graph, resolve, frame.temporalHistory);
+            WriteRenderGraphTexture(graph, resolve, frame.temporalOutput, RenderGraphAccess_ColorTarget, RenderGraphLoad_DontCare);
+            frame.sceneColor = frame.temporalOutput;
+        }
+
+        // The debug views of the G-buffer leave the shading passes without readers
+        const u32 composite = AddRenderGraphPass(graph, "Composite", RenderDeferredComposite);
+        if (app->renderTarget == RenderTargetType::DEFAULT)
+        {
+            ReadRenderGraphTexture(graph, composite, frame.sceneColor);
+        }
+        else
+        {
+            ReadRenderGraphTexture(graph, composite, frame.gAlbedo);
+            ReadRenderGraphTexture(graph, composite, frame.gNormal);
+            ReadRenderGraphTexture(graph, composite, frame.gDepth);
+        }
+        WriteRenderGraphTexture(graph, composite, frame.backbuffer, RenderGraphAccess_ColorTarget, RenderGraphLoad_DontCare);
     }
     else {
-        RenderForwardRenderingScene(app);
+        const u32 forward = AddRenderGraphPass(graph, "Forward rendering", RenderForwardRenderingScene);
+        WriteRenderGraphTexture(graph, forward, frame.backbuffer, RenderGraphAccess_ColorTarget, RenderGraphLoad_Clear, glm::vec4(0.05f, 0.05f, 0.05f, 1.0f));
+        WriteRenderGraphTexture(graph, forward, frame.backbuffer, RenderGraphAccess_DepthTarget, RenderGraphLoad_Clear, glm::vec4(1.0f));
     }
 
-    RenderSkybox(app);
+    // The deferred depth is copied into the default framebuffer by the graph
+    const u32 skybox = AddRenderGraphPass(graph, "Skybox", RenderSkybox);
+    ReadRenderGraphTexture(graph, skybox, sceneDepth, RenderGraphAccess_DepthTest);
+    WriteRenderGraphTexture(graph, skybox, frame.backbuffer, RenderGraphAccess_ColorTarget);
+
+    CompileRenderGraph(graph);
+
+    // The GPU time of the graph drives the scale of the next frames
+    BeginDynamicResolutionFrame(app->dynamicResolution);
+    ExecuteRenderGraph(graph, app);
+    EndDynamicResolutionFrame(app->dynamicResolution);
+
+    // Read back before the GUI is drawn on top, so the sequence shows the scene alone
+    UpdateFrameCapture(app->frameCapture, app->displaySize);
+
+    // The regions written in Update() can be reused once the GPU is done with this frame
+    FenceRingBufferFrame(app->globalBuffer);
+    FenceRingBufferFrame(app->lightsBuffer);
+    FenceRingBufferFrame(app->clusterBuffer);
+    FenceUniformBufferPoolFrame(app->uniformPool);
+
+    // Entities may be moved before the next Update(), the motion vectors start from here
+    for (Entity& entity : app->entities)
+        entity.previousWorldMatrix = entity.worldMatrix;
+}
+
+void Shutdown(App* app)
+{
+    // The encoders finish the frames in flight so the last files of a sequence are complete
+    ShutdownFrameCapture(app->frameCapture);
+    ShutdownJobSystem(app->jobSystem);
+    ShutdownTemporalUpsampling(app);
+
+    glDeleteVertexArrays(1, &app->quadVao);
+    glDeleteBuffers(1, &app->quadVbo);
+}
+
+void InitFullscreenQuad(App* app)
+{
+    const float quadVertices[] =
+    {
+        // positions        // texture Coords
+        -1.0f,  1.0f, 0.0f, 0.0f, 1.0f,
+        -1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
+         1.0f,  1.0f, 0.0f, 1.0f, 1.0f,
+         1.0f, -1.0f, 0.0f, 1.0f, 0.0f,
+    };
+
+    glGenVertexArrays(1, &app->quadVao);
+    glGenBuffers(1, &app->quadVbo);
+    glBindVertexArray(app->quadVao);
+    glBindBuffer(GL_ARRAY_BUFFER, app->quadVbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void RenderQuad(App* app)
@@ -597,32 +1197,7 @@ void RenderQuad(App* app)
         glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 1, -1, "RenderQuad");
     }
 
-    unsigned int quadVAO = 0;
-    unsigned int quadVBO;
-
-    if (quadVAO == 0)
-    {
-        float quadVertices[] =
-        {
-            // positions        // texture Coords
-            -1.0f,  1.0f, 0.0f, 0.0f, 1.0f,
-            -1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
-             1.0f,  1.0f, 0.0f, 1.0f, 1.0f,
-             1.0f, -1.0f, 0.0f, 1.0f, 0.0f,
-        };
-
-        // setup plane VAO
-        glGenVertexArrays(1, &quadVAO);
-        glGenBuffers(1, &quadVBO);
-        glBindVertexArray(quadVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    }
-    glBindVertexArray(quadVAO);
+    glBindVertexArray(app->quadVao);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
     glBindVertexArray(0);
 
@@ -635,8 +1210,9 @@ void RenderQuad(App* app)
 void InitSkybox(App* app)
 {
     app->skybox.shader = Shader("skybox.vert", "skybox.frag");
-    app->skybox.shader.Activate();
-    glUniform1i(glGetUniformLocation(app->skybox.shader.ID, "skybox"), 0);
+    app->skybox.viewLocation = app->skybox.shader.GetUniformLocation("view");
+    app->skybox.projectionLocation = app->skybox.shader.GetUniformLocation("projection");
+    app->skybox.cubemapUnit = app->skybox.shader.GetSamplerUnit("skybox");
     
     glEnable(GL_DEPTH_TEST); // Enables the Depth Buffer    
     glEnable(GL_CULL_FACE); // Enables Cull Facing    
@@ -658,192 +1234,140 @@ void InitSkybox(App* app)
     glBindVertexArray(0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
         
-    app->skybox.cubemapTextureId = loadCubemap(app->skybox.faces);
+    app->skybox.cubemapTextureId = loadCubemap(app->jobSystem, app->skybox.faces);
+
+    // Ambient lighting of the deferred shading, baked from the faces on the first run
+    InitImageBasedLighting(app->imageBasedLighting, app->jobSystem, app->skybox.faces, "Textures/skybox/ibl_cache.bin");
 }
 
 void RenderSkybox(App* app)
 {
-    if (app->enableDebugGroup)
-    {
-        glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 1, -1, "Skybox");
-    }
-
-    // Enable deferred rendering combined with a skybox
-    if(app->enableDeferredShading)
-    {
-        glEnable(GL_DEPTH_TEST);
+    // The render graph already copied the depth of the deferred scene into the default framebuffer
+    glm::mat4 view = glm::lookAt(app->camera.position, app->camera.position + app->camera.direction, app->camera.up);
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), (float)app->displaySize.x / app->displaySize.y, 0.1f, 100.0f);
+    DrawSkybox(app, view, projection);
+}
 
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, app->gFbo.GetTexture(RenderTargetType::FBO));
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-        glBlitFramebuffer(0, 0, app->displaySize.x, app->displaySize.y, 0, 0, app->displaySize.x, app->displaySize.y, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    }
+void DrawSkybox(App* app, const glm::mat4& view, const glm::mat4& projection)
+{
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_FALSE);
 
     // Since the cubemap will always have a depth of 1.0, we need that equal sign so it doesn't get discarded
     glDepthFunc(GL_LEQUAL);
 
     app->skybox.shader.Activate();
-    glm::mat4 view = glm::mat4(1.0f);
-    glm::mat4 projection = glm::mat4(1.0f);
     // We make the mat4 into a mat3 and then a mat4 again in order to get rid of the last row and column
     // The last row and column affect the translation of the skybox (which we don't want to affect)
-    view = glm::mat4(glm::mat3(glm::lookAt(app->camera.position, app->camera.position + app->camera.direction, app->camera.up)));
-    projection = glm::perspective(glm::radians(60.0f), (float)app->displaySize.x / app->displaySize.y, 0.1f, 100.0f);
-    glUniformMatrix4fv(glGetUniformLocation(app->skybox.shader.ID, "view"), 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(glGetUniformLocation(app->skybox.shader.ID, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    app->skybox.shader.setMat4(app->skybox.viewLocation, glm::mat4(glm::mat3(view)));
+    app->skybox.shader.setMat4(app->skybox.projectionLocation, projection);
 
     // Draws the cubemap as the last object so we can save a bit of performance by discarding all fragments
     // where an object is present (a depth of 1.0f will always fail against any object's depth value)
     glBindVertexArray(app->skybox.VAO);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, app->skybox.cubemapTextureId);
+    BindSamplerTexture(app->skybox.cubemapUnit, GL_TEXTURE_CUBE_MAP, app->skybox.cubemapTextureId);
     glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
     glBindVertexArray(0);
 
     // Switch back to the normal depth function
     glDepthFunc(GL_LESS);
-
-    if (app->enableDebugGroup)
-    {
-        glPopDebugGroup();
-    }
+    glDepthMask(GL_TRUE);
 }
 
-void InitWaterShader(App* app) 
+// A face is decoded on any thread, its upload is then queued for the main thread
+struct CubemapLoad
 {
-    Model model("Models/Plane/cube.obj");
-    Shader shader("water.vert", "water.frag");
-    app->water.model = model;
-    app->water.shader = shader;
-
-    app->waterPassShaderID = LoadProgram(app, "water_shader.glsl", "WATER_PASS_SHADER");
-
-    app->fboReflection = 0;
-    app->fboRefraction = 0;
-
-    {
-        u32 waterPlane = LoadModel(app, "Models/Plane.obj");
-
-        Entity entity = Entity(
-            glm::vec3(0.0f, 0.0f, 0.0f),    // Position
-            glm::vec3(1.0f),                // Scale factor
-            waterPlane                      // Model index
-        );
+    JobSystem*                      jobs;
+    JobCounter*                     counter;
+    const std::vector<std::string>* faces;
+    GLuint                          texture;
+    unsigned char*                  pixels[6];
+    glm::ivec2                      sizes[6];
+};
+
+static void UploadCubemapFace(void* data, u32 face, u32)
+{
+    CubemapLoad& load = *(CubemapLoad*)data;
+    glBindTexture(GL_TEXTURE_CUBE_MAP, load.texture);
+    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB, load.sizes[face].x, load.sizes[face].y, 0, GL_RGB, GL_UNSIGNED_BYTE, load.pixels[face]);
+    stbi_image_free(load.pixels[face]);
+}
 
-        app->entities.push_back(entity);
-    }
+static void DecodeCubemapFace(void* data, u32 face, u32)
+{
+    CubemapLoad& load = *(CubemapLoad*)data;
+    int channels;
+    // Cubemap faces are not flipped, unlike the other textures
+    stbi_set_flip_vertically_on_load_thread(false);
+    load.pixels[face] = stbi_load((*load.faces)[face].c_str(), &load.sizes[face].x, &load.sizes[face].y, &channels, 0);
+    if (load.pixels[face])
+        SubmitMainThreadJob(*load.jobs, UploadCubemapFace, data, face, face + 1, load.counter);
+    else
+        ELOG("Cubemap texture failed to load at path: %s", (*load.faces)[face].c_str());
+}
 
-    GLuint rtReflection = 0;
-    glGenTextures(1, &rtReflection);
-    glBindTexture(GL_TEXTURE_2D, rtReflection);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, app->displaySize.x, app->displaySize.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+unsigned int loadCubemap(JobSystem& jobs, const std::vector<std::string>& faces)
+{
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
-    GLuint rtRefraction = 0;
-    glGenTextures(1, &rtRefraction);
-    glBindTexture(GL_TEXTURE_2D, rtRefraction);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, app->displaySize.x, app->displaySize.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    // These are very important to prevent seams
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-    GLuint rtReflectionDepth = 0;
-    glGenTextures(1, &rtReflectionDepth);
-    glBindTexture(GL_TEXTURE_2D, rtReflectionDepth);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, app->displaySize.x, app->displaySize.y, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    // The faces are decoded side by side, the wait runs the uploads the decodes queue
+    JobCounter counter;
+    counter.pending = 0;
+    CubemapLoad load = {};
+    load.jobs = &jobs;
+    load.counter = &counter;
+    load.faces = &faces;
+    load.texture = textureID;
+    for (u32 i = 0; i < faces.size() && i < 6; i++)
+        SubmitJob(jobs, DecodeCubemapFace, &load, i, i + 1, &counter);
+    WaitForCounterAndMainThreadJobs(jobs, counter);
 
-    GLuint rtRefractionDepth = 0;
-    glGenTextures(1, &rtRefractionDepth);
-    glBindTexture(GL_TEXTURE_2D, rtRefractionDepth);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, app->displaySize.x, app->displaySize.y, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-
-    // FBO REFLECTION BIND->COLOR->DEPTH->RELEASE
-    glGenFramebuffers(1, &app->fboReflection);
-    glBindFramebuffer(GL_FRAMEBUFFER, app->fboReflection);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, rtReflection, 0);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, rtReflectionDepth, 0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glDeleteFramebuffers(1, &app->fboReflection);
-
-    // FBO REFRACTION BIND->COLOR->DEPTH->RELEASE
-    glGenFramebuffers(1, &app->fboRefraction);
-    glBindFramebuffer(GL_FRAMEBUFFER, app->fboRefraction);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, rtRefraction, 0);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, rtRefractionDepth, 0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glDeleteFramebuffers(1, &app->fboRefraction);
+    return textureID;
 }
 
-void RenderWater(App* app)
+void RenderTiledDeferredShading(App* app)
 {
     if (app->enableDebugGroup)
     {
-        glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 1, -1, "Water");
+        glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 1, -1, "Tiled deferred shading");
     }
 
-    /*glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    app->water.shader.Activate();
-
-    // view/projection transformations
-    glm::mat4 projection = glm::perspective(glm::radians(60.0f), (float)app->displaySize.x / (float)app->displaySize.y, 0.1f, 1000.0f);
-    glm::mat4 view = app->camera.viewMatrix;
-    app->water.shader.setMat4("projection", projection);
-    app->water.shader.setMat4("view", view);
-
-    // render the loaded model
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f)); // translate it down so it's at the center of the scene
-    model = glm::scale(model, glm::vec3(10.0f, 10.0f, 10.0f));	// it's a bit too big for our scene, so scale it down
-    app->water.shader.setMat4("model", model);
-
-    app->water.model.Draw(app->water.shader);*/
-
-    // ----------------------------------
-
-    #pragma region REFLECTION_PASS
+    Program& tiledDeferredProgram = app->programs[app->tiledDeferredShaderId];
+    glUseProgram(tiledDeferredProgram.handle);
 
-    //app->fboReflection->Bind(); //BIND IN INIT
+    glm::mat4 inverseProjection = glm::inverse(app->camera.projection);
+    glUniformMatrix4fv(app->programTiledDeferredUniformInverseProjection, 1, GL_FALSE, (GLfloat*)&inverseProjection);
+    glUniform2i(app->programTiledDeferredUniformOutputSize, app->renderSize.x, app->renderSize.y);
 
-    Camera reflectionCamera = app->camera;
+    const RenderGraph& graph = app->renderGraph;
+    const FrameResources& frame = app->frameResources;
+    BindSamplerTexture(app->programTiledDeferredUniformTextureDepth, GL_TEXTURE_2D, GetRenderGraphTexture(graph, frame.gDepth));
+    BindSamplerTexture(app->programTiledDeferredUniformTextureNormals, GL_TEXTURE_2D, GetRenderGraphTexture(graph, frame.gNormal));
+    BindSamplerTexture(app->programTiledDeferredUniformTextureAlbedo, GL_TEXTURE_2D, GetRenderGraphTexture(graph, frame.gAlbedo));
+    BindSamplerTexture(app->programTiledDeferredUniformShadowMap, GL_TEXTURE_2D_ARRAY, GetRenderGraphTexture(graph, frame.shadowMaps));
+    SetAmbientUniforms(app->imageBasedLighting, app->programTiledDeferredAmbient);
 
-    reflectionCamera.position.y = -reflectionCamera.position.y;
-    reflectionCamera.pitch = -reflectionCamera.pitch;
-    reflectionCamera.viewportWidth = app->displaySize.x;
-    reflectionCamera.viewportHeight = app->displaySize.y;
-    //matrix
+    // The resolve writes straight into the shading target, cleared by the graph beforehand.
+    // The pooled texture can be larger than the display, only its corner is written.
+    glBindImageTexture(0, GetRenderGraphTexture(graph, frame.shading), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
 
-    PassWaterScene(app, &reflectionCamera, GL_COLOR_ATTACHMENT0, WaterScenePart::Reflection);
-    //passBackground(&reflectionCamera, GL_COLOR_ATTACHMENT0);----> means rendering everything else? no function in ppt;
+    const u32 groupsX = (app->renderSize.x + TILED_DEFERRED_TILE_SIZE - 1) / TILED_DEFERRED_TILE_SIZE;
+    const u32 groupsY = (app->renderSize.y + TILED_DEFERRED_TILE_SIZE - 1) / TILED_DEFERRED_TILE_SIZE;
+    glDispatchCompute(groupsX, groupsY, 1);
 
-    //app->fboReflection->FreeMemory(); UNBIND IN INIT
-    #pragma endregion REFLECTION_PASS
+    // Later passes render on top of the result and sample it
+    glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
 
-    #pragma region REFRACTION_PASS
-    //app->fboRefraction->Bind();
-
-    Camera refractionCamera = app->camera;
-    refractionCamera.viewportWidth = app->displaySize.x;
-    refractionCamera.viewportWidth = app->displaySize.y;
-    //matrix
-
-    PassWaterScene(app, &refractionCamera, GL_COLOR_ATTACHMENT0, WaterScenePart::Refraction);
-
-    //app->fboRefraction->FreeMemory();
-    #pragma endregion REFRACTION_PASS   
+    glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
 
     if (app->enableDebugGroup)
     {
@@ -851,159 +1375,148 @@ void RenderWater(App* app)
     }
 }
 
-void PassWaterScene(App* app, Camera* camera, GLenum colorAttachment, WaterScenePart part) {
+void RenderLightVolumes(App* app)
+{
+    MeshStruct* sphere = app->sphereId < app->models.size() ? &app->meshes[app->models[app->sphereId].meshIdx] : NULL;
+    if (sphere == NULL)
+        return;
 
-    glDrawBuffer(colorAttachment);
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CLIP_DISTANCE0);
+    if (app->enableDebugGroup)
+    {
+        glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 1, -1, "Light volumes");
+    }
 
-    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // The volumes are tested against the copy of the scene depth the graph attached
+    Program& lightVolumeProgram = app->programs[app->lightVolumeShaderId];
+    glUseProgram(lightVolumeProgram.handle);
 
-    //shaderprogram
-    Program& waterShaderProgram = app->programs[app->waterPassShaderID];
-    glUseProgram(waterShaderProgram.handle);
+    glm::mat4 viewProjectionMatrix = app->camera.projection * app->camera.viewMatrix;
+    glUniformMatrix4fv(app->programLightVolumeUniformViewProjection, 1, GL_FALSE, (GLfloat*)&viewProjectionMatrix);
 
-    //Pass uniformvalues to the shader viewmatrix, projection, eyeworldspace...
-}
+    const RenderGraph& graph = app->renderGraph;
+    const FrameResources& frame = app->frameResources;
+    BindSamplerTexture(app->programLightVolumeUniformTextureDepth, GL_TEXTURE_2D, GetRenderGraphTexture(graph, frame.gDepth));
+    BindSamplerTexture(app->programLightVolumeUniformTextureNormals, GL_TEXTURE_2D, GetRenderGraphTexture(graph, frame.gNormal));
+    BindSamplerTexture(app->programLightVolumeUniformTextureAlbedo, GL_TEXTURE_2D, GetRenderGraphTexture(graph, frame.gAlbedo));
 
-unsigned int loadCubemap(std::vector<std::string> faces)
-{
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    // Only the back faces behind the scene surface are rasterized, which also works with the
+    // camera inside a volume. Depth clamping keeps the volumes crossing the far plane.
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_FALSE);
+    glDepthFunc(GL_GEQUAL);
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_FRONT);
+    glEnable(GL_DEPTH_CLAMP);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+
+    GLuint vao = FindVAO(*sphere, 0, lightVolumeProgram);
+    glBindVertexArray(vao);
+    glDrawElementsInstanced(GL_TRIANGLES, sphere->submeshes[0].indices.size(), GL_UNSIGNED_INT, (void*)(u64)sphere->submeshes[0].indexOffset, app->lights.size());
+
+    glDisable(GL_BLEND);
+    glDisable(GL_DEPTH_CLAMP);
+    glCullFace(GL_BACK); // Culling stays enabled, as set up in InitSkybox()
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_DEPTH_TEST);
 
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    // These are very important to prevent seams
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindVertexArray(0);
 
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < faces.size(); i++)
+    if (app->enableDebugGroup)
     {
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            stbi_set_flip_vertically_on_load(false);
-            glTexImage2D(
-                GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 
-                0, 
-                GL_RGB, 
-                width, 
-                height, 
-                0, 
-                GL_RGB, 
-                GL_UNSIGNED_BYTE, 
-                data
-            );
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
-    }    
-
-    return textureID;
+        glPopDebugGroup();
+    }
 }
 
-void RenderDeferredRenderingScene(App* app)
+void RenderGeometryPass(App* app)
 {
-    // Render object
-    {
-        app->gFbo.Bind();
-
-        Program& texturedMeshProgram = app->programs[app->geometryPassShaderId];
-        glUseProgram(texturedMeshProgram.handle);
-
-        glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(0), app->uniformBuffer.handle, app->globalParamsOffset, app->globalParamsSize);
+    glBeginQuery(GL_TIME_ELAPSED, app->gBufferTimerQueries[app->gBufferTimerFrame % 2]);
 
-        if (app->models.size() == 0) {
-            throw std::invalid_argument("There are no models. Check if there are models in the directory and if LoadModel() is called.");
-        }
-
-        for (int i = 0; i < app->entities.size(); ++i)
-        {
-            if (app->enableDebugGroup)
-            {
-                glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 1, -1, "Entity");
-            }
-
-            ModelStruct& model = app->models[app->entities[i].modelIndex];
-            MeshStruct& mesh = app->meshes[model.meshIdx];
-            glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(1), app->uniformBuffer.handle, app->entities[i].localParamsOffset, app->entities[i].localParamsSize);
-
-            for (u32 i = 0; i < mesh.submeshes.size(); ++i)
-            {
-                GLuint vao = FindVAO(mesh, i, texturedMeshProgram);
-                glBindVertexArray(vao);
+    glEnable(GL_DEPTH_TEST);
 
-                u32 subMeshMaterialIdx = model.materialIdx[i];
-                Material& submeshMaterial = app->materials[subMeshMaterialIdx];
+    Program& geometryPassProgram = app->programs[app->geometryPassShaderId];
+    glUseProgram(geometryPassProgram.handle);
 
-                glUniform1f(glGetUniformLocation(texturedMeshProgram.handle, "hasNormalMap"), (float)submeshMaterial.normalsTextureIdx);
-                glUniform1f(glGetUniformLocation(texturedMeshProgram.handle, "hasReliefMap"), (float)submeshMaterial.bumpTextureIdx);
+    glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(0), app->globalBuffer.buffer.handle, app->globalParamsOffset, app->globalParamsSize);
 
-                GLuint Relief = app->relief == true ? 1 : 0;
-                glUniform1f(glGetUniformLocation(texturedMeshProgram.handle, "Relief"), (float)Relief);
-                glUniform1f(glGetUniformLocation(texturedMeshProgram.handle, "Bumpiness"), app->bumpStrength);
+    if (app->models.size() == 0) {
+        throw std::invalid_argument("There are no models. Check if there are models in the directory and if LoadModel() is called.");
+    }
 
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, app->textures[submeshMaterial.albedoTextureIdx].handle);
-                glUniform1i(app->texturedMeshProgram_uTexture, 0);
+    GLuint Relief = app->relief == true ? 1 : 0;
+    glUniform1f(app->programGPassUniformRelief, (float)Relief);
+    glUniform1f(app->programGPassUniformBumpiness, app->bumpStrength);
 
-                Submesh& submesh = mesh.submeshes[i];
-                glDrawElements(GL_TRIANGLES, submesh.indices.size(), GL_UNSIGNED_INT, (void*)(u64)submesh.indexOffset);
-            }
+    BuildRenderQueue(app);
+    switch (app->geometrySubmission)
+    {
+    case GeometrySubmission_PerDraw:           ExecuteRenderQueue(app, RenderPass_Geometry); break;
+    case GeometrySubmission_Instanced:         ExecuteRenderQueueInstanced(app, RenderPass_Geometry); break;
+    case GeometrySubmission_MultiDrawIndirect: ExecuteRenderQueueIndirect(app, RenderPass_Geometry); break;
+    }
 
-            if (app->enableDebugGroup)
-            {
-                glPopDebugGroup();
-            }
-        }
+    glEndQuery(GL_TIME_ELAPSED);
 
-        app->gFbo.Unbind();
+    // The query of the previous frame is usually done by now, never wait for it
+    GLuint previousQuery = app->gBufferTimerQueries[(app->gBufferTimerFrame + 1) % 2];
+    GLint available = 0;
+    if (app->gBufferTimerFrame > 0)
+        glGetQueryObjectiv(previousQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available)
+    {
+        GLuint64 elapsedNs = 0;
+        glGetQueryObjectui64v(previousQuery, GL_QUERY_RESULT, &elapsedNs);
+        app->gBufferPassMs = (f32)(elapsedNs / 1.0e6);
     }
+    app->gBufferTimerFrame++;
 
     glBindTexture(GL_TEXTURE_2D, 0);
     glBindVertexArray(0);
     glUseProgram(0);
-    
-    // Shading pass
+}
 
+void RenderDeferredShading(App* app)
+{
     glDisable(GL_DEPTH_TEST);
 
-    app->shadingFbo.Bind();
+    const RenderGraph& graph = app->renderGraph;
+    const FrameResources& frame = app->frameResources;
 
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(0), app->globalBuffer.buffer.handle, app->globalParamsOffset, app->globalParamsSize);
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, BINDING(1), app->lightsBuffer.buffer.handle, app->lightsOffset, app->lightsSize);
+    glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(2), app->globalBuffer.buffer.handle, app->shadowParamsOffset, app->shadowParamsSize);
 
-    Program& shaderPassProgram = app->programs[app->shadingPassShaderId];
-    glUseProgram(shaderPassProgram.handle);
+    if (app->deferredLighting == DeferredLighting_Tiled)
+    {
+        RenderTiledDeferredShading(app);
+    }
+    else
+    {
+        const bool lightVolumes = app->deferredLighting == DeferredLighting_LightVolumes;
 
-    glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(0), app->globalBuffer.handle, app->globalParamsOffset, app->globalParamsSize);
+        Program& shaderPassProgram = app->programs[app->shadingPassShaderId];
+        glUseProgram(shaderPassProgram.handle);
 
-    glUniform1i(app->programShadingPassUniformTexturePosition, 0);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, app->gFbo.GetTexture(RenderTargetType::POSITION));
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, BINDING(2), app->clusterBuffer.buffer.handle, app->clustersOffset, app->clustersSize);
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, BINDING(3), app->clusterBuffer.buffer.handle, app->lightIndicesOffset, app->lightIndicesSize);
 
-    glUniform1i(app->programShadingPassUniformTextureNormals, 1);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, app->gFbo.GetTexture(RenderTargetType::NORMALS));
+        BindSamplerTexture(app->programShadingPassUniformTextureNormals, GL_TEXTURE_2D, GetRenderGraphTexture(graph, frame.gNormal));
 
-    glUniform1i(app->programShadingPassUniformTextureAlbedo, 2);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, app->gFbo.GetTexture(RenderTargetType::ALBEDO));
+        BindSamplerTexture(app->programShadingPassUniformTextureAlbedo, GL_TEXTURE_2D, GetRenderGraphTexture(graph, frame.gAlbedo));
 
-    glUniform1i(app->programShadingPassUniformTextureDepth, 3);
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, app->gFbo.GetTexture(RenderTargetType::DEPTH));
+        BindSamplerTexture(app->programShadingPassUniformTextureDepth, GL_TEXTURE_2D, GetRenderGraphTexture(graph, frame.gDepth));
 
-    RenderQuad(app);
+        BindSamplerTexture(app->programShadingPassUniformShadowMap, GL_TEXTURE_2D_ARRAY, GetRenderGraphTexture(graph, frame.shadowMaps));
 
-    app->shadingFbo.Unbind();
+        glUniform1i(app->programShadingPassUniformDirectionalOnly, lightVolumes ? 1 : 0);
+        SetAmbientUniforms(app->imageBasedLighting, app->programShadingPassAmbient);
+
+        RenderQuad(app);
+
+        if (lightVolumes)
+            RenderLightVolumes(app);
+    }
 
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, 0);
@@ -1015,73 +1528,81 @@ void RenderDeferredRenderingScene(App* app)
     glBindTexture(GL_TEXTURE_2D, 0);
 
     glUseProgram(0);
+}
 
-    // Render lights on top of the scene
+void RenderLights(App* app)
+{
+    // Tested against the G-buffer depth, which the skybox uses afterwards, so it is left untouched
     glEnable(GL_DEPTH_TEST);
-
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, app->gFbo.GetTexture(RenderTargetType::FBO));
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, app->shadingFbo.GetTexture(RenderTargetType::FBO));
-    glBlitFramebuffer(0, 0, app->displaySize.x, app->displaySize.y, 0, 0, app->displaySize.x, app->displaySize.y, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    app->shadingFbo.Bind(false);
+    glDepthMask(GL_FALSE);
 
     Program& lightsShader = app->programs[app->lightsShaderId];
     glUseProgram(lightsShader.handle);
 
-    for (u32 i = 0; i < app->lights.size(); ++i)
-    {
-        if (app->enableDebugGroup)
-        {
-            glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 1, -1, "Light");
-        }
+    glm::mat4 viewProjectionMatrix = app->camera.projection * app->camera.viewMatrix;
+    glUniformMatrix4fv(app->programLightsUniformViewProjection, 1, GL_FALSE, (GLfloat*)&viewProjectionMatrix);
 
-        // Render directional lights as planes and point lights as spheres
-        u32 modelIndex = 0U;
-        glm::mat4 worldMatrix;
-        switch (app->lights[i].type)
-        {
-            case LightType::LightType_Directional:
-                modelIndex = app->planeId;
-                worldMatrix = TransformPositionScale(app->lights[i].position, glm::vec3(3.0f, 3.0f, 3.0f));
-                worldMatrix = TransformRotation(worldMatrix, 90.0, glm::vec3(1.f, 0.f, 0.f));
-                break;
-            case LightType::LightType_Point:
-                modelIndex = app->sphereId;
-                worldMatrix = TransformPositionScale(app->lights[i].position, glm::vec3(0.3f, 0.3f, 0.3f));
-                break;
-        }
+    // Directional lights are rendered as planes and point lights as spheres, each shape
+    // with a single instanced draw over the whole light list
+    struct LightShape { LightType type; u32 modelIndex; f32 scale; };
+    const LightShape lightShapes[] = {
+        { LightType::LightType_Directional, app->planeId, 3.0f },
+        { LightType::LightType_Point, app->sphereId, 0.3f },
+    };
+
+    for (const LightShape& shape : lightShapes)
+    {
+        if (shape.modelIndex >= app->models.size())
+            continue;
 
-        glm::mat4 worldViewProjectionMatrix = app->camera.projection * app->camera.viewMatrix * worldMatrix;
-        glUniformMatrix4fv(app->programLightsUniformWorldMatrix, 1, GL_FALSE, (GLfloat*)&worldViewProjectionMatrix);
-        glUniform3f(app->programLightsUniformColor, app->lights[i].color.x, app->lights[i].color.y, app->lights[i].color.z);
+        glUniform1ui(app->programLightsUniformType, static_cast<u32>(shape.type));
+        glUniform1f(app->programLightsUniformScale, shape.scale);
 
-        MeshStruct& mesh = app->meshes[app->models[modelIndex].meshIdx];
+        MeshStruct& mesh = app->meshes[app->models[shape.modelIndex].meshIdx];
         GLuint vao = FindVAO(mesh, 0, lightsShader);
         glBindVertexArray(vao);
 
-        glDrawElements(GL_TRIANGLES, mesh.submeshes[0].indices.size(), GL_UNSIGNED_INT, (void*)(u64)mesh.submeshes[0].indexOffset);
-
-        if (app->enableDebugGroup)
-        {
-            glPopDebugGroup();
-        }
+        glDrawElementsInstanced(GL_TRIANGLES, mesh.submeshes[0].indices.size(), GL_UNSIGNED_INT, (void*)(u64)mesh.submeshes[0].indexOffset, app->lights.size());
     }
 
-    app->shadingFbo.Unbind();
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glDepthMask(GL_TRUE);
+}
 
-    Program& programTexturedGeometry = app->programs[app->texturedGeometryProgramIdx];
-    glUseProgram(programTexturedGeometry.handle);
+void RenderDeferredComposite(App* app)
+{
+    glDisable(GL_DEPTH_TEST);
+
+    const RenderGraph& graph = app->renderGraph;
+    const FrameResources& frame = app->frameResources;
 
-    glUniform1i(app->programUniformTexture, 0);
-    glActiveTexture(GL_TEXTURE0);
     if (app->renderTarget == RenderTargetType::DEFAULT)
     {
-        glBindTexture(GL_TEXTURE_2D, app->shadingFbo.GetTexture(RenderTargetType::DEFAULT));
+        Program& programTexturedGeometry = app->programs[app->texturedGeometryProgramIdx];
+        glUseProgram(programTexturedGeometry.handle);
+
+        glActiveTexture(GL_TEXTURE0 + app->programUniformTexture);
+        glBindTexture(GL_TEXTURE_2D, GetRenderGraphTexture(graph, frame.sceneColor));
+
+        // Sharpening makes up for the blur of the upscale, there is none at full resolution
+        const glm::vec2 texCoordScale = GetRenderGraphTextureScale(graph, frame.sceneColor);
+        const f32 sharpness = app->renderSize != app->displaySize ? app->dynamicResolution.sharpness : 0.0f;
+        glUniform2f(app->programTexturedGeometryUniformTexCoordScale, texCoordScale.x, texCoordScale.y);
+        glUniform1f(app->programTexturedGeometryUniformSharpness, sharpness);
     }
     else
     {
-        glBindTexture(GL_TEXTURE_2D, app->gFbo.GetTexture(app->renderTarget));
+        // The G-buffer targets are packed, decode them for display
+        Program& programGBufferView = app->programs[app->gBufferViewShaderId];
+        glUseProgram(programGBufferView.handle);
+
+        glUniform1i(app->programGBufferViewUniformRenderTarget, (GLint)app->renderTarget);
+        glUniform1f(app->programGBufferViewUniformFar, app->camera.zfar);
+        glUniform2f(app->programGBufferViewUniformSourceScale, (f32)app->renderSize.x / app->displaySize.x, (f32)app->renderSize.y / app->displaySize.y);
+        BindSamplerTexture(app->programGBufferViewUniformTextureNormals, GL_TEXTURE_2D, GetRenderGraphTexture(graph, frame.gNormal));
+        BindSamplerTexture(app->programGBufferViewUniformTextureAlbedo, GL_TEXTURE_2D, GetRenderGraphTexture(graph, frame.gAlbedo));
+        BindSamplerTexture(app->programGBufferViewUniformTextureDepth, GL_TEXTURE_2D, GetRenderGraphTexture(graph, frame.gDepth));
     }
 
     RenderQuad(app);
@@ -1090,36 +1611,246 @@ void RenderDeferredRenderingScene(App* app)
     glUseProgram(0);
 }
 
-void RenderForwardRenderingScene(App* app)
+void BuildRenderQueue(App* app)
 {
-    if (app->enableDebugGroup)
+    RenderQueue& queue = app->renderQueue;
+    ClearRenderQueue(queue);
+
+    const glm::mat4& view = app->camera.viewMatrix;
+
+    for (u32 entityIdx = 0; entityIdx < app->entities.size(); ++entityIdx)
     {
-        glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 1, -1, "RenderForwardRenderingScene");
+        const Entity& entity = app->entities[entityIdx];
+        if (entity.modelIndex >= app->models.size())
+            continue; // The model failed to load
+
+        if (!app->frustumCuller.entityVisible[entityIdx])
+            continue;
+
+        const ModelStruct& model = app->models[entity.modelIndex];
+        const MeshStruct& mesh = app->meshes[model.meshIdx];
+
+        // Distance to the camera along the view direction
+        const f32 viewDepth = -(view * entity.worldMatrix[3]).z;
+
+        for (u32 submeshIdx = 0; submeshIdx < mesh.submeshes.size(); ++submeshIdx)
+        {
+            if (!IsSubmeshVisible(app->frustumCuller, entityIdx, submeshIdx))
+                continue;
+
+            DrawPacket packet = {};
+            packet.programIdx = app->geometryPassShaderId;
+            packet.meshIdx = model.meshIdx;
+            packet.submeshIdx = submeshIdx;
+            packet.materialIdx = model.materialIdx[submeshIdx];
+            packet.entityIdx = entityIdx;
+
+            u64 key = MakeSortKey(RenderPass_Geometry, packet.programIdx, packet.materialIdx, mesh.submeshes[submeshIdx].sortIdx, viewDepth, app->camera.zfar);
+            SubmitDrawPacket(queue, key, packet);
+        }
     }
 
-    glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    SortRenderQueue(queue);
+}
 
-    app->backpack.shader.Activate();
+// Below this amount of draws a slice costs more to schedule than to record
+#define COMMAND_LIST_MIN_DRAWS_PER_SLICE 256
+
+// Records the draws of the sorted items [begin, end). It only reads the scene, so slices are
+// recorded side by side; VAOs that do not exist yet are left for the GL thread to create.
+static void RecordRenderQueueSlice(const App* app, u32 begin, u32 end, QueueRecording& recording)
+{
+    const RenderQueue& queue = app->renderQueue;
+    CommandList& list = recording.list;
+    ResetCommandList(list);
+    recording.vaoPatches.clear();
+
+    // Every slice starts from an unknown state, only the changes within it are recorded
+    u32    boundProgram = UINT32_MAX;
+    GLuint boundVao = 0;
+    u32    boundMaterial = UINT32_MAX;
+    u32    boundEntity = UINT32_MAX;
+
+    for (u32 i = begin; i < end; ++i)
+    {
+        const DrawPacket& packet = queue.packets[queue.items[i].packetIdx];
+        const Program& program = app->programs[packet.programIdx];
+        const MeshStruct& mesh = app->meshes[packet.meshIdx];
+        const Submesh& submesh = mesh.submeshes[packet.submeshIdx];
+
+        if (packet.programIdx != boundProgram)
+        {
+            RecordUseProgram(list, program.handle);
+            boundProgram = packet.programIdx;
+            boundMaterial = UINT32_MAX;
+        }
+
+        const GLuint vao = LookupVAO(mesh, packet.submeshIdx, program);
+        if (vao == 0)
+        {
+            VaoPatch patch = { (u32)list.commands.size(), queue.items[i].packetIdx };
+            recording.vaoPatches.push_back(patch);
+            RecordBindVertexArray(list, 0);
+            boundVao = 0;
+        }
+        else if (vao != boundVao)
+        {
+            RecordBindVertexArray(list, vao);
+            boundVao = vao;
+        }
+
+        if (packet.materialIdx != boundMaterial)
+        {
+            const Material& material = app->materials[packet.materialIdx];
+            RecordUniform1f(list, app->programGPassUniformHasNormalMap, (float)material.normalsTextureIdx);
+            RecordUniform1f(list, app->programGPassUniformHasReliefMap, (float)material.bumpTextureIdx);
+            RecordBindTexture(list, app->programGPassUniformTexture, GL_TEXTURE_2D, app->textures[material.albedoTextureIdx].handle);
+            boundMaterial = packet.materialIdx;
+        }
+
+        if (packet.entityIdx != boundEntity)
+        {
+            const Entity& entity = app->entities[packet.entityIdx];
+            RecordBindBufferRange(list, GL_UNIFORM_BUFFER, BINDING(1), GetUniformBlockBuffer(app->uniformPool, entity.localParams), entity.localParams.offset, entity.localParams.size);
+            boundEntity = packet.entityIdx;
+        }
+
+        RecordDrawElements(list, GL_TRIANGLES, submesh.indices.size(), GL_UNSIGNED_INT, submesh.indexOffset);
+    }
+}
+
+void ExecuteRenderQueue(App* app, RenderPassId pass)
+{
+    const RenderQueue& queue = app->renderQueue;
+
+    u32 begin, end;
+    GetRenderPassRange(queue, pass, begin, end);
+
+    // Each job records a contiguous slice of the sorted queue into its own list
+    const u32 drawCount = end - begin;
+    const u32 maxSlices = app->jobSystem.threadCount * JOBS_PER_THREAD;
+    const u32 sliceCount = app->enableParallelRecording ? glm::clamp(drawCount / COMMAND_LIST_MIN_DRAWS_PER_SLICE, 1u, maxSlices) : 1u;
+    const u32 drawsPerSlice = (drawCount + sliceCount - 1) / sliceCount;
+    if (app->queueRecordings.size() < sliceCount)
+        app->queueRecordings.resize(sliceCount);
+
+    ParallelFor(app->jobSystem, sliceCount, 1, 1, [=](u32 first, u32 last) {
+        for (u32 slice = first; slice < last; ++slice)
+        {
+            const u32 sliceBegin = glm::min(begin + slice * drawsPerSlice, end);
+            RecordRenderQueueSlice(app, sliceBegin, glm::min(sliceBegin + drawsPerSlice, end), app->queueRecordings[slice]);
+        }
+    });
+
+    // Replayed in queue order, the VAOs first drawn this frame are created right before
+    app->recordedCommands = 0;
+    for (u32 slice = 0; slice < sliceCount; ++slice)
+    {
+        QueueRecording& recording = app->queueRecordings[slice];
+        for (const VaoPatch& patch : recording.vaoPatches)
+        {
+            const DrawPacket& packet = queue.packets[patch.packetIdx];
+            recording.list.commands[patch.command].vertexArray.handle = FindVAO(app->meshes[packet.meshIdx], packet.submeshIdx, app->programs[packet.programIdx]);
+        }
+
+        ExecuteCommandList(recording.list);
+        app->recordedCommands += (u32)recording.list.commands.size();
+    }
+    app->recordingSlices = sliceCount;
+}
+
+// Off and On are fixed, Auto measures both modes first and then keeps the faster one,
+// trying the other one again every DEPTH_PREPASS_PROBE_INTERVAL frames since the overdraw
+// changes with the view
+static bool UseDepthPrepass(App* app)
+{
+    switch (app->depthPrepassMode)
+    {
+    case DepthPrepass_Off: return false;
+    case DepthPrepass_On:  return true;
+    default: break;
+    }
+
+    if (app->forwardPassMs[0] == 0.0f)
+        return false;
+    if (app->forwardPassMs[1] == 0.0f)
+        return true;
+    if (app->forwardTimerFrame % DEPTH_PREPASS_PROBE_INTERVAL == 0)
+        return !app->depthPrepassActive;
+    return app->depthPrepassActive;
+}
+
+// Reads the forward pass time of the previous frame without waiting for it
+static void ReadForwardPassTime(App* app)
+{
+    const u32 previous = (app->forwardTimerFrame + 1) % 2;
+    GLint available = 0;
+    if (app->forwardTimerFrame > 0)
+        glGetQueryObjectiv(app->forwardTimerQueries[previous], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return;
+
+    GLuint64 elapsedNs = 0;
+    glGetQueryObjectui64v(app->forwardTimerQueries[previous], GL_QUERY_RESULT, &elapsedNs);
+
+    f32& passMs = app->forwardPassMs[app->forwardTimerPrepass[previous] ? 1 : 0];
+    const f32 ms = (f32)(elapsedNs / 1.0e6);
+    passMs = passMs == 0.0f ? ms : glm::mix(passMs, ms, 0.25f);
+
+    // Only switch for a clear win, the timings are noisy
+    if (app->depthPrepassActive)
+        app->depthPrepassActive = app->forwardPassMs[1] < app->forwardPassMs[0] * 1.05f;
+    else
+        app->depthPrepassActive = app->forwardPassMs[1] < app->forwardPassMs[0] * 0.95f;
+}
+
+void RenderForwardRenderingScene(App* app)
+{
+    const bool depthPrepass = UseDepthPrepass(app);
+    app->forwardTimerPrepass[app->forwardTimerFrame % 2] = depthPrepass;
+    glBeginQuery(GL_TIME_ELAPSED, app->forwardTimerQueries[app->forwardTimerFrame % 2]);
 
     // view/projection transformations
     glm::mat4 projection = glm::perspective(glm::radians(60.0f), (float)app->displaySize.x / (float)app->displaySize.y, 0.1f, 100.0f);
     glm::mat4 view = app->camera.viewMatrix;
-    app->backpack.shader.setMat4("projection", projection);
-    app->backpack.shader.setMat4("view", view);
 
     // render the loaded model
     glm::mat4 model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f)); // translate it down so it's at the center of the scene
     model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));	// it's a bit too big for our scene, so scale it down
-    app->backpack.shader.setMat4("model", model);
+
+    if (depthPrepass)
+    {
+        // Depth only, then the color pass shades just the visible fragments
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+        app->depthPrepassShader.Activate();
+        app->depthPrepassShader.setMat4(app->depthPrepassUniformProjection, projection);
+        app->depthPrepassShader.setMat4(app->depthPrepassUniformView, view);
+        app->depthPrepassShader.setMat4(app->depthPrepassUniformModel, model);
+        app->backpack.model.DrawDepth();
+
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+    }
+
+    app->backpack.shader.Activate();
+    app->backpack.shader.setMat4(app->backpack.uniformProjection, projection);
+    app->backpack.shader.setMat4(app->backpack.uniformView, view);
+    app->backpack.shader.setMat4(app->backpack.uniformModel, model);
 
     app->backpack.model.Draw(app->backpack.shader);
 
-    if (app->enableDebugGroup)
+    if (depthPrepass)
     {
-        glPopDebugGroup();
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
     }
+
+    glEndQuery(GL_TIME_ELAPSED);
+    ReadForwardPassTime(app);
+    app->forwardTimerFrame++;
 }
 
 u32 loadTexture(char const* path)
@@ -1128,6 +1859,7 @@ u32 loadTexture(char const* path)
     glGenTextures(1, &textureID);
 
     int width, height, nrComponents;
+    stbi_set_flip_vertically_on_load_thread(false);
     unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
     if (data)
     {
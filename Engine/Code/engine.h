@@ -13,9 +13,24 @@
 #include "camera.h"
 #include "buffer_management.h"
 #include "entity.h"
-#include "framebuffer.h"
 #include "Shader.h"
 #include "Model.h"
+#include "program_reflection.h"
+#include "render_queue.h"
+#include "command_list.h"
+#include "batched_draw.h"
+#include "light_clustering.h"
+#include "frustum_culling.h"
+#include "aabb_tree.h"
+#include "occlusion_culling.h"
+#include "shadow_maps.h"
+#include "render_graph.h"
+#include "dynamic_resolution.h"
+#include "temporal_upsampling.h"
+#include "image_based_lighting.h"
+#include "job_system.h"
+#include "frame_capture.h"
+#include "water.h"
 
 struct Buffer
 {
@@ -26,6 +41,103 @@ struct Buffer
     void*   data;
 };
 
+#define RING_BUFFER_REGIONS 3
+
+// Streaming buffer split in one region per frame in flight. A fence guards each region,
+// so the CPU only writes memory the GPU has finished reading and never waits on a map.
+struct RingBuffer
+{
+    Buffer  buffer;         // head and size are limited to the region of the current frame
+    u32     regionSize;
+    u32     regionIdx;
+    GLsync  fences[RING_BUFFER_REGIONS];
+    void*   persistentData; // NULL if the context has no GL_ARB_buffer_storage
+};
+
+#define UNIFORM_POOL_CHUNK_SIZE (1024 * 1024)
+
+// Below this amount of entities testing all the submesh bounds is faster than walking the entity tree
+#define ENTITY_TREE_CULLING_MIN_ENTITIES 1024
+
+// Must match TILE_SIZE in tiled_deferred_shader.glsl
+#define TILED_DEFERRED_TILE_SIZE 16
+
+// How the deferred shading pass evaluates the lights
+enum DeferredLighting
+{
+    DeferredLighting_Clustered,    // Fullscreen quad looping over the light clusters
+    DeferredLighting_Tiled,        // Compute resolve with per-tile light lists
+    DeferredLighting_LightVolumes  // Fullscreen quad for directional lights, rasterized spheres for point lights
+};
+
+// Texture shown by the deferred composite, the G-buffer ones are decoded for display
+enum class RenderTargetType
+{
+    DEFAULT = 0,
+    POSITION,
+    NORMALS,
+    ALBEDO,
+    DEPTH
+};
+
+// Bytes written per pixel by the geometry pass: RGBA8 albedo/specular + RG16 normals + 24-bit depth (32 with padding)
+#define GBUFFER_BYTES_PER_PIXEL 12
+
+// Render graph resources of the frame being rendered, the passes look their textures up with them
+struct FrameResources
+{
+    u32 backbuffer;
+    u32 shadowMaps;
+    u32 gAlbedo;
+    u32 gNormal;
+    u32 gDepth;
+    u32 gVelocity;
+    u32 shading;
+    u32 temporalHistory;
+    u32 temporalOutput;
+    u32 sceneColor;  // What the composite shows, the shading or its temporal resolve
+    u32 waterReflection;
+    u32 waterReflectionDepth;
+    u32 waterRefraction;
+    u32 waterRefractionDepth;
+};
+
+// VAO bind recorded before the VAO existed, it is created on the GL thread before the replay
+struct VaoPatch
+{
+    u32 command;
+    u32 packetIdx;
+};
+
+// Commands of a slice of the render queue
+struct QueueRecording
+{
+    CommandList           list;
+    std::vector<VaoPatch> vaoPatches;
+};
+
+// Depth-only pass before the forward color pass, so hidden fragments are never shaded
+enum DepthPrepassMode
+{
+    DepthPrepass_Off,
+    DepthPrepass_On,
+    DepthPrepass_Auto  // Keeps whichever of the two measured faster on the GPU
+};
+
+// Frames between two measures of the mode the auto depth prepass is not using
+#define DEPTH_PREPASS_PROBE_INTERVAL 120
+
+// Growable set of fixed-size ring buffers. A chunk is only added when the ones
+// in use this frame are full, so the number of entities is not capped by the
+// size of a single buffer.
+struct UniformBufferPool
+{
+    std::vector<RingBuffer> chunks;
+    u32                     chunkSize;
+    u32                     alignment;
+    u32                     chunksInUse; // Chunks written since BeginUniformBufferPoolFrame()
+};
+
 struct Image
 {
     void*      pixels;
@@ -79,6 +191,11 @@ struct Submesh
     std::vector<u32>   indices;
     u32                vertexOffset;
     u32                indexOffset;
+    u32                sharedBaseVertex; // position in the static geometry buffers
+    u32                sharedFirstIndex;
+    u32                sortIdx;          // dense over every loaded submesh, the submesh field of the sort keys
+    glm::vec3          aabbMin; // local space bounds, used by the frustum culling
+    glm::vec3          aabbMax;
 
     std::vector<Vao>   vaos;
 };
@@ -114,6 +231,7 @@ struct Program
     std::string        programName;
     u64                lastWriteTimestamp; // What is this for?
     VertexShaderLayout vertexInputLayout;
+    ProgramReflection  reflection;
 };
 
 struct GLInfo
@@ -149,9 +267,23 @@ struct Light
     unsigned int intensity; // From 0 to 100
 };
 
+// Light as laid out (std430) in the lights storage buffer read by the shaders
+struct GPULight
+{
+    glm::vec3 position;
+    u32       type;
+    glm::vec3 color;
+    u32       intensity;
+    glm::vec3 direction;
+    f32       range; // Attenuation range of point lights, zero for directional lights
+};
+
 struct Skybox
 {
     Shader shader;
+    GLint viewLocation;
+    GLint projectionLocation;
+    i32 cubemapUnit;
     u32 cubemapTextureId;
     float vertices[24] = 
     {        
@@ -208,6 +340,11 @@ struct Object
 {
     Model model;
     Shader shader;
+
+    // Uniform locations resolved once the shader is linked
+    GLint uniformProjection;
+    GLint uniformView;
+    GLint uniformModel;
 };
 
 struct App
@@ -216,6 +353,9 @@ struct App
     f32  deltaTime;
     bool isRunning;
 
+    // Work-stealing workers shared by the subsystems, the main thread is one of them
+    JobSystem jobSystem;
+
     // Input
     Input input;
 
@@ -227,6 +367,16 @@ struct App
 
     Camera camera;    
     std::vector<Entity> entities;
+    FrustumCuller frustumCuller;
+    bool enableFrustumCulling;
+    OcclusionCuller occlusionCuller;
+    bool enableOcclusionCulling;
+    ShadowMaps shadowMaps;
+    bool enableShadows;
+    AabbTree entityTree;              // Bounds of the entities, for culling, picking and proximity queries
+    std::vector<u32> treeQueryResults;
+    u32 pickedEntity;
+    RenderQueue renderQueue;
     std::vector<Light> lights;
 
     std::vector<TextureStruct>  textures;
@@ -241,6 +391,8 @@ struct App
     u32 geometryPassShaderId;
     u32 shadingPassShaderId;
     u32 lightsShaderId;
+    u32 geometryPassIndirectShaderId;
+    u32 geometryPassInstancedShaderId;
     
     // model id
     u32 planeId;
@@ -249,57 +401,145 @@ struct App
     // OpenGL info
     GLInfo glInfo;
 
-    // Location of the texture uniform in the textured quad shader
-    GLuint programUniformTexture;
-    GLuint programGPassUniformTexture;
-    GLuint programShadingPassUniformTexturePosition;
-    GLuint programShadingPassUniformTextureNormals;
-    GLuint programShadingPassUniformTextureAlbedo;
-    GLuint programShadingPassUniformTextureDepth;
-    GLuint programLightsUniformColor;
-    GLuint programLightsUniformWorldMatrix;
-
-    // VAO object to link our screen filling quad with our textured quad shader
-    GLuint vao;
+    // Texture units assigned by the program reflection to the samplers we bind every frame
+    i32 programUniformTexture;
+    i32 programGPassUniformTexture;
+    i32 programShadingPassUniformTextureNormals;
+    i32 programShadingPassUniformTextureAlbedo;
+    i32 programShadingPassUniformTextureDepth;
+    i32 programShadingPassUniformShadowMap;
+
+    // Uniform locations resolved by the program reflection
+    u32 gBufferViewShaderId;
+    i32 programGBufferViewUniformTextureNormals;
+    i32 programGBufferViewUniformTextureAlbedo;
+    i32 programGBufferViewUniformTextureDepth;
+    GLint programGBufferViewUniformRenderTarget;
+    GLint programGBufferViewUniformFar;
+    GLint programGBufferViewUniformSourceScale;
+    GLint programTexturedGeometryUniformTexCoordScale;
+    GLint programTexturedGeometryUniformSharpness;
+    AmbientUniforms programShadingPassAmbient;
+    AmbientUniforms programTiledDeferredAmbient;
+
+    u32 tiledDeferredShaderId;
+    i32 programTiledDeferredUniformTextureDepth;
+    i32 programTiledDeferredUniformTextureNormals;
+    i32 programTiledDeferredUniformTextureAlbedo;
+    i32 programTiledDeferredUniformShadowMap;
+    GLint programTiledDeferredUniformInverseProjection;
+    GLint programTiledDeferredUniformOutputSize;
+
+    u32 lightVolumeShaderId;
+    i32 programLightVolumeUniformTextureDepth;
+    i32 programLightVolumeUniformTextureNormals;
+    i32 programLightVolumeUniformTextureAlbedo;
+    GLint programLightVolumeUniformViewProjection;
+    GLint programShadingPassUniformDirectionalOnly;
+
+    GLint programLightsUniformType;
+    GLint programLightsUniformScale;
+    GLint programLightsUniformViewProjection;
+    GLint programGPassUniformHasNormalMap;
+    GLint programGPassUniformHasReliefMap;
+    GLint programGPassUniformRelief;
+    GLint programGPassUniformBumpiness;
+    i32 programGPassIndirectUniformTexture;
+    i32 programGPassInstancedUniformTexture;
+    GLint programGPassInstancedUniformInstanceOffset;
+
+    // Screen filling quad of the fullscreen passes, created once in Init()
+    GLuint quadVao;
+    GLuint quadVbo;
 
     // Local params
-    Buffer uniformBuffer;    
+    UniformBufferPool uniformPool;
     GLint maxUniformBufferSize;
     GLint uniformBufferAlignment;
-    GLint texturedMeshProgram_uTexture;
 
     // Global params
-    Buffer  globalBuffer;
+    RingBuffer globalBuffer;
     GLint   maxGlobalParamsBufferSize;
     GLint   globalParamsAlignment;
     u32     globalParamsOffset;
     u32     globalParamsSize;
+    u32     shadowParamsOffset; // Shadow parameters block, in the same region as the global params
+    u32     shadowParamsSize;
+
+    // Lights, the count is part of the global params
+    RingBuffer lightsBuffer;
+    GLint   storageBufferAlignment;
+    u32     lightsOffset;
+    u32     lightsSize;
+
+    // Clustered light lists
+    LightClusterGrid lightClusters;
+    RingBuffer clusterBuffer;
+    u32     clustersOffset;
+    u32     clustersSize;
+    u32     lightIndicesOffset;
+    u32     lightIndicesSize;
 
     bool enableDebugGroup = true;
         
+    // Instancing and multi-draw indirect
+    GeometrySubmission geometrySubmission;
+    StaticGeometry staticGeometry;
+
+    // Per-draw submission, slices of the queue are recorded by several jobs
+    std::vector<QueueRecording> queueRecordings;
+    bool    enableParallelRecording;
+    u32     recordingSlices;
+    u32     recordedCommands;
+
     // FBO - Deferred Rendering
     bool enableDeferredShading;
-    GBuffer gFbo;
-    ShadingBuffer shadingFbo;
+    DeferredLighting deferredLighting;
+
+    // Passes of the frame and the pool of their targets
+    RenderGraph renderGraph;
+    FrameResources frameResources;
+
+    // Size the deferred targets are rendered at, upscaled to the display by the composite
+    DynamicResolution dynamicResolution;
+    TemporalUpsampling temporalUpsampling;
+    glm::ivec2 renderSize;
+
+    // GPU time of the pass writing the G-buffer, read back one frame late
+    GLuint  gBufferTimerQueries[2];
+    u32     gBufferTimerFrame;
+    f32     gBufferPassMs;
     RenderTargetType renderTarget = RenderTargetType::DEFAULT;
 
+    // Image sequence of the frames, read back and encoded in the background
+    FrameCapture frameCapture;
+
     //Skybox Shader
     Skybox skybox;
+    ImageBasedLighting imageBasedLighting;
 
     //Relief Mapping
     bool relief;
     float bumpStrength;
 
     //Water Shader
-    GLuint fboReflection;
-    GLuint fboRefraction;
-
-    GLuint waterPassShaderID;
+    Water water;
 
     bool renderWater;
 
     Object backpack;
-    Object water;
+
+    // Forward depth prepass
+    Shader depthPrepassShader;
+    GLint  depthPrepassUniformProjection;
+    GLint  depthPrepassUniformView;
+    GLint  depthPrepassUniformModel;
+    DepthPrepassMode depthPrepassMode;
+    bool   depthPrepassActive;       // Choice of the auto mode
+    GLuint forwardTimerQueries[2];
+    bool   forwardTimerPrepass[2];   // Whether the frame of each query used the prepass
+    u32    forwardTimerFrame;
+    f32    forwardPassMs[2];         // Smoothed GPU time of the forward pass without/with the prepass
 };
 
 void Init(App* app);
@@ -312,24 +552,36 @@ void Update(App* app);
 
 void Render(App* app);
 
+// Releases what has to be released while the context is current
+void Shutdown(App* app);
+
+void InitFullscreenQuad(App* app);
 void RenderQuad(App* app);
 
 //Skybox shader
 void InitSkybox(App* app);
 void RenderSkybox(App* app);
-unsigned int loadCubemap(std::vector<std::string> faces);
-
-void RenderDeferredRenderingScene(App* app);
+void DrawSkybox(App* app, const glm::mat4& view, const glm::mat4& projection);
+unsigned int loadCubemap(JobSystem& jobs, const std::vector<std::string>& faces);
+
+void RenderGeometryPass(App* app);
+void RenderDeferredShading(App* app);
+void RenderTiledDeferredShading(App* app);
+void RenderLightVolumes(App* app);
+void RenderLights(App* app);
+void RenderDeferredComposite(App* app);
+void BuildRenderQueue(App* app);
+void ExecuteRenderQueue(App* app, RenderPassId pass);
 void RenderForwardRenderingScene(App* app);
 
-//Water Shader
-void InitWaterShader(App* app);
-void RenderWater(App* app);
-void PassWaterScene(App* app, Camera* camera, GLenum colorAttachment, WaterScenePart part);
-
 //Engine stuff
+u32 LoadProgram(App* app, const char* filepath, const char* programName);
 u32 loadTexture(char const* path);
 u32 LoadTexture2D(App* app, const char* filepath);
 GLuint FindVAO(MeshStruct& mesh, u32 submeshIndex, const Program& program);
+GLuint LookupVAO(const MeshStruct& mesh, u32 submeshIndex, const Program& program); // 0 if not created yet, safe on any thread
 void SetAttributes(Program& program);
-void InitEntitiesInBulk(App* app, std::vector<glm::vec3> positions, u32 modelId, float scaleFactor = 1.0f);
\ No newline at end of file
+void InitEntitiesInBulk(App* app, std::vector<glm::vec3> positions, u32 modelId, float scaleFactor = 1.0f);
+Aabb ComputeEntityBounds(App* app, const Entity& entity);
+void MoveEntity(App* app, u32 entityIdx, const glm::mat4& worldMatrix);
+void PickEntity(App* app, glm::vec2 mousePos);
\ No newline at end of file
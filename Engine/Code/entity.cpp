@@ -3,7 +3,9 @@
 Entity::Entity(glm::vec3 pos, glm::vec3 scaleFactor, u32 modelIndex)
 {
     this->worldMatrix = TransformPositionScale(pos, scaleFactor);
+    this->previousWorldMatrix = this->worldMatrix;
     this->modelIndex = modelIndex;
+    this->treeProxy = UINT32_MAX;
 }
 
 glm::mat4 TransformPositionScale(const glm::vec3& pos, const glm::vec3& scaleFactors)
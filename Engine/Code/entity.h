@@ -2,14 +2,23 @@
 
 #include "platform.h"
 
+// Location of a block inside the chunked uniform buffer pool
+struct UniformBlockHandle
+{
+    u32 chunk;
+    u32 offset;
+    u32 size;
+};
+
 struct Entity
 {
     Entity(glm::vec3 pos, glm::vec3 scaleFactor, u32 modelIndex);
 
     glm::mat4  worldMatrix;  // Coordinates of an object with respect to the world space
+    glm::mat4  previousWorldMatrix; // worldMatrix of the last frame, for the motion vectors
     u32        modelIndex;
-    u32        localParamsOffset;
-    u32        localParamsSize;
+    u32        treeProxy;    // Leaf of the entity bounds in the entity tree
+    UniformBlockHandle localParams;
 };
 
 glm::mat4 TransformPositionScale(const glm::vec3& pos, const glm::vec3& scaleFactors);
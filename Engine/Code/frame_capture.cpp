@@ -0,0 +1,231 @@
+#include "frame_capture.h"
+
+#include <stb_image_write.h>
+
+#include <time.h>
+
+static void EncoderLoop(FrameCapture* capture)
+{
+    for (;;)
+    {
+        CaptureJob job;
+        {
+            std::unique_lock<std::mutex> lock(capture->jobsMutex);
+            capture->jobsCondition.wait(lock, [capture] { return capture->stopEncoders || !capture->jobs.empty(); });
+
+            // The queue is drained before stopping, so no readback is lost at shutdown
+            if (capture->jobs.empty())
+                return;
+
+            job = capture->jobs.front();
+            capture->jobs.pop_front();
+        }
+
+        const CaptureSlot& slot = *job.slot;
+        const int written = stbi_write_png(job.path, slot.size.x, slot.size.y, FRAME_CAPTURE_BYTES_PER_PIXEL, job.pixels,
+                                           slot.size.x * FRAME_CAPTURE_BYTES_PER_PIXEL);
+
+        if (written)
+            capture->writtenFrames++;
+        else
+            capture->failedFrames++;
+
+        // The GL thread unmaps the buffer once it sees the flag
+        job.slot->done.store(true, std::memory_order_release);
+    }
+}
+
+void InitFrameCapture(FrameCapture& capture)
+{
+    capture.frameStep = 1;
+
+    // The rows are read back bottom to top. Long sequences favor encoding speed over file size.
+    stbi_flip_vertically_on_write(1);
+    stbi_write_png_compression_level = 2;
+
+    for (u32 i = 0; i < FRAME_CAPTURE_SLOTS; ++i)
+    {
+        glGenBuffers(1, &capture.slots[i].buffer);
+        capture.slots[i].state = CaptureSlot_Free;
+    }
+
+    capture.stopEncoders = false;
+    for (u32 i = 0; i < FRAME_CAPTURE_ENCODERS; ++i)
+        capture.encoders.emplace_back(EncoderLoop, &capture);
+}
+
+static void StartEncoding(FrameCapture& capture, CaptureSlot& slot)
+{
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+
+    const u32 size = slot.size.x * slot.size.y * FRAME_CAPTURE_BYTES_PER_PIXEL;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    if (!pixels)
+    {
+        ELOG("Frame capture: glMapBufferRange() failed for frame %u", slot.frameIndex);
+        capture.failedFrames++;
+        slot.state = CaptureSlot_Free;
+        return;
+    }
+
+    CaptureJob job = {};
+    job.slot = &slot;
+    job.pixels = pixels;
+    sprintf_s(job.path, "%s/frame_%05u.png", capture.directory, slot.frameIndex);
+
+    slot.done.store(false, std::memory_order_relaxed);
+    slot.state = CaptureSlot_Encoding;
+    {
+        std::lock_guard<std::mutex> lock(capture.jobsMutex);
+        capture.jobs.push_back(job);
+    }
+    capture.jobsCondition.notify_one();
+}
+
+static void RetireEncodedSlots(FrameCapture& capture)
+{
+    for (CaptureSlot& slot : capture.slots)
+    {
+        if (slot.state != CaptureSlot_Encoding || !slot.done.load(std::memory_order_acquire))
+            continue;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.state = CaptureSlot_Free;
+    }
+}
+
+void ShutdownFrameCapture(FrameCapture& capture)
+{
+    // Readbacks still on the GPU are waited for, the rest of the sequence is written
+    for (CaptureSlot& slot : capture.slots)
+    {
+        if (slot.state != CaptureSlot_Reading)
+            continue;
+
+        GLenum result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+        {
+            StartEncoding(capture, slot);
+        }
+        else
+        {
+            glDeleteSync(slot.fence);
+            slot.state = CaptureSlot_Free;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(capture.jobsMutex);
+        capture.stopEncoders = true;
+    }
+    capture.jobsCondition.notify_all();
+    for (std::thread& encoder : capture.encoders)
+        encoder.join();
+    capture.encoders.clear();
+
+    RetireEncodedSlots(capture);
+    for (CaptureSlot& slot : capture.slots)
+        glDeleteBuffers(1, &slot.buffer);
+}
+
+void StartFrameCapture(FrameCapture& capture)
+{
+    char name[32];
+    const time_t now = time(NULL);
+    strftime(name, sizeof(name), "%Y%m%d_%H%M%S", localtime(&now));
+    sprintf_s(capture.directory, "Captures/%s", name);
+
+    if (!MakeDirectory("Captures") || !MakeDirectory(capture.directory))
+    {
+        ELOG("Frame capture: could not create the directory %s", capture.directory);
+        return;
+    }
+
+    capture.recording = true;
+    capture.frameCounter = 0;
+    capture.capturedFrames = 0;
+    capture.droppedFrames = 0;
+    capture.writtenFrames = 0;
+    capture.failedFrames = 0;
+    ILOG("Frame capture: recording to %s", capture.directory);
+}
+
+void StopFrameCapture(FrameCapture& capture)
+{
+    capture.recording = false;
+    ILOG("Frame capture: stopped after %u frames, %u dropped", capture.capturedFrames, capture.droppedFrames);
+}
+
+static void ReadBackFrame(FrameCapture& capture, glm::ivec2 displaySize)
+{
+    CaptureSlot* slot = nullptr;
+    for (CaptureSlot& candidate : capture.slots)
+    {
+        if (candidate.state == CaptureSlot_Free)
+        {
+            slot = &candidate;
+            break;
+        }
+    }
+
+    // Waiting for a slot would stall the frame on the encoders
+    if (!slot)
+    {
+        capture.droppedFrames++;
+        return;
+    }
+
+    const u32 size = displaySize.x * displaySize.y * FRAME_CAPTURE_BYTES_PER_PIXEL;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+    if (size > slot->capacity)
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        slot->capacity = size;
+    }
+
+    // The copy into the buffer is queued like any other command, nothing waits for it here
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glReadBuffer(GL_BACK);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, displaySize.x, displaySize.y, GL_RGB, GL_UNSIGNED_BYTE, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot->state = CaptureSlot_Reading;
+    slot->size = displaySize;
+    slot->frameIndex = capture.capturedFrames++;
+}
+
+void UpdateFrameCapture(FrameCapture& capture, glm::ivec2 displaySize)
+{
+    RetireEncodedSlots(capture);
+
+    // Polled without waiting, a readback that is not done yet is looked at again next frame
+    for (CaptureSlot& slot : capture.slots)
+    {
+        if (slot.state != CaptureSlot_Reading)
+            continue;
+
+        const GLenum result = glClientWaitSync(slot.fence, 0, 0);
+        if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+            StartEncoding(capture, slot);
+    }
+
+    if (capture.recording && capture.frameCounter++ % glm::max(capture.frameStep, 1u) == 0)
+        ReadBackFrame(capture, displaySize);
+}
+
+u32 GetPendingCaptureCount(const FrameCapture& capture)
+{
+    u32 pending = 0;
+    for (const CaptureSlot& slot : capture.slots)
+        pending += slot.state != CaptureSlot_Free ? 1 : 0;
+    return pending;
+}
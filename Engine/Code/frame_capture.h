@@ -0,0 +1,94 @@
+//
+// frame_capture.h: Records the frames to numbered image files without stalling the renderer.
+// Each frame is read back into a pixel buffer object of a small ring and fenced, the buffer
+// is only mapped once the fence has signaled on a later frame, and the mapped memory goes to
+// a pool of encoder threads that write the file. The buffer returns to the ring when its
+// file is written. With every buffer busy a frame is dropped, the frame rate never waits.
+//
+
+#pragma once
+
+#include <glad/glad.h>
+
+#include "platform.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#define FRAME_CAPTURE_SLOTS    8  // Readbacks in flight, on the GPU or in the encoders
+#define FRAME_CAPTURE_ENCODERS 4  // stb_image_write takes several frames per PNG, so they run side by side
+
+// The frames are PNG files of what was shown. The scene has no floating point target to read
+// back, it is shaded into 8-bit targets or the back buffer, so there is no HDR format.
+#define FRAME_CAPTURE_BYTES_PER_PIXEL 3
+
+enum CaptureSlotState
+{
+    CaptureSlot_Free,
+    CaptureSlot_Reading,  // glReadPixels issued, waiting for its fence
+    CaptureSlot_Encoding  // Mapped and owned by an encoder until done is set
+};
+
+struct CaptureSlot
+{
+    GLuint           buffer;
+    u32              capacity;
+    GLsync           fence;
+    CaptureSlotState state;
+    std::atomic<bool> done;
+
+    glm::ivec2       size;
+    u32              frameIndex;   // Number of the file in the sequence
+};
+
+struct CaptureJob
+{
+    CaptureSlot* slot;
+    const void*  pixels;
+    char         path[256];
+};
+
+struct FrameCapture
+{
+    // Settings, read when a recording starts
+    u32           frameStep;     // Captures one frame out of frameStep
+
+    bool          recording;
+    char          directory[128]; // Of the current or last sequence
+    u32           frameCounter;   // Rendered frames since the recording started
+    u32           capturedFrames;
+    u32           droppedFrames;  // No free slot when the frame was due
+    std::atomic<u32> writtenFrames;
+    std::atomic<u32> failedFrames;
+
+    CaptureSlot   slots[FRAME_CAPTURE_SLOTS];
+
+    // Encoder pool
+    std::vector<std::thread> encoders;
+    std::deque<CaptureJob>   jobs;
+    std::mutex               jobsMutex;
+    std::condition_variable  jobsCondition;
+    bool                     stopEncoders;
+};
+
+void InitFrameCapture(FrameCapture& capture);
+
+// Waits for the slots in flight and joins the encoders, call it while the context is current
+void ShutdownFrameCapture(FrameCapture& capture);
+
+// Starts a sequence in a new directory under Captures/
+void StartFrameCapture(FrameCapture& capture);
+void StopFrameCapture(FrameCapture& capture);
+
+/**
+ * Call once the frame is in the back buffer. Hands the readbacks whose fences have signaled
+ * to the encoders, returns the written buffers to the ring and, while recording, starts the
+ * readback of this frame. Never waits for the GPU or the encoders.
+ */
+void UpdateFrameCapture(FrameCapture& capture, glm::ivec2 displaySize);
+
+// Slots not yet free, the sequence is complete when it reaches 0 after stopping
+u32 GetPendingCaptureCount(const FrameCapture& capture);
@@ -0,0 +1,210 @@
+#include "frustum_culling.h"
+#include "engine.h"
+
+#include <algorithm>
+#include <float.h>
+#include <xmmintrin.h>
+
+// Below this amount of boxes the jobs cost more than the tests themselves
+#define CULLING_MIN_BOXES_PER_JOB 1024
+
+// World space boxes of the submeshes of an entity, written from box on
+static void WriteEntityBounds(FrustumCuller& culler, u32 box, const Entity& entity, const MeshStruct& mesh)
+{
+    // Absolute values of the rotation/scale, they map the local extents to world extents
+    const glm::mat3 linear = glm::mat3(entity.worldMatrix);
+    const glm::mat3 absLinear = glm::mat3(glm::abs(linear[0]), glm::abs(linear[1]), glm::abs(linear[2]));
+
+    for (u32 submeshIdx = 0; submeshIdx < mesh.submeshes.size(); ++submeshIdx, ++box)
+    {
+        const Submesh& submesh = mesh.submeshes[submeshIdx];
+        const glm::vec3 localCenter = (submesh.aabbMin + submesh.aabbMax) * 0.5f;
+        const glm::vec3 localExtent = (submesh.aabbMax - submesh.aabbMin) * 0.5f;
+
+        const glm::vec3 center = glm::vec3(entity.worldMatrix * glm::vec4(localCenter, 1.0f));
+        const glm::vec3 extent = absLinear * localExtent;
+
+        culler.centerX[box] = center.x;
+        culler.centerY[box] = center.y;
+        culler.centerZ[box] = center.z;
+        culler.extentX[box] = extent.x;
+        culler.extentY[box] = extent.y;
+        culler.extentZ[box] = extent.z;
+    }
+}
+
+void UpdateCullingBounds(FrustumCuller& culler, const std::vector<Entity>& entities, const std::vector<ModelStruct>& models,
+                         const std::vector<MeshStruct>& meshes)
+{
+    if (culler.entityCount == entities.size() && !culler.firstBox.empty())
+        return;
+
+    // Boxes of every entity, the ones of entities without a model are left empty
+    culler.firstBox.resize(entities.size());
+    culler.boxCount = 0;
+    for (u32 entityIdx = 0; entityIdx < entities.size(); ++entityIdx)
+    {
+        culler.firstBox[entityIdx] = culler.boxCount;
+        if (entities[entityIdx].modelIndex < models.size())
+            culler.boxCount += (u32)meshes[models[entities[entityIdx].modelIndex].meshIdx].submeshes.size();
+    }
+
+    // Padding boxes with negative extents can never pass the test. There are at least three of
+    // them, so the groups of four boxes starting at any entity can be loaded.
+    const u32 paddedCount = (culler.boxCount + 3 + 3) & ~3u;
+    culler.centerX.assign(paddedCount, 0.0f);
+    culler.centerY.assign(paddedCount, 0.0f);
+    culler.centerZ.assign(paddedCount, 0.0f);
+    culler.extentX.assign(paddedCount, -FLT_MAX);
+    culler.extentY.assign(paddedCount, -FLT_MAX);
+    culler.extentZ.assign(paddedCount, -FLT_MAX);
+
+    for (u32 entityIdx = 0; entityIdx < entities.size(); ++entityIdx)
+    {
+        const Entity& entity = entities[entityIdx];
+        if (entity.modelIndex < models.size())
+            WriteEntityBounds(culler, culler.firstBox[entityIdx], entity, meshes[models[entity.modelIndex].meshIdx]);
+    }
+
+    culler.boxVisible.resize(paddedCount);
+    culler.entityVisible.resize(entities.size());
+    culler.entityCount = (u32)entities.size();
+}
+
+void UpdateEntityCullingBounds(FrustumCuller& culler, u32 entityIdx, const Entity& entity, const std::vector<ModelStruct>& models,
+                               const std::vector<MeshStruct>& meshes)
+{
+    if (entityIdx >= culler.entityCount || entity.modelIndex >= models.size())
+        return; // Written by the next UpdateCullingBounds()
+
+    WriteEntityBounds(culler, culler.firstBox[entityIdx], entity, meshes[models[entity.modelIndex].meshIdx]);
+}
+
+void ExtractFrustumPlanes(const glm::mat4& m, glm::vec4 planes[6])
+{
+    const glm::vec4 row0 = glm::vec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+    const glm::vec4 row1 = glm::vec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+    const glm::vec4 row2 = glm::vec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+    const glm::vec4 row3 = glm::vec4(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    planes[0] = row3 + row0; // Left
+    planes[1] = row3 - row0; // Right
+    planes[2] = row3 + row1; // Bottom
+    planes[3] = row3 - row1; // Top
+    planes[4] = row3 + row2; // Near
+    planes[5] = row3 - row2; // Far
+}
+
+// Tests the boxes [begin, end) in groups of four, lanes past the end are not written
+static void CullBoxes(FrustumCuller& culler, const glm::vec4 planes[6], u32 begin, u32 end)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+
+    for (u32 i = begin; i < end; i += 4)
+    {
+        const __m128 cx = _mm_loadu_ps(&culler.centerX[i]);
+        const __m128 cy = _mm_loadu_ps(&culler.centerY[i]);
+        const __m128 cz = _mm_loadu_ps(&culler.centerZ[i]);
+        const __m128 ex = _mm_loadu_ps(&culler.extentX[i]);
+        const __m128 ey = _mm_loadu_ps(&culler.extentY[i]);
+        const __m128 ez = _mm_loadu_ps(&culler.extentZ[i]);
+
+        // A box is outside when it is fully behind any of the planes:
+        // dot(n, center) + d + dot(|n|, extent) < 0
+        __m128 outside = _mm_setzero_ps();
+        for (u32 p = 0; p < 6; ++p)
+        {
+            const __m128 nx = _mm_set1_ps(planes[p].x);
+            const __m128 ny = _mm_set1_ps(planes[p].y);
+            const __m128 nz = _mm_set1_ps(planes[p].z);
+
+            __m128 distance = _mm_add_ps(_mm_mul_ps(nx, cx), _mm_set1_ps(planes[p].w));
+            distance = _mm_add_ps(distance, _mm_mul_ps(ny, cy));
+            distance = _mm_add_ps(distance, _mm_mul_ps(nz, cz));
+
+            __m128 radius = _mm_mul_ps(_mm_andnot_ps(signMask, nx), ex);
+            radius = _mm_add_ps(radius, _mm_mul_ps(_mm_andnot_ps(signMask, ny), ey));
+            radius = _mm_add_ps(radius, _mm_mul_ps(_mm_andnot_ps(signMask, nz), ez));
+
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+        }
+
+        const int mask = _mm_movemask_ps(outside);
+        for (u32 lane = 0; lane < 4 && i + lane < end; ++lane)
+            culler.boxVisible[i + lane] = (mask & (1 << lane)) ? 0 : 1;
+    }
+}
+
+static u32 EntityLastBox(const FrustumCuller& culler, u32 entityIdx)
+{
+    return entityIdx + 1 < culler.entityCount ? culler.firstBox[entityIdx + 1] : culler.boxCount;
+}
+
+static void CullEntities(FrustumCuller& culler, const glm::vec4 planes[6], const u32* entities, u32 count)
+{
+    for (u32 i = 0; i < count; ++i)
+        CullBoxes(culler, planes, culler.firstBox[entities[i]], EntityLastBox(culler, entities[i]));
+}
+
+static void AccumulateEntityVisibility(FrustumCuller& culler, u32 entityIdx)
+{
+    const u32 first = culler.firstBox[entityIdx];
+    const u32 last = EntityLastBox(culler, entityIdx);
+
+    u8 visible = 0;
+    for (u32 box = first; box < last; ++box)
+    {
+        visible |= culler.boxVisible[box];
+        culler.visibleBoxCount += culler.boxVisible[box];
+    }
+
+    culler.entityVisible[entityIdx] = visible;
+    culler.visibleEntityCount += visible;
+}
+
+void CullFrustum(FrustumCuller& culler, JobSystem& jobs, const glm::mat4& viewProjection, bool enabled, const std::vector<u32>* candidateEntities)
+{
+    const u32 paddedCount = (u32)culler.boxVisible.size();
+
+    glm::vec4 planes[6];
+    ExtractFrustumPlanes(viewProjection, planes);
+
+    if (!enabled)
+    {
+        std::fill(culler.boxVisible.begin(), culler.boxVisible.end(), (u8)1);
+    }
+    else if (candidateEntities != NULL)
+    {
+        // Only the entities whose bounds the tree found in the frustum are tested, an entity
+        // writes only its own boxes so the candidates can be split across jobs
+        const u32* candidates = candidateEntities->data();
+        ParallelFor(jobs, (u32)candidateEntities->size(), CULLING_MIN_BOXES_PER_JOB, 1, [&culler, &planes, candidates](u32 begin, u32 end) {
+            CullEntities(culler, planes, candidates + begin, end - begin);
+        });
+    }
+    else
+    {
+        // Every job writes its own range of boxVisible, so they need no synchronization
+        ParallelFor(jobs, paddedCount, CULLING_MIN_BOXES_PER_JOB, 4, [&culler, &planes](u32 begin, u32 end) {
+            CullBoxes(culler, planes, begin, end);
+        });
+    }
+
+    // An entity is visible when any of its submeshes is. The boxes of the entities the tree
+    // rejected were not written, those entities are simply left invisible.
+    culler.visibleBoxCount = 0;
+    culler.visibleEntityCount = 0;
+    if (candidateEntities != NULL && enabled)
+    {
+        std::fill(culler.entityVisible.begin(), culler.entityVisible.end(), (u8)0);
+        for (u32 entityIdx : *candidateEntities)
+            AccumulateEntityVisibility(culler, entityIdx);
+    }
+    else
+    {
+        for (u32 entityIdx = 0; entityIdx < culler.entityCount; ++entityIdx)
+            AccumulateEntityVisibility(culler, entityIdx);
+    }
+}
+
@@ -0,0 +1,59 @@
+//
+// frustum_culling.h: View frustum culling of the entity submeshes. The world space bounds
+// of every submesh are kept as SoA arrays, tested against the six camera planes four boxes
+// at a time, and only the entities with a visible submesh get uniforms and draw packets.
+//
+
+#pragma once
+
+#include "platform.h"
+#include "job_system.h"
+
+struct Entity;
+struct ModelStruct;
+struct MeshStruct;
+
+struct FrustumCuller
+{
+    // World space bounds as center/extents, one box per entity submesh. The boxes of an
+    // entity are contiguous, starting at firstBox[entityIdx].
+    std::vector<f32> centerX, centerY, centerZ;
+    std::vector<f32> extentX, extentY, extentZ;
+    std::vector<u32> firstBox;
+    u32              boxCount;
+    u32              entityCount; // Entities the bounds were built for
+
+    // Results of the last CullFrustum()
+    std::vector<u8>  boxVisible;
+    std::vector<u8>  entityVisible;
+    u32              visibleBoxCount;
+    u32              visibleEntityCount;
+};
+
+/**
+ * Transforms the local bounds of every submesh by the world matrix of its entity.
+ * It only does work when entities are added, moved entities refit their own boxes.
+ */
+void UpdateCullingBounds(FrustumCuller& culler, const std::vector<Entity>& entities, const std::vector<ModelStruct>& models,
+                         const std::vector<MeshStruct>& meshes);
+
+// Rewrites the boxes of an entity that moved
+void UpdateEntityCullingBounds(FrustumCuller& culler, u32 entityIdx, const Entity& entity, const std::vector<ModelStruct>& models,
+                               const std::vector<MeshStruct>& meshes);
+
+// Planes of the frustum as (normal, distance) pointing inside (Gribb/Hartmann). They are not
+// normalized, the box tests only look at the sign.
+void ExtractFrustumPlanes(const glm::mat4& viewProjection, glm::vec4 planes[6]);
+
+/**
+ * Tests the bounds against the frustum planes of a view projection matrix. The tests run
+ * with SSE and the boxes are split across jobs when there are enough of them.
+ * When candidateEntities is given (usually from the entity tree), only their boxes are
+ * tested and the other entities are invisible. With enabled false every box is visible.
+ */
+void CullFrustum(FrustumCuller& culler, JobSystem& jobs, const glm::mat4& viewProjection, bool enabled, const std::vector<u32>* candidateEntities = NULL);
+
+inline bool IsSubmeshVisible(const FrustumCuller& culler, u32 entityIdx, u32 submeshIdx)
+{
+    return culler.boxVisible[culler.firstBox[entityIdx] + submeshIdx] != 0;
+}
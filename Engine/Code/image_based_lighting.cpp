@@ -0,0 +1,487 @@
+#include "image_based_lighting.h"
+#include "program_reflection.h"
+
+#include <stb_image.h>
+
+#include <chrono>
+#include <math.h>
+#include <xmmintrin.h>
+
+#define IBL_CACHE_MAGIC              0x4C424931 // "1IBL"
+#define IBL_MIN_SOURCE_SIZE          32         // Faces the rough mips are filtered from, smaller ones alias the narrow lobes
+#define IBL_MIN_TEXELS_PER_JOB       64
+#define IBL_SH_CHUNK_TEXELS          4096       // Texels of a partial SH sum, summed in order so the bake is deterministic
+
+struct IblCacheHeader
+{
+    u32       magic;
+    u32       version;
+    u32       size;
+    u32       mipCount;
+    u64       faceTimestamps[6];
+    glm::vec3 irradianceSH[IBL_SH_COEFFICIENTS];
+};
+
+// Texels of the six faces of a cubemap level, face after face and row after row. Every
+// channel is an array of its own so the filters read four texels at a time.
+struct CubeLevel
+{
+    u32 size;
+    std::vector<f32> r, g, b;
+    std::vector<f32> x, y, z;    // World direction through the texel center
+    std::vector<f32> solidAngle;
+};
+
+static u32 FaceTexelCount(u32 size)
+{
+    return size * size;
+}
+
+// Direction of a point of a face, s and t in [-1, 1] along the texture axes of GL cubemaps.
+// The skybox looks the faces up with z flipped, so the world direction is too.
+static glm::vec3 CubeDirection(u32 face, f32 s, f32 t)
+{
+    glm::vec3 direction;
+    switch (face)
+    {
+    case 0:  direction = glm::vec3(1.0f, -t, -s); break;  // +X
+    case 1:  direction = glm::vec3(-1.0f, -t, s); break;  // -X
+    case 2:  direction = glm::vec3(s, 1.0f, t); break;    // +Y
+    case 3:  direction = glm::vec3(s, -1.0f, -t); break;  // -Y
+    case 4:  direction = glm::vec3(s, -t, 1.0f); break;   // +Z
+    default: direction = glm::vec3(-s, -t, -1.0f); break; // -Z
+    }
+    return glm::normalize(direction) * glm::vec3(1.0f, 1.0f, -1.0f);
+}
+
+// Solid angle of the face area between the center and (s, t)
+static f32 AreaElement(f32 s, f32 t)
+{
+    return atan2f(s * t, sqrtf(s * s + t * t + 1.0f));
+}
+
+static void InitCubeLevel(CubeLevel& level, u32 size)
+{
+    const u32 count = 6 * FaceTexelCount(size);
+    assert(count % 4 == 0);
+
+    level.size = size;
+    level.r.assign(count, 0.0f);
+    level.g.assign(count, 0.0f);
+    level.b.assign(count, 0.0f);
+    level.x.resize(count);
+    level.y.resize(count);
+    level.z.resize(count);
+    level.solidAngle.resize(count);
+
+    const f32 texel = 2.0f / size;
+    for (u32 face = 0, i = 0; face < 6; ++face)
+    {
+        for (u32 row = 0; row < size; ++row)
+        {
+            for (u32 column = 0; column < size; ++column, ++i)
+            {
+                const f32 s0 = column * texel - 1.0f;
+                const f32 t0 = row * texel - 1.0f;
+                const glm::vec3 direction = CubeDirection(face, s0 + 0.5f * texel, t0 + 0.5f * texel);
+                level.x[i] = direction.x;
+                level.y[i] = direction.y;
+                level.z[i] = direction.z;
+                level.solidAngle[i] = AreaElement(s0, t0) - AreaElement(s0, t0 + texel) - AreaElement(s0 + texel, t0) + AreaElement(s0 + texel, t0 + texel);
+            }
+        }
+    }
+}
+
+// Averages the blocks of a face image covering every texel of the level. The faces are
+// displayed without a gamma curve, so the colors are integrated as they are shown.
+static void DownsampleFace(CubeLevel& level, u32 face, const u8* pixels, u32 faceSize)
+{
+    const u32 size = level.size;
+    for (u32 row = 0; row < size; ++row)
+    {
+        const u32 rowBegin = row * faceSize / size;
+        const u32 rowEnd = glm::max((row + 1) * faceSize / size, rowBegin + 1);
+        for (u32 column = 0; column < size; ++column)
+        {
+            const u32 columnBegin = column * faceSize / size;
+            const u32 columnEnd = glm::max((column + 1) * faceSize / size, columnBegin + 1);
+
+            u32 sum[3] = {};
+            for (u32 y = rowBegin; y < rowEnd; ++y)
+            {
+                const u8* pixel = pixels + (y * faceSize + columnBegin) * 3;
+                for (u32 x = columnBegin; x < columnEnd; ++x, pixel += 3)
+                {
+                    sum[0] += pixel[0];
+                    sum[1] += pixel[1];
+                    sum[2] += pixel[2];
+                }
+            }
+
+            const f32 scale = 1.0f / (255.0f * (rowEnd - rowBegin) * (columnEnd - columnBegin));
+            const u32 i = face * FaceTexelCount(size) + row * size + column;
+            level.r[i] = sum[0] * scale;
+            level.g[i] = sum[1] * scale;
+            level.b[i] = sum[2] * scale;
+        }
+    }
+}
+
+static void HalveCubeLevel(const CubeLevel& source, CubeLevel& level)
+{
+    InitCubeLevel(level, source.size / 2);
+
+    const u32 size = level.size;
+    for (u32 face = 0; face < 6; ++face)
+    {
+        for (u32 row = 0; row < size; ++row)
+        {
+            for (u32 column = 0; column < size; ++column)
+            {
+                const u32 i = face * FaceTexelCount(size) + row * size + column;
+                const u32 s = face * FaceTexelCount(source.size) + 2 * row * source.size + 2 * column;
+                const u32 taps[4] = { s, s + 1, s + source.size, s + source.size + 1 };
+                for (u32 tap : taps)
+                {
+                    level.r[i] += 0.25f * source.r[tap];
+                    level.g[i] += 0.25f * source.g[tap];
+                    level.b[i] += 0.25f * source.b[tap];
+                }
+            }
+        }
+    }
+}
+
+static f32 HorizontalSum(__m128 v)
+{
+    f32 lanes[4];
+    _mm_storeu_ps(lanes, v);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+// Sums of radiance * basis * solid angle over [begin, end), 27 sums plus the solid angle
+static void ProjectSH(const CubeLevel& level, u32 begin, u32 end, f32 sums[IBL_SH_COEFFICIENTS * 3 + 1])
+{
+    __m128 accumulators[IBL_SH_COEFFICIENTS * 3];
+    for (__m128& accumulator : accumulators)
+        accumulator = _mm_setzero_ps();
+    __m128 weightSum = _mm_setzero_ps();
+
+    const __m128 three = _mm_set1_ps(3.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    for (u32 i = begin; i < end; i += 4)
+    {
+        const __m128 x = _mm_loadu_ps(&level.x[i]);
+        const __m128 y = _mm_loadu_ps(&level.y[i]);
+        const __m128 z = _mm_loadu_ps(&level.z[i]);
+        const __m128 weight = _mm_loadu_ps(&level.solidAngle[i]);
+
+        __m128 basis[IBL_SH_COEFFICIENTS];
+        basis[0] = _mm_set1_ps(0.282095f);
+        basis[1] = _mm_mul_ps(_mm_set1_ps(0.488603f), y);
+        basis[2] = _mm_mul_ps(_mm_set1_ps(0.488603f), z);
+        basis[3] = _mm_mul_ps(_mm_set1_ps(0.488603f), x);
+        basis[4] = _mm_mul_ps(_mm_set1_ps(1.092548f), _mm_mul_ps(x, y));
+        basis[5] = _mm_mul_ps(_mm_set1_ps(1.092548f), _mm_mul_ps(y, z));
+        basis[6] = _mm_mul_ps(_mm_set1_ps(0.315392f), _mm_sub_ps(_mm_mul_ps(three, _mm_mul_ps(z, z)), one));
+        basis[7] = _mm_mul_ps(_mm_set1_ps(1.092548f), _mm_mul_ps(x, z));
+        basis[8] = _mm_mul_ps(_mm_set1_ps(0.546274f), _mm_sub_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)));
+
+        const __m128 r = _mm_mul_ps(_mm_loadu_ps(&level.r[i]), weight);
+        const __m128 g = _mm_mul_ps(_mm_loadu_ps(&level.g[i]), weight);
+        const __m128 b = _mm_mul_ps(_mm_loadu_ps(&level.b[i]), weight);
+        for (u32 c = 0; c < IBL_SH_COEFFICIENTS; ++c)
+        {
+            accumulators[c * 3 + 0] = _mm_add_ps(accumulators[c * 3 + 0], _mm_mul_ps(basis[c], r));
+            accumulators[c * 3 + 1] = _mm_add_ps(accumulators[c * 3 + 1], _mm_mul_ps(basis[c], g));
+            accumulators[c * 3 + 2] = _mm_add_ps(accumulators[c * 3 + 2], _mm_mul_ps(basis[c], b));
+        }
+        weightSum = _mm_add_ps(weightSum, weight);
+    }
+
+    for (u32 i = 0; i < IBL_SH_COEFFICIENTS * 3; ++i)
+        sums[i] = HorizontalSum(accumulators[i]);
+    sums[IBL_SH_COEFFICIENTS * 3] = HorizontalSum(weightSum);
+}
+
+// Irradiance over pi: the radiance coefficients convolved with the clamped cosine
+// (Ramamoorthi and Hanrahan), pi, 2pi/3 and pi/4 per band, divided by pi
+static void BakeIrradianceSH(const CubeLevel& level, JobSystem& jobs, glm::vec3 irradianceSH[IBL_SH_COEFFICIENTS])
+{
+    const u32 count = (u32)level.r.size();
+    const u32 chunkCount = (count + IBL_SH_CHUNK_TEXELS - 1) / IBL_SH_CHUNK_TEXELS;
+    std::vector<f32> partials(chunkCount * (IBL_SH_COEFFICIENTS * 3 + 1), 0.0f);
+
+    ParallelFor(jobs, chunkCount, 1, 1, [&](u32 begin, u32 end) {
+        for (u32 chunk = begin; chunk < end; ++chunk)
+        {
+            const u32 first = chunk * IBL_SH_CHUNK_TEXELS;
+            ProjectSH(level, first, glm::min(first + IBL_SH_CHUNK_TEXELS, count), &partials[chunk * (IBL_SH_COEFFICIENTS * 3 + 1)]);
+        }
+    });
+
+    f32 sums[IBL_SH_COEFFICIENTS * 3 + 1] = {};
+    for (u32 chunk = 0; chunk < chunkCount; ++chunk)
+    {
+        for (u32 i = 0; i < IBL_SH_COEFFICIENTS * 3 + 1; ++i)
+            sums[i] += partials[chunk * (IBL_SH_COEFFICIENTS * 3 + 1) + i];
+    }
+
+    // The texel solid angles add up to 4pi up to rounding, the difference is normalized away
+    const f32 normalization = 4.0f * glm::pi<f32>() / sums[IBL_SH_COEFFICIENTS * 3];
+    const f32 bands[IBL_SH_COEFFICIENTS] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+    for (u32 c = 0; c < IBL_SH_COEFFICIENTS; ++c)
+        irradianceSH[c] = glm::vec3(sums[c * 3], sums[c * 3 + 1], sums[c * 3 + 2]) * normalization * bands[c];
+}
+
+// Radiance around n weighted by the GGX lobe, with the view along the normal as in the
+// split sum approximation. Then NdotH^2 = (1 + NdotL) / 2 and the weight D(h) NdotL only
+// depends on NdotL, the constant factors of D cancel out in the normalization.
+static glm::vec3 FilterGGX(const CubeLevel& source, const glm::vec3& n, f32 alpha2)
+{
+    const __m128 nx = _mm_set1_ps(n.x);
+    const __m128 ny = _mm_set1_ps(n.y);
+    const __m128 nz = _mm_set1_ps(n.z);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 lobe = _mm_set1_ps(0.5f * (alpha2 - 1.0f));
+
+    __m128 sumR = zero, sumG = zero, sumB = zero, sumWeight = zero;
+    const u32 count = (u32)source.r.size();
+    for (u32 i = 0; i < count; i += 4)
+    {
+        __m128 NdotL = _mm_mul_ps(nx, _mm_loadu_ps(&source.x[i]));
+        NdotL = _mm_add_ps(NdotL, _mm_mul_ps(ny, _mm_loadu_ps(&source.y[i])));
+        NdotL = _mm_add_ps(NdotL, _mm_mul_ps(nz, _mm_loadu_ps(&source.z[i])));
+
+        const __m128 denominator = _mm_add_ps(_mm_mul_ps(_mm_add_ps(one, NdotL), lobe), one);
+        __m128 weight = _mm_div_ps(_mm_mul_ps(NdotL, _mm_loadu_ps(&source.solidAngle[i])), _mm_mul_ps(denominator, denominator));
+        weight = _mm_and_ps(weight, _mm_cmpgt_ps(NdotL, zero));
+
+        sumR = _mm_add_ps(sumR, _mm_mul_ps(weight, _mm_loadu_ps(&source.r[i])));
+        sumG = _mm_add_ps(sumG, _mm_mul_ps(weight, _mm_loadu_ps(&source.g[i])));
+        sumB = _mm_add_ps(sumB, _mm_mul_ps(weight, _mm_loadu_ps(&source.b[i])));
+        sumWeight = _mm_add_ps(sumWeight, weight);
+    }
+
+    return glm::vec3(HorizontalSum(sumR), HorizontalSum(sumG), HorizontalSum(sumB)) / glm::max(HorizontalSum(sumWeight), 1e-8f);
+}
+
+static void PrefilterSpecularMip(const CubeLevel& source, CubeLevel& level, JobSystem& jobs, f32 roughness)
+{
+    const f32 alpha = roughness * roughness;
+    ParallelFor(jobs, (u32)level.r.size(), IBL_MIN_TEXELS_PER_JOB, 4, [&](u32 begin, u32 end) {
+        for (u32 i = begin; i < end; ++i)
+        {
+            const glm::vec3 color = FilterGGX(source, glm::vec3(level.x[i], level.y[i], level.z[i]), alpha * alpha);
+            level.r[i] = color.r;
+            level.g[i] = color.g;
+            level.b[i] = color.b;
+        }
+    });
+}
+
+// RGB texels of every face, the layout the cache stores and GL uploads
+static void InterleaveCubeLevel(const CubeLevel& level, std::vector<f32>& texels)
+{
+    texels.resize(level.r.size() * 3);
+    for (u32 i = 0; i < level.r.size(); ++i)
+    {
+        texels[i * 3 + 0] = level.r[i];
+        texels[i * 3 + 1] = level.g[i];
+        texels[i * 3 + 2] = level.b[i];
+    }
+}
+
+static bool BakeImageBasedLighting(ImageBasedLighting& ibl, JobSystem& jobs, const std::vector<std::string>& faces, std::vector<f32> mips[IBL_SPECULAR_MIPS])
+{
+    // The faces are decoded side by side
+    u8* pixels[6] = {};
+    glm::ivec2 sizes[6] = {};
+    bool loaded = faces.size() == 6;
+    if (loaded)
+    {
+        ParallelFor(jobs, 6, 1, 1, [&](u32 begin, u32 end) {
+            for (u32 face = begin; face < end; ++face)
+            {
+                int channels;
+                stbi_set_flip_vertically_on_load_thread(false);
+                pixels[face] = stbi_load(faces[face].c_str(), &sizes[face].x, &sizes[face].y, &channels, 3);
+            }
+        });
+    }
+
+    const int faceSize = sizes[0].x;
+    for (u32 face = 0; face < 6 && loaded; ++face)
+    {
+        if (!pixels[face] || sizes[face].x != sizes[face].y || sizes[face].x != faceSize)
+        {
+            ELOG("Image based lighting: cubemap face %s is missing or not square like the others", faces[face].c_str());
+            loaded = false;
+        }
+    }
+
+    if (loaded)
+    {
+        // Every face is averaged down to the size of the first mip in a job of its own
+        CubeLevel levels[IBL_SPECULAR_MIPS];
+        InitCubeLevel(levels[0], IBL_SPECULAR_SIZE);
+        ParallelFor(jobs, 6, 1, 1, [&](u32 begin, u32 end) {
+            for (u32 face = begin; face < end; ++face)
+                DownsampleFace(levels[0], face, pixels[face], (u32)faceSize);
+        });
+
+        for (u32 mip = 1; mip < IBL_SPECULAR_MIPS; ++mip)
+            HalveCubeLevel(levels[mip - 1], levels[mip]);
+
+        BakeIrradianceSH(levels[0], jobs, ibl.irradianceSH);
+
+        // Mip 0 is the mirror reflection, the downsampled sky itself
+        InterleaveCubeLevel(levels[0], mips[0]);
+        for (u32 mip = 1; mip < IBL_SPECULAR_MIPS; ++mip)
+        {
+            CubeLevel prefiltered;
+            InitCubeLevel(prefiltered, levels[mip].size);
+
+            const u32 sourceMip = glm::min(mip, (u32)log2f((f32)IBL_SPECULAR_SIZE / IBL_MIN_SOURCE_SIZE));
+            PrefilterSpecularMip(levels[sourceMip], prefiltered, jobs, (f32)mip / (IBL_SPECULAR_MIPS - 1));
+            InterleaveCubeLevel(prefiltered, mips[mip]);
+        }
+    }
+
+    for (u32 face = 0; face < 6; ++face)
+        stbi_image_free(pixels[face]);
+
+    return loaded;
+}
+
+static void GetFaceTimestamps(const std::vector<std::string>& faces, u64 timestamps[6])
+{
+    for (u32 face = 0; face < 6; ++face)
+        timestamps[face] = face < faces.size() ? GetFileLastWriteTimestamp(faces[face].c_str()) : 0;
+}
+
+static bool ReadCache(ImageBasedLighting& ibl, const std::vector<std::string>& faces, const char* cachePath, std::vector<f32> mips[IBL_SPECULAR_MIPS])
+{
+    FILE* file = fopen(cachePath, "rb");
+    if (!file)
+        return false;
+
+    u64 timestamps[6];
+    GetFaceTimestamps(faces, timestamps);
+
+    IblCacheHeader header;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 && header.magic == IBL_CACHE_MAGIC &&
+                 header.version == IBL_CACHE_VERSION && header.size == IBL_SPECULAR_SIZE && header.mipCount == IBL_SPECULAR_MIPS &&
+                 memcmp(header.faceTimestamps, timestamps, sizeof(timestamps)) == 0;
+
+    for (u32 mip = 0; mip < IBL_SPECULAR_MIPS && valid; ++mip)
+    {
+        const u32 size = IBL_SPECULAR_SIZE >> mip;
+        mips[mip].resize(6 * FaceTexelCount(size) * 3);
+        valid = fread(mips[mip].data(), sizeof(f32), mips[mip].size(), file) == mips[mip].size();
+    }
+
+    fclose(file);
+
+    if (valid)
+        memcpy(ibl.irradianceSH, header.irradianceSH, sizeof(ibl.irradianceSH));
+    return valid;
+}
+
+static void WriteCache(const ImageBasedLighting& ibl, const std::vector<std::string>& faces, const char* cachePath, const std::vector<f32> mips[IBL_SPECULAR_MIPS])
+{
+    FILE* file = fopen(cachePath, "wb");
+    if (!file)
+    {
+        ELOG("Image based lighting: fopen() failed writing the cache %s", cachePath);
+        return;
+    }
+
+    IblCacheHeader header = {};
+    header.magic = IBL_CACHE_MAGIC;
+    header.version = IBL_CACHE_VERSION;
+    header.size = IBL_SPECULAR_SIZE;
+    header.mipCount = IBL_SPECULAR_MIPS;
+    GetFaceTimestamps(faces, header.faceTimestamps);
+    memcpy(header.irradianceSH, ibl.irradianceSH, sizeof(header.irradianceSH));
+
+    fwrite(&header, sizeof(header), 1, file);
+    for (u32 mip = 0; mip < IBL_SPECULAR_MIPS; ++mip)
+        fwrite(mips[mip].data(), sizeof(f32), mips[mip].size(), file);
+
+    fclose(file);
+}
+
+void InitImageBasedLighting(ImageBasedLighting& ibl, JobSystem& jobs, const std::vector<std::string>& faces, const char* cachePath)
+{
+    ibl.enabled = true;
+    ibl.intensity = 1.0f;
+    // Blinn-Phong exponent 128 as a GGX alpha of sqrt(2 / (128 + 2)), roughness is its square root
+    ibl.roughness = sqrtf(sqrtf(2.0f / 130.0f));
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<f32> mips[IBL_SPECULAR_MIPS];
+    ibl.loadedFromCache = ReadCache(ibl, faces, cachePath, mips);
+    if (!ibl.loadedFromCache)
+    {
+        if (BakeImageBasedLighting(ibl, jobs, faces, mips))
+        {
+            WriteCache(ibl, faces, cachePath, mips);
+        }
+        else
+        {
+            // Without a sky there is no ambient, the mips stay black
+            memset(ibl.irradianceSH, 0, sizeof(ibl.irradianceSH));
+            for (u32 mip = 0; mip < IBL_SPECULAR_MIPS; ++mip)
+                mips[mip].assign(6 * FaceTexelCount(IBL_SPECULAR_SIZE >> mip) * 3, 0.0f);
+            ibl.enabled = false;
+        }
+    }
+
+    ibl.bakeMs = std::chrono::duration<f32, std::milli>(std::chrono::steady_clock::now() - start).count();
+    ILOG("Image based lighting %s %s in %.1f ms", ibl.loadedFromCache ? "loaded from" : "baked to", cachePath, ibl.bakeMs);
+
+    glGenTextures(1, &ibl.specularTexture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, ibl.specularTexture);
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, IBL_SPECULAR_MIPS, GL_RGB16F, IBL_SPECULAR_SIZE, IBL_SPECULAR_SIZE);
+    for (u32 mip = 0; mip < IBL_SPECULAR_MIPS; ++mip)
+    {
+        const u32 size = IBL_SPECULAR_SIZE >> mip;
+        for (u32 face = 0; face < 6; ++face)
+        {
+            const f32* texels = &mips[mip][face * FaceTexelCount(size) * 3];
+            glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, 0, 0, size, size, GL_RGB, GL_FLOAT, texels);
+        }
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+    // The rough mips are a few texels wide, their edges have to filter across the faces
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+}
+
+AmbientUniforms FindAmbientUniforms(const ProgramReflection& reflection)
+{
+    AmbientUniforms uniforms;
+    uniforms.irradianceSH = FindUniformLocation(reflection, "uIrradianceSH");
+    uniforms.specularMap = FindSamplerUnit(reflection, "uSpecularMap");
+    uniforms.intensity = FindUniformLocation(reflection, "uAmbientIntensity");
+    uniforms.specularLod = FindUniformLocation(reflection, "uSpecularLod");
+    return uniforms;
+}
+
+void SetAmbientUniforms(const ImageBasedLighting& ibl, const AmbientUniforms& uniforms)
+{
+    glUniform3fv(uniforms.irradianceSH, IBL_SH_COEFFICIENTS, (GLfloat*)ibl.irradianceSH);
+    glUniform1f(uniforms.intensity, ibl.enabled ? ibl.intensity : 0.0f);
+    glUniform1f(uniforms.specularLod, ibl.roughness * (IBL_SPECULAR_MIPS - 1));
+    BindSamplerTexture(uniforms.specularMap, GL_TEXTURE_CUBE_MAP, ibl.specularTexture);
+}
@@ -0,0 +1,56 @@
+//
+// image_based_lighting.h: Ambient lighting from the skybox. The six faces are projected on
+// the CPU to L2 spherical harmonics for the diffuse irradiance and filtered with the GGX
+// lobe into a small cubemap whose mips hold increasing roughness for the specular. Both
+// are written to a cache file next to the faces and only baked again when a face changes,
+// so at runtime the shading costs nine coefficients and one cubemap fetch.
+//
+
+#pragma once
+
+#include <glad/glad.h>
+
+#include "platform.h"
+#include "job_system.h"
+
+#define IBL_SPECULAR_SIZE   128  // Mip 0 of the prefiltered cubemap, a mirror reflection
+#define IBL_SPECULAR_MIPS   6    // Down to 4x4, the last one at roughness 1
+#define IBL_SH_COEFFICIENTS 9    // Bands 0 to 2
+#define IBL_CACHE_VERSION   1    // Bump it when the bake changes
+
+struct ProgramReflection;
+
+struct ImageBasedLighting
+{
+    glm::vec3 irradianceSH[IBL_SH_COEFFICIENTS]; // Irradiance over pi in world space, times the albedo it is the diffuse radiance
+    GLuint    specularTexture;                   // Mip m is filtered with roughness m / (IBL_SPECULAR_MIPS - 1)
+
+    // Settings
+    bool      enabled;
+    f32       intensity;
+    f32       roughness; // The G-buffer has none, the default matches the Blinn-Phong exponent of the lights
+
+    // Stats of the initialization
+    bool      loadedFromCache;
+    f32       bakeMs;
+};
+
+// Uniforms of a shading program that reads the ambient lighting
+struct AmbientUniforms
+{
+    GLint irradianceSH;
+    i32   specularMap;
+    GLint intensity;
+    GLint specularLod;
+};
+
+/**
+ * Loads the ambient lighting of the cubemap faces from cachePath, or bakes it from the faces
+ * and writes the cache when that is missing, older than a face or from another version.
+ */
+void InitImageBasedLighting(ImageBasedLighting& ibl, JobSystem& jobs, const std::vector<std::string>& faces, const char* cachePath);
+
+AmbientUniforms FindAmbientUniforms(const ProgramReflection& reflection);
+
+// Sets the ambient uniforms of the bound program and binds the specular cubemap
+void SetAmbientUniforms(const ImageBasedLighting& ibl, const AmbientUniforms& uniforms);
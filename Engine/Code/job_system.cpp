@@ -0,0 +1,262 @@
+#include "job_system.h"
+
+// Deque of the calling thread, UINT32_MAX for threads the job system did not start
+static thread_local u32 ThreadIndex = UINT32_MAX;
+
+static void StoreJob(JobSlot& slot, const Job& job)
+{
+    slot.function.store(job.function, std::memory_order_relaxed);
+    slot.data.store(job.data, std::memory_order_relaxed);
+    slot.begin.store(job.begin, std::memory_order_relaxed);
+    slot.end.store(job.end, std::memory_order_relaxed);
+    slot.counter.store(job.counter, std::memory_order_relaxed);
+}
+
+static void LoadJob(const JobSlot& slot, Job& job)
+{
+    job.function = slot.function.load(std::memory_order_relaxed);
+    job.data = slot.data.load(std::memory_order_relaxed);
+    job.begin = slot.begin.load(std::memory_order_relaxed);
+    job.end = slot.end.load(std::memory_order_relaxed);
+    job.counter = slot.counter.load(std::memory_order_relaxed);
+}
+
+bool PushJob(JobDeque& deque, const Job& job)
+{
+    const i64 bottom = deque.bottom.load(std::memory_order_relaxed);
+    const i64 top = deque.top.load(std::memory_order_acquire);
+    if (bottom - top >= JOB_DEQUE_CAPACITY)
+        return false;
+
+    // Released with the bottom, a thief that sees the new bottom sees the job
+    StoreJob(deque.slots[bottom & (JOB_DEQUE_CAPACITY - 1)], job);
+    deque.bottom.store(bottom + 1, std::memory_order_release);
+    return true;
+}
+
+// Owner side, the newest job first since its data is the most likely to be in cache
+bool PopJob(JobDeque& deque, Job& job)
+{
+    const i64 bottom = deque.bottom.load(std::memory_order_relaxed) - 1;
+    deque.bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    i64 top = deque.top.load(std::memory_order_relaxed);
+
+    if (top > bottom)
+    {
+        deque.bottom.store(bottom + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    LoadJob(deque.slots[bottom & (JOB_DEQUE_CAPACITY - 1)], job);
+    if (top == bottom)
+    {
+        // The last job, a thief may be taking it at the same time
+        const bool won = deque.top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        deque.bottom.store(bottom + 1, std::memory_order_relaxed);
+        return won;
+    }
+    return true;
+}
+
+// Thief side, the oldest job, which for a split loop is the largest amount of work left
+bool StealJob(JobDeque& deque, Job& job)
+{
+    i64 top = deque.top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const i64 bottom = deque.bottom.load(std::memory_order_acquire);
+    if (top >= bottom)
+        return false;
+
+    LoadJob(deque.slots[top & (JOB_DEQUE_CAPACITY - 1)], job);
+    return deque.top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+static void ExecuteJob(JobSystem& jobs, const Job& job)
+{
+    job.function(job.data, job.begin, job.end);
+    jobs.executedJobs.fetch_add(1, std::memory_order_relaxed);
+    if (job.counter)
+        job.counter->pending.fetch_sub(1, std::memory_order_release);
+}
+
+// Own deque first, then the others starting after this thread so thieves spread out
+static bool RunOneJob(JobSystem& jobs, u32 thread)
+{
+    Job job;
+    bool found = PopJob(jobs.deques[thread], job);
+    for (u32 i = 1; i < jobs.threadCount && !found; ++i)
+    {
+        found = StealJob(jobs.deques[(thread + i) % jobs.threadCount], job);
+        if (found)
+            jobs.stolenJobs.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (!found)
+        return false;
+
+    jobs.queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+    ExecuteJob(jobs, job);
+    return true;
+}
+
+static void WorkerLoop(JobSystem* jobs, u32 thread)
+{
+    ThreadIndex = thread;
+
+    u32 idle = 0;
+    while (!jobs->stop.load(std::memory_order_acquire))
+    {
+        if (RunOneJob(*jobs, thread))
+        {
+            idle = 0;
+            continue;
+        }
+
+        if (++idle < JOB_SPIN_COUNT)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // A pusher that saw no sleeper pushed before the check below, so no wake-up is lost
+        jobs->sleepingWorkers.fetch_add(1);
+        {
+            std::unique_lock<std::mutex> lock(jobs->sleepMutex);
+            jobs->sleepCondition.wait(lock, [jobs] { return jobs->stop.load() || jobs->queuedJobs.load() > 0; });
+        }
+        jobs->sleepingWorkers.fetch_sub(1);
+        idle = 0;
+    }
+}
+
+void InitJobSystem(JobSystem& jobs, u32 threadCount)
+{
+    if (threadCount == 0)
+        threadCount = glm::max(std::thread::hardware_concurrency(), 1u);
+    jobs.threadCount = glm::min(threadCount, (u32)JOB_SYSTEM_MAX_THREADS);
+    jobs.deques.reset(new JobDeque[jobs.threadCount]);
+    for (u32 i = 0; i < jobs.threadCount; ++i)
+    {
+        jobs.deques[i].top = 0;
+        jobs.deques[i].bottom = 0;
+    }
+
+    jobs.queuedJobs = 0;
+    jobs.sleepingWorkers = 0;
+    jobs.stop = false;
+    jobs.executedJobs = 0;
+    jobs.stolenJobs = 0;
+
+    ThreadIndex = 0;
+    for (u32 thread = 1; thread < jobs.threadCount; ++thread)
+        jobs.workers.emplace_back(WorkerLoop, &jobs, thread);
+}
+
+void ShutdownJobSystem(JobSystem& jobs)
+{
+    {
+        std::lock_guard<std::mutex> lock(jobs.sleepMutex);
+        jobs.stop = true;
+    }
+    jobs.sleepCondition.notify_all();
+    for (std::thread& worker : jobs.workers)
+        worker.join();
+    jobs.workers.clear();
+
+    RunMainThreadJobs(jobs);
+}
+
+void SubmitJob(JobSystem& jobs, JobFunction function, void* data, u32 begin, u32 end, JobCounter* counter)
+{
+    Job job = { function, data, begin, end, counter };
+    if (counter)
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+    const u32 thread = ThreadIndex;
+    if (thread >= jobs.threadCount || !PushJob(jobs.deques[thread], job))
+    {
+        ExecuteJob(jobs, job);
+        return;
+    }
+
+    jobs.queuedJobs.fetch_add(1);
+    if (jobs.sleepingWorkers.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(jobs.sleepMutex);
+        jobs.sleepCondition.notify_one();
+    }
+}
+
+void SubmitMainThreadJob(JobSystem& jobs, JobFunction function, void* data, u32 begin, u32 end, JobCounter* counter)
+{
+    Job job = { function, data, begin, end, counter };
+    if (counter)
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(jobs.mainThreadMutex);
+    jobs.mainThreadJobs.push_back(job);
+}
+
+void RunMainThreadJobs(JobSystem& jobs)
+{
+    ASSERT(ThreadIndex == 0, "Main thread jobs can only run on the main thread");
+
+    // Swapped out so the jobs can queue more main thread jobs, or wait on them, while running
+    std::vector<Job> running;
+    {
+        std::lock_guard<std::mutex> lock(jobs.mainThreadMutex);
+        running.swap(jobs.mainThreadJobs);
+    }
+
+    for (const Job& job : running)
+        ExecuteJob(jobs, job);
+}
+
+void WaitForCounter(JobSystem& jobs, JobCounter& counter)
+{
+    const u32 thread = ThreadIndex;
+    while (counter.pending.load(std::memory_order_acquire) != 0)
+    {
+        if (thread < jobs.threadCount && RunOneJob(jobs, thread))
+            continue;
+
+        std::this_thread::yield();
+    }
+}
+
+void WaitForCounterAndMainThreadJobs(JobSystem& jobs, JobCounter& counter)
+{
+    ASSERT(ThreadIndex == 0, "Main thread jobs can only run on the main thread");
+
+    while (counter.pending.load(std::memory_order_acquire) != 0)
+    {
+        RunMainThreadJobs(jobs);
+        if (RunOneJob(jobs, 0))
+            continue;
+
+        std::this_thread::yield();
+    }
+}
+
+void ParallelFor(JobSystem& jobs, u32 count, u32 minItemsPerJob, u32 alignment, JobFunction function, void* data)
+{
+    if (count == 0)
+        return;
+
+    const u32 jobCount = glm::clamp(count / glm::max(minItemsPerJob, 1u), 1u, jobs.threadCount * JOBS_PER_THREAD);
+    const u32 itemsPerJob = ((count + jobCount - 1) / jobCount + alignment - 1) / alignment * alignment;
+    if (itemsPerJob >= count)
+    {
+        function(data, 0, count);
+        return;
+    }
+
+    // The first range runs here, the others wait in this thread's deque for whoever is idle
+    JobCounter counter;
+    counter.pending = 0;
+    for (u32 begin = itemsPerJob; begin < count; begin += itemsPerJob)
+        SubmitJob(jobs, function, data, begin, glm::min(begin + itemsPerJob, count), &counter);
+
+    function(data, 0, itemsPerJob);
+    WaitForCounter(jobs, counter);
+}
@@ -0,0 +1,131 @@
+//
+// job_system.h: Work-stealing scheduler shared by the engine subsystems. Every thread owns a
+// deque of jobs, it pushes and pops its own jobs at the bottom while idle threads steal from
+// the top of the others, so the work of a parallel loop spreads over every core without a
+// central queue to contend on. A job counts down its counter when done, and a thread waiting
+// on a counter runs other jobs meanwhile, so jobs can wait on jobs. GL calls have a lane of
+// their own that only the main thread runs, at the start of the frame or in a load-time wait,
+// never in the middle of a render pass.
+//
+
+#pragma once
+
+#include "platform.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#define JOB_SYSTEM_MAX_THREADS 64    // Main thread included
+#define JOB_DEQUE_CAPACITY     1024  // Power of two, a thread whose deque is full runs the job at once
+#define JOBS_PER_THREAD        4     // Parallel loops are cut finer than the threads so stealing can balance them
+#define JOB_SPIN_COUNT         64    // Empty attempts before an idle worker sleeps
+
+// Runs the items [begin, end) of data
+typedef void (*JobFunction)(void* data, u32 begin, u32 end);
+
+// Jobs not finished yet, a dependency is waited for with WaitForCounter()
+struct JobCounter
+{
+    std::atomic<u32> pending;
+};
+
+struct Job
+{
+    JobFunction function;
+    void*       data;
+    u32         begin;
+    u32         end;
+    JobCounter* counter;
+};
+
+// A job in a deque. A thief reads the slot before it knows it won the job, while the owner may
+// be reusing the slot, so the fields are relaxed atomics and the losing read is thrown away.
+struct JobSlot
+{
+    std::atomic<JobFunction> function;
+    std::atomic<void*>       data;
+    std::atomic<u32>         begin;
+    std::atomic<u32>         end;
+    std::atomic<JobCounter*> counter;
+};
+
+// Chase-Lev deque, only its owner touches the bottom. The ends are on different cache lines
+// since thieves write one and the owner the other.
+struct JobDeque
+{
+    std::atomic<i64> top;
+    u8               padding[64 - sizeof(i64)];
+    std::atomic<i64> bottom;
+    JobSlot          slots[JOB_DEQUE_CAPACITY];
+};
+
+struct JobSystem
+{
+    u32 threadCount; // Workers and the main thread, which is thread 0
+    std::unique_ptr<JobDeque[]> deques;
+    std::vector<std::thread>    workers;
+
+    // Idle workers sleep until a job is pushed
+    std::atomic<i32>        queuedJobs;
+    std::atomic<u32>        sleepingWorkers;
+    std::mutex              sleepMutex;
+    std::condition_variable sleepCondition;
+    std::atomic<bool>       stop;
+
+    // Jobs only the main thread runs, for GL work
+    std::mutex       mainThreadMutex;
+    std::vector<Job> mainThreadJobs;
+
+    // Stats
+    std::atomic<u32> executedJobs;
+    std::atomic<u32> stolenJobs;
+};
+
+// Starts a worker per hardware thread besides the calling one, which becomes the main thread.
+// A thread count other than 0 replaces the hardware one, the tests use it.
+void InitJobSystem(JobSystem& jobs, u32 threadCount = 0);
+void ShutdownJobSystem(JobSystem& jobs);
+
+/**
+ * Pushes a job to the deque of the calling thread, where any idle thread can steal it. The
+ * counter, if any, is incremented now and decremented when the job is done. Threads the
+ * system did not start have no deque and run the job at once.
+ */
+void SubmitJob(JobSystem& jobs, JobFunction function, void* data, u32 begin, u32 end, JobCounter* counter);
+
+// Queues a job for the main thread, it runs on the next RunMainThreadJobs() or WaitForCounterAndMainThreadJobs() there
+void SubmitMainThreadJob(JobSystem& jobs, JobFunction function, void* data, u32 begin, u32 end, JobCounter* counter);
+
+// Runs the jobs queued for the main thread, call it from the main thread once per frame
+void RunMainThreadJobs(JobSystem& jobs);
+
+// Runs other jobs until the counter reaches 0. Jobs queued for the main thread are left alone,
+// since render passes wait here while GL state is bound.
+void WaitForCounter(JobSystem& jobs, JobCounter& counter);
+
+// WaitForCounter() that also runs the main thread jobs, for loads that queue GL work outside of
+// the render passes. Main thread only.
+void WaitForCounterAndMainThreadJobs(JobSystem& jobs, JobCounter& counter);
+
+/**
+ * Splits [0, count) in ranges of at least minItemsPerJob items, multiples of alignment,
+ * and runs them on every thread. Returns when all of them are done. Small loops run on
+ * the calling thread alone.
+ */
+void ParallelFor(JobSystem& jobs, u32 count, u32 minItemsPerJob, u32 alignment, JobFunction function, void* data);
+
+template <typename Function>
+void ParallelFor(JobSystem& jobs, u32 count, u32 minItemsPerJob, u32 alignment, const Function& function)
+{
+    ParallelFor(jobs, count, minItemsPerJob, alignment, [](void* data, u32 begin, u32 end) {
+        (*(const Function*)data)(begin, end);
+    }, (void*)&function);
+}
+
+// Deque operations, exposed for the tests. Push and pop are for the owner thread only.
+bool PushJob(JobDeque& deque, const Job& job);
+bool PopJob(JobDeque& deque, Job& job);
+bool StealJob(JobDeque& deque, Job& job);
@@ -0,0 +1,195 @@
+#include "light_clustering.h"
+#include "engine.h"
+
+#include <float.h>
+#include <xmmintrin.h>
+
+// Below this amount of lights the jobs cost more than the assignment itself
+#define CLUSTER_MIN_LIGHTS_PER_JOB 64
+
+f32 PointLightRange(const Light& light)
+{
+    // Solve (intensity * maxColor) / (1 + 0.3d + 0.5d^2) = 1/256 for d
+    const f32 brightness = light.intensity * 0.01f * glm::max(light.color.r, glm::max(light.color.g, light.color.b));
+    const f32 k = brightness * 256.0f;
+    if (k <= 1.0f)
+        return 0.0f;
+
+    return -0.3f + sqrtf(0.09f - 2.0f * (1.0f - k));
+}
+
+static void BuildClusterBounds(LightClusterGrid& grid, const glm::mat4& projection, f32 znear, f32 zfar, glm::ivec2 viewportSize)
+{
+    grid.projection = projection;
+    grid.viewportSize = viewportSize;
+    grid.znear = znear;
+    grid.zfar = zfar;
+
+    grid.tileSize.x = (f32)((viewportSize.x + CLUSTER_GRID_X - 1) / CLUSTER_GRID_X);
+    grid.tileSize.y = (f32)((viewportSize.y + CLUSTER_GRID_Y - 1) / CLUSTER_GRID_Y);
+
+    // slice = log(depth) * scale + bias maps [znear, zfar] to [0, CLUSTER_GRID_Z]
+    const f32 logRatio = logf(zfar / znear);
+    grid.sliceScale = (f32)CLUSTER_GRID_Z / logRatio;
+    grid.sliceBias = -(f32)CLUSTER_GRID_Z * logf(znear) / logRatio;
+
+    const glm::mat4 invProjection = glm::inverse(projection);
+    grid.bounds.resize(CLUSTER_COUNT);
+
+    for (u32 z = 0; z < CLUSTER_GRID_Z; ++z)
+    {
+        const f32 sliceNear = znear * powf(zfar / znear, (f32)z / CLUSTER_GRID_Z);
+        const f32 sliceFar = znear * powf(zfar / znear, (f32)(z + 1) / CLUSTER_GRID_Z);
+
+        for (u32 y = 0; y < CLUSTER_GRID_Y; ++y)
+        {
+            for (u32 x = 0; x < CLUSTER_GRID_X; ++x)
+            {
+                // Same pixel partition as the shaders, the last tiles may be smaller
+                const f32 x0 = glm::min(x * grid.tileSize.x, (f32)viewportSize.x) / viewportSize.x * 2.0f - 1.0f;
+                const f32 x1 = glm::min((x + 1) * grid.tileSize.x, (f32)viewportSize.x) / viewportSize.x * 2.0f - 1.0f;
+                const f32 y0 = glm::min(y * grid.tileSize.y, (f32)viewportSize.y) / viewportSize.y * 2.0f - 1.0f;
+                const f32 y1 = glm::min((y + 1) * grid.tileSize.y, (f32)viewportSize.y) / viewportSize.y * 2.0f - 1.0f;
+                const glm::vec2 corners[4] = { {x0, y0}, {x1, y0}, {x0, y1}, {x1, y1} };
+
+                ClusterBounds& bounds = grid.bounds[x + y * CLUSTER_GRID_X + z * CLUSTER_GRID_X * CLUSTER_GRID_Y];
+                bounds.min = glm::vec3(FLT_MAX);
+                bounds.max = glm::vec3(-FLT_MAX);
+
+                for (u32 i = 0; i < 4; ++i)
+                {
+                    // Point of the corner ray on the near plane, then scaled to the slice depths
+                    glm::vec4 p = invProjection * glm::vec4(corners[i], -1.0f, 1.0f);
+                    glm::vec3 ray = glm::vec3(p) / p.w;
+                    ray /= -ray.z;
+
+                    bounds.min = glm::min(bounds.min, glm::min(ray * sliceNear, ray * sliceFar));
+                    bounds.max = glm::max(bounds.max, glm::max(ray * sliceNear, ray * sliceFar));
+                }
+            }
+        }
+    }
+}
+
+static void AssignSliceLights(LightClusterGrid& grid, u32 z)
+{
+    ClusterSlice& slice = grid.slices[z];
+    slice.lightIdx.clear();
+    slice.x.clear();
+    slice.y.clear();
+    slice.z.clear();
+    slice.radiusSq.clear();
+    slice.indices.clear();
+
+    // Lights whose depth range overlaps the slice, stored as SoA for the SIMD tests
+    const ClusterBounds& sliceBounds = grid.bounds[z * CLUSTER_GRID_X * CLUSTER_GRID_Y];
+    for (u32 i = 0; i < grid.viewLights.size(); ++i)
+    {
+        const glm::vec4& light = grid.viewLights[i];
+        if (light.z - light.w > sliceBounds.max.z || light.z + light.w < sliceBounds.min.z)
+            continue;
+
+        slice.lightIdx.push_back(grid.viewLightIdx[i]);
+        slice.x.push_back(light.x);
+        slice.y.push_back(light.y);
+        slice.z.push_back(light.z);
+        slice.radiusSq.push_back(light.w * light.w);
+    }
+
+    // Padding lights can never pass the test
+    while (slice.lightIdx.size() % 4 != 0)
+    {
+        slice.lightIdx.push_back(0);
+        slice.x.push_back(0.0f);
+        slice.y.push_back(0.0f);
+        slice.z.push_back(0.0f);
+        slice.radiusSq.push_back(-1.0f);
+    }
+
+    const u32 candidateCount = (u32)slice.lightIdx.size();
+    const __m128 zero = _mm_setzero_ps();
+
+    for (u32 tile = 0; tile < CLUSTER_GRID_X * CLUSTER_GRID_Y; ++tile)
+    {
+        const u32 clusterIdx = tile + z * CLUSTER_GRID_X * CLUSTER_GRID_Y;
+        const ClusterBounds& bounds = grid.bounds[clusterIdx];
+
+        const __m128 minX = _mm_set1_ps(bounds.min.x), maxX = _mm_set1_ps(bounds.max.x);
+        const __m128 minY = _mm_set1_ps(bounds.min.y), maxY = _mm_set1_ps(bounds.max.y);
+        const __m128 minZ = _mm_set1_ps(bounds.min.z), maxZ = _mm_set1_ps(bounds.max.z);
+
+        LightCluster& cluster = grid.clusters[clusterIdx];
+        cluster.offset = (u32)slice.indices.size(); // Relative to the slice until the lists are merged
+
+        for (u32 i = 0; i < candidateCount; i += 4)
+        {
+            // Squared distance from the sphere centers to the box
+            const __m128 cx = _mm_loadu_ps(&slice.x[i]);
+            const __m128 cy = _mm_loadu_ps(&slice.y[i]);
+            const __m128 cz = _mm_loadu_ps(&slice.z[i]);
+
+            const __m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(minX, cx), zero), _mm_max_ps(_mm_sub_ps(cx, maxX), zero));
+            const __m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(minY, cy), zero), _mm_max_ps(_mm_sub_ps(cy, maxY), zero));
+            const __m128 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(minZ, cz), zero), _mm_max_ps(_mm_sub_ps(cz, maxZ), zero));
+            const __m128 distSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+            const int mask = _mm_movemask_ps(_mm_cmple_ps(distSq, _mm_loadu_ps(&slice.radiusSq[i])));
+            for (u32 lane = 0; lane < 4; ++lane)
+                if (mask & (1 << lane))
+                    slice.indices.push_back(slice.lightIdx[i + lane]);
+        }
+
+        cluster.count = (u32)slice.indices.size() - cluster.offset;
+    }
+}
+
+void BuildLightClusters(LightClusterGrid& grid, JobSystem& jobs, const std::vector<Light>& lights, const glm::mat4& view, const glm::mat4& projection,
+                        f32 znear, f32 zfar, glm::ivec2 viewportSize)
+{
+    if (grid.bounds.empty() || grid.projection != projection || grid.viewportSize != viewportSize || grid.znear != znear || grid.zfar != zfar)
+        BuildClusterBounds(grid, projection, znear, zfar, viewportSize);
+
+    grid.clusters.resize(CLUSTER_COUNT);
+    grid.slices.resize(CLUSTER_GRID_Z);
+    grid.lightIndices.clear();
+    grid.viewLights.clear();
+    grid.viewLightIdx.clear();
+
+    for (u32 i = 0; i < lights.size(); ++i)
+    {
+        const Light& light = lights[i];
+        if (light.type == LightType_Directional)
+        {
+            grid.lightIndices.push_back(i);
+            continue;
+        }
+
+        const f32 range = PointLightRange(light);
+        if (range <= 0.0f)
+            continue;
+
+        grid.viewLights.push_back(glm::vec4(glm::vec3(view * glm::vec4(light.position, 1.0f)), range));
+        grid.viewLightIdx.push_back(i);
+    }
+
+    grid.directionalLightCount = (u32)grid.lightIndices.size();
+
+    // Every slice writes its own clusters and index list, so they need no synchronization. The
+    // near slices hold more lights, a job per slice lets the idle threads steal the rest.
+    const u32 minSlicesPerJob = grid.viewLights.size() >= CLUSTER_MIN_LIGHTS_PER_JOB ? 1 : CLUSTER_GRID_Z;
+    ParallelFor(jobs, CLUSTER_GRID_Z, minSlicesPerJob, 1, [&grid](u32 begin, u32 end) {
+        for (u32 z = begin; z < end; ++z)
+            AssignSliceLights(grid, z);
+    });
+
+    // Merge the per slice lists after the directional lights
+    for (u32 z = 0; z < CLUSTER_GRID_Z; ++z)
+    {
+        const u32 base = (u32)grid.lightIndices.size();
+        const ClusterSlice& slice = grid.slices[z];
+        grid.lightIndices.insert(grid.lightIndices.end(), slice.indices.begin(), slice.indices.end());
+
+        for (u32 tile = 0; tile < CLUSTER_GRID_X * CLUSTER_GRID_Y; ++tile)
+            grid.clusters[tile + z * CLUSTER_GRID_X * CLUSTER_GRID_Y].offset += base;
+    }
+}
@@ -0,0 +1,73 @@
+//
+// light_clustering.h: Clustered light culling. The view frustum is split in screen tiles
+// times exponential depth slices, and every point light is assigned to the clusters its
+// attenuation range overlaps, so the shaders only loop over the lights of their cluster.
+//
+
+#pragma once
+
+#include "platform.h"
+#include "job_system.h"
+
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_COUNT  (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
+
+struct Light;
+
+struct ClusterBounds
+{
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+// Range of a cluster in the light index list, read as an uvec2 by the shaders
+struct LightCluster
+{
+    u32 offset;
+    u32 count;
+};
+
+// Scratch of the worker that assigns the lights of one depth slice
+struct ClusterSlice
+{
+    std::vector<u32> lightIdx;
+    std::vector<f32> x, y, z, radiusSq;
+    std::vector<u32> indices;
+};
+
+struct LightClusterGrid
+{
+    // View space bounds of every cluster, only rebuilt when the projection or viewport change
+    std::vector<ClusterBounds> bounds;
+    glm::mat4  projection;
+    glm::ivec2 viewportSize;
+    f32        znear;
+    f32        zfar;
+
+    // Mapping from fragment to cluster, uploaded with the global params
+    glm::vec2  tileSize;
+    f32        sliceScale;
+    f32        sliceBias;
+
+    std::vector<glm::vec4>    viewLights; // View space position and range of the point lights
+    std::vector<u32>          viewLightIdx;
+    std::vector<ClusterSlice> slices;
+
+    // Results: directional lights go first in the index list and apply to every cluster
+    std::vector<LightCluster> clusters;
+    std::vector<u32>          lightIndices;
+    u32                       directionalLightCount;
+};
+
+// Distance at which a point light stops contributing visibly (below 1/256) with the shading pass attenuation
+f32 PointLightRange(const Light& light);
+
+/**
+ * Assigns the lights to the clusters of the current view. The cluster/light tests run four
+ * lights at a time with SSE, and the depth slices are split across jobs when there are
+ * enough lights to pay for them.
+ */
+void BuildLightClusters(LightClusterGrid& grid, JobSystem& jobs, const std::vector<Light>& lights, const glm::mat4& view, const glm::mat4& projection,
+                        f32 znear, f32 zfar, glm::ivec2 viewportSize);
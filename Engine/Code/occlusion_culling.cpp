@@ -0,0 +1,279 @@
+#include "occlusion_culling.h"
+#include "engine.h"
+
+#include <algorithm>
+#include <float.h>
+#include <xmmintrin.h>
+
+// Below this amount of triangles the jobs cost more than the rasterization itself
+#define OCCLUSION_MIN_TRIANGLES_PER_JOB 256
+
+void AddOccluderTriangles(OcclusionCuller& occlusion, const f32* vertices, u32 strideInFloats, u32 vertexCount,
+                          const u32* indices, u32 indexCount, const glm::mat4& worldViewProjection)
+{
+    // Positions are always the first attribute
+    occlusion.clipVertices.resize(vertexCount);
+    for (u32 v = 0; v < vertexCount; ++v)
+    {
+        const f32* position = &vertices[v * strideInFloats];
+        occlusion.clipVertices[v] = worldViewProjection * glm::vec4(position[0], position[1], position[2], 1.0f);
+    }
+
+    const glm::vec3 scale = glm::vec3(0.5f * OCCLUSION_BUFFER_WIDTH, 0.5f * OCCLUSION_BUFFER_HEIGHT, 0.5f);
+
+    for (u32 i = 0; i + 2 < indexCount; i += 3)
+    {
+        const glm::vec4& c0 = occlusion.clipVertices[indices[i]];
+        const glm::vec4& c1 = occlusion.clipVertices[indices[i + 1]];
+        const glm::vec4& c2 = occlusion.clipVertices[indices[i + 2]];
+
+        // Triangles crossing the near plane are dropped instead of clipped, an occluder
+        // missing a few triangles only hides less
+        if (c0.z < -c0.w || c1.z < -c1.w || c2.z < -c2.w)
+            continue;
+
+        OcclusionTriangle triangle;
+        triangle.v0 = (glm::vec3(c0) / c0.w + 1.0f) * scale;
+        triangle.v1 = (glm::vec3(c1) / c1.w + 1.0f) * scale;
+        triangle.v2 = (glm::vec3(c2) / c2.w + 1.0f) * scale;
+
+        // Back faces (counter clockwise is front, as for GL) and degenerate triangles
+        const f32 area = (triangle.v1.x - triangle.v0.x) * (triangle.v2.y - triangle.v0.y) -
+                         (triangle.v2.x - triangle.v0.x) * (triangle.v1.y - triangle.v0.y);
+        if (area <= 0.0f)
+            continue;
+
+        occlusion.triangles.push_back(triangle);
+    }
+}
+
+// Draws the triangles into the rows [bandBegin, bandEnd) of the depth buffer, then updates
+// the max depth of the tiles of the band
+static void RasterizeBand(OcclusionCuller& occlusion, u32 bandBegin, u32 bandEnd)
+{
+    f32* depthBuffer = occlusion.depth.data();
+    const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+    for (const OcclusionTriangle& triangle : occlusion.triangles)
+    {
+        const glm::vec3& v0 = triangle.v0;
+        const glm::vec3& v1 = triangle.v1;
+        const glm::vec3& v2 = triangle.v2;
+
+        // Pixels whose centers may be inside the triangle, the columns aligned to the SIMD width
+        const i32 minX = glm::max((i32)floorf(glm::min(v0.x, glm::min(v1.x, v2.x))), 0) & ~3;
+        const i32 maxX = glm::min((i32)ceilf(glm::max(v0.x, glm::max(v1.x, v2.x))), OCCLUSION_BUFFER_WIDTH - 1);
+        const i32 minY = glm::max((i32)floorf(glm::min(v0.y, glm::min(v1.y, v2.y))), (i32)bandBegin);
+        const i32 maxY = glm::min((i32)ceilf(glm::max(v0.y, glm::max(v1.y, v2.y))), (i32)bandEnd - 1);
+        if (minX > maxX || minY > maxY)
+            continue;
+
+        // Edge functions A * x + B * y + C, positive inside for counter clockwise triangles
+        const f32 a0 = v1.y - v2.y, b0 = v2.x - v1.x, c0 = -(a0 * v1.x + b0 * v1.y);
+        const f32 a1 = v2.y - v0.y, b1 = v0.x - v2.x, c1 = -(a1 * v2.x + b1 * v2.y);
+        const f32 a2 = v0.y - v1.y, b2 = v1.x - v0.x, c2 = -(a2 * v0.x + b2 * v0.y);
+
+        // Depth plane
+        const f32 area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+        const f32 dzdx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+        const f32 dzdy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+
+        const __m128 edgeA0 = _mm_set1_ps(a0), edgeA1 = _mm_set1_ps(a1), edgeA2 = _mm_set1_ps(a2);
+        const __m128 depthDx = _mm_set1_ps(dzdx);
+        const __m128 zero = _mm_setzero_ps();
+
+        for (i32 y = minY; y <= maxY; ++y)
+        {
+            const f32 py = (f32)y + 0.5f;
+            const __m128 rowE0 = _mm_set1_ps(b0 * py + c0);
+            const __m128 rowE1 = _mm_set1_ps(b1 * py + c1);
+            const __m128 rowE2 = _mm_set1_ps(b2 * py + c2);
+            const __m128 rowDepth = _mm_set1_ps(v0.z + dzdy * (py - v0.y) - dzdx * v0.x);
+
+            f32* row = depthBuffer + y * OCCLUSION_BUFFER_WIDTH;
+            for (i32 x = minX; x <= maxX; x += 4)
+            {
+                const __m128 px = _mm_add_ps(_mm_set1_ps((f32)x), laneOffsets);
+
+                const __m128 e0 = _mm_add_ps(_mm_mul_ps(edgeA0, px), rowE0);
+                const __m128 e1 = _mm_add_ps(_mm_mul_ps(edgeA1, px), rowE1);
+                const __m128 e2 = _mm_add_ps(_mm_mul_ps(edgeA2, px), rowE2);
+                const __m128 inside = _mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+                if (_mm_movemask_ps(inside) == 0)
+                    continue;
+
+                const __m128 z = _mm_add_ps(_mm_mul_ps(depthDx, px), rowDepth);
+                const __m128 previous = _mm_loadu_ps(row + x);
+                const __m128 closest = _mm_min_ps(previous, z);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closest), _mm_andnot_ps(inside, previous)));
+            }
+        }
+    }
+
+    // Farthest depth of every tile, lets the bounds tests skip whole tiles
+    for (u32 tileY = bandBegin / OCCLUSION_TILE_SIZE; tileY < bandEnd / OCCLUSION_TILE_SIZE; ++tileY)
+    {
+        for (u32 tileX = 0; tileX < OCCLUSION_TILES_X; ++tileX)
+        {
+            __m128 maxDepth = _mm_setzero_ps();
+            for (u32 y = 0; y < OCCLUSION_TILE_SIZE; ++y)
+            {
+                const f32* row = depthBuffer + (tileY * OCCLUSION_TILE_SIZE + y) * OCCLUSION_BUFFER_WIDTH + tileX * OCCLUSION_TILE_SIZE;
+                for (u32 x = 0; x < OCCLUSION_TILE_SIZE; x += 4)
+                    maxDepth = _mm_max_ps(maxDepth, _mm_loadu_ps(row + x));
+            }
+
+            f32 lanes[4];
+            _mm_storeu_ps(lanes, maxDepth);
+            occlusion.tileMaxDepth[tileX + tileY * OCCLUSION_TILES_X] = glm::max(glm::max(lanes[0], lanes[1]), glm::max(lanes[2], lanes[3]));
+        }
+    }
+}
+
+void RasterizeOccluders(OcclusionCuller& occlusion, JobSystem& jobs)
+{
+    occlusion.depth.assign(OCCLUSION_BUFFER_WIDTH * OCCLUSION_BUFFER_HEIGHT, 1.0f);
+    occlusion.tileMaxDepth.assign(OCCLUSION_TILES_X * OCCLUSION_TILES_Y, 1.0f);
+
+    // Bands of whole tile rows, every job only writes the rows of its band. Every band walks
+    // all the triangles, so there are only as many as the triangle count pays for.
+    const u32 maxBands = glm::max((u32)occlusion.triangles.size() / OCCLUSION_MIN_TRIANGLES_PER_JOB, 1u);
+    const u32 minTileRowsPerBand = (OCCLUSION_TILES_Y + maxBands - 1) / maxBands;
+    ParallelFor(jobs, OCCLUSION_TILES_Y, minTileRowsPerBand, 1, [&occlusion](u32 begin, u32 end) {
+        RasterizeBand(occlusion, begin * OCCLUSION_TILE_SIZE, end * OCCLUSION_TILE_SIZE);
+    });
+}
+
+bool IsBoxOccluded(const OcclusionCuller& occlusion, const glm::mat4& viewProjection, const glm::vec3& center, const glm::vec3& extent)
+{
+    // Screen rectangle and closest depth of the eight corners
+    glm::vec2 rectMin = glm::vec2(FLT_MAX);
+    glm::vec2 rectMax = glm::vec2(-FLT_MAX);
+    f32 nearestDepth = FLT_MAX;
+
+    for (u32 i = 0; i < 8; ++i)
+    {
+        const glm::vec3 corner = center + extent * glm::vec3(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f);
+        const glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+        if (clip.z < -clip.w)
+            return false; // Crosses the near plane
+
+        const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        rectMin = glm::min(rectMin, glm::vec2(ndc));
+        rectMax = glm::max(rectMax, glm::vec2(ndc));
+        nearestDepth = glm::min(nearestDepth, ndc.z * 0.5f + 0.5f);
+    }
+
+    const glm::vec2 size = glm::vec2(OCCLUSION_BUFFER_WIDTH, OCCLUSION_BUFFER_HEIGHT);
+    const glm::ivec2 pixelMin = glm::max(glm::ivec2(glm::floor((rectMin * 0.5f + 0.5f) * size)), glm::ivec2(0));
+    const glm::ivec2 pixelMax = glm::min(glm::ivec2(glm::floor((rectMax * 0.5f + 0.5f) * size)), glm::ivec2(size) - 1);
+    if (pixelMin.x > pixelMax.x || pixelMin.y > pixelMax.y)
+        return false; // Outside of the screen, the frustum test decides
+
+    // Tiles entirely closer than the box are skipped, the others are tested pixel by pixel
+    for (i32 tileY = pixelMin.y / OCCLUSION_TILE_SIZE; tileY <= pixelMax.y / OCCLUSION_TILE_SIZE; ++tileY)
+    {
+        for (i32 tileX = pixelMin.x / OCCLUSION_TILE_SIZE; tileX <= pixelMax.x / OCCLUSION_TILE_SIZE; ++tileX)
+        {
+            if (occlusion.tileMaxDepth[tileX + tileY * OCCLUSION_TILES_X] < nearestDepth)
+                continue;
+
+            const i32 x0 = glm::max(pixelMin.x, tileX * OCCLUSION_TILE_SIZE);
+            const i32 x1 = glm::min(pixelMax.x, (tileX + 1) * OCCLUSION_TILE_SIZE - 1);
+            const i32 y0 = glm::max(pixelMin.y, tileY * OCCLUSION_TILE_SIZE);
+            const i32 y1 = glm::min(pixelMax.y, (tileY + 1) * OCCLUSION_TILE_SIZE - 1);
+
+            for (i32 y = y0; y <= y1; ++y)
+                for (i32 x = x0; x <= x1; ++x)
+                    if (occlusion.depth[x + y * OCCLUSION_BUFFER_WIDTH] >= nearestDepth)
+                        return false;
+        }
+    }
+
+    return true;
+}
+
+void CullOcclusion(OcclusionCuller& occlusion, JobSystem& jobs, FrustumCuller& culler, const std::vector<Entity>& entities,
+                   const std::vector<ModelStruct>& models, const std::vector<MeshStruct>& meshes,
+                   const glm::mat4& viewProjection, const glm::vec3& cameraPosition)
+{
+    // The biggest visible submeshes on screen that are cheap enough to draw
+    occlusion.occluderCandidates.clear();
+    for (u32 entityIdx = 0; entityIdx < culler.entityCount; ++entityIdx)
+    {
+        if (!culler.entityVisible[entityIdx])
+            continue;
+
+        const MeshStruct& mesh = meshes[models[entities[entityIdx].modelIndex].meshIdx];
+        for (u32 submeshIdx = 0; submeshIdx < mesh.submeshes.size(); ++submeshIdx)
+        {
+            const u32 box = culler.firstBox[entityIdx] + submeshIdx;
+            if (!culler.boxVisible[box] || mesh.submeshes[submeshIdx].indices.size() / 3 > OCCLUSION_MAX_OCCLUDER_TRIANGLES)
+                continue;
+
+            const glm::vec3 center = glm::vec3(culler.centerX[box], culler.centerY[box], culler.centerZ[box]);
+            const f32 radius = glm::length(glm::vec3(culler.extentX[box], culler.extentY[box], culler.extentZ[box]));
+            const f32 distance = glm::max(glm::distance(center, cameraPosition) - radius, 0.001f);
+
+            OccluderCandidate candidate = { radius / distance, entityIdx, submeshIdx };
+            if (candidate.size >= OCCLUSION_MIN_OCCLUDER_SIZE)
+                occlusion.occluderCandidates.push_back(candidate);
+        }
+    }
+
+    const u32 occluderCount = glm::min((u32)occlusion.occluderCandidates.size(), (u32)OCCLUSION_MAX_OCCLUDERS);
+    std::partial_sort(occlusion.occluderCandidates.begin(), occlusion.occluderCandidates.begin() + occluderCount, occlusion.occluderCandidates.end(),
+                      [](const OccluderCandidate& a, const OccluderCandidate& b) { return a.size > b.size; });
+
+    occlusion.triangles.clear();
+    for (u32 i = 0; i < occluderCount; ++i)
+    {
+        const OccluderCandidate& candidate = occlusion.occluderCandidates[i];
+        const Entity& entity = entities[candidate.entityIdx];
+        const Submesh& submesh = meshes[models[entity.modelIndex].meshIdx].submeshes[candidate.submeshIdx];
+        const u32 strideInFloats = submesh.vertexBufferLayout.stride / sizeof(f32);
+        AddOccluderTriangles(occlusion, submesh.vertices.data(), strideInFloats, submesh.vertices.size() / strideInFloats,
+                             submesh.indices.data(), submesh.indices.size(), viewProjection * entity.worldMatrix);
+    }
+
+    occlusion.occluderCount = occluderCount;
+    occlusion.occludedBoxCount = 0;
+    if (occlusion.triangles.empty())
+        return;
+
+    RasterizeOccluders(occlusion, jobs);
+
+    // Occluders are never hidden by themselves: their bounds are closer than their own triangles
+    for (u32 entityIdx = 0; entityIdx < culler.entityCount; ++entityIdx)
+    {
+        if (!culler.entityVisible[entityIdx])
+            continue;
+
+        const u32 firstBox = culler.firstBox[entityIdx];
+        const u32 lastBox = entityIdx + 1 < culler.entityCount ? culler.firstBox[entityIdx + 1] : culler.boxCount;
+
+        u8 visible = 0;
+        for (u32 box = firstBox; box < lastBox; ++box)
+        {
+            if (!culler.boxVisible[box])
+                continue;
+
+            const glm::vec3 center = glm::vec3(culler.centerX[box], culler.centerY[box], culler.centerZ[box]);
+            const glm::vec3 extent = glm::vec3(culler.extentX[box], culler.extentY[box], culler.extentZ[box]);
+            if (IsBoxOccluded(occlusion, viewProjection, center, extent))
+            {
+                culler.boxVisible[box] = 0;
+                culler.visibleBoxCount--;
+                occlusion.occludedBoxCount++;
+            }
+
+            visible |= culler.boxVisible[box];
+        }
+
+        if (!visible)
+        {
+            culler.entityVisible[entityIdx] = 0;
+            culler.visibleEntityCount--;
+        }
+    }
+}
@@ -0,0 +1,68 @@
+//
+// occlusion_culling.h: Software occlusion culling. The largest visible submeshes are drawn
+// as occluders into a small depth buffer on the CPU (SSE, four pixels at a time, the screen
+// split in horizontal bands across jobs), and the bounds that passed the frustum test are
+// then rejected when every pixel they cover has a closer occluder.
+//
+
+#pragma once
+
+#include "platform.h"
+#include "job_system.h"
+
+#define OCCLUSION_BUFFER_WIDTH            256
+#define OCCLUSION_BUFFER_HEIGHT           144
+#define OCCLUSION_TILE_SIZE               8    // Pixels per side of the tiles with a max depth
+#define OCCLUSION_MAX_OCCLUDERS           16
+#define OCCLUSION_MAX_OCCLUDER_TRIANGLES  4096 // Heavier submeshes cost more to draw than they save
+#define OCCLUSION_MIN_OCCLUDER_SIZE       0.1f // Bounding radius over distance to the camera
+
+#define OCCLUSION_TILES_X (OCCLUSION_BUFFER_WIDTH / OCCLUSION_TILE_SIZE)
+#define OCCLUSION_TILES_Y (OCCLUSION_BUFFER_HEIGHT / OCCLUSION_TILE_SIZE)
+
+struct Entity;
+struct ModelStruct;
+struct MeshStruct;
+struct FrustumCuller;
+
+// Triangle in occlusion buffer pixels, with depth in [0, 1]
+struct OcclusionTriangle
+{
+    glm::vec3 v0, v1, v2;
+};
+
+struct OccluderCandidate
+{
+    f32 size;
+    u32 entityIdx;
+    u32 submeshIdx;
+};
+
+struct OcclusionCuller
+{
+    std::vector<f32> depth;    // OCCLUSION_BUFFER_WIDTH * OCCLUSION_BUFFER_HEIGHT, 1 is the far plane
+    std::vector<f32> tileMaxDepth;
+
+    // Scratch of the current frame
+    std::vector<OcclusionTriangle> triangles;
+    std::vector<glm::vec4>         clipVertices;
+    std::vector<OccluderCandidate> occluderCandidates;
+
+    u32 occluderCount;
+    u32 occludedBoxCount;
+};
+
+/**
+ * Draws the occluders of the current view and clears the visibility of the submeshes of the
+ * frustum culler that they hide. Entities left without visible submeshes become invisible.
+ */
+void CullOcclusion(OcclusionCuller& occlusion, JobSystem& jobs, FrustumCuller& culler, const std::vector<Entity>& entities,
+                   const std::vector<ModelStruct>& models, const std::vector<MeshStruct>& meshes,
+                   const glm::mat4& viewProjection, const glm::vec3& cameraPosition);
+
+// Only exposed for debugging, tests and benchmarks, CullOcclusion() does all three steps.
+// The triangles of an occluder are appended to the ones already in occlusion.triangles.
+void AddOccluderTriangles(OcclusionCuller& occlusion, const f32* vertices, u32 strideInFloats, u32 vertexCount,
+                          const u32* indices, u32 indexCount, const glm::mat4& worldViewProjection);
+void RasterizeOccluders(OcclusionCuller& occlusion, JobSystem& jobs);
+bool IsBoxOccluded(const OcclusionCuller& occlusion, const glm::mat4& viewProjection, const glm::vec3& center, const glm::vec3& extent);
@@ -13,6 +13,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <errno.h>
 #endif
 
 #include "engine.h"
@@ -106,6 +107,12 @@ void OnGlfwCharEvent(GLFWwindow* window, unsigned int character)
 void OnGlfwResizeFramebuffer(GLFWwindow* window, int width, int height)
 {
     App* app = (App*)glfwGetWindowUserPointer(window);
+
+    // A minimized window has no framebuffer, keep rendering at the last size. The render
+    // targets follow the new size on their own, see render_graph.h.
+    if (width == 0 || height == 0)
+        return;
+
     app->displaySize = glm::vec2(width, height);
 }
 
@@ -161,6 +168,9 @@ int main()
         return -1;
     }
 
+    // Optional GL 4.4 entry points used by the per-frame ring buffers
+    LoadBufferStorageExtension((GLADloadproc) glfwGetProcAddress);
+
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
 
@@ -263,6 +273,8 @@ int main()
         GlobalFrameArenaHead = 0;
     }
 
+    Shutdown(&app);
+
     free(GlobalFrameArenaMemory);
 
     ImGui_ImplOpenGL3_Shutdown();
@@ -400,6 +412,15 @@ u64 GetFileLastWriteTimestamp(const char* filepath)
     return 0;
 }
 
+bool MakeDirectory(const char* path)
+{
+#ifdef _WIN32
+    return CreateDirectoryA(path, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+#endif
+}
+
 void LogString(const char* str)
 {
 #ifdef _WIN32
@@ -81,6 +81,12 @@ String ReadTextFile(const char *filepath);
  */
 u64 GetFileLastWriteTimestamp(const char *filepath);
 
+/**
+ * Creates a directory inside an existing one. Returns false if it could not be created,
+ * an already existing directory counts as created.
+ */
+bool MakeDirectory(const char *path);
+
 /**
  * It logs a string to whichever outputs are configured in the platform layer.
  * By default, the string is printed in the output console of VisualStudio.
@@ -0,0 +1,124 @@
+#include "program_reflection.h"
+#include <string.h>
+
+static bool IsSamplerType(GLenum type)
+{
+    switch (type)
+    {
+    case GL_SAMPLER_1D:
+    case GL_SAMPLER_2D:
+    case GL_SAMPLER_3D:
+    case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_1D_SHADOW:
+    case GL_SAMPLER_2D_SHADOW:
+    case GL_SAMPLER_CUBE_SHADOW:
+    case GL_SAMPLER_1D_ARRAY:
+    case GL_SAMPLER_2D_ARRAY:
+    case GL_SAMPLER_1D_ARRAY_SHADOW:
+    case GL_SAMPLER_2D_ARRAY_SHADOW:
+    case GL_SAMPLER_2D_MULTISAMPLE:
+    case GL_SAMPLER_2D_MULTISAMPLE_ARRAY:
+    case GL_SAMPLER_BUFFER:
+    case GL_SAMPLER_2D_RECT:
+    case GL_INT_SAMPLER_2D:
+    case GL_INT_SAMPLER_3D:
+    case GL_INT_SAMPLER_CUBE:
+    case GL_INT_SAMPLER_2D_ARRAY:
+    case GL_INT_SAMPLER_BUFFER:
+    case GL_UNSIGNED_INT_SAMPLER_2D:
+    case GL_UNSIGNED_INT_SAMPLER_3D:
+    case GL_UNSIGNED_INT_SAMPLER_CUBE:
+    case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY:
+    case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void ReflectProgram(GLuint programHandle, ProgramReflection& reflection)
+{
+    reflection.uniforms.clear();
+    reflection.uniformBlocks.clear();
+    reflection.samplerCount = 0;
+
+    GLchar  name[128];
+    GLsizei nameLength;
+
+    // Uniforms in the default block (the ones inside uniform blocks have no location)
+    GLint uniformCount = 0;
+    glGetProgramiv(programHandle, GL_ACTIVE_UNIFORMS, &uniformCount);
+
+    for (GLint i = 0; i < uniformCount; ++i)
+    {
+        GLint  arraySize;
+        GLenum type;
+        glGetActiveUniform(programHandle, (GLuint)i, sizeof(name), &nameLength, &arraySize, &type, name);
+
+        GLint location = glGetUniformLocation(programHandle, name);
+        if (location == -1)
+            continue;
+
+        // Arrays are reported as "name[0]", register them by their base name
+        if (nameLength > 3 && strcmp(name + nameLength - 3, "[0]") == 0)
+            name[nameLength - 3] = '\0';
+
+        UniformInfo uniform = {};
+        uniform.location = location;
+        uniform.type = type;
+        uniform.arraySize = arraySize;
+        uniform.samplerUnit = -1;
+
+        if (IsSamplerType(type))
+        {
+            uniform.samplerUnit = (i32)reflection.samplerCount;
+            for (GLint j = 0; j < arraySize; ++j)
+                glProgramUniform1i(programHandle, location + j, (GLint)reflection.samplerCount++);
+        }
+
+        reflection.uniforms[name] = uniform;
+    }
+
+    // Uniform blocks
+    GLint blockCount = 0;
+    glGetProgramiv(programHandle, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+
+    for (GLint i = 0; i < blockCount; ++i)
+    {
+        glGetActiveUniformBlockName(programHandle, (GLuint)i, sizeof(name), &nameLength, name);
+
+        UniformBlockInfo block = {};
+        block.index = (GLuint)i;
+        glGetActiveUniformBlockiv(programHandle, (GLuint)i, GL_UNIFORM_BLOCK_BINDING, &block.binding);
+        glGetActiveUniformBlockiv(programHandle, (GLuint)i, GL_UNIFORM_BLOCK_DATA_SIZE, &block.dataSize);
+
+        reflection.uniformBlocks[name] = block;
+    }
+}
+
+GLint FindUniformLocation(const ProgramReflection& reflection, const char* name)
+{
+    auto it = reflection.uniforms.find(name);
+    return it != reflection.uniforms.end() ? it->second.location : -1;
+}
+
+i32 FindSamplerUnit(const ProgramReflection& reflection, const char* name)
+{
+    auto it = reflection.uniforms.find(name);
+    return it != reflection.uniforms.end() ? it->second.samplerUnit : -1;
+}
+
+GLint FindUniformBlockBinding(const ProgramReflection& reflection, const char* name)
+{
+    auto it = reflection.uniformBlocks.find(name);
+    return it != reflection.uniformBlocks.end() ? it->second.binding : -1;
+}
+
+void BindSamplerTexture(i32 samplerUnit, GLenum target, GLuint texture)
+{
+    if (samplerUnit < 0)
+        return;
+
+    glActiveTexture(GL_TEXTURE0 + samplerUnit);
+    glBindTexture(target, texture);
+}
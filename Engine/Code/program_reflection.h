@@ -0,0 +1,48 @@
+//
+// program_reflection.h: Tables of the active uniforms, uniform blocks and samplers of a linked program.
+// They are filled once at link time so the render loops never query GL by name.
+//
+
+#pragma once
+
+#include <glad/glad.h>
+#include <unordered_map>
+
+#include "platform.h"
+
+struct UniformInfo
+{
+    GLint  location;
+    GLenum type;
+    GLint  arraySize;
+    i32    samplerUnit; // -1 if the uniform is not a sampler
+};
+
+struct UniformBlockInfo
+{
+    GLuint index;
+    GLint  binding;
+    GLint  dataSize;
+};
+
+struct ProgramReflection
+{
+    std::unordered_map<std::string, UniformInfo>      uniforms;
+    std::unordered_map<std::string, UniformBlockInfo> uniformBlocks;
+    u32                                               samplerCount;
+};
+
+/**
+ * Enumerates the active uniforms and uniform blocks of a linked program. Every sampler
+ * gets its own texture unit (in enumeration order) which is written to the program,
+ * so callers only have to bind textures to the unit returned by FindSamplerUnit().
+ */
+void ReflectProgram(GLuint programHandle, ProgramReflection& reflection);
+
+// Returns -1 when the uniform is not active in the program
+GLint FindUniformLocation(const ProgramReflection& reflection, const char* name);
+i32   FindSamplerUnit(const ProgramReflection& reflection, const char* name);
+GLint FindUniformBlockBinding(const ProgramReflection& reflection, const char* name);
+
+// Binds a texture to the unit of a reflected sampler, does nothing if the sampler is not active
+void BindSamplerTexture(i32 samplerUnit, GLenum target, GLuint texture);
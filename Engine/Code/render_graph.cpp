@@ -0,0 +1,573 @@
+#include "render_graph.h"
+#include "engine.h"
+
+#include <string.h>
+
+static bool IsWrite(RenderGraphAccess access)
+{
+    return access == RenderGraphAccess_ColorTarget || access == RenderGraphAccess_DepthTarget || access == RenderGraphAccess_Storage;
+}
+
+// Whether the access depends on what earlier passes left in the texture
+static bool IsRead(const RenderGraphUse& use)
+{
+    return !IsWrite(use.access) || use.load == RenderGraphLoad_Keep;
+}
+
+static u32 BytesPerPixel(GLenum internalFormat)
+{
+    switch (internalFormat)
+    {
+    case GL_R8:                return 1;
+    case GL_RG8:               return 2;
+    case GL_RGBA16F:           return 8;
+    case GL_RGBA32F:           return 16;
+    case GL_DEPTH32F_STENCIL8: return 8;
+    default:                   return 4;
+    }
+}
+
+static u64 TextureBytes(const RenderGraphTextureDesc& desc)
+{
+    return (u64)desc.size.x * desc.size.y * desc.samples * BytesPerPixel(desc.internalFormat);
+}
+
+static bool IsResizing(const RenderGraph& graph)
+{
+    return graph.stableFrames < RENDER_GRAPH_RESIZE_DEBOUNCE;
+}
+
+void BeginRenderGraph(RenderGraph& graph)
+{
+    graph.resources.clear();
+    graph.passes.clear();
+}
+
+u32 CreateRenderGraphTexture(RenderGraph& graph, const char* name, glm::ivec2 size, GLenum internalFormat, u32 samples)
+{
+    RenderGraphResource resource = {};
+    resource.name = name;
+    resource.desc = { size, internalFormat, samples };
+    resource.capacity = size;
+    resource.texture = RENDER_GRAPH_NONE;
+    graph.resources.push_back(resource);
+    return (u32)graph.resources.size() - 1;
+}
+
+u32 CreateRenderGraphScaledTexture(RenderGraph& graph, const char* name, glm::ivec2 size, glm::ivec2 capacity, GLenum internalFormat)
+{
+    assert(size.x <= capacity.x && size.y <= capacity.y);
+    const u32 resource = CreateRenderGraphTexture(graph, name, size, internalFormat);
+    graph.resources[resource].capacity = capacity;
+    return resource;
+}
+
+// Description a pooled texture needs to hold a resource
+static RenderGraphTextureDesc AllocationDesc(const RenderGraphResource& resource)
+{
+    RenderGraphTextureDesc desc = resource.desc;
+    desc.size = resource.capacity;
+    return desc;
+}
+
+u32 ImportRenderGraphTexture(RenderGraph& graph, const char* name, GLuint texture, glm::ivec2 size, GLenum internalFormat)
+{
+    const u32 resource = CreateRenderGraphTexture(graph, name, size, internalFormat);
+    graph.resources[resource].imported = true;
+    graph.resources[resource].importedTexture = texture;
+    return resource;
+}
+
+u32 ImportRenderGraphBackbuffer(RenderGraph& graph, glm::ivec2 size)
+{
+    // The first size is considered settled, the textures are created at their exact size
+    if (graph.backbufferSize == glm::ivec2(0))
+    {
+        graph.stableFrames = RENDER_GRAPH_RESIZE_DEBOUNCE;
+    }
+    else if (size != graph.backbufferSize)
+    {
+        graph.stableFrames = 0;
+    }
+    else if (graph.stableFrames < RENDER_GRAPH_RESIZE_DEBOUNCE)
+    {
+        graph.stableFrames++;
+    }
+    graph.backbufferSize = size;
+
+    const u32 resource = ImportRenderGraphTexture(graph, "Backbuffer", 0, size, GL_RGBA8);
+    graph.resources[resource].backbuffer = true;
+    return resource;
+}
+
+u32 AddRenderGraphPass(RenderGraph& graph, const char* name, RenderGraphExecute execute, bool sideEffects)
+{
+    RenderGraphPass pass = {};
+    pass.name = name;
+    pass.execute = execute;
+    pass.sideEffects = sideEffects;
+    pass.depthCopy = RENDER_GRAPH_NONE;
+    graph.passes.push_back(pass);
+    return (u32)graph.passes.size() - 1;
+}
+
+void ReadRenderGraphTexture(RenderGraph& graph, u32 pass, u32 resource, RenderGraphAccess access)
+{
+    assert(!IsWrite(access));
+    graph.passes[pass].uses.push_back({ resource, access, RenderGraphLoad_Keep, glm::vec4(0.0f) });
+}
+
+void WriteRenderGraphTexture(RenderGraph& graph, u32 pass, u32 resource, RenderGraphAccess access, RenderGraphLoad load, glm::vec4 clearValue)
+{
+    assert(IsWrite(access));
+    assert(access != RenderGraphAccess_Storage || load == RenderGraphLoad_Keep); // Storage is never attached, so never cleared
+    graph.passes[pass].uses.push_back({ resource, access, load, clearValue });
+}
+
+// Deletes the cached framebuffers a texture is attached to
+static void DeleteFramebuffers(RenderGraph& graph, GLuint handle)
+{
+    for (u32 i = 0; i < graph.framebuffers.size();)
+    {
+        RenderGraphFramebuffer& framebuffer = graph.framebuffers[i];
+        bool attached = framebuffer.depth == handle;
+        for (u32 c = 0; c < RENDER_GRAPH_MAX_COLOR_TARGETS; ++c)
+            attached |= framebuffer.colors[c] == handle;
+
+        if (attached)
+        {
+            glDeleteFramebuffers(1, &framebuffer.handle);
+            graph.framebuffers[i] = graph.framebuffers.back();
+            graph.framebuffers.pop_back();
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+static void DeleteTexture(RenderGraph& graph, u32 textureIdx)
+{
+    DeleteFramebuffers(graph, graph.textures[textureIdx].handle);
+
+    glDeleteTextures(1, &graph.textures[textureIdx].handle);
+    graph.textures[textureIdx] = graph.textures.back();
+    graph.textures.pop_back();
+}
+
+// Whether a resource can be placed in a pooled texture
+static bool FitsTexture(const RenderGraph& graph, const RenderGraphTextureDesc& texture, const RenderGraphTextureDesc& desc)
+{
+    if (texture.internalFormat != desc.internalFormat || texture.samples != desc.samples)
+        return false;
+
+    // Larger textures are only used while resizing, afterwards they are left to be released
+    if (IsResizing(graph))
+        return texture.size.x >= desc.size.x && texture.size.y >= desc.size.y;
+
+    return texture.size == desc.size;
+}
+
+// Finds the smallest free pooled texture the resource fits in, or creates one
+static u32 AcquireTexture(RenderGraph& graph, const RenderGraphTextureDesc& desc, u32 firstPass, u32 lastPass)
+{
+    u32 textureIdx = RENDER_GRAPH_NONE;
+    u64 textureArea = UINT64_MAX;
+    for (u32 i = 0; i < graph.textures.size(); ++i)
+    {
+        const RenderGraphTexture& texture = graph.textures[i];
+        const bool free = texture.busyUntilPass == RENDER_GRAPH_NONE || texture.busyUntilPass < firstPass;
+        const u64 area = (u64)texture.desc.size.x * texture.desc.size.y;
+        if (free && area < textureArea && FitsTexture(graph, texture.desc, desc))
+        {
+            textureIdx = i;
+            textureArea = area;
+        }
+    }
+
+    if (textureIdx == RENDER_GRAPH_NONE)
+    {
+        RenderGraphTexture texture = {};
+        texture.desc = desc;
+
+        // Room to grow, so dragging the window edge does not allocate every frame
+        if (IsResizing(graph))
+        {
+            const glm::ivec2 granularity = glm::ivec2(RENDER_GRAPH_SIZE_GRANULARITY);
+            texture.desc.size = (desc.size + granularity - 1) / granularity * granularity;
+        }
+
+        glGenTextures(1, &texture.handle);
+        if (desc.samples > 1)
+        {
+            glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, texture.handle);
+            glTexStorage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, desc.samples, desc.internalFormat, texture.desc.size.x, texture.desc.size.y, GL_TRUE);
+            glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+        }
+        else
+        {
+            glBindTexture(GL_TEXTURE_2D, texture.handle);
+            glTexStorage2D(GL_TEXTURE_2D, 1, desc.internalFormat, texture.desc.size.x, texture.desc.size.y);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+
+        graph.textures.push_back(texture);
+        graph.allocationCount++;
+        textureIdx = (u32)graph.textures.size() - 1;
+    }
+
+    RenderGraphTexture& texture = graph.textures[textureIdx];
+    if (texture.busyUntilPass == RENDER_GRAPH_NONE)
+        graph.pooledBytes += TextureBytes(texture.desc);
+    texture.busyUntilPass = lastPass;
+    texture.unusedFrames = 0;
+    return textureIdx;
+}
+
+void CompileRenderGraph(RenderGraph& graph)
+{
+    // Textures left unused for a while (usually after a resize) are released
+    for (u32 i = 0; i < graph.textures.size();)
+    {
+        RenderGraphTexture& texture = graph.textures[i];
+        texture.busyUntilPass = RENDER_GRAPH_NONE;
+        if (++texture.unusedFrames > RENDER_GRAPH_TEXTURE_LIFETIME)
+            DeleteTexture(graph, i);
+        else
+            ++i;
+    }
+
+    // Walking back from the last pass, a pass runs when it has side effects or writes something
+    // a later pass reads. A write that does not keep the contents ends the need for earlier writers.
+    std::vector<u8> needed(graph.resources.size(), 0);
+    graph.culledPassCount = 0;
+    for (u32 i = (u32)graph.passes.size(); i-- > 0;)
+    {
+        RenderGraphPass& pass = graph.passes[i];
+
+        bool alive = pass.sideEffects;
+        for (const RenderGraphUse& use : pass.uses)
+        {
+            if (IsWrite(use.access) && (graph.resources[use.resource].imported || needed[use.resource]))
+                alive = true;
+        }
+
+        pass.culled = !alive;
+        if (!alive)
+        {
+            graph.culledPassCount++;
+            continue;
+        }
+
+        for (const RenderGraphUse& use : pass.uses)
+        {
+            if (!IsRead(use))
+                needed[use.resource] = 0;
+        }
+        for (const RenderGraphUse& use : pass.uses)
+        {
+            if (IsRead(use))
+                needed[use.resource] = 1;
+        }
+    }
+
+    // Lifetimes of the resources among the passes that run
+    for (RenderGraphResource& resource : graph.resources)
+    {
+        resource.firstPass = RENDER_GRAPH_NONE;
+        resource.lastPass = 0;
+        resource.texture = RENDER_GRAPH_NONE;
+    }
+    for (u32 i = 0; i < graph.passes.size(); ++i)
+    {
+        if (graph.passes[i].culled)
+            continue;
+
+        for (const RenderGraphUse& use : graph.passes[i].uses)
+        {
+            RenderGraphResource& resource = graph.resources[use.resource];
+            resource.firstPass = glm::min(resource.firstPass, i);
+            resource.lastPass = glm::max(resource.lastPass, i);
+        }
+    }
+
+    // Pooled textures in pass order, so a texture is reused as soon as its last reader ran
+    graph.transientCount = 0;
+    graph.transientBytes = 0;
+    graph.pooledBytes = 0;
+    for (u32 i = 0; i < graph.passes.size(); ++i)
+    {
+        RenderGraphPass& pass = graph.passes[i];
+        pass.depthCopy = RENDER_GRAPH_NONE;
+        if (pass.culled)
+            continue;
+
+        for (u32 r = 0; r < graph.resources.size(); ++r)
+        {
+            RenderGraphResource& resource = graph.resources[r];
+            if (resource.imported || resource.firstPass != i)
+                continue;
+
+            resource.texture = AcquireTexture(graph, AllocationDesc(resource), i, resource.lastPass);
+            graph.transientCount++;
+            graph.transientBytes += TextureBytes(AllocationDesc(resource));
+        }
+
+        // A texture cannot be attached while the pass samples it, the pass tests a copy instead
+        for (const RenderGraphUse& depthUse : pass.uses)
+        {
+            if (depthUse.access != RenderGraphAccess_DepthTest)
+                continue;
+
+            for (const RenderGraphUse& use : pass.uses)
+            {
+                if (use.resource == depthUse.resource && use.access == RenderGraphAccess_Sample)
+                {
+                    pass.depthCopy = AcquireTexture(graph, AllocationDesc(graph.resources[use.resource]), i, i);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+GLuint GetRenderGraphTexture(const RenderGraph& graph, u32 resource)
+{
+    const RenderGraphResource& graphResource = graph.resources[resource];
+    if (graphResource.imported)
+        return graphResource.importedTexture;
+
+    return graphResource.texture != RENDER_GRAPH_NONE ? graph.textures[graphResource.texture].handle : 0;
+}
+
+void ReleaseRenderGraphTexture(RenderGraph& graph, GLuint texture)
+{
+    DeleteFramebuffers(graph, texture);
+}
+
+glm::vec2 GetRenderGraphTextureScale(const RenderGraph& graph, u32 resource)
+{
+    const RenderGraphResource& graphResource = graph.resources[resource];
+    if (graphResource.imported || graphResource.texture == RENDER_GRAPH_NONE)
+        return glm::vec2(1.0f);
+
+    return glm::vec2(graphResource.desc.size) / glm::vec2(graph.textures[graphResource.texture].desc.size);
+}
+
+static GLuint FindFramebuffer(RenderGraph& graph, const GLuint* colors, u32 colorCount, GLuint depth)
+{
+    GLuint key[RENDER_GRAPH_MAX_COLOR_TARGETS] = {};
+    for (u32 c = 0; c < colorCount; ++c)
+        key[c] = colors[c];
+
+    for (RenderGraphFramebuffer& framebuffer : graph.framebuffers)
+    {
+        if (framebuffer.depth == depth && memcmp(framebuffer.colors, key, sizeof(key)) == 0)
+        {
+            framebuffer.unusedFrames = 0;
+            return framebuffer.handle;
+        }
+    }
+
+    RenderGraphFramebuffer framebuffer = {};
+    memcpy(framebuffer.colors, key, sizeof(key));
+    framebuffer.depth = depth;
+
+    glGenFramebuffers(1, &framebuffer.handle);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.handle);
+
+    GLenum drawBuffers[RENDER_GRAPH_MAX_COLOR_TARGETS];
+    for (u32 c = 0; c < colorCount; ++c)
+    {
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + c, colors[c], 0);
+        drawBuffers[c] = GL_COLOR_ATTACHMENT0 + c;
+    }
+    if (depth != 0)
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth, 0);
+
+    if (colorCount > 0)
+        glDrawBuffers(colorCount, drawBuffers);
+    else
+        glDrawBuffer(GL_NONE);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        ELOG("Render graph framebuffer is incomplete");
+
+    graph.framebuffers.push_back(framebuffer);
+    return framebuffer.handle;
+}
+
+// Scaled when the sizes differ, as when a lower resolution scene is tested in the backbuffer
+static void CopyDepth(RenderGraph& graph, GLuint source, glm::ivec2 sourceSize, GLuint destinationFramebuffer, glm::ivec2 destinationSize)
+{
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, FindFramebuffer(graph, NULL, 0, source));
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, destinationFramebuffer);
+    glBlitFramebuffer(0, 0, sourceSize.x, sourceSize.y, 0, 0, destinationSize.x, destinationSize.y, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    graph.blitCount++;
+}
+
+// Binds the targets of a pass, with the clears and depth copies they need
+static void BindPassTargets(RenderGraph& graph, const RenderGraphPass& pass)
+{
+    GLuint colors[RENDER_GRAPH_MAX_COLOR_TARGETS] = {};
+    u32 colorCount = 0;
+    const RenderGraphUse* depthUse = NULL;
+    bool backbuffer = false;
+    glm::ivec2 size = glm::ivec2(0);
+
+    for (const RenderGraphUse& use : pass.uses)
+    {
+        const RenderGraphResource& resource = graph.resources[use.resource];
+        if (use.access == RenderGraphAccess_ColorTarget)
+        {
+            if (resource.backbuffer)
+            {
+                backbuffer = true;
+            }
+            else
+            {
+                assert(colorCount < RENDER_GRAPH_MAX_COLOR_TARGETS);
+                colors[colorCount++] = GetRenderGraphTexture(graph, use.resource);
+            }
+            size = resource.desc.size;
+        }
+        else if (use.access == RenderGraphAccess_DepthTarget || use.access == RenderGraphAccess_DepthTest)
+        {
+            depthUse = &use;
+            if (size == glm::ivec2(0))
+                size = resource.desc.size;
+        }
+    }
+
+    if (colorCount == 0 && !backbuffer && depthUse == NULL)
+        return;
+
+    // The default framebuffer has its own color and depth, it cannot be mixed with textures
+    assert(!backbuffer || colorCount == 0);
+
+    GLuint depth = 0;
+    if (depthUse != NULL)
+    {
+        const RenderGraphResource& resource = graph.resources[depthUse->resource];
+        if (backbuffer && !resource.backbuffer)
+        {
+            // Copied once, until the texture is written again
+            if (graph.backbufferDepthSource != depthUse->resource || graph.backbufferDepthVersion != resource.version)
+            {
+                CopyDepth(graph, GetRenderGraphTexture(graph, depthUse->resource), resource.desc.size, 0, size);
+                graph.backbufferDepthSource = depthUse->resource;
+                graph.backbufferDepthVersion = resource.version;
+            }
+        }
+        else if (pass.depthCopy != RENDER_GRAPH_NONE)
+        {
+            depth = graph.textures[pass.depthCopy].handle;
+            CopyDepth(graph, GetRenderGraphTexture(graph, depthUse->resource), resource.desc.size, FindFramebuffer(graph, NULL, 0, depth), resource.desc.size);
+        }
+        else if (!resource.backbuffer)
+        {
+            depth = GetRenderGraphTexture(graph, depthUse->resource);
+        }
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, backbuffer ? 0 : FindFramebuffer(graph, colors, colorCount, depth));
+    glViewport(0, 0, size.x, size.y);
+
+    // Clears only where the pass asked for it or the target holds nothing from this frame,
+    // and only the part of the textures the resources cover
+    GLenum invalidated[RENDER_GRAPH_MAX_COLOR_TARGETS + 1];
+    u32 invalidatedCount = 0;
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthMask(GL_TRUE);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(0, 0, size.x, size.y);
+
+    u32 colorIdx = 0;
+    for (const RenderGraphUse& use : pass.uses)
+    {
+        if (use.access != RenderGraphAccess_ColorTarget && use.access != RenderGraphAccess_DepthTarget)
+            continue;
+
+        const bool color = use.access == RenderGraphAccess_ColorTarget;
+        const GLint drawBuffer = color && !backbuffer ? colorIdx++ : 0;
+        const bool firstWrite = graph.resources[use.resource].version == 0;
+
+        if (use.load == RenderGraphLoad_Clear || (use.load == RenderGraphLoad_Keep && firstWrite))
+        {
+            const glm::vec4 value = use.load == RenderGraphLoad_Clear ? use.clearValue : glm::vec4(color ? 0.0f : 1.0f);
+            glClearBufferfv(color ? GL_COLOR : GL_DEPTH, drawBuffer, &value.x);
+            graph.clearCount++;
+        }
+        else if (use.load == RenderGraphLoad_DontCare)
+        {
+            if (backbuffer)
+                invalidated[invalidatedCount++] = color ? GL_COLOR : GL_DEPTH;
+            else
+                invalidated[invalidatedCount++] = color ? GL_COLOR_ATTACHMENT0 + drawBuffer : GL_DEPTH_ATTACHMENT;
+        }
+    }
+
+    glDisable(GL_SCISSOR_TEST);
+
+    if (invalidatedCount > 0)
+        glInvalidateSubFramebuffer(GL_FRAMEBUFFER, invalidatedCount, invalidated, 0, 0, size.x, size.y);
+}
+
+void ExecuteRenderGraph(RenderGraph& graph, App* app)
+{
+    graph.clearCount = 0;
+    graph.blitCount = 0;
+    graph.backbufferDepthSource = RENDER_GRAPH_NONE;
+    for (RenderGraphResource& resource : graph.resources)
+        resource.version = 0;
+
+    for (RenderGraphFramebuffer& framebuffer : graph.framebuffers)
+        framebuffer.unusedFrames++;
+
+    for (const RenderGraphPass& pass : graph.passes)
+    {
+        if (pass.culled)
+            continue;
+
+        if (app->enableDebugGroup)
+        {
+            glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 1, -1, pass.name);
+        }
+
+        BindPassTargets(graph, pass);
+        pass.execute(app);
+
+        for (const RenderGraphUse& use : pass.uses)
+        {
+            if (IsWrite(use.access))
+                graph.resources[use.resource].version++;
+        }
+
+        if (app->enableDebugGroup)
+        {
+            glPopDebugGroup();
+        }
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // Framebuffers of targets that are still pooled but no longer used together
+    for (u32 i = 0; i < graph.framebuffers.size();)
+    {
+        if (graph.framebuffers[i].unusedFrames > RENDER_GRAPH_TEXTURE_LIFETIME)
+        {
+            glDeleteFramebuffers(1, &graph.framebuffers[i].handle);
+            graph.framebuffers[i] = graph.framebuffers.back();
+            graph.framebuffers.pop_back();
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
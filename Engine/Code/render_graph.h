@@ -0,0 +1,173 @@
+//
+// render_graph.h: Frame graph of the render passes. Every frame the passes are declared with
+// the textures they read and write, passes whose outputs nobody reads are culled, transient
+// textures with disjoint lifetimes share the same pooled GL texture, and the graph binds the
+// framebuffers, clears the targets that need it and copies depth where a pass cannot attach it.
+//
+// Pooled textures can be larger than the resources placed in them, the passes then render
+// into the bottom left corner. While the window is being resized the pool only grows, in
+// steps of RENDER_GRAPH_SIZE_GRANULARITY, and once the size has settled the targets are
+// allocated again at their exact size.
+//
+
+#pragma once
+
+#include <glad/glad.h>
+
+#include "platform.h"
+
+#define RENDER_GRAPH_MAX_COLOR_TARGETS 4
+#define RENDER_GRAPH_TEXTURE_LIFETIME  8  // Frames a pooled texture or framebuffer survives unused
+#define RENDER_GRAPH_NONE              UINT32_MAX
+#define RENDER_GRAPH_SIZE_GRANULARITY  256 // Pixels textures grow by while the window is being resized
+#define RENDER_GRAPH_RESIZE_DEBOUNCE   30  // Frames the backbuffer size has to stay the same before textures fit it exactly
+
+struct App;
+
+enum RenderGraphAccess
+{
+    RenderGraphAccess_Sample,      // Read by the shaders of the pass
+    RenderGraphAccess_DepthTest,   // Depth attachment the pass tests against without writing
+    RenderGraphAccess_ColorTarget, // Color attachment
+    RenderGraphAccess_DepthTarget, // Depth attachment
+    RenderGraphAccess_Storage      // Written by the pass itself (its own framebuffers, image stores)
+};
+
+// What a write does with the previous contents of the target
+enum RenderGraphLoad
+{
+    RenderGraphLoad_Keep,     // Drawn on top, cleared first when nothing wrote it yet this frame
+    RenderGraphLoad_Clear,
+    RenderGraphLoad_DontCare  // The pass covers every pixel, the contents are invalidated
+};
+
+struct RenderGraphTextureDesc
+{
+    glm::ivec2 size;
+    GLenum     internalFormat;
+    u32        samples;        // 1 for GL_TEXTURE_2D, more for GL_TEXTURE_2D_MULTISAMPLE
+};
+
+struct RenderGraphResource
+{
+    const char*            name;
+    RenderGraphTextureDesc desc;        // Size the passes render at
+    glm::ivec2             capacity;    // Size the texture is allocated at
+    GLuint                 importedTexture;
+    bool                   imported;    // Owned outside of the graph, its contents outlive the frame
+    bool                   backbuffer;  // The default framebuffer, only usable as a target
+
+    // Set by CompileRenderGraph()
+    u32                    firstPass;   // Lifetime among the passes that are not culled
+    u32                    lastPass;
+    u32                    texture;     // Pooled texture of a transient resource
+
+    // Set by ExecuteRenderGraph()
+    u32                    version;     // Writes so far this frame
+};
+
+struct RenderGraphUse
+{
+    u32               resource;
+    RenderGraphAccess access;
+    RenderGraphLoad   load;
+    glm::vec4         clearValue; // Color, or the depth in x, for RenderGraphLoad_Clear
+};
+
+typedef void (*RenderGraphExecute)(App* app);
+
+struct RenderGraphPass
+{
+    const char*                 name;
+    RenderGraphExecute          execute;
+    std::vector<RenderGraphUse> uses;
+    bool                        sideEffects; // Kept even when nothing reads its outputs
+    bool                        culled;
+    u32                         depthCopy;   // Pooled texture the depth is copied to when the pass also samples it
+};
+
+struct RenderGraphTexture
+{
+    GLuint                 handle;
+    RenderGraphTextureDesc desc;          // Allocated size, at least the size of the resources placed in it
+    u32                    busyUntilPass; // Last pass of the resource using it, RENDER_GRAPH_NONE when free
+    u32                    unusedFrames;
+};
+
+struct RenderGraphFramebuffer
+{
+    GLuint handle;
+    GLuint colors[RENDER_GRAPH_MAX_COLOR_TARGETS];
+    GLuint depth;
+    u32    unusedFrames;
+};
+
+struct RenderGraph
+{
+    // Declared every frame
+    std::vector<RenderGraphResource> resources;
+    std::vector<RenderGraphPass>     passes;
+
+    // Kept across frames
+    std::vector<RenderGraphTexture>     textures;
+    std::vector<RenderGraphFramebuffer> framebuffers;
+
+    // Depth resource (and its version) last copied into the default framebuffer
+    u32 backbufferDepthSource;
+    u32 backbufferDepthVersion;
+
+    // Resize debouncing
+    glm::ivec2 backbufferSize;
+    u32        stableFrames;   // Frames since the backbuffer size last changed
+
+    // Stats of the last frame
+    u32 culledPassCount;
+    u32 transientCount;
+    u64 transientBytes; // What the transient resources would take without aliasing
+    u64 pooledBytes;    // What the pooled textures used this frame take
+    u32 clearCount;
+    u32 blitCount;
+    u32 allocationCount; // Textures created since startup
+};
+
+// Drops the passes and resources of the previous frame, the pooled textures are kept
+void BeginRenderGraph(RenderGraph& graph);
+
+// Resources, the returned index is used to declare the accesses of the passes. The size of
+// the backbuffer is the one the resize debouncing follows.
+u32 CreateRenderGraphTexture(RenderGraph& graph, const char* name, glm::ivec2 size, GLenum internalFormat, u32 samples = 1);
+// Rendered at a size that changes from frame to frame up to capacity, the texture is allocated at capacity
+u32 CreateRenderGraphScaledTexture(RenderGraph& graph, const char* name, glm::ivec2 size, glm::ivec2 capacity, GLenum internalFormat);
+u32 ImportRenderGraphTexture(RenderGraph& graph, const char* name, GLuint texture, glm::ivec2 size, GLenum internalFormat);
+u32 ImportRenderGraphBackbuffer(RenderGraph& graph, glm::ivec2 size);
+
+// Forgets the framebuffers of an imported texture, call it before deleting the texture
+void ReleaseRenderGraphTexture(RenderGraph& graph, GLuint texture);
+
+u32  AddRenderGraphPass(RenderGraph& graph, const char* name, RenderGraphExecute execute, bool sideEffects = false);
+void ReadRenderGraphTexture(RenderGraph& graph, u32 pass, u32 resource, RenderGraphAccess access = RenderGraphAccess_Sample);
+void WriteRenderGraphTexture(RenderGraph& graph, u32 pass, u32 resource, RenderGraphAccess access,
+                             RenderGraphLoad load = RenderGraphLoad_Keep, glm::vec4 clearValue = glm::vec4(0.0f));
+
+/**
+ * Culls the passes that do not contribute to the backbuffer or an imported texture, walking
+ * back from the last pass, then assigns a pooled texture to every transient resource. A
+ * texture is shared by resources of the same format and sample count whose lifetimes do not
+ * overlap, and that fit in it: exactly once the size is stable, anywhere inside it while the
+ * window is being resized.
+ */
+void CompileRenderGraph(RenderGraph& graph);
+
+/**
+ * Runs the passes left by CompileRenderGraph() in declaration order. Before each one the
+ * graph binds a framebuffer with its targets, sets the viewport to the size of the
+ * resources, clears the targets that ask for it (or that nothing wrote yet) and copies the
+ * depth it tests against when the texture cannot be attached.
+ */
+void ExecuteRenderGraph(RenderGraph& graph, App* app);
+
+// GL texture of a resource, only valid while the graph executes
+GLuint GetRenderGraphTexture(const RenderGraph& graph, u32 resource);
+
+// Part of its texture a resource covers, to scale the texture coordinates that sample it
+glm::vec2 GetRenderGraphTextureScale(const RenderGraph& graph, u32 resource);
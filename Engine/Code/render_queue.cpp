@@ -0,0 +1,103 @@
+#include "render_queue.h"
+
+#define SORT_KEY_DEPTH_SHIFT    0
+#define SORT_KEY_SUBMESH_SHIFT  (SORT_KEY_DEPTH_SHIFT + SORT_KEY_DEPTH_BITS)
+#define SORT_KEY_MATERIAL_SHIFT (SORT_KEY_SUBMESH_SHIFT + SORT_KEY_SUBMESH_BITS)
+#define SORT_KEY_PROGRAM_SHIFT  (SORT_KEY_MATERIAL_SHIFT + SORT_KEY_MATERIAL_BITS)
+#define SORT_KEY_PASS_SHIFT     (SORT_KEY_PROGRAM_SHIFT + SORT_KEY_PROGRAM_BITS)
+
+static u64 KeyField(u64 value, u32 bits, u32 shift)
+{
+    return (value & ((1ull << bits) - 1ull)) << shift;
+}
+
+u64 MakeSortKey(RenderPassId pass, u32 programIdx, u32 materialIdx, u32 submeshSortIdx, f32 viewDepth, f32 zfar)
+{
+    const u32 maxDepth = (1u << SORT_KEY_DEPTH_BITS) - 1u;
+    const f32 normalizedDepth = glm::clamp(viewDepth / zfar, 0.0f, 1.0f);
+    const u32 depth = (u32)(normalizedDepth * (f32)maxDepth);
+
+    return KeyField(pass, SORT_KEY_PASS_BITS, SORT_KEY_PASS_SHIFT) |
+           KeyField(programIdx, SORT_KEY_PROGRAM_BITS, SORT_KEY_PROGRAM_SHIFT) |
+           KeyField(materialIdx, SORT_KEY_MATERIAL_BITS, SORT_KEY_MATERIAL_SHIFT) |
+           KeyField(submeshSortIdx, SORT_KEY_SUBMESH_BITS, SORT_KEY_SUBMESH_SHIFT) |
+           KeyField(depth, SORT_KEY_DEPTH_BITS, SORT_KEY_DEPTH_SHIFT);
+}
+
+void ClearRenderQueue(RenderQueue& queue)
+{
+    queue.packets.clear();
+    queue.items.clear();
+}
+
+void SubmitDrawPacket(RenderQueue& queue, u64 sortKey, const DrawPacket& packet)
+{
+    SortItem item = { sortKey, (u32)queue.packets.size() };
+    queue.packets.push_back(packet);
+    queue.items.push_back(item);
+}
+
+void SortRenderQueue(RenderQueue& queue)
+{
+    const u32 count = (u32)queue.items.size();
+    if (count < 2)
+        return;
+
+    queue.scratch.resize(count);
+
+    // One histogram per key byte, all of them computed in a single sweep
+    u32 histograms[8][256] = {};
+    for (u32 i = 0; i < count; ++i)
+    {
+        u64 key = queue.items[i].key;
+        for (u32 byte = 0; byte < 8; ++byte)
+            histograms[byte][(key >> (byte * 8)) & 0xFF]++;
+    }
+
+    SortItem* src = queue.items.data();
+    SortItem* dst = queue.scratch.data();
+
+    for (u32 byte = 0; byte < 8; ++byte)
+    {
+        u32* histogram = histograms[byte];
+
+        // All the keys share this byte, the pass would not move anything
+        const u32 firstBucket = (src[0].key >> (byte * 8)) & 0xFF;
+        if (histogram[firstBucket] == count)
+            continue;
+
+        u32 offset = 0;
+        for (u32 bucket = 0; bucket < 256; ++bucket)
+        {
+            u32 bucketCount = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += bucketCount;
+        }
+
+        for (u32 i = 0; i < count; ++i)
+        {
+            const u32 bucket = (src[i].key >> (byte * 8)) & 0xFF;
+            dst[histogram[bucket]++] = src[i];
+        }
+
+        SortItem* tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    if (src != queue.items.data())
+        queue.items.swap(queue.scratch);
+}
+
+void GetRenderPassRange(const RenderQueue& queue, RenderPassId pass, u32& begin, u32& end)
+{
+    const u32 count = (u32)queue.items.size();
+
+    begin = 0;
+    while (begin < count && (queue.items[begin].key >> SORT_KEY_PASS_SHIFT) < (u64)pass)
+        ++begin;
+
+    end = begin;
+    while (end < count && (queue.items[end].key >> SORT_KEY_PASS_SHIFT) == (u64)pass)
+        ++end;
+}
@@ -0,0 +1,62 @@
+//
+// render_queue.h: Per-frame list of draw packets ordered by a 64-bit sort key.
+// Passes submit their draws, the queue is radix-sorted once and each pass then
+// executes its contiguous range with the minimum amount of state changes.
+//
+
+#pragma once
+
+#include "platform.h"
+
+enum RenderPassId
+{
+    RenderPass_Geometry,
+    RenderPass_Count
+};
+
+// Sort key layout, from the most to the least significant bits:
+// | pass (4) | program (8) | material (16) | submesh (16) | depth (20) |
+// The submesh field holds the dense index every submesh gets when it is loaded, so the draws
+// of a submesh stay together. Within a bucket the draws end up ordered front to back.
+#define SORT_KEY_PASS_BITS     4
+#define SORT_KEY_PROGRAM_BITS  8
+#define SORT_KEY_MATERIAL_BITS 16
+#define SORT_KEY_SUBMESH_BITS  16
+#define SORT_KEY_DEPTH_BITS    20
+
+struct DrawPacket
+{
+    u32 programIdx;
+    u32 meshIdx;
+    u32 submeshIdx;
+    u32 materialIdx;
+    u32 entityIdx;
+};
+
+struct SortItem
+{
+    u64 key;
+    u32 packetIdx;
+};
+
+struct RenderQueue
+{
+    std::vector<DrawPacket> packets;
+    std::vector<SortItem>   items;
+    std::vector<SortItem>   scratch;
+};
+
+/**
+ * Builds the sort key of a draw. The view depth is quantized in [0, zfar], so
+ * opaque draws sharing the same state are issued front to back (early-z friendly).
+ */
+u64 MakeSortKey(RenderPassId pass, u32 programIdx, u32 materialIdx, u32 submeshSortIdx, f32 viewDepth, f32 zfar);
+
+void ClearRenderQueue(RenderQueue& queue);
+void SubmitDrawPacket(RenderQueue& queue, u64 sortKey, const DrawPacket& packet);
+
+// LSD radix sort of the submitted keys (8 bits per pass, passes with a single bucket are skipped)
+void SortRenderQueue(RenderQueue& queue);
+
+// Range [begin, end) of the sorted items that belong to a pass
+void GetRenderPassRange(const RenderQueue& queue, RenderPassId pass, u32& begin, u32& end);
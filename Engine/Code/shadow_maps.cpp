@@ -0,0 +1,385 @@
+#include "shadow_maps.h"
+#include "engine.h"
+
+#include <float.h>
+
+#define SHADOW_SLOPE_BIAS    2.0f  // glPolygonOffset factors of the caster depth
+#define SHADOW_CONSTANT_BIAS 4.0f
+#define SHADOW_DEPTH_MARGIN  1.0f  // World units added in front of and behind the scene bounds
+
+// Cascades below this one are rendered every frame, the others are cached
+#define SHADOW_FIRST_CACHED_CASCADE 1
+
+void InitShadowMaps(App* app)
+{
+    ShadowMaps& shadows = app->shadowMaps;
+
+    const u32 layerCount = SHADOW_MAX_LIGHTS * SHADOW_CASCADE_COUNT;
+    glGenTextures(1, &shadows.texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, shadows.texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, layerCount, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+
+    // Linear filtering with the comparison enabled gives a bilinear PCF tap per fetch
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenFramebuffers(1, &shadows.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, shadows.framebuffer);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+
+    // Layers that were never rendered read as fully lit
+    for (u32 layer = 0; layer < layerCount; ++layer)
+    {
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadows.texture, 0, layer);
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    shadows.programIdx = LoadProgram(app, "shadow_map_shader.glsl", "SHADOW_MAP_SHADER");
+    Program& program = app->programs[shadows.programIdx];
+    shadows.uniformWorldViewProjection = FindUniformLocation(program.reflection, "uWorldViewProjectionMatrix");
+
+    for (u32 slot = 0; slot < SHADOW_MAX_LIGHTS; ++slot)
+    {
+        shadows.lightIndices[slot] = UINT32_MAX;
+        for (u32 cascade = 0; cascade < SHADOW_CASCADE_COUNT; ++cascade)
+            shadows.cascades[slot][cascade] = {};
+    }
+    shadows.frame = 0;
+}
+
+// Rotation of the light space, it only depends on the light direction so the texel grid
+// stays fixed in the world while the camera moves
+static glm::mat4 LightViewMatrix(const glm::vec3& direction)
+{
+    const glm::vec3 up = fabsf(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    return glm::lookAt(glm::vec3(0.0f), direction, up);
+}
+
+static void ComputeCascadeSplits(ShadowMaps& shadows, f32 znear, f32 zfar)
+{
+    const f32 distance = glm::min(SHADOW_DISTANCE, zfar);
+    for (u32 cascade = 0; cascade < SHADOW_CASCADE_COUNT; ++cascade)
+    {
+        const f32 t = (f32)(cascade + 1) / SHADOW_CASCADE_COUNT;
+        const f32 logSplit = znear * powf(distance / znear, t);
+        const f32 uniformSplit = znear + (distance - znear) * t;
+        shadows.splits[cascade] = SHADOW_SPLIT_LAMBDA * logSplit + (1.0f - SHADOW_SPLIT_LAMBDA) * uniformSplit;
+    }
+}
+
+// Smallest sphere around the slice of the view frustum between two view depths. Its radius
+// only depends on the projection, so the cascade size does not change as the camera turns.
+static void FitSliceSphere(const Camera& camera, f32 nearDepth, f32 farDepth, glm::vec3& center, f32& radius)
+{
+    // Squared distance to the view axis of the frustum corners, per unit of depth
+    const glm::mat4 inverseProjection = glm::inverse(camera.projection);
+    f32 cornerSlope2 = 0.0f;
+    for (u32 i = 0; i < 4; ++i)
+    {
+        const glm::vec4 corner = inverseProjection * glm::vec4(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, -1.0f, 1.0f);
+        const glm::vec3 ray = glm::vec3(corner) / -corner.z;
+        cornerSlope2 = glm::max(cornerSlope2, ray.x * ray.x + ray.y * ray.y);
+    }
+
+    // Point of the view axis as far from the near corners as from the far corners
+    f32 centerDepth = 0.5f * (nearDepth + farDepth) * (1.0f + cornerSlope2);
+    centerDepth = glm::min(centerDepth, farDepth);
+    radius = sqrtf((farDepth - centerDepth) * (farDepth - centerDepth) + cornerSlope2 * farDepth * farDepth);
+
+    // Rounding keeps the texel size constant against float noise
+    radius = ceilf(radius * 16.0f) / 16.0f;
+
+    const glm::mat4 inverseView = glm::inverse(camera.viewMatrix);
+    center = glm::vec3(inverseView * glm::vec4(0.0f, 0.0f, -centerDepth, 1.0f));
+}
+
+// True when the light space square covers the whole sphere
+static bool CascadeCovers(const ShadowCascade& cascade, const glm::vec2& center, f32 radius)
+{
+    const glm::vec2 offset = glm::abs(center - cascade.center);
+    return glm::max(offset.x, offset.y) + radius <= cascade.halfExtent;
+}
+
+static void FitCascade(ShadowCascade& cascade, const glm::mat4& lightView, const glm::vec3& lightDirection, const glm::vec2& center,
+                       f32 halfExtent, const Aabb& sceneBounds)
+{
+    // Snapping the center to whole texels moves the map by texel steps only, the shadow
+    // edges stay in place instead of crawling
+    const f32 texelSize = 2.0f * halfExtent / SHADOW_MAP_SIZE;
+    const glm::vec2 snappedCenter = glm::floor(center / texelSize) * texelSize;
+
+    // Depth range of every caster and receiver of the scene, the map only has to be
+    // precise along the slice but casters in front of it must not be clipped
+    f32 minZ = FLT_MAX;
+    f32 maxZ = -FLT_MAX;
+    for (u32 i = 0; i < 8; ++i)
+    {
+        const glm::vec3 corner = glm::vec3(i & 1 ? sceneBounds.max.x : sceneBounds.min.x,
+                                           i & 2 ? sceneBounds.max.y : sceneBounds.min.y,
+                                           i & 4 ? sceneBounds.max.z : sceneBounds.min.z);
+        const f32 z = (lightView * glm::vec4(corner, 1.0f)).z;
+        minZ = glm::min(minZ, z);
+        maxZ = glm::max(maxZ, z);
+    }
+
+    const glm::mat4 projection = glm::ortho(snappedCenter.x - halfExtent, snappedCenter.x + halfExtent,
+                                            snappedCenter.y - halfExtent, snappedCenter.y + halfExtent,
+                                            -maxZ - SHADOW_DEPTH_MARGIN, -minZ + SHADOW_DEPTH_MARGIN);
+
+    cascade.viewProjection = projection * lightView;
+    cascade.lightDirection = lightDirection;
+    cascade.center = snappedCenter;
+    cascade.halfExtent = halfExtent;
+    cascade.texelSize = texelSize;
+    cascade.pending = true;
+}
+
+void UpdateShadowCascades(App* app)
+{
+    ShadowMaps& shadows = app->shadowMaps;
+    shadows.frame++;
+
+    // The first directional lights of the list cast the shadows
+    u32 slot = 0;
+    for (u32 i = 0; i < app->lights.size() && slot < SHADOW_MAX_LIGHTS; ++i)
+    {
+        if (app->lights[i].type != LightType_Directional)
+            continue;
+
+        if (shadows.lightIndices[slot] != i)
+        {
+            shadows.lightIndices[slot] = i;
+            for (u32 cascade = 0; cascade < SHADOW_CASCADE_COUNT; ++cascade)
+                shadows.cascades[slot][cascade].valid = false;
+        }
+        slot++;
+    }
+    for (; slot < SHADOW_MAX_LIGHTS; ++slot)
+        shadows.lightIndices[slot] = UINT32_MAX;
+
+    // A layer fitted last frame but never rendered (the deferred path was off) no longer
+    // matches its matrix
+    for (u32 s = 0; s < SHADOW_MAX_LIGHTS; ++s)
+    {
+        for (u32 cascade = 0; cascade < SHADOW_CASCADE_COUNT; ++cascade)
+        {
+            ShadowCascade& layer = shadows.cascades[s][cascade];
+            if (layer.pending)
+                layer.valid = false;
+            layer.pending = false;
+        }
+    }
+
+    if (!app->enableShadows || app->entityTree.root == AABB_TREE_NULL_NODE)
+        return;
+
+    const Aabb& sceneBounds = app->entityTree.nodes[app->entityTree.root].aabb;
+    ComputeCascadeSplits(shadows, app->camera.znear, app->camera.zfar);
+
+    glm::vec3 sliceCenters[SHADOW_CASCADE_COUNT];
+    f32 sliceRadii[SHADOW_CASCADE_COUNT];
+    for (u32 cascade = 0; cascade < SHADOW_CASCADE_COUNT; ++cascade)
+    {
+        const f32 nearDepth = cascade == 0 ? app->camera.znear : shadows.splits[cascade - 1];
+        FitSliceSphere(app->camera, nearDepth, shadows.splits[cascade], sliceCenters[cascade], sliceRadii[cascade]);
+    }
+
+    // Cached cascades that need a new map, the ones that no longer cover their slice first
+    // (the shaders fall back to the next cascade meanwhile), nearer cascades before farther
+    u32 budget = SHADOW_MAX_CACHED_UPDATES_PER_FRAME;
+    for (u32 pass = 0; pass < 2; ++pass)
+    {
+        for (u32 cascade = 0; cascade < SHADOW_CASCADE_COUNT; ++cascade)
+        {
+            for (u32 s = 0; s < SHADOW_MAX_LIGHTS; ++s)
+            {
+                if (shadows.lightIndices[s] == UINT32_MAX)
+                    continue;
+
+                ShadowCascade& layer = shadows.cascades[s][cascade];
+                const glm::vec3 lightDirection = glm::normalize(app->lights[shadows.lightIndices[s]].direction);
+                const glm::mat4 lightView = LightViewMatrix(lightDirection);
+                const glm::vec2 center = glm::vec2(lightView * glm::vec4(sliceCenters[cascade], 1.0f));
+
+                if (cascade < SHADOW_FIRST_CACHED_CASCADE)
+                {
+                    if (pass == 0)
+                        FitCascade(layer, lightView, lightDirection, center, sliceRadii[cascade], sceneBounds);
+                    continue;
+                }
+
+                if (layer.pending || budget == 0)
+                    continue;
+
+                const f32 halfExtent = sliceRadii[cascade] * SHADOW_CACHE_PADDING;
+                const bool uncovered = !layer.valid || layer.lightDirection != lightDirection || layer.halfExtent != halfExtent ||
+                                       !CascadeCovers(layer, center, sliceRadii[cascade]);
+                const bool update = pass == 0 ? uncovered : layer.stale;
+                if (update)
+                {
+                    FitCascade(layer, lightView, lightDirection, center, halfExtent, sceneBounds);
+                    budget--;
+                }
+            }
+        }
+    }
+}
+
+void InvalidateShadowMaps(ShadowMaps& shadows, const Aabb& bounds)
+{
+    for (u32 slot = 0; slot < SHADOW_MAX_LIGHTS; ++slot)
+    {
+        for (u32 cascade = SHADOW_FIRST_CACHED_CASCADE; cascade < SHADOW_CASCADE_COUNT; ++cascade)
+        {
+            ShadowCascade& layer = shadows.cascades[slot][cascade];
+            if (!layer.valid || layer.stale)
+                continue;
+
+            // The depth range spans the whole scene, only the light space square matters
+            glm::vec2 boxMin = glm::vec2(FLT_MAX);
+            glm::vec2 boxMax = glm::vec2(-FLT_MAX);
+            for (u32 i = 0; i < 8; ++i)
+            {
+                const glm::vec3 corner = glm::vec3(i & 1 ? bounds.max.x : bounds.min.x,
+                                                   i & 2 ? bounds.max.y : bounds.min.y,
+                                                   i & 4 ? bounds.max.z : bounds.min.z);
+                const glm::vec2 clip = glm::vec2(layer.viewProjection * glm::vec4(corner, 1.0f));
+                boxMin = glm::min(boxMin, clip);
+                boxMax = glm::max(boxMax, clip);
+            }
+
+            if (boxMax.x >= -1.0f && boxMin.x <= 1.0f && boxMax.y >= -1.0f && boxMin.y <= 1.0f)
+                layer.stale = true;
+        }
+    }
+}
+
+void PushShadowParams(App* app, Buffer& buffer)
+{
+    const ShadowMaps& shadows = app->shadowMaps;
+
+    // Light clip space to texture space
+    const glm::mat4 bias = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
+
+    for (u32 slot = 0; slot < SHADOW_MAX_LIGHTS; ++slot)
+    {
+        for (u32 cascade = 0; cascade < SHADOW_CASCADE_COUNT; ++cascade)
+        {
+            // A zero matrix puts every pixel outside of a layer without a map, the shaders move
+            // on to the next cascade
+            const ShadowCascade& layer = shadows.cascades[slot][cascade];
+            const glm::mat4 shadowMatrix = layer.valid || layer.pending ? bias * layer.viewProjection : glm::mat4(0.0f);
+            PushMat4(buffer, shadowMatrix);
+        }
+    }
+
+    glm::vec4 splits;
+    for (u32 cascade = 0; cascade < SHADOW_CASCADE_COUNT; ++cascade)
+        splits[cascade] = shadows.splits[cascade];
+    PushVec4(buffer, splits);
+
+    for (u32 slot = 0; slot < SHADOW_MAX_LIGHTS; ++slot)
+    {
+        glm::vec4 texelSizes;
+        for (u32 cascade = 0; cascade < SHADOW_CASCADE_COUNT; ++cascade)
+            texelSizes[cascade] = shadows.cascades[slot][cascade].texelSize;
+        PushVec4(buffer, texelSizes);
+    }
+
+    // The shaders skip the shadow lookups of the slots left unused (uvec4, up to 4 lights)
+    for (u32 slot = 0; slot < 4; ++slot)
+    {
+        const bool active = app->enableShadows && slot < SHADOW_MAX_LIGHTS && shadows.lightIndices[slot] != UINT32_MAX;
+        PushUInt(buffer, active ? shadows.lightIndices[slot] : UINT32_MAX);
+    }
+}
+
+void RenderShadowMaps(App* app)
+{
+    ShadowMaps& shadows = app->shadowMaps;
+    shadows.renderedCascades = 0;
+    shadows.renderedCasters = 0;
+
+    if (app->enableDebugGroup)
+    {
+        glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 1, -1, "Shadow maps");
+    }
+
+    Program& program = app->programs[shadows.programIdx];
+    glUseProgram(program.handle);
+    glBindFramebuffer(GL_FRAMEBUFFER, shadows.framebuffer);
+    glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+
+    // Casters in front of the near plane are clamped to it instead of being clipped, and the
+    // slope-scaled offset keeps the lit surfaces from shadowing themselves
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_TRUE);
+    glEnable(GL_DEPTH_CLAMP);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(SHADOW_SLOPE_BIAS, SHADOW_CONSTANT_BIAS);
+
+    // Depth only needs the positions, every mesh goes through the shared static geometry
+    glBindVertexArray(app->staticGeometry.vao);
+
+    for (u32 slot = 0; slot < SHADOW_MAX_LIGHTS; ++slot)
+    {
+        for (u32 cascade = 0; cascade < SHADOW_CASCADE_COUNT; ++cascade)
+        {
+            ShadowCascade& layer = shadows.cascades[slot][cascade];
+            if (!layer.pending)
+                continue;
+
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadows.texture, 0, slot * SHADOW_CASCADE_COUNT + cascade);
+            glClear(GL_DEPTH_BUFFER_BIT);
+
+            glm::vec4 planes[6];
+            ExtractFrustumPlanes(layer.viewProjection, planes);
+            shadows.casters.clear();
+            QueryTreeFrustum(app->entityTree, planes, shadows.casters);
+
+            for (u32 i = 0; i < shadows.casters.size(); ++i)
+            {
+                const Entity& entity = app->entities[shadows.casters[i]];
+                if (entity.modelIndex >= app->models.size())
+                    continue;
+
+                const glm::mat4 worldViewProjection = layer.viewProjection * entity.worldMatrix;
+                glUniformMatrix4fv(shadows.uniformWorldViewProjection, 1, GL_FALSE, (GLfloat*)&worldViewProjection);
+
+                const MeshStruct& mesh = app->meshes[app->models[entity.modelIndex].meshIdx];
+                for (u32 submeshIdx = 0; submeshIdx < mesh.submeshes.size(); ++submeshIdx)
+                {
+                    const Submesh& submesh = mesh.submeshes[submeshIdx];
+                    glDrawElementsBaseVertex(GL_TRIANGLES, submesh.indices.size(), GL_UNSIGNED_INT,
+                                             (void*)(u64)(submesh.sharedFirstIndex * sizeof(u32)), submesh.sharedBaseVertex);
+                }
+            }
+
+            layer.valid = true;
+            layer.stale = false;
+            layer.pending = false;
+            layer.renderedFrame = shadows.frame;
+            shadows.renderedCascades++;
+            shadows.renderedCasters += (u32)shadows.casters.size();
+        }
+    }
+
+    glBindVertexArray(0);
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glDisable(GL_DEPTH_CLAMP);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, app->displaySize.x, app->displaySize.y);
+    glUseProgram(0);
+
+    if (app->enableDebugGroup)
+    {
+        glPopDebugGroup();
+    }
+}
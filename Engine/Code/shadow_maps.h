@@ -0,0 +1,75 @@
+//
+// shadow_maps.h: Cascaded shadow maps of the directional lights. Every cascade is fitted
+// to a bounding sphere of its slice of the camera frustum and snapped to whole texels, so
+// the shadow edges do not swim when the camera moves. The near cascade is rendered every
+// frame, the far ones are cached and only rendered again when they stop covering their
+// slice, the light changes or geometry moves inside them, with a fixed budget per frame.
+//
+
+#pragma once
+
+#include <glad/glad.h>
+
+#include "platform.h"
+#include "aabb_tree.h"
+
+#define SHADOW_MAX_LIGHTS      2    // Directional lights casting shadows, must match the shaders
+#define SHADOW_CASCADE_COUNT   4    // Must match the shaders
+#define SHADOW_MAP_SIZE        1024
+#define SHADOW_DISTANCE        100.0f // View depth covered by the cascades
+#define SHADOW_SPLIT_LAMBDA    0.75f  // Blend between logarithmic (1) and uniform (0) splits
+#define SHADOW_CACHE_PADDING   1.2f   // Cached cascades cover a larger area so the camera can move before they are rendered again
+#define SHADOW_MAX_CACHED_UPDATES_PER_FRAME 1 // Cascades after the first one rendered in a frame
+
+struct App;
+struct Buffer;
+
+struct ShadowCascade
+{
+    glm::mat4 viewProjection;  // World to light clip space the layer was rendered with
+    glm::vec3 lightDirection;
+    glm::vec2 center;          // Light space center of the area covered by the layer
+    f32       halfExtent;
+    f32       texelSize;       // World units per texel
+    u32       renderedFrame;
+    bool      valid;           // The layer holds a rendered map
+    bool      stale;           // Geometry moved inside the layer since it was rendered
+    bool      pending;         // Will be rendered this frame
+};
+
+struct ShadowMaps
+{
+    GLuint texture;      // Depth array, one layer per light and cascade
+    GLuint framebuffer;
+    u32    programIdx;
+    GLint  uniformWorldViewProjection;
+
+    ShadowCascade cascades[SHADOW_MAX_LIGHTS][SHADOW_CASCADE_COUNT];
+    u32    lightIndices[SHADOW_MAX_LIGHTS]; // Index in App::lights of each slot, UINT32_MAX when unused
+    f32    splits[SHADOW_CASCADE_COUNT];    // View depth where each cascade ends
+    u32    frame;
+
+    std::vector<u32> casters; // Scratch of the caster queries
+
+    // Stats of the last frame
+    u32    renderedCascades;
+    u32    renderedCasters;
+};
+
+void InitShadowMaps(App* app);
+
+/**
+ * Picks the directional lights casting shadows, fits their cascades to the camera and
+ * decides which layers are rendered this frame. The near cascade always is, the others
+ * when their cached map is stale, within SHADOW_MAX_CACHED_UPDATES_PER_FRAME.
+ */
+void UpdateShadowCascades(App* app);
+
+// Marks the cached cascades overlapping a box as stale, call it when geometry moves
+void InvalidateShadowMaps(ShadowMaps& shadows, const Aabb& bounds);
+
+// Pushes the shadow parameters block read by the deferred lighting shaders
+void PushShadowParams(App* app, Buffer& buffer);
+
+// Draws the depth of the casters of the cascades scheduled by UpdateShadowCascades()
+void RenderShadowMaps(App* app);
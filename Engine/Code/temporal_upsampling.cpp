@@ -0,0 +1,137 @@
+#include "temporal_upsampling.h"
+#include "engine.h"
+
+static void CreateHistoryTextures(App* app, glm::ivec2 size)
+{
+    TemporalUpsampling& temporal = app->temporalUpsampling;
+    for (u32 i = 0; i < 2; ++i)
+    {
+        if (temporal.historyTextures[i] != 0)
+        {
+            ReleaseRenderGraphTexture(app->renderGraph, temporal.historyTextures[i]);
+            glDeleteTextures(1, &temporal.historyTextures[i]);
+        }
+
+        // Sampled bilinearly by the filtered reprojection
+        glGenTextures(1, &temporal.historyTextures[i]);
+        glBindTexture(GL_TEXTURE_2D, temporal.historyTextures[i]);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, size.x, size.y);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    temporal.historySize = size;
+    temporal.resolvedFrame = UINT32_MAX;
+}
+
+void InitTemporalUpsampling(App* app)
+{
+    TemporalUpsampling& temporal = app->temporalUpsampling;
+    temporal.enabled = false;
+    temporal.renderScale = 0.67f;
+    temporal.blend = 0.1f;
+    temporal.viewProjection = glm::mat4(1.0f);
+    temporal.previousViewProjection = glm::mat4(1.0f);
+    temporal.resolvedFrame = UINT32_MAX;
+
+    temporal.programIdx = LoadProgram(app, "temporal_resolve_shader.glsl", "TEMPORAL_RESOLVE_SHADER");
+    Program& program = app->programs[temporal.programIdx];
+    temporal.uniformCurrent = FindSamplerUnit(program.reflection, "uCurrent");
+    temporal.uniformVelocity = FindSamplerUnit(program.reflection, "uVelocity");
+    temporal.uniformDepth = FindSamplerUnit(program.reflection, "uDepth");
+    temporal.uniformHistory = FindSamplerUnit(program.reflection, "uHistory");
+    temporal.uniformDisplaySize = FindUniformLocation(program.reflection, "uDisplaySize");
+    temporal.uniformBlend = FindUniformLocation(program.reflection, "uBlend");
+    temporal.uniformResetHistory = FindUniformLocation(program.reflection, "uResetHistory");
+
+    glGenVertexArrays(1, &temporal.emptyVao);
+}
+
+void ShutdownTemporalUpsampling(App* app)
+{
+    glDeleteVertexArrays(1, &app->temporalUpsampling.emptyVao);
+}
+
+glm::ivec2 GetTemporalRenderSize(const TemporalUpsampling& temporal, glm::ivec2 displaySize)
+{
+    return glm::max(glm::ivec2(glm::vec2(displaySize) * temporal.renderScale), glm::ivec2(1));
+}
+
+// Low discrepancy sequence, consecutive offsets spread evenly over the pixel
+static f32 Halton(u32 index, u32 base)
+{
+    f32 result = 0.0f;
+    f32 fraction = 1.0f / base;
+    for (; index > 0; index /= base, fraction /= base)
+        result += fraction * (index % base);
+    return result;
+}
+
+void UpdateTemporalUpsampling(App* app, const glm::mat4& projection)
+{
+    TemporalUpsampling& temporal = app->temporalUpsampling;
+    temporal.frame++;
+
+    // The motion vectors are measured against the matrices of the last frame
+    temporal.previousViewProjection = temporal.viewProjection;
+    temporal.viewProjection = projection * app->camera.viewMatrix;
+
+    temporal.active = temporal.enabled && app->enableDeferredShading;
+    if (!temporal.active)
+    {
+        app->camera.projection = projection;
+        temporal.jitter = glm::vec2(0.0f);
+        return;
+    }
+
+    if (temporal.historySize != app->displaySize)
+        CreateHistoryTextures(app, app->displaySize);
+
+    // The fewer render pixels cover a display pixel, the more offsets it takes to cover it
+    const f32 upscale = (f32)(app->displaySize.x * app->displaySize.y) / (f32)(app->renderSize.x * app->renderSize.y);
+    temporal.jitterPhases = glm::clamp((u32)ceilf(TEMPORAL_MIN_JITTER_PHASES * upscale), (u32)TEMPORAL_MIN_JITTER_PHASES, (u32)TEMPORAL_MAX_JITTER_PHASES);
+
+    // Offset in render pixels, the first Halton index is skipped since it is 0
+    const u32 phase = temporal.frame % temporal.jitterPhases + 1;
+    const glm::vec2 offset = glm::vec2(Halton(phase, 2), Halton(phase, 3)) - 0.5f;
+    temporal.jitter = offset * 2.0f / glm::vec2(app->renderSize);
+    app->camera.projection = glm::translate(glm::vec3(temporal.jitter, 0.0f)) * projection;
+
+    temporal.historyIndex ^= 1;
+}
+
+void RenderTemporalResolve(App* app)
+{
+    TemporalUpsampling& temporal = app->temporalUpsampling;
+    const RenderGraph& graph = app->renderGraph;
+    const FrameResources& frame = app->frameResources;
+
+    glDisable(GL_DEPTH_TEST);
+
+    Program& program = app->programs[temporal.programIdx];
+    glUseProgram(program.handle);
+
+    // The render size and the jitter come from the global parameters
+    glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(0), app->globalBuffer.buffer.handle, app->globalParamsOffset, app->globalParamsSize);
+
+    // The history is only usable when it was resolved on the previous frame
+    const glm::vec4 displaySize = glm::vec4(glm::vec2(app->displaySize), 1.0f / glm::vec2(app->displaySize));
+    glUniform4fv(temporal.uniformDisplaySize, 1, (GLfloat*)&displaySize);
+    glUniform1f(temporal.uniformBlend, temporal.blend);
+    glUniform1i(temporal.uniformResetHistory, temporal.resolvedFrame + 1 != temporal.frame ? 1 : 0);
+
+    BindSamplerTexture(temporal.uniformCurrent, GL_TEXTURE_2D, GetRenderGraphTexture(graph, frame.shading));
+    BindSamplerTexture(temporal.uniformVelocity, GL_TEXTURE_2D, GetRenderGraphTexture(graph, frame.gVelocity));
+    BindSamplerTexture(temporal.uniformDepth, GL_TEXTURE_2D, GetRenderGraphTexture(graph, frame.gDepth));
+    BindSamplerTexture(temporal.uniformHistory, GL_TEXTURE_2D, GetRenderGraphTexture(graph, frame.temporalHistory));
+
+    glBindVertexArray(temporal.emptyVao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+
+    glUseProgram(0);
+    temporal.resolvedFrame = temporal.frame;
+}
@@ -0,0 +1,67 @@
+//
+// temporal_upsampling.h: Reconstructs the display resolution image from the lower resolution
+// deferred targets over several frames. The projection moves by a sub-pixel offset every
+// frame, the geometry pass writes how far every pixel moved since the previous frame, and
+// the resolve blends the current samples into a history reprojected with those motion
+// vectors. The history is clamped to the colors around the pixel, so what was hidden or
+// changed on the previous frame does not leave trails.
+//
+
+#pragma once
+
+#include <glad/glad.h>
+
+#include "platform.h"
+
+#define TEMPORAL_MIN_JITTER_PHASES 8   // Offsets of the sequence at full resolution
+#define TEMPORAL_MAX_JITTER_PHASES 32  // The sequence grows with the upscale so every display pixel gets samples
+
+struct App;
+
+struct TemporalUpsampling
+{
+    // Settings
+    bool  enabled;
+    f32   renderScale; // Of each axis, used while dynamic resolution is off
+    f32   blend;       // Weight of a current sample that lands on the pixel center
+
+    // Resolve
+    u32    programIdx;
+    i32    uniformCurrent;
+    i32    uniformVelocity;
+    i32    uniformDepth;
+    i32    uniformHistory;
+    GLint  uniformDisplaySize;
+    GLint  uniformBlend;
+    GLint  uniformResetHistory;
+    GLuint emptyVao; // The fullscreen triangle has no vertex buffer, GL still wants a VAO bound
+
+    // Resolved images, one is the history of the other
+    GLuint     historyTextures[2];
+    glm::ivec2 historySize;
+    u32        historyIndex;  // Written this frame
+    u32        resolvedFrame; // Frame the history was last written, only the next one can reuse it
+
+    // Matrices without the jitter, the motion vectors only hold the movement
+    glm::mat4 viewProjection;
+    glm::mat4 previousViewProjection;
+    glm::vec2 jitter;         // NDC offset of the projection this frame
+    u32       jitterPhases;
+    u32       frame;
+    bool      active;         // Jittered and resolved this frame
+};
+
+void InitTemporalUpsampling(App* app);
+void ShutdownTemporalUpsampling(App* app);
+
+/**
+ * Keeps the matrices of the last frame and, when the deferred path upsamples, jitters the
+ * camera projection of this one. Call it once the render size of the frame is known.
+ */
+void UpdateTemporalUpsampling(App* app, const glm::mat4& projection);
+
+// Size the deferred targets are rendered at when temporal upsampling picks it
+glm::ivec2 GetTemporalRenderSize(const TemporalUpsampling& temporal, glm::ivec2 displaySize);
+
+// Render graph pass, resolves the shading target into the current history texture
+void RenderTemporalResolve(App* app);
@@ -0,0 +1,262 @@
+#include "water.h"
+#include "engine.h"
+#include "assimp_model_loading.h"
+
+#define WATER_PLANE_SCALE 0.1f // The plane model is about 430 units wide
+
+static void CreateReflectionTarget(App* app, glm::ivec2 size)
+{
+    Water& water = app->water;
+    if (water.reflectionTexture != 0)
+    {
+        ReleaseRenderGraphTexture(app->renderGraph, water.reflectionTexture);
+        ReleaseRenderGraphTexture(app->renderGraph, water.reflectionDepth);
+        glDeleteTextures(1, &water.reflectionTexture);
+        glDeleteTextures(1, &water.reflectionDepth);
+    }
+
+    glGenTextures(1, &water.reflectionTexture);
+    glBindTexture(GL_TEXTURE_2D, water.reflectionTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, size.x, size.y);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glGenTextures(1, &water.reflectionDepth);
+    glBindTexture(GL_TEXTURE_2D, water.reflectionDepth);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, size.x, size.y);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    water.reflectionSize = size;
+    water.reflectionValid = false;
+}
+
+void InitWater(App* app)
+{
+    Water& water = app->water;
+    water.entityIdx = UINT32_MAX;
+    water.height = 0.0f;
+    water.reflectionDivisor = 2;
+    water.refractionDivisor = 2;
+    water.alternateReflection = true;
+
+    u32 waterPlane = LoadModel(app, "Models/Plane/plane.obj");
+    if (waterPlane != UINT32_MAX)
+    {
+        std::vector<glm::vec3> positions = { glm::vec3(0.0f, water.height, 0.0f) };
+        InitEntitiesInBulk(app, positions, waterPlane, WATER_PLANE_SCALE);
+        water.entityIdx = (u32)app->entities.size() - 1;
+    }
+
+    water.sceneProgramIdx = LoadProgram(app, "water_shader.glsl", "WATER_SCENE_SHADER");
+    Program& sceneProgram = app->programs[water.sceneProgramIdx];
+    water.sceneUniformWorld = FindUniformLocation(sceneProgram.reflection, "uWorldMatrix");
+    water.sceneUniformViewProjection = FindUniformLocation(sceneProgram.reflection, "uViewProjectionMatrix");
+    water.sceneUniformClipPlane = FindUniformLocation(sceneProgram.reflection, "uClipPlane");
+    water.sceneUniformLightDirection = FindUniformLocation(sceneProgram.reflection, "uLightDirection");
+    water.sceneUniformLightColor = FindUniformLocation(sceneProgram.reflection, "uLightColor");
+    water.sceneUniformTexture = FindSamplerUnit(sceneProgram.reflection, "uTexture");
+
+    water.surfaceProgramIdx = LoadProgram(app, "water_shader.glsl", "WATER_PASS_SHADER");
+    Program& surfaceProgram = app->programs[water.surfaceProgramIdx];
+    water.surfaceUniformWorld = FindUniformLocation(surfaceProgram.reflection, "uWorldMatrix");
+    water.surfaceUniformViewProjection = FindUniformLocation(surfaceProgram.reflection, "uViewProjectionMatrix");
+    water.surfaceUniformReflectionViewProjection = FindUniformLocation(surfaceProgram.reflection, "uReflectionViewProjectionMatrix");
+    water.surfaceUniformCameraPosition = FindUniformLocation(surfaceProgram.reflection, "uCameraPosition");
+    water.surfaceUniformViewportSize = FindUniformLocation(surfaceProgram.reflection, "uViewportSize");
+    water.surfaceUniformRefractionCoverage = FindUniformLocation(surfaceProgram.reflection, "uRefractionCoverage");
+    water.surfaceUniformDepthRange = FindUniformLocation(surfaceProgram.reflection, "uDepthRange");
+    water.surfaceUniformTime = FindUniformLocation(surfaceProgram.reflection, "uTime");
+    water.surfaceUniformReflectionMap = FindSamplerUnit(surfaceProgram.reflection, "uReflectionMap");
+    water.surfaceUniformReflectionDepth = FindSamplerUnit(surfaceProgram.reflection, "uReflectionDepth");
+    water.surfaceUniformRefractionMap = FindSamplerUnit(surfaceProgram.reflection, "uRefractionMap");
+    water.surfaceUniformRefractionDepth = FindSamplerUnit(surfaceProgram.reflection, "uRefractionDepth");
+
+    CreateReflectionTarget(app, GetWaterTargetSize(app->displaySize, water.reflectionDivisor));
+}
+
+glm::ivec2 GetWaterTargetSize(glm::ivec2 size, u32 divisor)
+{
+    return glm::max(size / glm::ivec2(divisor), glm::ivec2(1));
+}
+
+bool PrepareWaterReflection(App* app)
+{
+    Water& water = app->water;
+    water.frame++;
+    water.time += app->deltaTime;
+    water.renderedScenes = 0;
+    water.renderedDraws = 0;
+
+    const glm::ivec2 size = GetWaterTargetSize(app->displaySize, water.reflectionDivisor);
+    if (size != water.reflectionSize)
+        CreateReflectionTarget(app, size);
+
+    // A reflection from the previous frame is reprojected by the surface, so skipping every
+    // other update only shows as a one frame lag on moving objects
+    return !water.reflectionValid || !water.alternateReflection || (water.frame % 2) == 0;
+}
+
+// Mirrors the world across the water plane
+static glm::mat4 WaterReflectionMatrix(f32 height)
+{
+    glm::mat4 reflection = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, height, 0.0f));
+    reflection = glm::scale(reflection, glm::vec3(1.0f, -1.0f, 1.0f));
+    return glm::translate(reflection, glm::vec3(0.0f, -height, 0.0f));
+}
+
+// Draws the scene except the water itself, clipped to one side of the plane, with a single
+// directional light. The entity uniforms of the main view cannot be used, the entities
+// outside of it have none, so every draw goes through the shared static geometry.
+static void PassWaterScene(App* app, const glm::mat4& view, WaterScenePart part)
+{
+    Water& water = app->water;
+    const glm::mat4 viewProjection = app->camera.projection * view;
+
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CLIP_DISTANCE0);
+
+    // The mirrored view flips the winding
+    glDisable(GL_CULL_FACE);
+
+    Program& sceneProgram = app->programs[water.sceneProgramIdx];
+    glUseProgram(sceneProgram.handle);
+    glUniformMatrix4fv(water.sceneUniformViewProjection, 1, GL_FALSE, (GLfloat*)&viewProjection);
+
+    const glm::vec4 clipPlane = part == WaterScenePart::Reflection
+        ? glm::vec4(0.0f, 1.0f, 0.0f, -water.height + WATER_CLIP_OFFSET)
+        : glm::vec4(0.0f, -1.0f, 0.0f, water.height + WATER_CLIP_OFFSET);
+    glUniform4fv(water.sceneUniformClipPlane, 1, (GLfloat*)&clipPlane);
+
+    glm::vec3 lightDirection = glm::vec3(0.0f, -1.0f, 0.0f);
+    glm::vec3 lightColor = glm::vec3(1.0f);
+    for (const Light& light : app->lights)
+    {
+        if (light.type == LightType::LightType_Directional)
+        {
+            lightDirection = glm::normalize(light.direction);
+            lightColor = light.color;
+            break;
+        }
+    }
+    glUniform3fv(water.sceneUniformLightDirection, 1, (GLfloat*)&lightDirection);
+    glUniform3fv(water.sceneUniformLightColor, 1, (GLfloat*)&lightColor);
+
+    glm::vec4 planes[6];
+    ExtractFrustumPlanes(viewProjection, planes);
+    water.visible.clear();
+    QueryTreeFrustum(app->entityTree, planes, water.visible);
+
+    glBindVertexArray(app->staticGeometry.vao);
+
+    for (u32 i = 0; i < water.visible.size(); ++i)
+    {
+        const u32 entityIdx = water.visible[i];
+        const Entity& entity = app->entities[entityIdx];
+        if (entityIdx == water.entityIdx || entity.modelIndex >= app->models.size())
+            continue;
+
+        glUniformMatrix4fv(water.sceneUniformWorld, 1, GL_FALSE, (GLfloat*)&entity.worldMatrix);
+
+        const ModelStruct& model = app->models[entity.modelIndex];
+        const MeshStruct& mesh = app->meshes[model.meshIdx];
+        for (u32 submeshIdx = 0; submeshIdx < mesh.submeshes.size(); ++submeshIdx)
+        {
+            const Material& material = app->materials[model.materialIdx[submeshIdx]];
+            BindSamplerTexture(water.sceneUniformTexture, GL_TEXTURE_2D, app->textures[material.albedoTextureIdx].handle);
+
+            const Submesh& submesh = mesh.submeshes[submeshIdx];
+            glDrawElementsBaseVertex(GL_TRIANGLES, submesh.indices.size(), GL_UNSIGNED_INT,
+                                     (void*)(u64)(submesh.sharedFirstIndex * sizeof(u32)), submesh.sharedBaseVertex);
+            water.renderedDraws++;
+        }
+    }
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glDisable(GL_CLIP_DISTANCE0);
+
+    // The sky fills what the scene left empty
+    const glm::mat4 skyboxProjection = glm::perspective(glm::radians(60.0f), (float)app->displaySize.x / app->displaySize.y, 0.1f, 100.0f);
+    DrawSkybox(app, view, skyboxProjection);
+
+    glEnable(GL_CULL_FACE);
+    water.renderedScenes++;
+}
+
+void RenderWaterReflection(App* app)
+{
+    Water& water = app->water;
+    const glm::mat4 view = app->camera.viewMatrix * WaterReflectionMatrix(water.height);
+
+    PassWaterScene(app, view, WaterScenePart::Reflection);
+
+    water.reflectionViewProjection = app->camera.projection * view;
+    water.reflectionValid = true;
+}
+
+void RenderWaterRefraction(App* app)
+{
+    PassWaterScene(app, app->camera.viewMatrix, WaterScenePart::Refraction);
+}
+
+void RenderWaterSurface(App* app)
+{
+    Water& water = app->water;
+    if (water.entityIdx == UINT32_MAX)
+        return;
+
+    const RenderGraph& graph = app->renderGraph;
+    const FrameResources& frame = app->frameResources;
+
+    Program& surfaceProgram = app->programs[water.surfaceProgramIdx];
+    glUseProgram(surfaceProgram.handle);
+
+    const Entity& entity = app->entities[water.entityIdx];
+    const glm::mat4 viewProjection = app->camera.projection * app->camera.viewMatrix;
+    const glm::vec2 viewportSize = glm::vec2(app->renderSize);
+    const glm::vec2 refractionCoverage = GetRenderGraphTextureScale(graph, frame.waterRefraction);
+    const glm::vec2 depthRange = glm::vec2(app->camera.znear, app->camera.zfar);
+    glUniformMatrix4fv(water.surfaceUniformWorld, 1, GL_FALSE, (GLfloat*)&entity.worldMatrix);
+    glUniformMatrix4fv(water.surfaceUniformViewProjection, 1, GL_FALSE, (GLfloat*)&viewProjection);
+    glUniformMatrix4fv(water.surfaceUniformReflectionViewProjection, 1, GL_FALSE, (GLfloat*)&water.reflectionViewProjection);
+    glUniform3fv(water.surfaceUniformCameraPosition, 1, (GLfloat*)&app->camera.position);
+    glUniform2fv(water.surfaceUniformViewportSize, 1, (GLfloat*)&viewportSize);
+    glUniform2fv(water.surfaceUniformRefractionCoverage, 1, (GLfloat*)&refractionCoverage);
+    glUniform2fv(water.surfaceUniformDepthRange, 1, (GLfloat*)&depthRange);
+    glUniform1f(water.surfaceUniformTime, water.time);
+
+    BindSamplerTexture(water.surfaceUniformReflectionMap, GL_TEXTURE_2D, GetRenderGraphTexture(graph, frame.waterReflection));
+    BindSamplerTexture(water.surfaceUniformReflectionDepth, GL_TEXTURE_2D, GetRenderGraphTexture(graph, frame.waterReflectionDepth));
+    BindSamplerTexture(water.surfaceUniformRefractionMap, GL_TEXTURE_2D, GetRenderGraphTexture(graph, frame.waterRefraction));
+    BindSamplerTexture(water.surfaceUniformRefractionDepth, GL_TEXTURE_2D, GetRenderGraphTexture(graph, frame.waterRefractionDepth));
+
+    // Drawn over the plane the geometry pass left in the G-buffer, pulled forward so it wins
+    // the depth test against it
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_FALSE);
+    glDepthFunc(GL_LEQUAL);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(-1.0f, -1.0f);
+    glDisable(GL_CULL_FACE);
+
+    glBindVertexArray(app->staticGeometry.vao);
+    const MeshStruct& mesh = app->meshes[app->models[entity.modelIndex].meshIdx];
+    for (const Submesh& submesh : mesh.submeshes)
+    {
+        glDrawElementsBaseVertex(GL_TRIANGLES, submesh.indices.size(), GL_UNSIGNED_INT,
+                                 (void*)(u64)(submesh.sharedFirstIndex * sizeof(u32)), submesh.sharedBaseVertex);
+    }
+    glBindVertexArray(0);
+
+    glEnable(GL_CULL_FACE);
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    glUseProgram(0);
+}
@@ -0,0 +1,84 @@
+//
+// water.h: Planar water. The scene is rendered mirrored across the water plane into a
+// reflection target and clipped below it into a refraction target, each at its own fraction
+// of the display resolution, and the surface blends both with a depth-aware upsample. The
+// reflection lives in a texture of its own so it can be rendered every other frame, the
+// surface projects into it with the matrix of its last update.
+//
+
+#pragma once
+
+#include <glad/glad.h>
+
+#include "platform.h"
+
+#define WATER_CLIP_OFFSET 0.1f // World units the clip planes are pushed past the surface, hides seams at the shore
+
+struct App;
+
+struct Water
+{
+    u32   entityIdx;   // Plane entity of the surface, UINT32_MAX when the model failed to load
+    f32   height;
+
+    // Reflection and refraction scenes
+    u32   sceneProgramIdx;
+    GLint sceneUniformWorld;
+    GLint sceneUniformViewProjection;
+    GLint sceneUniformClipPlane;
+    GLint sceneUniformLightDirection;
+    GLint sceneUniformLightColor;
+    i32   sceneUniformTexture;
+
+    // Surface
+    u32   surfaceProgramIdx;
+    GLint surfaceUniformWorld;
+    GLint surfaceUniformViewProjection;
+    GLint surfaceUniformReflectionViewProjection;
+    GLint surfaceUniformCameraPosition;
+    GLint surfaceUniformViewportSize;
+    GLint surfaceUniformRefractionCoverage;
+    GLint surfaceUniformDepthRange;
+    GLint surfaceUniformTime;
+    i32   surfaceUniformReflectionMap;
+    i32   surfaceUniformReflectionDepth;
+    i32   surfaceUniformRefractionMap;
+    i32   surfaceUniformRefractionDepth;
+
+    // Settings
+    u32   reflectionDivisor;   // The reflection is the display size divided by it, the refraction
+                               // the render size of the deferred targets
+    u32   refractionDivisor;
+    bool  alternateReflection; // Render the reflection every other frame
+
+    // Reflection kept across frames
+    GLuint    reflectionTexture;
+    GLuint    reflectionDepth;
+    glm::ivec2 reflectionSize;
+    glm::mat4 reflectionViewProjection; // Mirrored view of the last update
+    bool      reflectionValid;
+    u32       frame;
+    f32       time;     // Animates the waves
+
+    std::vector<u32> visible; // Scratch of the entity queries
+
+    // Stats of the last frame
+    u32   renderedScenes;
+    u32   renderedDraws;
+};
+
+void InitWater(App* app);
+
+/**
+ * Resizes the reflection target when the display or the divisor changed and decides whether
+ * the reflection is rendered this frame. Call it before declaring the water passes.
+ */
+bool PrepareWaterReflection(App* app);
+
+// Target size of a water pass for a frame rendered at size
+glm::ivec2 GetWaterTargetSize(glm::ivec2 size, u32 divisor);
+
+// Render graph passes
+void RenderWaterReflection(App* app);
+void RenderWaterRefraction(App* app);
+void RenderWaterSurface(App* app);
@@ -0,0 +1,325 @@
+#include "test.h"
+#include "aabb_tree.h"
+#include "frustum_culling.h"
+
+#include <algorithm>
+
+#define TREE_BENCHMARK_ENTITIES 100000
+
+static std::vector<Aabb> RandomBoxes(u32 count, f32 worldSize, u32 seed)
+{
+    TestRandom random = { seed };
+    std::vector<Aabb> boxes(count);
+    for (Aabb& box : boxes)
+    {
+        const glm::vec3 center = glm::vec3(RandomFloat(random, -worldSize, worldSize), RandomFloat(random, -worldSize, worldSize), RandomFloat(random, -worldSize, worldSize));
+        const glm::vec3 extent = glm::vec3(RandomFloat(random, 0.25f, 2.0f), RandomFloat(random, 0.25f, 2.0f), RandomFloat(random, 0.25f, 2.0f));
+        box = Aabb{ center - extent, center + extent };
+    }
+    return boxes;
+}
+
+static AabbTree BuildTree(const std::vector<Aabb>& boxes, std::vector<u32>& proxies)
+{
+    AabbTree tree = CreateAabbTree(256);
+    proxies.resize(boxes.size());
+    for (u32 i = 0; i < boxes.size(); ++i)
+        proxies[i] = CreateTreeProxy(tree, boxes[i], i);
+    return tree;
+}
+
+static bool BoxesOverlap(const Aabb& a, const Aabb& b)
+{
+    return glm::all(glm::lessThanEqual(a.min, b.max)) && glm::all(glm::greaterThanEqual(a.max, b.min));
+}
+
+static bool BoxInFrustum(const Aabb& box, const glm::vec4 planes[6])
+{
+    const glm::vec3 center = (box.min + box.max) * 0.5f;
+    const glm::vec3 extent = (box.max - box.min) * 0.5f;
+    for (u32 p = 0; p < 6; ++p)
+    {
+        const glm::vec3 normal = glm::vec3(planes[p]);
+        if (glm::dot(normal, center) + planes[p].w + glm::dot(glm::abs(normal), extent) < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+static Aabb FatBox(const Aabb& box)
+{
+    return Aabb{ box.min - glm::vec3(AABB_TREE_FAT_MARGIN), box.max + glm::vec3(AABB_TREE_FAT_MARGIN) };
+}
+
+// Links, heights and boxes of every node reachable from the root, returns the leaf count
+static u32 CheckTreeStructure(const AabbTree& tree, u32 nodeIdx, u32 parent)
+{
+    const AabbTreeNode& node = tree.nodes[nodeIdx];
+    CHECK(node.parent == parent);
+    CHECK(node.height >= 0);
+    if (node.child1 == AABB_TREE_NULL_NODE)
+    {
+        CHECK(node.height == 0);
+        return 1;
+    }
+
+    const AabbTreeNode& child1 = tree.nodes[node.child1];
+    const AabbTreeNode& child2 = tree.nodes[node.child2];
+    CHECK(node.height == 1 + glm::max(child1.height, child2.height));
+    CHECK(glm::all(glm::equal(node.aabb.min, glm::min(child1.aabb.min, child2.aabb.min))));
+    CHECK(glm::all(glm::equal(node.aabb.max, glm::max(child1.aabb.max, child2.aabb.max))));
+    return CheckTreeStructure(tree, node.child1, nodeIdx) + CheckTreeStructure(tree, node.child2, nodeIdx);
+}
+
+static void CheckTree(const AabbTree& tree)
+{
+    if (tree.root == AABB_TREE_NULL_NODE)
+    {
+        CHECK(tree.proxyCount == 0);
+        return;
+    }
+
+    CHECK(CheckTreeStructure(tree, tree.root, AABB_TREE_NULL_NODE) == tree.proxyCount);
+    // The rotations only keep the tree roughly balanced, its height stays logarithmic all the same
+    CHECK(tree.nodes[tree.root].height <= 2 * (i32)ceilf(log2f((f32)tree.proxyCount)));
+}
+
+// Found means overlapping the entity box, the tree may also return what only overlaps its fat box
+static void CheckQueryResults(std::vector<u32> results, const std::vector<Aabb>& boxes, bool (*exactTest)(const Aabb&, const void*),
+                              const void* query)
+{
+    std::sort(results.begin(), results.end());
+    CHECK(std::adjacent_find(results.begin(), results.end()) == results.end());
+    for (u32 i = 0; i < boxes.size(); ++i)
+    {
+        const bool found = std::binary_search(results.begin(), results.end(), i);
+        if (exactTest(boxes[i], query))
+            CHECK(found);
+        else if (found)
+            CHECK(exactTest(FatBox(boxes[i]), query));
+    }
+}
+
+static glm::mat4 TestViewProjection(f32 farPlane)
+{
+    const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, farPlane);
+    return projection * glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+TEST(AabbTreeQueriesMatchBruteForce)
+{
+    const std::vector<Aabb> boxes = RandomBoxes(5000, 100.0f, 1);
+    std::vector<u32> proxies;
+    AabbTree tree = BuildTree(boxes, proxies);
+    CheckTree(tree);
+
+    std::vector<u32> results;
+    const Aabb queryBox = { glm::vec3(-20.0f, -10.0f, 0.0f), glm::vec3(15.0f, 25.0f, 30.0f) };
+    QueryTreeAabb(tree, queryBox, results);
+    CHECK(!results.empty());
+    CheckQueryResults(results, boxes, [](const Aabb& box, const void* query) { return BoxesOverlap(box, *(const Aabb*)query); }, &queryBox);
+
+    // Inside a sphere is approximated by its bounding box on the brute-force side, only the
+    // boxes the tree finds are checked against the sphere itself
+    results.clear();
+    const glm::vec3 sphereCenter = glm::vec3(10.0f, -5.0f, 3.0f);
+    const f32 sphereRadius = 20.0f;
+    QueryTreeSphere(tree, sphereCenter, sphereRadius, results);
+    CHECK(!results.empty());
+    for (u32 result : results)
+    {
+        const Aabb fat = FatBox(boxes[result]);
+        const glm::vec3 closest = glm::clamp(sphereCenter, fat.min, fat.max);
+        CHECK(glm::distance(closest, sphereCenter) <= sphereRadius);
+    }
+
+    // Walking the nodes and the depth first copy find the same entities
+    glm::vec4 planes[6];
+    ExtractFrustumPlanes(TestViewProjection(80.0f), planes);
+    results.clear();
+    QueryTreeFrustum(tree, planes, results);
+    CHECK(!results.empty());
+    CheckQueryResults(results, boxes, [](const Aabb& box, const void* query) { return BoxInFrustum(box, (const glm::vec4*)query); }, planes);
+
+    FlattenAabbTree(tree);
+    FlattenAabbTree(tree);
+    CHECK(tree.flatValid);
+    std::vector<u32> flatResults;
+    QueryTreeFrustum(tree, planes, flatResults);
+    std::sort(results.begin(), results.end());
+    std::sort(flatResults.begin(), flatResults.end());
+    CHECK(results == flatResults);
+
+    // The closest hit along a ray is the closest fat box the ray enters
+    const glm::vec3 origin = glm::vec3(-120.0f, 1.0f, 2.0f);
+    const glm::vec3 direction = glm::normalize(glm::vec3(1.0f, 0.05f, 0.02f));
+    f32 hitDistance;
+    const u32 hit = QueryTreeRay(tree, origin, direction, 500.0f, hitDistance);
+    CHECK(hit != UINT32_MAX);
+
+    f32 closestDistance = 500.0f;
+    u32 closest = UINT32_MAX;
+    for (u32 i = 0; i < boxes.size(); ++i)
+    {
+        const Aabb fat = FatBox(boxes[i]);
+        const glm::vec3 t0 = (fat.min - origin) / direction;
+        const glm::vec3 t1 = (fat.max - origin) / direction;
+        const f32 enter = glm::max(glm::max(glm::min(t0.x, t1.x), glm::min(t0.y, t1.y)), glm::max(glm::min(t0.z, t1.z), 0.0f));
+        const f32 exit = glm::min(glm::min(glm::max(t0.x, t1.x), glm::max(t0.y, t1.y)), glm::max(t0.z, t1.z));
+        if (enter <= exit && enter < closestDistance)
+        {
+            closestDistance = enter;
+            closest = i;
+        }
+    }
+    CHECK(hit == closest);
+    CHECK(glm::abs(hitDistance - closestDistance) < 1e-3f);
+}
+
+TEST(AabbTreeMoveRefitsTheProxy)
+{
+    std::vector<Aabb> boxes = RandomBoxes(2000, 50.0f, 2);
+    std::vector<u32> proxies;
+    AabbTree tree = BuildTree(boxes, proxies);
+
+    // A move within the fat margin leaves the tree as it is
+    const Aabb nudged = { boxes[0].min + glm::vec3(AABB_TREE_FAT_MARGIN * 0.5f), boxes[0].max + glm::vec3(AABB_TREE_FAT_MARGIN * 0.5f) };
+    const Aabb fatBefore = tree.nodes[proxies[0]].aabb;
+    CHECK(!MoveTreeProxy(tree, proxies[0], nudged));
+    CHECK(glm::all(glm::equal(tree.nodes[proxies[0]].aabb.min, fatBefore.min)));
+    boxes[0] = nudged;
+
+    // Far moves reinsert the leaves, the queries find them at the new place only
+    TestRandom random = { 3 };
+    for (u32 i = 0; i < boxes.size(); i += 3)
+    {
+        const glm::vec3 offset = glm::vec3(RandomFloat(random, -30.0f, 30.0f), RandomFloat(random, -30.0f, 30.0f), RandomFloat(random, -30.0f, 30.0f));
+        boxes[i] = Aabb{ boxes[i].min + offset, boxes[i].max + offset };
+        CHECK(MoveTreeProxy(tree, proxies[i], boxes[i]));
+    }
+    CheckTree(tree);
+    CHECK(tree.proxyCount == boxes.size());
+
+    std::vector<u32> results;
+    const Aabb movedBox = boxes[3];
+    QueryTreeAabb(tree, movedBox, results);
+    CHECK(std::find(results.begin(), results.end(), 3u) != results.end());
+    CheckQueryResults(results, boxes, [](const Aabb& box, const void* query) { return BoxesOverlap(box, *(const Aabb*)query); }, &movedBox);
+
+    glm::vec4 planes[6];
+    ExtractFrustumPlanes(TestViewProjection(60.0f), planes);
+    results.clear();
+    QueryTreeFrustum(tree, planes, results);
+    CheckQueryResults(results, boxes, [](const Aabb& box, const void* query) { return BoxInFrustum(box, (const glm::vec4*)query); }, planes);
+
+    // The depth first copy is dropped by a reinsertion and rebuilt once the tree settles
+    FlattenAabbTree(tree);
+    CHECK(!tree.flatValid);
+    FlattenAabbTree(tree);
+    CHECK(tree.flatValid);
+    CHECK(!MoveTreeProxy(tree, proxies[1], boxes[1]));
+    CHECK(tree.flatValid);
+    boxes[1] = Aabb{ boxes[1].min + glm::vec3(10.0f), boxes[1].max + glm::vec3(10.0f) };
+    CHECK(MoveTreeProxy(tree, proxies[1], boxes[1]));
+    CHECK(!tree.flatValid);
+    FlattenAabbTree(tree);
+    FlattenAabbTree(tree);
+    CHECK(tree.flatValid);
+
+    results.clear();
+    QueryTreeFrustum(tree, planes, results);
+    CheckQueryResults(results, boxes, [](const Aabb& box, const void* query) { return BoxInFrustum(box, (const glm::vec4*)query); }, planes);
+
+    // Destroyed proxies are gone from the queries and their nodes are reused
+    for (u32 i = 0; i < boxes.size(); i += 2)
+        DestroyTreeProxy(tree, proxies[i]);
+    CheckTree(tree);
+    CHECK(tree.proxyCount == boxes.size() / 2);
+
+    results.clear();
+    QueryTreeAabb(tree, Aabb{ glm::vec3(-1000.0f), glm::vec3(1000.0f) }, results);
+    CHECK(results.size() == boxes.size() / 2);
+    for (u32 result : results)
+        CHECK(result % 2 == 1);
+
+    const size_t nodeCount = tree.nodes.size();
+    for (u32 i = 0; i < boxes.size(); i += 2)
+        proxies[i] = CreateTreeProxy(tree, boxes[i], i);
+    CheckTree(tree);
+    CHECK(tree.nodes.size() == nodeCount);
+}
+
+BENCHMARK(AabbTreeQueries100k)
+{
+    const std::vector<Aabb> boxes = RandomBoxes(TREE_BENCHMARK_ENTITIES, 500.0f, 4);
+    std::vector<u32> proxies;
+    AabbTree tree;
+    const f64 buildMs = MeasureMs(1, [&]() { tree = BuildTree(boxes, proxies); });
+    printf("    build: %.2f ms for %u entities, height %d\n", buildMs, (u32)boxes.size(), tree.nodes[tree.root].height);
+
+    const f64 flattenMs = MeasureMs(20, [&]() {
+        tree.flatValid = false;
+        tree.changed = false;
+        FlattenAabbTree(tree);
+    });
+    printf("    flatten: %.3f ms\n", flattenMs);
+
+    std::vector<u32> results;
+    results.reserve(boxes.size());
+
+    const f32 farPlanes[] = { 100.0f, 300.0f, 1000.0f };
+    for (f32 farPlane : farPlanes)
+    {
+        glm::vec4 planes[6];
+        ExtractFrustumPlanes(TestViewProjection(farPlane), planes);
+
+        tree.flatValid = false;
+        const f64 nodesMs = MeasureMs(20, [&]() {
+            results.clear();
+            QueryTreeFrustum(tree, planes, results);
+        });
+
+        tree.changed = false;
+        FlattenAabbTree(tree);
+        const f64 treeMs = MeasureMs(20, [&]() {
+            results.clear();
+            QueryTreeFrustum(tree, planes, results);
+        });
+        const u32 found = (u32)results.size();
+
+        const f64 bruteForceMs = MeasureMs(20, [&]() {
+            results.clear();
+            for (u32 i = 0; i < boxes.size(); ++i)
+                if (BoxInFrustum(boxes[i], planes))
+                    results.push_back(i);
+        });
+        printf("    frustum, far %.0f: %.3f ms for %u results, %.3f ms walking the nodes, brute force %.3f ms\n", farPlane, treeMs, found, nodesMs, bruteForceMs);
+    }
+
+    const Aabb queryBox = { glm::vec3(-25.0f), glm::vec3(25.0f) };
+    const f64 aabbMs = MeasureMs(20, [&]() {
+        results.clear();
+        QueryTreeAabb(tree, queryBox, results);
+    });
+    printf("    aabb of 50 units: %.3f ms for %u results\n", aabbMs, (u32)results.size());
+
+    f32 hitDistance;
+    const f64 rayMs = MeasureMs(20, [&]() {
+        QueryTreeRay(tree, glm::vec3(-600.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), 1200.0f, hitDistance);
+    });
+    printf("    ray through the world: %.3f ms\n", rayMs);
+
+    // A thousand entities leave their fat boxes every frame
+    TestRandom random = { 5 };
+    std::vector<Aabb> moved = boxes;
+    const f64 moveMs = MeasureMs(20, [&]() {
+        for (u32 i = 0; i < 1000; ++i)
+        {
+            const u32 entity = (u32)RandomFloat(random, 0.0f, (f32)boxes.size() - 1.0f);
+            const glm::vec3 offset = glm::vec3(RandomFloat(random, -1.0f, 1.0f), RandomFloat(random, -1.0f, 1.0f), RandomFloat(random, -1.0f, 1.0f));
+            moved[entity] = Aabb{ moved[entity].min + offset, moved[entity].max + offset };
+            MoveTreeProxy(tree, proxies[entity], moved[entity]);
+        }
+    });
+    printf("    1000 moves: %.3f ms, the frustum queries walk the nodes until the tree settles\n", moveMs);
+}
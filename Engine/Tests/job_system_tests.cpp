@@ -0,0 +1,260 @@
+#include "test.h"
+#include "job_system.h"
+
+// More threads than most machines have cores, so the tests see contention everywhere
+#define TEST_THREADS 8
+
+TEST(JobDequeContention)
+{
+    const u32 jobCount = 200000;
+    std::unique_ptr<std::atomic<u32>[]> taken(new std::atomic<u32>[jobCount]());
+    std::unique_ptr<JobDeque> deque(new JobDeque);
+    deque->top = 0;
+    deque->bottom = 0;
+
+    // Thieves take from the top while the owner pushes and pops at the bottom
+    std::atomic<bool> done(false);
+    std::atomic<u32> stolen(0);
+    std::vector<std::thread> thieves;
+    for (u32 i = 0; i < TEST_THREADS - 1; ++i)
+    {
+        thieves.emplace_back([&]() {
+            Job job;
+            while (!done.load(std::memory_order_acquire))
+            {
+                if (StealJob(*deque, job))
+                {
+                    taken[job.begin].fetch_add(1);
+                    stolen.fetch_add(1);
+                }
+            }
+        });
+    }
+
+    Job job = {};
+    u32 pushed = 0;
+    while (pushed < jobCount)
+    {
+        job.begin = pushed;
+        if (PushJob(*deque, job))
+            pushed++;
+
+        // Popping one in three keeps the deque short, so the owner and the thieves meet on the last job
+        Job popped;
+        if ((pushed % 3 == 0 || pushed == jobCount) && PopJob(*deque, popped))
+            taken[popped.begin].fetch_add(1);
+    }
+
+    Job popped;
+    while (PopJob(*deque, popped))
+        taken[popped.begin].fetch_add(1);
+
+    done.store(true, std::memory_order_release);
+    for (std::thread& thief : thieves)
+        thief.join();
+
+    u32 wrongCount = 0;
+    for (u32 i = 0; i < jobCount; ++i)
+        wrongCount += taken[i].load() != 1;
+    CHECK(wrongCount == 0);
+    CHECK(deque->top.load() == deque->bottom.load());
+    printf("    %u of %u jobs stolen\n", stolen.load(), jobCount);
+}
+
+TEST(JobParallelForRunsEveryItemOnce)
+{
+    JobSystem jobs;
+    InitJobSystem(jobs, TEST_THREADS);
+
+    const u32 counts[] = { 1, 7, 64, 1000, 100003 };
+    const u32 alignments[] = { 1, 4, 64 };
+    for (u32 count : counts)
+    {
+        for (u32 alignment : alignments)
+        {
+            std::unique_ptr<std::atomic<u32>[]> visits(new std::atomic<u32>[count]());
+            std::atomic<u32> misalignedRanges(0);
+            ParallelFor(jobs, count, 16, alignment, [&](u32 begin, u32 end) {
+                if (begin % alignment != 0 || end > count)
+                    misalignedRanges.fetch_add(1);
+                for (u32 i = begin; i < end && i < count; ++i)
+                    visits[i].fetch_add(1);
+            });
+
+            u32 wrongCount = 0;
+            for (u32 i = 0; i < count; ++i)
+                wrongCount += visits[i].load() != 1;
+            CHECK(wrongCount == 0);
+            CHECK(misalignedRanges.load() == 0);
+        }
+    }
+
+    ShutdownJobSystem(jobs);
+}
+
+TEST(JobNestedParallelFor)
+{
+    JobSystem jobs;
+    InitJobSystem(jobs, TEST_THREADS);
+
+    // The outer jobs wait on their inner loops, the waits run the inner jobs of the others
+    const u32 outerCount = 32;
+    const u32 innerCount = 4096;
+    std::unique_ptr<std::atomic<u32>[]> visits(new std::atomic<u32>[outerCount * innerCount]());
+    ParallelFor(jobs, outerCount, 1, 1, [&](u32 outerBegin, u32 outerEnd) {
+        for (u32 outer = outerBegin; outer < outerEnd; ++outer)
+        {
+            ParallelFor(jobs, innerCount, 64, 1, [&](u32 begin, u32 end) {
+                for (u32 inner = begin; inner < end; ++inner)
+                    visits[outer * innerCount + inner].fetch_add(1);
+            });
+        }
+    });
+
+    u32 wrongCount = 0;
+    for (u32 i = 0; i < outerCount * innerCount; ++i)
+        wrongCount += visits[i].load() != 1;
+    CHECK(wrongCount == 0);
+
+    ShutdownJobSystem(jobs);
+}
+
+struct DependentJobs
+{
+    JobSystem*       jobs;
+    JobCounter*      counter;
+    std::atomic<u32> childrenRun;
+};
+
+static void ChildJob(void* data, u32, u32)
+{
+    DependentJobs& dependent = *(DependentJobs*)data;
+    dependent.childrenRun.fetch_add(1);
+}
+
+// Children count on the counter of their parent before it is done, so the wait covers them too
+static void ParentJob(void* data, u32, u32)
+{
+    DependentJobs& dependent = *(DependentJobs*)data;
+    for (u32 i = 0; i < 8; ++i)
+        SubmitJob(*dependent.jobs, ChildJob, data, i, i + 1, dependent.counter);
+}
+
+TEST(JobWaitForCounterCoversDependentJobs)
+{
+    JobSystem jobs;
+    InitJobSystem(jobs, TEST_THREADS);
+
+    for (u32 round = 0; round < 100; ++round)
+    {
+        JobCounter counter;
+        counter.pending = 0;
+        DependentJobs dependent;
+        dependent.jobs = &jobs;
+        dependent.counter = &counter;
+        dependent.childrenRun = 0;
+
+        for (u32 i = 0; i < 32; ++i)
+            SubmitJob(jobs, ParentJob, &dependent, i, i + 1, &counter);
+        WaitForCounter(jobs, counter);
+
+        CHECK(dependent.childrenRun.load() == 32 * 8);
+        CHECK(counter.pending.load() == 0);
+    }
+
+    ShutdownJobSystem(jobs);
+}
+
+struct MainLaneJobs
+{
+    JobSystem*       jobs;
+    JobCounter*      mainCounter;
+    std::atomic<u32> mainJobsRun;
+    std::thread::id  mainJobThread;
+};
+
+static void MainLaneJob(void* data, u32, u32)
+{
+    MainLaneJobs& lane = *(MainLaneJobs*)data;
+    lane.mainJobThread = std::this_thread::get_id();
+    lane.mainJobsRun.fetch_add(1);
+}
+
+static void QueueMainLaneJob(void* data, u32, u32)
+{
+    MainLaneJobs& lane = *(MainLaneJobs*)data;
+    SubmitMainThreadJob(*lane.jobs, MainLaneJob, data, 0, 1, lane.mainCounter);
+}
+
+TEST(JobMainLaneRunsOnlyWhereDrained)
+{
+    JobSystem jobs;
+    InitJobSystem(jobs, TEST_THREADS);
+
+    // A render pass waits with GL state bound, the GL jobs queued meanwhile wait for the next frame
+    JobCounter counter;
+    counter.pending = 0;
+    JobCounter mainCounter;
+    mainCounter.pending = 0;
+    MainLaneJobs lane;
+    lane.jobs = &jobs;
+    lane.mainCounter = &mainCounter;
+    lane.mainJobsRun = 0;
+
+    for (u32 i = 0; i < 16; ++i)
+        SubmitJob(jobs, QueueMainLaneJob, &lane, i, i + 1, &counter);
+    WaitForCounter(jobs, counter);
+    CHECK(lane.mainJobsRun.load() == 0);
+    CHECK(mainCounter.pending.load() == 16);
+
+    RunMainThreadJobs(jobs);
+    CHECK(lane.mainJobsRun.load() == 16);
+    CHECK(mainCounter.pending.load() == 0);
+    CHECK(lane.mainJobThread == std::this_thread::get_id());
+
+    // A load waits on jobs that queue their GL work on the same counter, like the cubemap faces
+    lane.mainCounter = &counter;
+    lane.mainJobsRun = 0;
+    lane.mainJobThread = std::thread::id();
+    for (u32 i = 0; i < 6; ++i)
+        SubmitJob(jobs, QueueMainLaneJob, &lane, i, i + 1, &counter);
+    WaitForCounterAndMainThreadJobs(jobs, counter);
+    CHECK(lane.mainJobsRun.load() == 6);
+    CHECK(lane.mainJobThread == std::this_thread::get_id());
+
+    ShutdownJobSystem(jobs);
+}
+
+BENCHMARK(JobParallelForScaling)
+{
+    const u32 count = 1 << 22;
+    std::vector<f32> values(count);
+    for (u32 i = 0; i < count; ++i)
+        values[i] = (f32)i;
+
+    // Powers of two up to the hardware threads, and those themselves
+    const u32 hardwareThreads = glm::min(glm::max(std::thread::hardware_concurrency(), 1u), (u32)JOB_SYSTEM_MAX_THREADS);
+    std::vector<u32> threadCounts;
+    for (u32 threads = 1; threads < hardwareThreads; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(hardwareThreads);
+
+    f64 singleThreadMs = 0.0;
+    for (u32 threads : threadCounts)
+    {
+        JobSystem jobs;
+        InitJobSystem(jobs, threads);
+
+        const f64 ms = MeasureMs(10, [&]() {
+            ParallelFor(jobs, count, 4096, 1, [&](u32 begin, u32 end) {
+                for (u32 i = begin; i < end; ++i)
+                    values[i] = glm::sqrt(values[i] * values[i] + 1.0f) * 0.5f + glm::sin(values[i]);
+            });
+        });
+        if (threads == 1)
+            singleThreadMs = ms;
+        printf("    %u threads: %.3f ms for %u items, %.2fx, %u jobs stolen\n", threads, ms, count, singleThreadMs / ms, jobs.stolenJobs.load());
+
+        ShutdownJobSystem(jobs);
+    }
+}
@@ -0,0 +1,213 @@
+#include "test.h"
+#include "occlusion_culling.h"
+
+// Camera at the origin looking down +z, as the engine sets up its projection
+static glm::mat4 TestViewProjection()
+{
+    const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+    return projection * glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+// Quad facing the camera at the given depth, both windings so one of them is a front face
+static void AddWall(OcclusionCuller& occlusion, const glm::mat4& viewProjection, glm::vec2 min, glm::vec2 max, f32 z)
+{
+    const f32 vertices[] = { min.x, min.y, z,   max.x, min.y, z,   max.x, max.y, z,   min.x, max.y, z };
+    const u32 indices[] = { 0, 1, 2, 0, 2, 3,   0, 2, 1, 0, 3, 2 };
+    AddOccluderTriangles(occlusion, vertices, 3, 4, indices, ARRAY_COUNT(indices), viewProjection);
+}
+
+// Closed box mesh with the faces wound counter clockwise seen from outside, like the engine meshes
+static void MakeBoxMesh(const glm::vec3& center, const glm::vec3& extent, std::vector<f32>& vertices, std::vector<u32>& indices)
+{
+    for (u32 axis = 0; axis < 3; ++axis)
+    {
+        for (f32 side = -1.0f; side <= 1.0f; side += 2.0f)
+        {
+            const glm::vec3 normal = glm::vec3(axis == 0, axis == 1, axis == 2) * side;
+            const glm::vec3 u = glm::vec3(axis == 1, axis == 2, axis == 0);
+            const glm::vec3 v = glm::cross(normal, u);
+
+            const u32 first = (u32)vertices.size() / 3;
+            const glm::vec3 corners[4] = { normal - u - v, normal + u - v, normal + u + v, normal - u + v };
+            for (const glm::vec3& corner : corners)
+            {
+                const glm::vec3 position = center + corner * extent;
+                vertices.insert(vertices.end(), { position.x, position.y, position.z });
+            }
+
+            // u x v points along the normal, so 0 1 2 is counter clockwise seen from outside
+            indices.insert(indices.end(), { first, first + 1, first + 2, first, first + 2, first + 3 });
+        }
+    }
+}
+
+static void AddBoxOccluder(OcclusionCuller& occlusion, const glm::mat4& viewProjection, const glm::vec3& center, const glm::vec3& extent)
+{
+    std::vector<f32> vertices;
+    std::vector<u32> indices;
+    MakeBoxMesh(center, extent, vertices, indices);
+    AddOccluderTriangles(occlusion, vertices.data(), 3, vertices.size() / 3, indices.data(), indices.size(), viewProjection);
+}
+
+TEST(OcclusionWallHidesTheBoxesBehindIt)
+{
+    JobSystem jobs;
+    InitJobSystem(jobs);
+
+    OcclusionCuller occlusion = {};
+    const glm::mat4 viewProjection = TestViewProjection();
+    AddWall(occlusion, viewProjection, glm::vec2(-10.0f), glm::vec2(10.0f), 10.0f);
+    CHECK(occlusion.triangles.size() == 2);
+    RasterizeOccluders(occlusion, jobs);
+
+    // Behind the wall, whatever their size on screen
+    CHECK(IsBoxOccluded(occlusion, viewProjection, glm::vec3(0.0f, 0.0f, 20.0f), glm::vec3(1.0f)));
+    CHECK(IsBoxOccluded(occlusion, viewProjection, glm::vec3(3.0f, -2.0f, 50.0f), glm::vec3(8.0f)));
+    CHECK(IsBoxOccluded(occlusion, viewProjection, glm::vec3(-7.0f, 7.0f, 11.0f), glm::vec3(0.5f)));
+
+    // In front of the wall, crossing it, or sticking out of its sides
+    CHECK(!IsBoxOccluded(occlusion, viewProjection, glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(1.0f)));
+    CHECK(!IsBoxOccluded(occlusion, viewProjection, glm::vec3(0.0f, 0.0f, 10.0f), glm::vec3(1.0f)));
+    CHECK(!IsBoxOccluded(occlusion, viewProjection, glm::vec3(25.0f, 0.0f, 20.0f), glm::vec3(2.0f)));
+    CHECK(!IsBoxOccluded(occlusion, viewProjection, glm::vec3(0.0f, 30.0f, 40.0f), glm::vec3(2.0f)));
+
+    ShutdownJobSystem(jobs);
+}
+
+TEST(OcclusionBoxDoesNotHideItsOwnMesh)
+{
+    JobSystem jobs;
+    InitJobSystem(jobs);
+
+    const glm::mat4 viewProjection = TestViewProjection();
+    const glm::vec3 centers[] = { glm::vec3(0.0f, 0.0f, 8.0f), glm::vec3(3.0f, -1.0f, 6.0f), glm::vec3(-20.0f, 8.0f, 40.0f) };
+    const glm::vec3 extents[] = { glm::vec3(2.0f), glm::vec3(0.5f, 2.0f, 1.0f), glm::vec3(5.0f, 1.0f, 3.0f) };
+
+    for (u32 i = 0; i < ARRAY_COUNT(centers); ++i)
+    {
+        OcclusionCuller occlusion = {};
+        AddBoxOccluder(occlusion, viewProjection, centers[i], extents[i]);
+        CHECK(!occlusion.triangles.empty());
+        RasterizeOccluders(occlusion, jobs);
+
+        // The front faces of the occluder lie on its bounds, the bounds are never behind them
+        CHECK(!IsBoxOccluded(occlusion, viewProjection, centers[i], extents[i]));
+        CHECK(!IsBoxOccluded(occlusion, viewProjection, centers[i], extents[i] * 1.01f));
+
+        // Only the back faces are culled, the front ones hide what is right behind the box
+        const glm::vec3 behind = centers[i] * (1.0f + 4.0f * glm::length(extents[i]) / glm::length(centers[i]));
+        CHECK(IsBoxOccluded(occlusion, viewProjection, behind, extents[i] * 0.1f));
+    }
+
+    ShutdownJobSystem(jobs);
+}
+
+TEST(OcclusionNearPlaneCrossing)
+{
+    JobSystem jobs;
+    InitJobSystem(jobs);
+
+    OcclusionCuller occlusion = {};
+    const glm::mat4 viewProjection = TestViewProjection();
+
+    // A floor running from behind the camera into the distance is dropped, it hides nothing
+    const f32 floor[] = { -50.0f, -1.0f, -5.0f,   50.0f, -1.0f, -5.0f,   50.0f, -1.0f, 90.0f,   -50.0f, -1.0f, 90.0f };
+    const u32 floorIndices[] = { 0, 1, 2, 0, 2, 3,   0, 2, 1, 0, 3, 2 };
+    AddOccluderTriangles(occlusion, floor, 3, 4, floorIndices, ARRAY_COUNT(floorIndices), viewProjection);
+    CHECK(occlusion.triangles.empty());
+
+    // Boxes around the camera cross the near plane and are never hidden
+    AddWall(occlusion, viewProjection, glm::vec2(-10.0f), glm::vec2(10.0f), 10.0f);
+    RasterizeOccluders(occlusion, jobs);
+    CHECK(!IsBoxOccluded(occlusion, viewProjection, glm::vec3(0.0f), glm::vec3(1.0f)));
+    CHECK(!IsBoxOccluded(occlusion, viewProjection, glm::vec3(0.0f, 0.0f, 15.0f), glm::vec3(1.0f, 1.0f, 16.0f)));
+    CHECK(IsBoxOccluded(occlusion, viewProjection, glm::vec3(0.0f, 0.0f, 15.0f), glm::vec3(1.0f, 1.0f, 4.0f)));
+
+    // Boxes entirely behind the camera are left to the frustum test
+    CHECK(!IsBoxOccluded(occlusion, viewProjection, glm::vec3(0.0f, 0.0f, -20.0f), glm::vec3(1.0f)));
+
+    ShutdownJobSystem(jobs);
+}
+
+TEST(OcclusionEdgeTiles)
+{
+    JobSystem jobs;
+    InitJobSystem(jobs);
+
+    OcclusionCuller occlusion = {};
+    const glm::mat4 viewProjection = TestViewProjection();
+
+    // Much larger than the screen, every pixel up to the last row and column is covered
+    AddWall(occlusion, viewProjection, glm::vec2(-100.0f), glm::vec2(100.0f), 10.0f);
+    RasterizeOccluders(occlusion, jobs);
+    for (u32 y = 0; y < OCCLUSION_BUFFER_HEIGHT; ++y)
+        for (u32 x = 0; x < OCCLUSION_BUFFER_WIDTH; ++x)
+            CHECK(occlusion.depth[x + y * OCCLUSION_BUFFER_WIDTH] < 1.0f);
+    for (f32 tileMaxDepth : occlusion.tileMaxDepth)
+        CHECK(tileMaxDepth < 1.0f);
+
+    // Boxes in the corners and partly off screen are tested on the pixels they cover
+    const f32 halfHeight = 30.0f * tanf(glm::radians(30.0f));
+    const f32 halfWidth = halfHeight * 16.0f / 9.0f;
+    CHECK(IsBoxOccluded(occlusion, viewProjection, glm::vec3(halfWidth, halfHeight, 30.0f), glm::vec3(1.0f)));
+    CHECK(IsBoxOccluded(occlusion, viewProjection, glm::vec3(-halfWidth, -halfHeight, 30.0f), glm::vec3(1.0f)));
+    CHECK(IsBoxOccluded(occlusion, viewProjection, glm::vec3(-halfWidth - 0.5f, 0.0f, 30.0f), glm::vec3(1.0f)));
+
+    // Off screen boxes are left to the frustum test
+    CHECK(!IsBoxOccluded(occlusion, viewProjection, glm::vec3(halfWidth * 2.0f, 0.0f, 30.0f), glm::vec3(1.0f)));
+
+    // A wall covering only the last tile columns: the tiles right of it are left empty and the
+    // boxes in front of them stay visible
+    occlusion.triangles.clear();
+    const f32 edgeWidth = 10.0f * tanf(glm::radians(30.0f)) * 16.0f / 9.0f;
+    AddWall(occlusion, viewProjection, glm::vec2(-2.0f * edgeWidth, -20.0f), glm::vec2(-0.8f * edgeWidth, 20.0f), 10.0f);
+    RasterizeOccluders(occlusion, jobs);
+    CHECK(occlusion.depth[(OCCLUSION_BUFFER_WIDTH - 1) + (OCCLUSION_BUFFER_HEIGHT - 1) * OCCLUSION_BUFFER_WIDTH] < 1.0f);
+    CHECK(occlusion.depth[0] == 1.0f);
+    CHECK(occlusion.tileMaxDepth[OCCLUSION_TILES_X - 1] < 1.0f);
+    CHECK(occlusion.tileMaxDepth[OCCLUSION_TILES_X * OCCLUSION_TILES_Y - 1] < 1.0f);
+    CHECK(occlusion.tileMaxDepth[0] == 1.0f);
+    CHECK(IsBoxOccluded(occlusion, viewProjection, glm::vec3(-0.95f * 3.0f * edgeWidth, 0.0f, 30.0f), glm::vec3(0.5f)));
+    CHECK(!IsBoxOccluded(occlusion, viewProjection, glm::vec3(0.0f, 0.0f, 30.0f), glm::vec3(0.5f)));
+
+    ShutdownJobSystem(jobs);
+}
+
+BENCHMARK(OcclusionRasterizeAndTest)
+{
+    JobSystem jobs;
+    InitJobSystem(jobs);
+
+    OcclusionCuller occlusion = {};
+    const glm::mat4 viewProjection = TestViewProjection();
+
+    // As many occluders as CullOcclusion() keeps, each a stack of thin boxes of a few thousand triangles
+    TestRandom random = { 7 };
+    for (u32 i = 0; i < OCCLUSION_MAX_OCCLUDERS; ++i)
+    {
+        const glm::vec3 center = glm::vec3(RandomFloat(random, -15.0f, 15.0f), RandomFloat(random, -6.0f, 6.0f), RandomFloat(random, 10.0f, 40.0f));
+        const glm::vec3 extent = glm::vec3(RandomFloat(random, 1.0f, 4.0f), RandomFloat(random, 1.0f, 4.0f), RandomFloat(random, 1.0f, 4.0f));
+        for (u32 slice = 0; slice < 200; ++slice)
+        {
+            const f32 offset = ((f32)slice / 200.0f - 0.5f) * 2.0f * extent.z;
+            AddBoxOccluder(occlusion, viewProjection, center + glm::vec3(0.0f, 0.0f, offset), glm::vec3(extent.x, extent.y, extent.z / 200.0f));
+        }
+    }
+
+    const f64 rasterizeMs = MeasureMs(20, [&]() { RasterizeOccluders(occlusion, jobs); });
+    printf("    rasterize: %.3f ms for %u triangles on %u threads\n", rasterizeMs, (u32)occlusion.triangles.size(), jobs.threadCount);
+
+    std::vector<glm::vec3> centers(10000);
+    for (glm::vec3& center : centers)
+        center = glm::vec3(RandomFloat(random, -30.0f, 30.0f), RandomFloat(random, -15.0f, 15.0f), RandomFloat(random, 5.0f, 90.0f));
+
+    u32 occluded = 0;
+    const f64 testMs = MeasureMs(20, [&]() {
+        occluded = 0;
+        for (const glm::vec3& center : centers)
+            occluded += IsBoxOccluded(occlusion, viewProjection, center, glm::vec3(0.5f)) ? 1 : 0;
+    });
+    printf("    %u boxes tested: %.3f ms, %u occluded\n", (u32)centers.size(), testMs, occluded);
+
+    ShutdownJobSystem(jobs);
+}
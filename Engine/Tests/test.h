@@ -0,0 +1,79 @@
+//
+// test.h: Headless tests and benchmarks of the CPU-side engine modules. TEST() and BENCHMARK()
+// register a function that test_main.cpp runs, CHECK() reports a failure and lets the test
+// go on. Nothing here needs a window or a GL context.
+//
+
+#pragma once
+
+#include "platform.h"
+
+#include <chrono>
+
+typedef void (*TestFunction)();
+
+struct TestCase
+{
+    const char*  name;
+    TestFunction function;
+    bool         benchmark;
+};
+
+std::vector<TestCase>& GetTestCases();
+
+struct TestRegistrar
+{
+    TestRegistrar(const char* name, TestFunction function, bool benchmark)
+    {
+        TestCase testCase = { name, function, benchmark };
+        GetTestCases().push_back(testCase);
+    }
+};
+
+void ReportFailure(const char* file, int line, const char* expression);
+
+#define TEST(name)                                                       \
+    static void name();                                                  \
+    static TestRegistrar name##Registrar(#name, name, false);            \
+    static void name()
+
+#define BENCHMARK(name)                                                  \
+    static void name();                                                  \
+    static TestRegistrar name##Registrar(#name, name, true);             \
+    static void name()
+
+#define CHECK(condition)                                                 \
+    do                                                                   \
+    {                                                                    \
+        if (!(condition))                                                \
+            ReportFailure(__FILE__, __LINE__, #condition);               \
+    } while (0)
+
+// Best time of the runs in milliseconds, the first run warms the caches up and is not counted
+template <typename Function>
+f64 MeasureMs(u32 runs, const Function& function)
+{
+    function();
+
+    f64 best = 1e30;
+    for (u32 run = 0; run < runs; ++run)
+    {
+        const auto start = std::chrono::high_resolution_clock::now();
+        function();
+        const auto end = std::chrono::high_resolution_clock::now();
+        best = glm::min(best, std::chrono::duration<f64, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+// Deterministic random numbers, so every run of a test sees the same scene
+struct TestRandom
+{
+    u32 state;
+};
+
+inline f32 RandomFloat(TestRandom& random, f32 min, f32 max)
+{
+    random.state = random.state * 1664525u + 1013904223u;
+    return min + (max - min) * (f32)(random.state >> 8) / (f32)(1u << 24);
+}
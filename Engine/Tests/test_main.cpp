@@ -0,0 +1,63 @@
+//
+// test_main.cpp: Runs the registered tests, or the benchmarks with --benchmark. Any other
+// argument only keeps the cases whose name contains it. Returns the number of failed tests.
+//
+
+#include "test.h"
+
+#include <string.h>
+
+static u32 CurrentFailures = 0;
+
+std::vector<TestCase>& GetTestCases()
+{
+    static std::vector<TestCase> testCases;
+    return testCases;
+}
+
+void ReportFailure(const char* file, int line, const char* expression)
+{
+    printf("    %s(%d): CHECK(%s) failed\n", file, line, expression);
+    CurrentFailures++;
+}
+
+// The engine modules log through the platform layer
+void LogString(const char* str)
+{
+    printf("    %s\n", str);
+}
+
+int main(int argc, char** argv)
+{
+    bool benchmarks = false;
+    const char* filter = NULL;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--benchmark") == 0)
+            benchmarks = true;
+        else
+            filter = argv[i];
+    }
+
+    u32 runCount = 0;
+    u32 failedCount = 0;
+    for (const TestCase& testCase : GetTestCases())
+    {
+        if (testCase.benchmark != benchmarks || (filter && !strstr(testCase.name, filter)))
+            continue;
+
+        printf("%s\n", testCase.name);
+        CurrentFailures = 0;
+        testCase.function();
+        runCount++;
+
+        if (CurrentFailures > 0)
+        {
+            printf("    FAILED\n");
+            failedCount++;
+        }
+    }
+
+    printf("%u %s run, %u failed\n", runCount, benchmarks ? "benchmarks" : "tests", failedCount);
+    return (int)failedCount;
+}
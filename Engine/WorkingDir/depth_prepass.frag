@@ -0,0 +1,6 @@
+#version 330 core
+
+// Only depth is written, the color writes are masked during the prepass
+void main()
+{
+}
@@ -1,9 +1,8 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
-layout (location = 2) in vec2 aTexCoords;
 
-out vec2 TexCoords;
+// Must produce the same depth as model_loading.vert for the GL_EQUAL color pass
+invariant gl_Position;
 
 uniform mat4 model;
 uniform mat4 view;
@@ -11,6 +10,5 @@ uniform mat4 projection;
 
 void main()
 {
-    //TexCoords = aTexCoords;    
     gl_Position = projection * view * model * vec4(aPos, 1.0);
-}
\ No newline at end of file
+}
@@ -0,0 +1,75 @@
+#ifdef GBUFFER_VIEW_SHADER
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec2 aTexCoord;
+
+void main()
+{
+	gl_Position = vec4(aPosition, 1.0);
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+layout(binding = 0, std140) uniform GlobalParams
+{
+	vec3 uCameraPosition;
+	unsigned int uLightCount; 
+	mat4 uViewMatrix;
+	uvec4 uClusterGrid;  // xyz: cluster counts, w: directional lights at the start of uLightIndices
+	vec4 uClusterParams; // xy: tile size in pixels, z: depth slice scale, w: depth slice bias
+	mat4 uInverseViewProjectionMatrix;
+	vec4 uViewportSize;   // xy: size of the rendered area in pixels, zw: its inverse
+	vec4 uJitter;         // xy: NDC offset of the projection, zw: the same in render pixels
+};
+
+uniform sampler2D gNormal;     // Octahedral encoding
+uniform sampler2D gAlbedoSpec;
+uniform sampler2D gDepth;      // Hardware depth, the position is reconstructed from it
+
+uniform int uRenderTarget;     // RenderTargetType: 1 position, 2 normals, 3 albedo, 4 depth
+uniform float uFar;
+uniform vec2 uSourceScale;     // Render size over display size, the G-buffer only covers that corner
+
+layout(location = 0) out vec4 oColor;
+
+vec3 DecodeNormal(vec2 f)
+{
+	f = f * 2.0 - 1.0;
+	vec3 n = vec3(f.x, f.y, 1.0 - abs(f.x) - abs(f.y));
+	float t = clamp(-n.z, 0.0, 1.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+vec3 ReconstructPosition(ivec2 pixel, float depth)
+{
+	vec2 uv = (vec2(pixel) + 0.5) * uViewportSize.zw;
+	vec4 position = uInverseViewProjectionMatrix * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+	return position.xyz / position.w;
+}
+
+void main()
+{
+	// Decodes the slim G-buffer so the debug views look like the former full targets
+	ivec2 pixel = ivec2(gl_FragCoord.xy * uSourceScale);
+	float depth = texelFetch(gDepth, pixel, 0).r;
+	vec3 position = ReconstructPosition(pixel, depth);
+
+	vec3 color = vec3(0.0);
+	switch (uRenderTarget)
+	{
+		case 1: color = position; break;
+		case 2: color = DecodeNormal(texelFetch(gNormal, pixel, 0).rg); break;
+		case 3: color = texelFetch(gAlbedoSpec, pixel, 0).rgb; break;
+		case 4: color = vec3(-(uViewMatrix * vec4(position, 1.0)).z / uFar); break;
+		default: break;
+	}
+
+	oColor = vec4(color, 1.0);
+}
+
+#endif
+#endif
\ No newline at end of file
@@ -0,0 +1,96 @@
+#if defined(GEOMETRY_PASS_INDIRECT_SHADER) || defined(GEOMETRY_PASS_INSTANCED_SHADER)
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(binding = 0, std140) uniform GlobalParams
+{
+	vec3 uCameraPosition;
+	unsigned int uLightCount;
+	mat4 uViewMatrix;
+	uvec4 uClusterGrid;  // xyz: cluster counts, w: directional lights at the start of uLightIndices
+	vec4 uClusterParams; // xy: tile size in pixels, z: depth slice scale, w: depth slice bias
+	mat4 uInverseViewProjectionMatrix;
+	vec4 uViewportSize;   // xy: size of the rendered area in pixels, zw: its inverse
+	vec4 uJitter;         // xy: NDC offset of the projection, zw: the same in render pixels
+};
+
+struct DrawData
+{
+	mat4 worldMatrix;
+	mat4 worldViewProjectionMatrix;
+	mat4 previousWorldViewProjectionMatrix; // Unjittered, of the last frame
+};
+
+layout(binding = 0, std430) readonly buffer DrawParams
+{
+	DrawData uDraws[];
+};
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec2 aTexCoord;
+
+#if defined(GEOMETRY_PASS_INDIRECT_SHADER)
+layout(location = 3) in uint aDrawId; // baseInstance of the indirect command + gl_InstanceID
+#define DRAW_INDEX aDrawId
+#else
+uniform uint uInstanceOffset; // first instance of the group in uDraws
+#define DRAW_INDEX (uInstanceOffset + uint(gl_InstanceID))
+#endif
+
+out vec2 vTexCoord;
+out vec3 vPosition; // in worldspace
+out vec3 vNormal; // in worldspace
+out vec4 vCurrentClip;  // Without the jitter
+out vec4 vPreviousClip;
+
+void main()
+{
+	DrawData draw = uDraws[DRAW_INDEX];
+
+	vTexCoord = aTexCoord;
+	vPosition = vec3(draw.worldMatrix * vec4(aPosition, 1.0));
+	vNormal = vec3(draw.worldMatrix * vec4(aNormal, 0.0));
+	gl_Position = draw.worldViewProjectionMatrix * vec4(aPosition, 1.0);
+
+	// The jitter only moves the samples, it is no motion of the surface
+	vCurrentClip = gl_Position - vec4(uJitter.xy * gl_Position.w, 0.0, 0.0);
+	vPreviousClip = draw.previousWorldViewProjectionMatrix * vec4(aPosition, 1.0);
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+in vec2 vTexCoord;
+in vec3 vPosition; // in worldspace
+in vec3 vNormal; // in worldspace
+in vec4 vCurrentClip;
+in vec4 vPreviousClip;
+
+uniform sampler2D uTexture;
+
+// Position is reconstructed from the depth buffer by the shading passes
+layout(location = 0) out vec4 gAlbedoSpec; // rgb: albedo, a: specular
+layout(location = 1) out vec2 gNormal;     // Octahedral encoding in [0, 1]
+layout(location = 2) out vec2 gVelocity;   // uv movement since the previous frame, only bound for the temporal upsampling
+
+vec2 OctWrap(vec2 v)
+{
+	return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 EncodeNormal(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	n.xy = n.z >= 0.0 ? n.xy : OctWrap(n.xy);
+	return n.xy * 0.5 + 0.5;
+}
+
+void main()
+{
+	gNormal = EncodeNormal(normalize(vNormal));
+	gVelocity = (vCurrentClip.xy / vCurrentClip.w - vPreviousClip.xy / vPreviousClip.w) * 0.5;
+	gAlbedoSpec = vec4(texture(uTexture, vTexCoord).rgb, 1.0);
+}
+
+#endif
+#endif
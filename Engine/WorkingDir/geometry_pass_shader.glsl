@@ -2,25 +2,23 @@
 
 #if defined(VERTEX) ///////////////////////////////////////////////////
 
-struct Light {
-	unsigned int type; 
-	vec3 position;
-	vec3 color; 
-	vec3 direction;
-	unsigned int intensity;
-};
-
 layout(binding = 0, std140) uniform GlobalParams
 {
 	vec3 uCameraPosition;
 	unsigned int uLightCount; 
-	Light uLights[16];
+	mat4 uViewMatrix;
+	uvec4 uClusterGrid;  // xyz: cluster counts, w: directional lights at the start of uLightIndices
+	vec4 uClusterParams; // xy: tile size in pixels, z: depth slice scale, w: depth slice bias
+	mat4 uInverseViewProjectionMatrix;
+	vec4 uViewportSize;   // xy: size of the rendered area in pixels, zw: its inverse
+	vec4 uJitter;         // xy: NDC offset of the projection, zw: the same in render pixels
 };
 
 layout(binding = 1, std140) uniform LocalParams
 {
 	mat4 uWorldMatrix;
 	mat4 uWorldViewProjectionMatrix;
+	mat4 uPreviousWorldViewProjectionMatrix; // Unjittered, of the last frame
 };
 
 layout(location = 0) in vec3 aPosition;
@@ -30,6 +28,8 @@ layout(location = 2) in vec2 aTexCoord;
 out vec2 vTexCoord;
 out vec3 vPosition; // in worldspace
 out vec3 vNormal; // in worldspace
+out vec4 vCurrentClip;  // Without the jitter
+out vec4 vPreviousClip;
 
 void main()
 {
@@ -37,6 +37,10 @@ void main()
 	vPosition = vec3(uWorldMatrix * vec4(aPosition, 1.0));
 	vNormal = vec3(uWorldMatrix * vec4(aNormal, 0.0));
 	gl_Position = uWorldViewProjectionMatrix * vec4(aPosition, 1.0);
+
+	// The jitter only moves the samples, it is no motion of the surface
+	vCurrentClip = gl_Position - vec4(uJitter.xy * gl_Position.w, 0.0, 0.0);
+	vPreviousClip = uPreviousWorldViewProjectionMatrix * vec4(aPosition, 1.0);
 }
 
 #elif defined(FRAGMENT) ///////////////////////////////////////////////
@@ -44,31 +48,33 @@ void main()
 in vec2 vTexCoord;
 in vec3 vPosition; // in worldspace
 in vec3 vNormal; // in worldspace
+in vec4 vCurrentClip;
+in vec4 vPreviousClip;
 
 uniform sampler2D uTexture;
 
-layout(location = 0) out vec4 FragColor;
-layout (location = 1) out vec3 gPosition;
-layout (location = 2) out vec3 gNormal;
-layout (location = 3) out vec3 gAlbedoSpec;
-layout(location = 4) out vec4 gDepth;
+// Position is reconstructed from the depth buffer by the shading passes
+layout(location = 0) out vec4 gAlbedoSpec; // rgb: albedo, a: specular
+layout(location = 1) out vec2 gNormal;     // Octahedral encoding in [0, 1]
+layout(location = 2) out vec2 gVelocity;   // uv movement since the previous frame, only bound for the temporal upsampling
 
-float near = 0.1;
-float far = 100.0;
+vec2 OctWrap(vec2 v)
+{
+	return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
 
-float LinearizeDepth(float depth)
+vec2 EncodeNormal(vec3 n)
 {
-	float z = depth * 2.0 - 1.0;
-	return (2.0 * near * far) / (far + near - z * (far - near));
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	n.xy = n.z >= 0.0 ? n.xy : OctWrap(n.xy);
+	return n.xy * 0.5 + 0.5;
 }
 
 void main()
 {
-	gPosition = vPosition; 
-	gNormal = normalize(vNormal);
-	gAlbedoSpec.rgb = texture(uTexture, vTexCoord).rgb;
-	gDepth = vec4(vec3(LinearizeDepth(gl_FragCoord.z) / far), 1.0);
-	FragColor = texture(uTexture, vTexCoord);
+	gNormal = EncodeNormal(normalize(vNormal));
+	gVelocity = (vCurrentClip.xy / vCurrentClip.w - vPreviousClip.xy / vPreviousClip.w) * 0.5;
+	gAlbedoSpec = vec4(texture(uTexture, vTexCoord).rgb, 1.0);
 }
 
 #endif
@@ -0,0 +1,146 @@
+#ifdef LIGHT_VOLUME_SHADER
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+struct Light {
+	vec3 position;
+	unsigned int type; 
+	vec3 color; 
+	unsigned int intensity;
+	vec3 direction;
+	float range; // Zero for directional lights
+};
+
+layout(binding = 1, std430) readonly buffer Lights
+{
+	Light uLights[];
+};
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec2 aTexCoord;
+
+uniform mat4 uViewProjectionMatrix;
+
+flat out unsigned int vLightIndex;
+
+// The unit sphere mesh is a polyhedron inscribed in the sphere, grow it to contain the whole range
+const float VOLUME_SCALE = 1.05;
+
+void main()
+{
+	// One instance per light, directional lights are shaded by the fullscreen pass
+	Light light = uLights[gl_InstanceID];
+	vLightIndex = uint(gl_InstanceID);
+
+	if (light.type != 1u || light.range <= 0.0)
+	{
+		gl_Position = vec4(0.0);
+		return;
+	}
+
+	gl_Position = uViewProjectionMatrix * vec4(light.position + aPosition * light.range * VOLUME_SCALE, 1.0);
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+struct Light {
+	vec3 position;
+	unsigned int type; 
+	vec3 color; 
+	unsigned int intensity;
+	vec3 direction;
+	float range; // Zero for directional lights
+};
+
+layout(binding = 0, std140) uniform GlobalParams
+{
+	vec3 uCameraPosition;
+	unsigned int uLightCount; 
+	mat4 uViewMatrix;
+	uvec4 uClusterGrid;  // xyz: cluster counts, w: directional lights at the start of uLightIndices
+	vec4 uClusterParams; // xy: tile size in pixels, z: depth slice scale, w: depth slice bias
+	mat4 uInverseViewProjectionMatrix;
+	vec4 uViewportSize;   // xy: size of the rendered area in pixels, zw: its inverse
+	vec4 uJitter;         // xy: NDC offset of the projection, zw: the same in render pixels
+};
+
+layout(binding = 1, std430) readonly buffer Lights
+{
+	Light uLights[];
+};
+
+flat in unsigned int vLightIndex;
+
+uniform sampler2D gNormal;     // Octahedral encoding
+uniform sampler2D gAlbedoSpec;
+uniform sampler2D gDepth;      // Hardware depth, the position is reconstructed from it
+
+vec3 DecodeNormal(vec2 f)
+{
+	f = f * 2.0 - 1.0;
+	vec3 n = vec3(f.x, f.y, 1.0 - abs(f.x) - abs(f.y));
+	float t = clamp(-n.z, 0.0, 1.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+vec3 ReconstructPosition(ivec2 pixel, float depth)
+{
+	vec2 uv = (vec2(pixel) + 0.5) * uViewportSize.zw;
+	vec4 position = uInverseViewProjectionMatrix * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+	return position.xyz / position.w;
+}
+
+layout(location = 0) out vec4 FragColor;
+
+vec3 CalculatePointLight(Light light, vec3 normal, vec3 view_dir, vec3 frag_pos, vec3 pixelColor);
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(gDepth, pixel, 0).r;
+	vec3 FragPos = ReconstructPosition(pixel, depth);
+
+	// The depth test only bounds the volume from behind, reject the surfaces in front of it as well
+	Light light = uLights[vLightIndex];
+	vec3 toLight = light.position - FragPos;
+	if (depth >= 1.0 || dot(toLight, toLight) > light.range * light.range)
+		discard;
+
+	vec3 Normal = DecodeNormal(texelFetch(gNormal, pixel, 0).rg);
+
+	vec3 Diffuse = texelFetch(gAlbedoSpec, pixel, 0).rgb;
+	vec3 viewDir = normalize(uCameraPosition - FragPos);
+
+	FragColor = vec4(CalculatePointLight(light, Normal, viewDir, FragPos, Diffuse), 0.0);
+}
+
+vec3 CalculatePointLight(Light light, vec3 normal, vec3 view_dir, vec3 frag_pos, vec3 pixelColor)
+{
+	float intensity = float(light.intensity);
+	intensity *= 0.01;
+
+	// Diffuse 
+	vec3 lightDirection = normalize(light.position - frag_pos);
+	float diff = max(dot(normal, lightDirection), 0.0);
+	vec3 diffuse = light.color * diff * pixelColor * intensity;
+
+	// Specular
+    vec3 halfwayDir = normalize(lightDirection + view_dir);  
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), 128.0);
+	vec3 specular = light.color * spec * intensity;
+
+	// Attenuation
+ 	float distance = length(light.position - frag_pos);
+    float attenuation = 1.0 / (1.0 + 0.3 * distance + 0.5 * (distance * distance));    
+
+	diffuse *= attenuation;
+    specular *= attenuation;
+
+	vec3 result = (diffuse + specular);
+	return result;
+}
+
+#endif
+#endif
\ No newline at end of file
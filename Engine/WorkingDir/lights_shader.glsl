@@ -2,26 +2,54 @@
 
 #if defined(VERTEX) ///////////////////////////////////////////////////
 
+struct Light {
+	vec3 position;
+	unsigned int type; 
+	vec3 color; 
+	unsigned int intensity;
+	vec3 direction;
+	float range; // Zero for directional lights
+};
+
+layout(binding = 1, std430) readonly buffer Lights
+{
+	Light uLights[];
+};
+
 layout(location = 0) in vec3 aPosition;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexCoord;
 
-uniform mat4 uWorldViewProjectionMatrix;
+uniform mat4 uViewProjectionMatrix;
+uniform unsigned int uLightType;
+uniform float uLightScale;
+
+flat out vec3 vColor;
 
 void main()
 {
-	gl_Position = uWorldViewProjectionMatrix * vec4(aPosition, 1.0);
+	// One instance per light, the ones of another type are collapsed and culled
+	Light light = uLights[gl_InstanceID];
+	vColor = light.color;
+
+	if (light.type != uLightType)
+	{
+		gl_Position = vec4(0.0);
+		return;
+	}
+
+	gl_Position = uViewProjectionMatrix * vec4(light.position + aPosition * uLightScale, 1.0);
 }
 
 #elif defined(FRAGMENT) ///////////////////////////////////////////////
 
-uniform vec3 lightColor; 
+flat in vec3 vColor;
 
 layout(location = 0) out vec4 FragColor;
 
 void main()
 {
-	FragColor = vec4(lightColor, 1.0);
+	FragColor = vec4(vColor, 1.0);
 }
 
 #endif
@@ -5,6 +5,9 @@ layout (location = 2) in vec2 aTexCoords;
 
 out vec2 TexCoords;
 
+// Same depth as depth_prepass.vert
+invariant gl_Position;
+
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
@@ -2,19 +2,16 @@
 
 #if defined(VERTEX) ///////////////////////////////////////////////////
 
-struct Light {
-	unsigned int type; 
-	vec3 position;
-	vec3 color; 
-	vec3 direction;
-	unsigned int intensity;
-};
-
 layout(binding = 0, std140) uniform GlobalParams
 {
 	vec3 uCameraPosition;
 	unsigned int uLightCount; 
-	Light uLights[16];
+	mat4 uViewMatrix;
+	uvec4 uClusterGrid;  // xyz: cluster counts, w: directional lights at the start of uLightIndices
+	vec4 uClusterParams; // xy: tile size in pixels, z: depth slice scale, w: depth slice bias
+	mat4 uInverseViewProjectionMatrix;
+	vec4 uViewportSize;   // xy: size of the rendered area in pixels, zw: its inverse
+	vec4 uJitter;         // xy: NDC offset of the projection, zw: the same in render pixels
 };
 
 layout(location = 0) in vec3 aPosition;
@@ -33,26 +30,158 @@ void main()
 
 
 struct Light {
-	unsigned int type; 
 	vec3 position;
+	unsigned int type; 
 	vec3 color; 
-	vec3 direction;
 	unsigned int intensity;
+	vec3 direction;
+	float range; // Zero for directional lights
 };
 
 layout(binding = 0, std140) uniform GlobalParams
 {
 	vec3 uCameraPosition;
 	unsigned int uLightCount; 
-	Light uLights[16];
+	mat4 uViewMatrix;
+	uvec4 uClusterGrid;  // xyz: cluster counts, w: directional lights at the start of uLightIndices
+	vec4 uClusterParams; // xy: tile size in pixels, z: depth slice scale, w: depth slice bias
+	mat4 uInverseViewProjectionMatrix;
+	vec4 uViewportSize;   // xy: size of the rendered area in pixels, zw: its inverse
+	vec4 uJitter;         // xy: NDC offset of the projection, zw: the same in render pixels
+};
+
+layout(binding = 1, std430) readonly buffer Lights
+{
+	Light uLights[];
 };
 
+layout(binding = 2, std430) readonly buffer LightClusters
+{
+	uvec2 uClusters[]; // Offset and count in uLightIndices
+};
+
+layout(binding = 3, std430) readonly buffer LightIndices
+{
+	unsigned int uLightIndices[];
+};
+
+uvec2 FindLightCluster(vec3 worldPosition)
+{
+	float depth = max(-(uViewMatrix * vec4(worldPosition, 1.0)).z, 1e-4);
+	unsigned int slice = uint(clamp(log(depth) * uClusterParams.z + uClusterParams.w, 0.0, float(uClusterGrid.z - 1)));
+	uvec2 tile = min(uvec2(gl_FragCoord.xy / uClusterParams.xy), uClusterGrid.xy - 1);
+	return uClusters[tile.x + (tile.y + slice * uClusterGrid.y) * uClusterGrid.x];
+}
+
 in vec2 vTexCoord;
 
-uniform sampler2D gPosition;
-uniform sampler2D gNormal;
+uniform sampler2D gNormal;     // Octahedral encoding
 uniform sampler2D gAlbedoSpec;
-uniform sampler2D gDepth;
+uniform sampler2D gDepth;      // Hardware depth, the position is reconstructed from it
+
+vec3 DecodeNormal(vec2 f)
+{
+	f = f * 2.0 - 1.0;
+	vec3 n = vec3(f.x, f.y, 1.0 - abs(f.x) - abs(f.y));
+	float t = clamp(-n.z, 0.0, 1.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+vec3 ReconstructPosition(ivec2 pixel, float depth)
+{
+	vec2 uv = (vec2(pixel) + 0.5) * uViewportSize.zw;
+	vec4 position = uInverseViewProjectionMatrix * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+	return position.xyz / position.w;
+}
+
+#define SHADOW_MAX_LIGHTS 2
+#define SHADOW_CASCADE_COUNT 4
+
+layout(binding = 2, std140) uniform ShadowParams
+{
+	mat4 uShadowMatrices[SHADOW_MAX_LIGHTS * SHADOW_CASCADE_COUNT]; // World to shadow map space, per light and cascade
+	vec4 uShadowSplits;                                             // View depth where each cascade ends
+	vec4 uShadowTexelSizes[SHADOW_MAX_LIGHTS];                      // World units per texel of each cascade
+	uvec4 uShadowLights;                                            // Light of each shadow map, 0xFFFFFFFF if unused
+};
+
+uniform sampler2DArrayShadow uShadowMap;
+
+float CalculateShadow(unsigned int lightIndex, vec3 frag_pos, vec3 normal)
+{
+	int slot = -1;
+	for (int i = 0; i < SHADOW_MAX_LIGHTS; ++i)
+	{
+		if (uShadowLights[i] == lightIndex)
+			slot = i;
+	}
+	if (slot < 0)
+		return 1.0;
+
+	float depth = -(uViewMatrix * vec4(frag_pos, 1.0)).z;
+	vec2 texel = 1.0 / vec2(textureSize(uShadowMap, 0).xy);
+	for (int cascade = 0; cascade < SHADOW_CASCADE_COUNT; ++cascade)
+	{
+		if (depth > uShadowSplits[cascade])
+			continue;
+
+		// Moving the lookup about a texel along the normal avoids most of the shadow acne
+		int layer = slot * SHADOW_CASCADE_COUNT + cascade;
+		vec3 offsetPos = frag_pos + normal * uShadowTexelSizes[slot][cascade] * 1.5;
+		vec3 coords = (uShadowMatrices[layer] * vec4(offsetPos, 1.0)).xyz;
+
+		// A cached cascade may not cover the pixel until it is rendered again, the next one does
+		if (any(lessThan(coords.xy, texel)) || any(greaterThan(coords.xy, 1.0 - texel)))
+			continue;
+
+		// 3x3 PCF, every tap is a bilinear comparison
+		float lit = 0.0;
+		for (int y = -1; y <= 1; ++y)
+		{
+			for (int x = -1; x <= 1; ++x)
+				lit += texture(uShadowMap, vec4(coords.xy + vec2(x, y) * texel, float(layer), coords.z));
+		}
+		return lit / 9.0;
+	}
+
+	return 1.0;
+}
+
+// Ambient lighting of the sky, baked by image_based_lighting.cpp
+uniform vec3 uIrradianceSH[9];    // L2 irradiance over pi
+uniform samplerCube uSpecularMap; // GGX prefiltered, the roughness grows with the mip
+uniform float uAmbientIntensity;
+uniform float uSpecularLod;
+
+vec3 EvaluateIrradiance(vec3 n)
+{
+	vec3 result = uIrradianceSH[0] * 0.282095;
+	result += uIrradianceSH[1] * 0.488603 * n.y;
+	result += uIrradianceSH[2] * 0.488603 * n.z;
+	result += uIrradianceSH[3] * 0.488603 * n.x;
+	result += uIrradianceSH[4] * 1.092548 * n.x * n.y;
+	result += uIrradianceSH[5] * 1.092548 * n.y * n.z;
+	result += uIrradianceSH[6] * 0.315392 * (3.0 * n.z * n.z - 1.0);
+	result += uIrradianceSH[7] * 1.092548 * n.x * n.z;
+	result += uIrradianceSH[8] * 0.546274 * (n.x * n.x - n.y * n.y);
+	return max(result, vec3(0.0));
+}
+
+vec3 CalculateAmbient(vec3 normal, vec3 view_dir, vec3 pixelColor)
+{
+	// Dielectric Fresnel, what the sky reflects does not reach the diffuse
+	float fresnel = 0.04 + 0.96 * pow(1.0 - max(dot(normal, view_dir), 0.0), 5.0);
+
+	// Same flip of z as the skybox
+	vec3 reflected = reflect(-view_dir, normal) * vec3(1.0, 1.0, -1.0);
+	vec3 specular = textureLod(uSpecularMap, reflected, uSpecularLod).rgb;
+
+	return uAmbientIntensity * (pixelColor * EvaluateIrradiance(normal) * (1.0 - fresnel) + specular * fresnel);
+}
+
+// Set when the point lights are shaded by their light volumes
+uniform bool uDirectionalOnly;
 
 layout(location = 0) out vec4 FragColor;
 
@@ -60,17 +189,34 @@ vec3 CalculateLighting(Light light, vec3 normal, vec3 view_dir, vec3 frag_pos, v
 
 void main()
 {
-	// retrieve data from gbuffer
-    vec3 FragPos = texture(gPosition, vTexCoord).rgb;
-    vec3 Normal = texture(gNormal, vTexCoord).rgb;
-    vec3 Diffuse = texture(gAlbedoSpec, vTexCoord).rgb;
+	// retrieve data from gbuffer, the background keeps the clear color
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(gDepth, pixel, 0).r;
+	if (depth >= 1.0)
+		discard;
+
+    vec3 FragPos = ReconstructPosition(pixel, depth);
+    vec3 Normal = DecodeNormal(texelFetch(gNormal, pixel, 0).rg);
+    vec3 Diffuse = texelFetch(gAlbedoSpec, pixel, 0).rgb;
     float Specular = 0;
 
 	vec3 viewDir  = normalize(uCameraPosition - FragPos);
 
     vec3 lighting  = vec3(0.0);
-    for(int i = 0; i < uLightCount; ++i)
-		lighting += CalculateLighting(uLights[i], Normal, viewDir, FragPos, Diffuse);
+    for(unsigned int i = 0; i < uClusterGrid.w; ++i)
+	{
+		unsigned int lightIndex = uLightIndices[i];
+		lighting += CalculateShadow(lightIndex, FragPos, Normal) * CalculateLighting(uLights[lightIndex], Normal, viewDir, FragPos, Diffuse);
+	}
+
+	if (!uDirectionalOnly)
+	{
+		uvec2 cluster = FindLightCluster(FragPos);
+		for(unsigned int i = 0; i < cluster.y; ++i)
+			lighting += CalculateLighting(uLights[uLightIndices[cluster.x + i]], Normal, viewDir, FragPos, Diffuse);
+	}
+
+	lighting += CalculateAmbient(Normal, viewDir, Diffuse);
 
     FragColor = vec4(lighting, 1.0);
 }
@@ -0,0 +1,22 @@
+#ifdef SHADOW_MAP_SHADER
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(location = 0) in vec3 aPosition;
+
+uniform mat4 uWorldViewProjectionMatrix;
+
+void main()
+{
+	gl_Position = uWorldViewProjectionMatrix * vec4(aPosition, 1.0);
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+// Depth only, the shadow map has no color attachment
+void main()
+{
+}
+
+#endif
+#endif
\ No newline at end of file
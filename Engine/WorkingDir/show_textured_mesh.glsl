@@ -2,19 +2,16 @@
 
 #if defined(VERTEX) ///////////////////////////////////////////////////
 
-struct Light {
-	unsigned int type; 
-	vec3 position;
-	vec3 color; 
-	vec3 direction;
-	unsigned int intensity;
-};
-
 layout(binding = 0, std140) uniform GlobalParams
 {
 	vec3 uCameraPosition;
 	unsigned int uLightCount; 
-	Light uLights[16];
+	mat4 uViewMatrix;
+	uvec4 uClusterGrid;  // xyz: cluster counts, w: directional lights at the start of uLightIndices
+	vec4 uClusterParams; // xy: tile size in pixels, z: depth slice scale, w: depth slice bias
+	mat4 uInverseViewProjectionMatrix;
+	vec4 uViewportSize;   // xy: size of the rendered area in pixels, zw: its inverse
+	vec4 uJitter;         // xy: NDC offset of the projection, zw: the same in render pixels
 };
 
 layout(binding = 1, std140) uniform LocalParams
@@ -51,20 +48,49 @@ in vec3 viewDir;
 uniform sampler2D uTexture;
 
 struct Light {
-	unsigned int type; 
 	vec3 position;
+	unsigned int type; 
 	vec3 color; 
-	vec3 direction;
 	unsigned int intensity;
+	vec3 direction;
+	float range; // Zero for directional lights
 };
 
 layout(binding = 0, std140) uniform GlobalParams
 {
 	vec3 uCameraPosition;
 	unsigned int uLightCount; 
-	Light uLights[16];
+	mat4 uViewMatrix;
+	uvec4 uClusterGrid;  // xyz: cluster counts, w: directional lights at the start of uLightIndices
+	vec4 uClusterParams; // xy: tile size in pixels, z: depth slice scale, w: depth slice bias
+	mat4 uInverseViewProjectionMatrix;
+	vec4 uViewportSize;   // xy: size of the rendered area in pixels, zw: its inverse
+	vec4 uJitter;         // xy: NDC offset of the projection, zw: the same in render pixels
+};
+
+layout(binding = 1, std430) readonly buffer Lights
+{
+	Light uLights[];
 };
 
+layout(binding = 2, std430) readonly buffer LightClusters
+{
+	uvec2 uClusters[]; // Offset and count in uLightIndices
+};
+
+layout(binding = 3, std430) readonly buffer LightIndices
+{
+	unsigned int uLightIndices[];
+};
+
+uvec2 FindLightCluster(vec3 worldPosition)
+{
+	float depth = max(-(uViewMatrix * vec4(worldPosition, 1.0)).z, 1e-4);
+	unsigned int slice = uint(clamp(log(depth) * uClusterParams.z + uClusterParams.w, 0.0, float(uClusterGrid.z - 1)));
+	uvec2 tile = min(uvec2(gl_FragCoord.xy / uClusterParams.xy), uClusterGrid.xy - 1);
+	return uClusters[tile.x + (tile.y + slice * uClusterGrid.y) * uClusterGrid.x];
+}
+
 layout(location = 0) out vec4 FragColor;
 
 vec3 CalculateLighting(Light light, vec3 normal, vec3 viewDir, vec3 frag_pos);
@@ -73,8 +99,12 @@ void main()
 {
 	vec3 lightColorInfluence = vec3(0.0);
 	
-	for(int i = 0; i < uLightCount; ++i)
-		lightColorInfluence += CalculateLighting(uLights[i], vNormal, viewDir, vPosition);
+	for(unsigned int i = 0; i < uClusterGrid.w; ++i)
+		lightColorInfluence += CalculateLighting(uLights[uLightIndices[i]], vNormal, viewDir, vPosition);
+
+	uvec2 cluster = FindLightCluster(vPosition);
+	for(unsigned int i = 0; i < cluster.y; ++i)
+		lightColorInfluence += CalculateLighting(uLights[uLightIndices[cluster.x + i]], vNormal, viewDir, vPosition);
 
 	FragColor = texture(uTexture, vTexCoord) * vec4(lightColorInfluence, 1.0);
 }
@@ -107,7 +137,7 @@ vec3 CalculatePointLight(Light light, vec3 normal, vec3 view_dir, vec3 frag_pos)
  	float distance = length(light.position - frag_pos);
     float attenuation = 1.0 / (1.0 + 0.5 * distance + 1.0 * (distance * distance));    
 
-	vec3 result = (diffuse + specular);
+	vec3 result = (diffuse + specular) * attenuation;
 	return result;
 }
 
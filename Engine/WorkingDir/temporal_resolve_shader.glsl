@@ -0,0 +1,135 @@
+#ifdef TEMPORAL_RESOLVE_SHADER
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+// Triangle covering the screen, built from the vertex index with no vertex buffer bound
+void main()
+{
+	vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+layout(binding = 0, std140) uniform GlobalParams
+{
+	vec3 uCameraPosition;
+	unsigned int uLightCount;
+	mat4 uViewMatrix;
+	uvec4 uClusterGrid;  // xyz: cluster counts, w: directional lights at the start of uLightIndices
+	vec4 uClusterParams; // xy: tile size in pixels, z: depth slice scale, w: depth slice bias
+	mat4 uInverseViewProjectionMatrix;
+	vec4 uViewportSize;   // xy: size of the rendered area in pixels, zw: its inverse
+	vec4 uJitter;         // xy: NDC offset of the projection, zw: the same in render pixels
+};
+
+uniform sampler2D uCurrent;  // Shading at the render size, in the corner of the texture
+uniform sampler2D uVelocity; // uv movement since the previous frame
+uniform sampler2D uDepth;
+uniform sampler2D uHistory;  // Resolved previous frame at the display size
+
+uniform vec4 uDisplaySize;   // xy: size in pixels, zw: its inverse
+uniform float uBlend;
+uniform bool uResetHistory;
+
+layout(location = 0) out vec4 oColor;
+
+const float VARIANCE_CLIP_GAMMA = 1.25; // Standard deviations the history may be away from the neighbourhood mean
+
+// Catmull-Rom filtered history, five bilinear taps since the corners of the 4x4 weigh little.
+// Bilinear alone blurs a little more on every frame the history is reprojected.
+vec3 SampleHistory(vec2 uv)
+{
+	vec2 size = uDisplaySize.xy;
+	vec2 position = uv * size;
+	vec2 center = floor(position - 0.5) + 0.5;
+	vec2 f = position - center;
+
+	vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+	vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+	vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+	vec2 w3 = f * f * (-0.5 + 0.5 * f);
+	vec2 w12 = w1 + w2;
+
+	vec2 uv0 = (center - 1.0) * uDisplaySize.zw;
+	vec2 uv12 = (center + w2 / w12) * uDisplaySize.zw;
+	vec2 uv3 = (center + 2.0) * uDisplaySize.zw;
+
+	vec3 color = texture(uHistory, vec2(uv12.x, uv0.y)).rgb * (w12.x * w0.y);
+	color += texture(uHistory, vec2(uv0.x, uv12.y)).rgb * (w0.x * w12.y);
+	color += texture(uHistory, uv12).rgb * (w12.x * w12.y);
+	color += texture(uHistory, vec2(uv3.x, uv12.y)).rgb * (w3.x * w12.y);
+	color += texture(uHistory, vec2(uv12.x, uv3.y)).rgb * (w12.x * w3.y);
+	float weight = w12.x * w0.y + w0.x * w12.y + w12.x * w12.y + w3.x * w12.y + w12.x * w3.y;
+	return max(color / weight, vec3(0.0));
+}
+
+void main()
+{
+	vec2 uv = gl_FragCoord.xy * uDisplaySize.zw;
+
+	// Unjittered position of the pixel center in render pixels. The sample of render pixel p
+	// shows what is at p + 0.5 - jitter.
+	vec2 position = uv * uViewportSize.xy;
+	ivec2 nearest = ivec2(floor(position + uJitter.zw));
+	ivec2 maxPixel = ivec2(uViewportSize.xy) - 1;
+	vec2 displayPerRender = uDisplaySize.xy * uViewportSize.zw;
+
+	// Current samples around the pixel weighted by their distance in display pixels, and
+	// the statistics of the neighbourhood the history is clamped to
+	vec3 current = vec3(0.0);
+	float weightSum = 0.0;
+	float maxWeight = 0.0;
+	vec3 moment1 = vec3(0.0);
+	vec3 moment2 = vec3(0.0);
+	float closestDepth = 1.0;
+	ivec2 closest = clamp(nearest, ivec2(0), maxPixel);
+	for (int y = -1; y <= 1; ++y)
+	{
+		for (int x = -1; x <= 1; ++x)
+		{
+			ivec2 pixel = clamp(nearest + ivec2(x, y), ivec2(0), maxPixel);
+			vec3 color = texelFetch(uCurrent, pixel, 0).rgb;
+
+			// Gaussian fit of a Blackman-Harris window
+			vec2 offset = (vec2(pixel) + 0.5 - uJitter.zw - position) * displayPerRender;
+			float weight = exp(-2.29 * dot(offset, offset));
+			current += color * weight;
+			weightSum += weight;
+			maxWeight = max(maxWeight, weight);
+
+			moment1 += color;
+			moment2 += color * color;
+
+			// Edges move with the closest surface, not with the background behind them
+			float depth = texelFetch(uDepth, pixel, 0).r;
+			if (depth < closestDepth)
+			{
+				closestDepth = depth;
+				closest = pixel;
+			}
+		}
+	}
+	current /= max(weightSum, 1e-5);
+
+	vec2 historyUv = uv - texelFetch(uVelocity, closest, 0).rg;
+	if (uResetHistory || any(lessThan(historyUv, vec2(0.0))) || any(greaterThan(historyUv, vec2(1.0))))
+	{
+		oColor = vec4(current, 1.0);
+		return;
+	}
+
+	// The history is clamped to a box around the neighbourhood mean, so what was hidden or
+	// lit differently on the previous frame does not leave trails
+	vec3 mean = moment1 / 9.0;
+	vec3 deviation = sqrt(max(moment2 / 9.0 - mean * mean, vec3(0.0)));
+	vec3 history = clamp(SampleHistory(historyUv), mean - VARIANCE_CLIP_GAMMA * deviation, mean + VARIANCE_CLIP_GAMMA * deviation);
+
+	// A sample landing on the pixel replaces more of the history than one far from it, so
+	// every display pixel converges to the samples that covered it across the jitter sequence
+	float alpha = uBlend * maxWeight;
+	oColor = vec4(mix(history, current, alpha), 1.0);
+}
+
+#endif
+#endif
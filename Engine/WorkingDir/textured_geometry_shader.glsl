@@ -8,9 +8,11 @@ layout(location = 2) in vec2 aTexCoord;
 
 out vec2 vTexCoord;
 
+uniform vec2 uTexCoordScale; // Part of the texture holding the image, it can be pooled at a larger size
+
 void main()
 {
-	vTexCoord = aTexCoord;
+	vTexCoord = aTexCoord * uTexCoordScale;
 	gl_Position = vec4(aPosition, 1.0);
 }
 
@@ -19,13 +21,41 @@ void main()
 in vec2 vTexCoord;
 
 uniform sampler2D uTexture;
+uniform vec2 uTexCoordScale;
+uniform float uSharpness;    // 0 for a plain bilinear upscale, up to 1
 
 layout(location = 0) out vec4 oColor;
 
 void main()
 {
-	oColor = texture(uTexture, vTexCoord);
+	// The taps stay inside the rendered corner, past it the texture holds older frames
+	vec2 texel = 1.0 / vec2(textureSize(uTexture, 0));
+	vec2 minTexCoord = 0.5 * texel;
+	vec2 maxTexCoord = uTexCoordScale - 0.5 * texel;
+	vec2 uv = clamp(vTexCoord, minTexCoord, maxTexCoord);
+
+	vec4 center = texture(uTexture, uv);
+	if (uSharpness <= 0.0)
+	{
+		oColor = center;
+		return;
+	}
+
+	vec3 north = texture(uTexture, clamp(uv + vec2(0.0, texel.y), minTexCoord, maxTexCoord)).rgb;
+	vec3 south = texture(uTexture, clamp(uv - vec2(0.0, texel.y), minTexCoord, maxTexCoord)).rgb;
+	vec3 east = texture(uTexture, clamp(uv + vec2(texel.x, 0.0), minTexCoord, maxTexCoord)).rgb;
+	vec3 west = texture(uTexture, clamp(uv - vec2(texel.x, 0.0), minTexCoord, maxTexCoord)).rgb;
+
+	// Contrast adaptive sharpening: the weight of the cross shrinks where the neighbourhood
+	// already spans the whole range, so edges do not ring and flat areas get the most
+	vec3 minColor = min(center.rgb, min(min(north, south), min(east, west)));
+	vec3 maxColor = max(center.rgb, max(max(north, south), max(east, west)));
+	vec3 amount = sqrt(clamp(min(minColor, 1.0 - maxColor) / max(maxColor, 1e-4), 0.0, 1.0));
+	vec3 weight = -amount * mix(0.125, 0.2, uSharpness);
+
+	vec3 color = (center.rgb + (north + south + east + west) * weight) / (1.0 + 4.0 * weight);
+	oColor = vec4(clamp(color, 0.0, 1.0), center.a);
 }
 
 #endif
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,330 @@
+#ifdef TILED_DEFERRED_SHADER
+
+#if defined(COMPUTE) //////////////////////////////////////////////////
+
+#define TILE_SIZE 16
+#define MAX_TILE_LIGHTS 256
+
+layout(local_size_x = TILE_SIZE, local_size_y = TILE_SIZE) in;
+
+struct Light {
+	vec3 position;
+	unsigned int type; 
+	vec3 color; 
+	unsigned int intensity;
+	vec3 direction;
+	float range; // Zero for directional lights
+};
+
+layout(binding = 0, std140) uniform GlobalParams
+{
+	vec3 uCameraPosition;
+	unsigned int uLightCount; 
+	mat4 uViewMatrix;
+	uvec4 uClusterGrid;  // xyz: cluster counts, w: directional lights at the start of uLightIndices
+	vec4 uClusterParams; // xy: tile size in pixels, z: depth slice scale, w: depth slice bias
+	mat4 uInverseViewProjectionMatrix;
+	vec4 uViewportSize;   // xy: size of the rendered area in pixels, zw: its inverse
+	vec4 uJitter;         // xy: NDC offset of the projection, zw: the same in render pixels
+};
+
+layout(binding = 1, std430) readonly buffer Lights
+{
+	Light uLights[];
+};
+
+uniform sampler2D gNormal;     // Octahedral encoding
+uniform sampler2D gAlbedoSpec;
+uniform sampler2D gDepth;      // Hardware depth, the position is reconstructed from it
+
+vec3 DecodeNormal(vec2 f)
+{
+	f = f * 2.0 - 1.0;
+	vec3 n = vec3(f.x, f.y, 1.0 - abs(f.x) - abs(f.y));
+	float t = clamp(-n.z, 0.0, 1.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+vec3 ReconstructPosition(ivec2 pixel, float depth)
+{
+	vec2 uv = (vec2(pixel) + 0.5) * uViewportSize.zw;
+	vec4 position = uInverseViewProjectionMatrix * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+	return position.xyz / position.w;
+}
+
+#define SHADOW_MAX_LIGHTS 2
+#define SHADOW_CASCADE_COUNT 4
+
+layout(binding = 2, std140) uniform ShadowParams
+{
+	mat4 uShadowMatrices[SHADOW_MAX_LIGHTS * SHADOW_CASCADE_COUNT]; // World to shadow map space, per light and cascade
+	vec4 uShadowSplits;                                             // View depth where each cascade ends
+	vec4 uShadowTexelSizes[SHADOW_MAX_LIGHTS];                      // World units per texel of each cascade
+	uvec4 uShadowLights;                                            // Light of each shadow map, 0xFFFFFFFF if unused
+};
+
+uniform sampler2DArrayShadow uShadowMap;
+
+float CalculateShadow(unsigned int lightIndex, vec3 frag_pos, vec3 normal)
+{
+	int slot = -1;
+	for (int i = 0; i < SHADOW_MAX_LIGHTS; ++i)
+	{
+		if (uShadowLights[i] == lightIndex)
+			slot = i;
+	}
+	if (slot < 0)
+		return 1.0;
+
+	float depth = -(uViewMatrix * vec4(frag_pos, 1.0)).z;
+	vec2 texel = 1.0 / vec2(textureSize(uShadowMap, 0).xy);
+	for (int cascade = 0; cascade < SHADOW_CASCADE_COUNT; ++cascade)
+	{
+		if (depth > uShadowSplits[cascade])
+			continue;
+
+		// Moving the lookup about a texel along the normal avoids most of the shadow acne
+		int layer = slot * SHADOW_CASCADE_COUNT + cascade;
+		vec3 offsetPos = frag_pos + normal * uShadowTexelSizes[slot][cascade] * 1.5;
+		vec3 coords = (uShadowMatrices[layer] * vec4(offsetPos, 1.0)).xyz;
+
+		// A cached cascade may not cover the pixel until it is rendered again, the next one does
+		if (any(lessThan(coords.xy, texel)) || any(greaterThan(coords.xy, 1.0 - texel)))
+			continue;
+
+		// 3x3 PCF, every tap is a bilinear comparison
+		float lit = 0.0;
+		for (int y = -1; y <= 1; ++y)
+		{
+			for (int x = -1; x <= 1; ++x)
+				lit += texture(uShadowMap, vec4(coords.xy + vec2(x, y) * texel, float(layer), coords.z));
+		}
+		return lit / 9.0;
+	}
+
+	return 1.0;
+}
+
+// Ambient lighting of the sky, baked by image_based_lighting.cpp
+uniform vec3 uIrradianceSH[9];    // L2 irradiance over pi
+uniform samplerCube uSpecularMap; // GGX prefiltered, the roughness grows with the mip
+uniform float uAmbientIntensity;
+uniform float uSpecularLod;
+
+vec3 EvaluateIrradiance(vec3 n)
+{
+	vec3 result = uIrradianceSH[0] * 0.282095;
+	result += uIrradianceSH[1] * 0.488603 * n.y;
+	result += uIrradianceSH[2] * 0.488603 * n.z;
+	result += uIrradianceSH[3] * 0.488603 * n.x;
+	result += uIrradianceSH[4] * 1.092548 * n.x * n.y;
+	result += uIrradianceSH[5] * 1.092548 * n.y * n.z;
+	result += uIrradianceSH[6] * 0.315392 * (3.0 * n.z * n.z - 1.0);
+	result += uIrradianceSH[7] * 1.092548 * n.x * n.z;
+	result += uIrradianceSH[8] * 0.546274 * (n.x * n.x - n.y * n.y);
+	return max(result, vec3(0.0));
+}
+
+vec3 CalculateAmbient(vec3 normal, vec3 view_dir, vec3 pixelColor)
+{
+	// Dielectric Fresnel, what the sky reflects does not reach the diffuse
+	float fresnel = 0.04 + 0.96 * pow(1.0 - max(dot(normal, view_dir), 0.0), 5.0);
+
+	// Same flip of z as the skybox
+	vec3 reflected = reflect(-view_dir, normal) * vec3(1.0, 1.0, -1.0);
+	vec3 specular = textureLod(uSpecularMap, reflected, uSpecularLod).rgb;
+
+	return uAmbientIntensity * (pixelColor * EvaluateIrradiance(normal) * (1.0 - fresnel) + specular * fresnel);
+}
+
+uniform mat4 uInverseProjectionMatrix;
+uniform ivec2 uOutputSize; // The pooled output can be larger, only this corner is shaded
+
+// Color target of the shading pass
+layout(binding = 0, rgba8) uniform writeonly image2D uOutput;
+
+shared unsigned int sMinDepth;
+shared unsigned int sMaxDepth;
+shared unsigned int sLightCount;
+shared unsigned int sLightIndices[MAX_TILE_LIGHTS];
+
+vec3 CalculateLighting(Light light, vec3 normal, vec3 view_dir, vec3 frag_pos, vec3 pixelColor);
+
+vec3 TileCornerRay(vec2 pixel, vec2 size)
+{
+	// View space direction through a pixel corner, scaled so that its depth is 1
+	vec4 p = uInverseProjectionMatrix * vec4(pixel / size * 2.0 - 1.0, -1.0, 1.0);
+	vec3 ray = p.xyz / p.w;
+	return ray / -ray.z;
+}
+
+void main()
+{
+	ivec2 size = uOutputSize;
+	ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+	bool inside = all(lessThan(pixel, size));
+
+	if (gl_LocalInvocationIndex == 0)
+	{
+		sMinDepth = 0xFFFFFFFFu;
+		sMaxDepth = 0u;
+		sLightCount = 0u;
+	}
+
+	barrier();
+
+	// Depth bounds of the tile, the background (cleared depth) does not count
+	vec3 FragPos = vec3(0.0);
+	vec3 Normal = vec3(0.0);
+	bool geometry = false;
+	if (inside)
+	{
+		float depth = texelFetch(gDepth, pixel, 0).r;
+		geometry = depth < 1.0;
+		if (geometry)
+		{
+			FragPos = ReconstructPosition(pixel, depth);
+			Normal = DecodeNormal(texelFetch(gNormal, pixel, 0).rg);
+		}
+	}
+
+	if (geometry)
+	{
+		// Positive floats keep their order when compared as integers
+		float depth = max(-(uViewMatrix * vec4(FragPos, 1.0)).z, 0.0);
+		atomicMin(sMinDepth, floatBitsToUint(depth));
+		atomicMax(sMaxDepth, floatBitsToUint(depth));
+	}
+
+	barrier();
+
+	// Tile bounds in view space
+	float minDepth = uintBitsToFloat(sMinDepth);
+	float maxDepth = uintBitsToFloat(sMaxDepth);
+	bool emptyTile = sMaxDepth < sMinDepth;
+
+	vec2 tileMin = vec2(gl_WorkGroupID.xy * TILE_SIZE);
+	vec2 tileMax = min(tileMin + TILE_SIZE, vec2(size));
+	vec3 rays[4] = vec3[](TileCornerRay(tileMin, vec2(size)), TileCornerRay(vec2(tileMax.x, tileMin.y), vec2(size)),
+	                      TileCornerRay(vec2(tileMin.x, tileMax.y), vec2(size)), TileCornerRay(tileMax, vec2(size)));
+
+	vec3 boundsMin = vec3(1e30);
+	vec3 boundsMax = vec3(-1e30);
+	for (int i = 0; i < 4; ++i)
+	{
+		boundsMin = min(boundsMin, min(rays[i] * minDepth, rays[i] * maxDepth));
+		boundsMax = max(boundsMax, max(rays[i] * minDepth, rays[i] * maxDepth));
+	}
+
+	// Every thread of the tile culls a strided subset of the lights
+	if (!emptyTile)
+	{
+		for (unsigned int i = gl_LocalInvocationIndex; i < uLightCount; i += TILE_SIZE * TILE_SIZE)
+		{
+			Light light = uLights[i];
+
+			bool visible = light.type == 0u;
+			if (!visible && light.range > 0.0)
+			{
+				vec3 center = (uViewMatrix * vec4(light.position, 1.0)).xyz;
+				vec3 closest = clamp(center, boundsMin, boundsMax);
+				visible = dot(center - closest, center - closest) <= light.range * light.range;
+			}
+
+			if (visible)
+			{
+				unsigned int slot = atomicAdd(sLightCount, 1u);
+				if (slot < MAX_TILE_LIGHTS)
+					sLightIndices[slot] = i;
+			}
+		}
+	}
+
+	barrier();
+
+	if (!geometry)
+		return;
+
+	vec3 Diffuse = texelFetch(gAlbedoSpec, pixel, 0).rgb;
+	vec3 viewDir = normalize(uCameraPosition - FragPos);
+
+	vec3 lighting = vec3(0.0);
+	unsigned int tileLightCount = min(sLightCount, uint(MAX_TILE_LIGHTS));
+	for (unsigned int i = 0; i < tileLightCount; ++i)
+	{
+		unsigned int lightIndex = sLightIndices[i];
+		lighting += CalculateShadow(lightIndex, FragPos, Normal) * CalculateLighting(uLights[lightIndex], Normal, viewDir, FragPos, Diffuse);
+	}
+
+	lighting += CalculateAmbient(Normal, viewDir, Diffuse);
+
+	imageStore(uOutput, pixel, vec4(lighting, 1.0));
+}
+vec3 CalculateDirectionalLight(Light light, vec3 normal, vec3 view_dir, vec3 pixelColor)
+{
+	float intensity = float(light.intensity);
+	intensity *= 0.01;
+
+	// Diffuse 
+	vec3 lightDirection = normalize(-light.direction);
+	float diff = max(dot(lightDirection, normal), 0.0);
+	vec3 diffuse = light.color * diff * pixelColor *  intensity;
+
+	// Specular
+	vec3 halfwayDir = normalize(lightDirection + view_dir);
+	float spec = pow(max(dot(normal, halfwayDir), 0.0), 128.0);
+	vec3 specular = light.color * spec * intensity;
+
+	vec3 result = (diffuse + specular);
+	return result;
+}
+
+vec3 CalculatePointLight(Light light, vec3 normal, vec3 view_dir, vec3 frag_pos, vec3 pixelColor)
+{
+	float intensity = float(light.intensity);
+	intensity *= 0.01;
+
+	// Diffuse 
+	vec3 lightDirection = normalize(light.position - frag_pos);
+	float diff = max(dot(normal, lightDirection), 0.0);
+	vec3 diffuse = light.color * diff * pixelColor * intensity;
+
+	// Specular
+    vec3 halfwayDir = normalize(lightDirection + view_dir);  
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), 128.0);
+	vec3 specular = light.color * spec * intensity;
+
+	// Attenuation
+ 	float distance = length(light.position - frag_pos);
+    float attenuation = 1.0 / (1.0 + 0.3 * distance + 0.5 * (distance * distance));    
+
+	diffuse *= attenuation;
+    specular *= attenuation;
+
+	vec3 result = (diffuse + specular);
+	return result;
+}
+
+
+vec3 CalculateLighting(Light light, vec3 normal, vec3 view_dir, vec3 frag_pos, vec3 pixelColor)
+{
+	vec3 result = vec3(0.0);
+
+	switch(light.type)
+	{
+		case 0: 
+			result = CalculateDirectionalLight(light, normal, view_dir, pixelColor);
+			break;
+		case 1:
+			result = CalculatePointLight(light, normal, view_dir, frag_pos, pixelColor);
+			break;
+
+		default: break;
+	}
+
+	return result;
+}
+
+#endif
+#endif
\ No newline at end of file
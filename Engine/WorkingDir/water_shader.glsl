@@ -1,87 +1,169 @@
+#ifdef WATER_SCENE_SHADER
+
+// Scene seen in the water, rendered at a fraction of the display resolution with a single
+// directional light and clipped to one side of the water plane
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec2 aTexCoord;
+
+uniform mat4 uWorldMatrix;
+uniform mat4 uViewProjectionMatrix;
+uniform vec4 uClipPlane; // World space, the side with positive distance is kept
+
+out vec3 vNormal;
+out vec2 vTexCoord;
+
+void main()
+{
+	vec4 positionWorld = uWorldMatrix * vec4(aPosition, 1.0);
+	gl_ClipDistance[0] = dot(positionWorld, uClipPlane);
+
+	vNormal = mat3(uWorldMatrix) * aNormal;
+	vTexCoord = aTexCoord;
+	gl_Position = uViewProjectionMatrix * positionWorld;
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+in vec3 vNormal;
+in vec2 vTexCoord;
+
+uniform sampler2D uTexture;
+uniform vec3 uLightDirection;
+uniform vec3 uLightColor;
+
+layout(location = 0) out vec4 oColor;
+
+void main()
+{
+	vec3 albedo = texture(uTexture, vTexCoord).rgb;
+	float diffuse = max(dot(normalize(vNormal), -uLightDirection), 0.0);
+	oColor = vec4(albedo * (0.3 + diffuse * uLightColor), 1.0);
+}
+
+#endif
+#endif
+
 #ifdef WATER_PASS_SHADER
 
 #if defined(VERTEX) ///////////////////////////////////////////////////
 
-layout(location=0) in vec3 position;
-layout(location=1) in vec3 normal;
+layout(location = 0) in vec3 aPosition;
 
-uniform mat4 projectionMatrix;
-uniform mat4 worldViewMatrix;
+uniform mat4 uWorldMatrix;
+uniform mat4 uViewProjectionMatrix;
 
-out Data{
-	vec3 positionViewspace;
-	vec3 normalViewspace;
-} VSOut;
+out vec3 vPositionWorld;
 
-void main(void)
+void main()
 {
-	VSOut.positionViewspace = vec3(worldViewMatrix * vec4(position,1.0));
-	VSOut.normalViewspace = vec3(worldViewMatrix * vec4(normal,0.0));
-	gl_Position = projectionMatrix * vec4(VSOut.positionViewspace, 1.0);
+	vPositionWorld = vec3(uWorldMatrix * vec4(aPosition, 1.0));
+	gl_Position = uViewProjectionMatrix * vec4(vPositionWorld, 1.0);
 }
 
 #elif defined(FRAGMENT) ///////////////////////////////////////////////
 
-uniform vec2 viewportSize;
-uniform mat4 modelViewMatrix;
-uniform mat4 viewMatrixInv;
-uniform mat4 projectionMatrixInv;
-uniform sampler2D reflectionMap;
-uniform sampler2D refractionMap;
-uniform sampler2D reflectionDepth;
-uniform sampler2D refractionDepth;
-uniform sampler2D normalMap;
-uniform sampler2D dudvMap;
-
-in Data{
-	vec3 positionViewspace;
-	vec3 normalViewspace;
-} FSIn;
-
-out vec4 outColor;
-
-vec3 fresnelSchlick(float cosTheta, vec3 F0){
-	return F0 + (1.0 - F0) * pow(1.0 - cosTheta, 5.0);
+in vec3 vPositionWorld;
+
+uniform mat4 uReflectionViewProjectionMatrix; // Mirrored view the reflection was last rendered with
+uniform vec3 uCameraPosition;
+uniform vec2 uViewportSize;
+uniform vec2 uRefractionCoverage;             // Part of the pooled refraction texture holding the image
+uniform vec2 uDepthRange;                     // Near and far planes of the camera
+uniform float uTime;
+
+uniform sampler2D uReflectionMap;
+uniform sampler2D uReflectionDepth;
+uniform sampler2D uRefractionMap;
+uniform sampler2D uRefractionDepth;
+
+layout(location = 0) out vec4 oColor;
+
+const float WAVE_STRENGTH = 0.02;          // Offset of the texture coordinates by the ripples
+const float TURBIDITY_DISTANCE = 10.0;     // Water depth at which the ground is no longer seen
+const vec3  WATER_COLOR = vec3(0.25, 0.4, 0.6);
+const float BILATERAL_DEPTH_EPSILON = 0.05;
+
+float LinearDepth(float depth)
+{
+	float near = uDepthRange.x;
+	float far = uDepthRange.y;
+	return near * far / (far - depth * (far - near));
 }
 
-vec3 reconstructPixelPosition(float depth){
-	vec2 texCoords = gl_FragCoord.xy / viewportSize;
-	vec3 positionNDC = vec3(texCoords * 2.0 - vec2(1.0), depth * 2.0 - 1.0);
-	vec4 positionEyespace = projectionMatrixInv * vec4(positionNDC, 1.0);
-	positionEyespace.xyz /= positionEyespace.w;
-	return positionEyespace.xyz;
+// Upsamples a low resolution target from the four texels around uv. Each one is weighted
+// bilinearly and by how close its depth is to the depth of the nearest texel, so the colors
+// of the background do not bleed over silhouettes and the other way around. coverage is the
+// part of the texture the image covers.
+vec3 UpsampleBilateral(sampler2D colorMap, sampler2D depthMap, vec2 uv, vec2 coverage)
+{
+	vec2 size = vec2(textureSize(colorMap, 0)) * coverage;
+	ivec2 maxTexel = ivec2(size) - 1;
+	vec2 position = clamp(uv, 0.0, 1.0) * size - 0.5;
+	ivec2 base = ivec2(floor(position));
+	vec2 f = fract(position);
+
+	ivec2 nearest = clamp(ivec2(floor(position + 0.5)), ivec2(0), maxTexel);
+	float referenceDepth = LinearDepth(texelFetch(depthMap, nearest, 0).r);
+
+	vec3 color = vec3(0.0);
+	float weightSum = 0.0;
+	for (int i = 0; i < 4; ++i)
+	{
+		ivec2 offset = ivec2(i & 1, i >> 1);
+		ivec2 texel = clamp(base + offset, ivec2(0), maxTexel);
+		float bilinear = (offset.x == 1 ? f.x : 1.0 - f.x) * (offset.y == 1 ? f.y : 1.0 - f.y);
+		float depth = LinearDepth(texelFetch(depthMap, texel, 0).r);
+		float weight = bilinear / (BILATERAL_DEPTH_EPSILON + abs(depth - referenceDepth) / referenceDepth);
+		color += texelFetch(colorMap, texel, 0).rgb * weight;
+		weightSum += weight;
+	}
+	return color / max(weightSum, 1e-5);
+}
+
+// Procedural ripples, no normal map is shipped with the water
+vec3 WaveNormal(vec2 position)
+{
+	vec2 slope = vec2(0.0);
+	slope += 0.6 * cos(dot(position, vec2(0.8, 0.6)) * 1.3 + uTime * 1.1) * vec2(0.8, 0.6);
+	slope += 0.4 * cos(dot(position, vec2(-0.5, 0.9)) * 2.1 + uTime * 1.7) * vec2(-0.5, 0.9);
+	slope += 0.2 * cos(dot(position, vec2(0.3, -1.0)) * 3.7 + uTime * 2.3) * vec2(0.3, -1.0);
+	return normalize(vec3(-slope.x * 0.15, 1.0, -slope.y * 0.15));
+}
+
+vec3 FresnelSchlick(float cosTheta, vec3 F0)
+{
+	return F0 + (1.0 - F0) * pow(1.0 - cosTheta, 5.0);
 }
 
 void main()
 {
-	vec3 N = normalize(FSIn.normalViewspace);
-	vec3 V = normalize(-FSIn.positionViewspace);
-	vec3 Pw = vec3(viewMatrixInv * vec4(FSIn.positionViewspace, 1.0));
-	vec2 texCoord = gl_FragCoord.xy / viewportSize;
-
-	const vec2 waveLength = vec2(2.0);
-	const vec2 waveStrength = vec2(0.05);
-	const float turbidityDistance = 10.0;
-
-	vec2 distortion = (2.0 * texture(dudvMap, Pw.xz / waveLength).rg - vec2(1.0)) * waveStrength + waveStrength/7.0;
-
-	vec2 reflectionTexCoord = vec2(texCoord.s, 1.0 - texCoord.t) + distortion;
-	vec2 refractionTexCoord = texCoord + distortion;
-	vec3 reflectionColor = texture(reflectionMap, reflectionTexCoord).rgb;
-	vec3 refractionColor = texture(refractionMap, refractionTexCoord).rgb;
-
-	float distortedGroundDepth = texture(refractionDepth, refractionTexCoord).x;
-	vec3 distortedGroundPosViewspace = reconstructPixelPosition(distortedGroundDepth);
-	float distortedWaterDepth = FSIn.positionViewspace.z - distortedGroundPosViewspace.z;
-	float tintFactor = clamp(distotedWaterDepth / turbidityDistance, 0.0, 1.0);
-	vec3 waterColor = vec3(0.25, 0.4, 0.6);
-	refractionColor = mix(refractionColor, waterColor, tintFactor);
-
-	//Fresnel
-	vec3 F0 = vec3(0.1);
-	vec3 F = fresnelSchlick(max(0.0, dot(V,N))m F0);
-	outColor.rgb = mix(fractionColor, reflectionColor, F);
-	outColor.a = 1.0;
+	vec3 N = WaveNormal(vPositionWorld.xz);
+	vec3 V = normalize(uCameraPosition - vPositionWorld);
+	vec2 distortion = N.xz * WAVE_STRENGTH;
+
+	// The surface point lies on the mirror plane, so projecting it with the mirrored view
+	// finds it in the reflection even when that was rendered on an earlier frame
+	vec4 reflectionClip = uReflectionViewProjectionMatrix * vec4(vPositionWorld, 1.0);
+	vec2 reflectionTexCoord = reflectionClip.xy / reflectionClip.w * 0.5 + 0.5 + distortion;
+	vec2 refractionTexCoord = gl_FragCoord.xy / uViewportSize + distortion;
+
+	vec3 reflectionColor = UpsampleBilateral(uReflectionMap, uReflectionDepth, reflectionTexCoord, vec2(1.0));
+	vec3 refractionColor = UpsampleBilateral(uRefractionMap, uRefractionDepth, refractionTexCoord, uRefractionCoverage);
+
+	// Tinted by the amount of water between the surface and the ground behind it
+	vec2 groundTexCoord = clamp(refractionTexCoord, 0.0, 1.0) * uRefractionCoverage;
+	float groundDepth = LinearDepth(texture(uRefractionDepth, groundTexCoord).r);
+	float waterDepth = max(groundDepth - LinearDepth(gl_FragCoord.z), 0.0);
+	float tintFactor = clamp(waterDepth / TURBIDITY_DISTANCE, 0.0, 1.0);
+	refractionColor = mix(refractionColor, WATER_COLOR, tintFactor);
+
+	vec3 F = FresnelSchlick(max(dot(V, N), 0.0), vec3(0.1));
+	oColor = vec4(mix(refractionColor, reflectionColor, F), 1.0);
 }
+
+#endif
 #endif
-#endif
\ No newline at end of file